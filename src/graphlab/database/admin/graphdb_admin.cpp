@@ -54,8 +54,10 @@ namespace graphlab {
          return true;
        }
      }
-     case RESET: {
-       QueryMessage qm(QueryMessage::ADMIN, QueryMessage::RESET);
+     case RESET: 
+     case FREEZE: {
+       QueryMessage qm(QueryMessage::ADMIN, 
+                       cmd == RESET ? QueryMessage::RESET : QueryMessage::FREEZE);
        std::vector<query_result> results;
        std::vector<int> errorcodes;
        qo.update_all(qm.message(), qm.length(), results);
@@ -66,6 +68,24 @@ namespace graphlab {
        }
        return true;
      }
+     case SAVE:
+     case LOAD: {
+       if (argc < 1) {
+         std::cout << "Image directory not provided. Abort" << std::endl;
+         return false;
+       }
+       QueryMessage qm(QueryMessage::ADMIN,
+                       cmd == SAVE ? QueryMessage::SAVE : QueryMessage::LOAD);
+       qm << std::string(argv[0]);
+       std::vector<query_result> results;
+       qo.update_all(qm.message(), qm.length(), results);
+       for (size_t i = 0; i < results.size(); ++i) {
+         int error = qo.parse_reply(results[i]);
+         if (error != 0)
+           return false;
+       }
+       return true;
+     }
      default: {
        logstream(LOG_WARNING) << glstrerr(EINVCMD) << std::endl;
        return false;
@@ -78,6 +98,12 @@ namespace graphlab {
       return START;
     } else if (str == "reset") {
       return RESET;
+    } else if (str == "freeze") {
+      return FREEZE;
+    } else if (str == "save") {
+      return SAVE;
+    } else if (str == "load") {
+      return LOAD;
     } else {
       return UNKNOWN;
     }
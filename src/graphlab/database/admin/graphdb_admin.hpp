@@ -8,6 +8,9 @@ namespace graphlab {
     enum cmd_type {
       START,
       RESET,
+      FREEZE,
+      SAVE,
+      LOAD,
       UNKNOWN,
     };
     
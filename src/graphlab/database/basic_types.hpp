@@ -39,6 +39,7 @@ inline std::pair<graph_shard_id_t, graph_leid_t> split_eid(graph_eid_t eid) {
 
 inline graph_eid_t make_eid(graph_shard_id_t shardid, graph_leid_t leid) {
   eid_union u;
+  u.eid = 0;
   u.split.shard_id = shardid;
   u.split.local_eid = leid;
   return u.eid;
@@ -1,30 +1,84 @@
 #include<graphlab/database/client/graphdb_client.hpp>
+#include<graphlab/database/graph_ordered_index.hpp>
+#include<algorithm>
+#include<sys/time.h>
 namespace graphlab {
+  // Orders the results of range and top-k queries by value, then by id.
+  static inline uint64_t id_value_key(const graph_database::id_value_pair& p) {
+    return graph_ordered_index::encode(p.second.type(),
+        reinterpret_cast<const char*>(p.second.get_raw_pointer()));
+  }
+
+  static bool id_value_less(const graph_database::id_value_pair& a,
+                            const graph_database::id_value_pair& b) {
+    uint64_t ka = id_value_key(a), kb = id_value_key(b);
+    return ka < kb || (ka == kb && a.first < b.first);
+  }
+
+  static bool id_value_greater(const graph_database::id_value_pair& a,
+                               const graph_database::id_value_pair& b) {
+    return id_value_less(b, a);
+  }
+
   // ----------------------------- Batch Methods --------------------------------------
+  // The shard of every row of a batch sent to one shard.
+  template<typename T>
+  static graph_shard_id_t fixed_shard(graph_shard_id_t shard, const T&) {
+    return shard;
+  }
+
   bool graphdb_client::add_edges(const std::vector<edge_insert_descriptor>& edges,
                                  std::vector<int>& errorcodes) {
+    return add_edges_helper(edges, NULL, errorcodes);
+  }
+
+  bool graphdb_client::add_edges_to_shard(graph_shard_id_t shard,
+                                          const std::vector<edge_insert_descriptor>& edges,
+                                          std::vector<int>& errorcodes) {
+    return add_edges_helper(edges, &shard, errorcodes);
+  }
 
+  bool graphdb_client::add_edges_helper(const std::vector<edge_insert_descriptor>& edges,
+                                        const graph_shard_id_t* shard,
+                                        std::vector<int>& errorcodes) {
     QueryMessage::header header(QueryMessage::BADD, QueryMessage::EDGE);
-    bool success = scatter_messages<edge_insert_descriptor, char>(header, edges, boost::bind(&graphdb_client::ein2shard, this, _1), NULL, errorcodes);
-    
-    // add mirrors
-    mirror_table_type mirror_table = mirror_table_from_edges(edges);
-    std::vector<mirror_insert_descriptor> vid_mirror_pairs;
-    for (mirror_table_type::iterator it = mirror_table.begin(); it != mirror_table.end(); it++) {
-      graph_vid_t vid = it->first;
-      std::vector<graph_shard_id_t> mirrors(it->second.begin(), it->second.end());
-      vid_mirror_pairs.push_back (mirror_insert_descriptor(vid, mirrors));
+    scatter_requests requests;
+    boost::function<graph_shard_id_t (const edge_insert_descriptor&)> get_shard;
+    if (shard == NULL) {
+      get_shard = boost::bind(&graphdb_client::ein2shard, this, _1);
+    } else {
+      get_shard = boost::bind(fixed_shard<edge_insert_descriptor>, *shard, _1);
     }
+    scatter_send(header, edges, get_shard, false, requests);
 
-    success &= add_vertex_mirrors(vid_mirror_pairs, errorcodes);
-    ASSERT_TRUE(success);
+    // the mirrors not registered by earlier batches, sent along with the edges
+    std::vector<mirror_insert_descriptor> vid_mirror_pairs;
+    new_mirrors_of_edges(edges, shard, vid_mirror_pairs);
+    QueryMessage::header mirror_header(QueryMessage::BADD, QueryMessage::VMIRROR);
+    scatter_requests mirror_requests;
+    scatter_send<mirror_insert_descriptor>(mirror_header, vid_mirror_pairs,
+                                           boost::bind(&graphdb_client::vidpair2shard<std::vector<graph_shard_id_t> >, this, _1),
+                                           false, mirror_requests);
 
-    // check error codes
-    // for (size_t i = 0; i < errorcodes.size(); ++i) {
-    //   if (errorcodes[i] != 0)
-    //     return false;
-    // }
-    return true;
+    bool success = scatter_gather<char>(header, requests, edges.size(), NULL, errorcodes);
+    std::vector<int> mirror_errorcodes;
+    success &= scatter_gather<char>(mirror_header, mirror_requests, vid_mirror_pairs.size(),
+                                    NULL, mirror_errorcodes);
+    // Only registered mirrors are remembered, so that a batch skipping a
+    // mirror another batch is still sending cannot report success before
+    // it is registered. The failed ones are sent again with the next
+    // edges of their vertices.
+    known_mirrors_lock.lock();
+    for (size_t i = 0; i < vid_mirror_pairs.size(); ++i) {
+      if (mirror_errorcodes[i] == 0) {
+        const std::vector<graph_shard_id_t>& mirrors = vid_mirror_pairs[i].second;
+        for (size_t j = 0; j < mirrors.size(); ++j) {
+          known_mirrors.insert(vid_mirror_pairs[i].first, mirrors[j]);
+        }
+      }
+    }
+    known_mirrors_lock.unlock();
+    return success;
   }
 
   bool graphdb_client::add_vertices(const std::vector<vertex_insert_descriptor>& vertices,
@@ -39,6 +93,13 @@ namespace graphlab {
     return success;
   }
 
+  bool graphdb_client::add_vertices_to_shard(graph_shard_id_t shard,
+                                             const std::vector<vertex_insert_descriptor>& vertices,
+                                             std::vector<int>& errorcodes) {
+    QueryMessage::header header(QueryMessage::BADD, QueryMessage::VERTEX);
+    return scatter_messages<vertex_insert_descriptor, char>(header, vertices, boost::bind(fixed_shard<vertex_insert_descriptor>, shard, _1), NULL, errorcodes);
+  }
+
   bool graphdb_client::add_vertex_mirrors(const std::vector<mirror_insert_descriptor>& vid_mirror_pairs,
                                           std::vector<int>& errorcodes) {
     QueryMessage::header header(QueryMessage::BADD, QueryMessage::VMIRROR);
@@ -56,8 +117,9 @@ namespace graphlab {
                                  std::vector<graph_row>& out, 
                                  std::vector<int>& errorcodes) {
 
-    QueryMessage::header header(QueryMessage::BGET, QueryMessage::EDGE);
-    bool success = scatter_messages<graph_eid_t, graph_row>(header, eids, boost::bind(&graphdb_client::eid2shard, this, _1), &out, errorcodes);
+    boost::shared_ptr<graph_row_codec> rc = shared_row_codec();
+    QueryMessage::header header(QueryMessage::BGET, QueryMessage::EDGE, rc->version());
+    bool success = scatter_messages<graph_eid_t, graph_row>(header, eids, boost::bind(&graphdb_client::eid2shard, this, _1), &out, errorcodes, rc);
 
     // for (size_t i = 0; i < errorcodes.size(); ++i) {
     //   if (errorcodes[i] != 0)
@@ -69,8 +131,9 @@ namespace graphlab {
   bool graphdb_client::get_vertices(const std::vector<graph_vid_t>& vids,
                                     std::vector<graph_row>& out, 
                                     std::vector<int>& errorcodes) {
-    QueryMessage::header header(QueryMessage::BGET, QueryMessage::VERTEX);
-    bool success = scatter_messages<graph_vid_t, graph_row>(header, vids, boost::bind(&graphdb_client::vid2shard, this, _1), &out, errorcodes);
+    boost::shared_ptr<graph_row_codec> rc = shared_row_codec();
+    QueryMessage::header header(QueryMessage::BGET, QueryMessage::VERTEX, rc->version());
+    bool success = scatter_messages<graph_vid_t, graph_row>(header, vids, boost::bind(&graphdb_client::vid2shard, this, _1), &out, errorcodes, rc);
 
     // for (size_t i = 0; i < errorcodes.size(); ++i) {
     //   if (errorcodes[i] != 0)
@@ -103,99 +166,459 @@ namespace graphlab {
     return success;  
   }
 
-  int graphdb_client::add_edge(graph_vid_t source, graph_vid_t dest, const graph_row& data) {
-    QueryMessage qm(QueryMessage::ADD, QueryMessage::EDGE);
-    qm << source << dest << data;
-    graph_shard_id_t target = shard_manager.get_master(source, dest); 
-    query_result future = queryobj.update(target, qm.message(), qm.length());
+  bool graphdb_client::get_vertices(const std::vector<graph_vid_t>& vids,
+                                    const graph_row_filter& filter,
+                                    std::vector<std::pair<graph_vid_t, graph_row> >& out,
+                                    std::vector<int>& errorcodes) {
+    return filter_helper(true, vids, filter, boost::bind(&graphdb_client::vid2shard, this, _1),
+                         out, errorcodes);
+  }
+
+  bool graphdb_client::get_edges(const std::vector<graph_eid_t>& eids,
+                                 const graph_row_filter& filter,
+                                 std::vector<std::pair<graph_eid_t, graph_row> >& out,
+                                 std::vector<int>& errorcodes) {
+    return filter_helper(false, eids, filter, boost::bind(&graphdb_client::eid2shard, this, _1),
+                         out, errorcodes);
+  }
+
+  bool graphdb_client::filter_helper(bool is_vertex, const std::vector<uint64_t>& ids,
+                                     const graph_row_filter& filter,
+                                     boost::function<graph_shard_id_t (const uint64_t&)> get_shard,
+                                     std::vector<std::pair<uint64_t, graph_row> >& out,
+                                     std::vector<int>& errorcodes) {
+    typedef std::map<graph_shard_id_t, std::vector<size_t> > shard_positions_type;
+    shard_positions_type positions;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      positions[get_shard(ids[i])].push_back(i);
+    }
+
+    std::vector<query_result> replies;
+    for (shard_positions_type::iterator it = positions.begin(); it != positions.end(); ++it) {
+      std::vector<uint64_t> shard_ids;
+      for (size_t j = 0; j < it->second.size(); ++j) {
+        shard_ids.push_back(ids[it->second[j]]);
+      }
+      QueryMessage qm(QueryMessage::BGET, QueryMessage::FILTER);
+      qm << is_vertex << filter << shard_ids;
+      replies.push_back(queryobj.query(it->first, qm.message(), qm.length()));
+    }
+
+    // the matching rows of all shards, by position in ids
+    bool success = true;
+    errorcodes.assign(ids.size(), 0);
+    std::vector<std::pair<size_t, graph_row> > matches;
+    size_t k = 0;
+    for (shard_positions_type::iterator it = positions.begin(); it != positions.end(); ++it, ++k) {
+      const std::vector<size_t>& pos = it->second;
+      if (replies[k].get_status() != 0) {
+        logstream(LOG_ERROR) << glstrerr(ESRVUNREACH) << std::endl;
+        for (size_t j = 0; j < pos.size(); ++j) {
+          errorcodes[pos[j]] = ESRVUNREACH;
+        }
+        success = false;
+        continue;
+      }
+      std::string reply = replies[k].get_reply();
+      iarchive iarc(reply.c_str(), reply.length());
+      bool success_k;
+      std::vector<std::pair<size_t, graph_row> > rows;
+      iarc >> success_k >> rows;
+      if (!success_k) {
+        std::vector<int> errorcodes_k;
+        iarc >> errorcodes_k;
+        for (size_t j = 0; j < pos.size() && j < errorcodes_k.size(); ++j) {
+          errorcodes[pos[j]] = errorcodes_k[j];
+        }
+        success = false;
+      }
+      for (size_t j = 0; j < rows.size(); ++j) {
+        matches.push_back(std::make_pair(pos[rows[j].first], graph_row()));
+        matches.back().second.swap(rows[j].second);
+      }
+    }
+
+    std::vector<std::pair<size_t, size_t> > order(matches.size());
+    for (size_t i = 0; i < matches.size(); ++i) {
+      order[i] = std::make_pair(matches[i].first, i);
+    }
+    std::sort(order.begin(), order.end());
+    out.clear();
+    out.resize(matches.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      out[i].first = ids[order[i].first];
+      out[i].second.swap(matches[order[i].second].second);
+    }
+    return success;
+  }
+
+  bool graphdb_client::get_vertices_adj(const std::vector<graph_vid_t>& vids, bool in_edges,
+                                        std::vector<vertex_adj_descriptor>& out,
+                                        std::vector<int>& errorcodes) {
+    typedef std::map<graph_shard_id_t, std::vector<size_t> > shard_positions_type;
+    typedef std::pair<std::vector<graph_shard_id_t>, vertex_adj_descriptor> mirror_adj_type;
+    out.clear();
+    out.resize(vids.size());
+    errorcodes.assign(vids.size(), 0);
 
+    // positions of the vids to ask to each shard, for their mirrors or adjacency
+    shard_positions_type mirror_queries, adj_queries;
+    mirror_lock.lock();
+    for (size_t i = 0; i < vids.size(); ++i) {
+      boost::unordered_map<graph_vid_t, std::vector<graph_shard_id_t> >::iterator it =
+          mirror_cache.find(vids[i]);
+      if (it == mirror_cache.end()) {
+        mirror_queries[shard_manager.get_master(vids[i])].push_back(i);
+      } else {
+        for (size_t j = 0; j < it->second.size(); ++j) {
+          adj_queries[it->second[j]].push_back(i);
+        }
+      }
+    }
+    mirror_lock.unlock();
 
-    std::vector<graph_shard_id_t> mirrors(target);
-    // send out mirrors
-    add_vertex_mirror(source, mirrors);
-    add_vertex_mirror(target, mirrors);
+    // first hop: the masters answer with the mirrors and their own adjacency
+    std::vector<std::pair<graph_shard_id_t, query_result> > replies;
+    scatter_vids(QueryMessage::VMIRROR, in_edges, vids, mirror_queries, replies);
+    for (size_t k = 0; k < replies.size(); ++k) {
+      graph_shard_id_t master = replies[k].first;
+      std::vector<size_t>& ids = mirror_queries[master];
+      std::vector<mirror_adj_type> results;
+      std::vector<int> errorcodes_k;
+      bool success_k = queryobj.parse_batch_reply(replies[k].second, &results, errorcodes_k);
+      if (!success_k && results.size() != ids.size()) {
+        // server unreachable
+        errorcodes_k.resize(ids.size(), errorcodes_k[0]);
+        results.resize(ids.size());
+      }
+      for (size_t j = 0; j < ids.size(); ++j) {
+        size_t i = ids[j];
+        int err = success_k ? 0 : errorcodes_k[j];
+        if (err == EINVID) {
+          // the master has no mirrors of the vertex: ask its neighborhood,
+          // in case edges were added without registering their mirrors
+          std::vector<graph_shard_id_t> spans;
+          shard_manager.get_neighbors(master, spans);
+          for (size_t m = 0; m < spans.size(); ++m) {
+            adj_queries[spans[m]].push_back(i);
+          }
+          continue;
+        } else if (err != 0) {
+          errorcodes[i] = err;
+          continue;
+        }
+        std::vector<graph_shard_id_t>& mirrors = results[j].first;
+        cache_mirrors(vids[i], mirrors);
+        out[i] += results[j].second;
+        for (size_t m = 0; m < mirrors.size(); ++m) {
+          if (mirrors[m] != master) {
+            adj_queries[mirrors[m]].push_back(i);
+          }
+        }
+      }
+    }
 
-    return queryobj.parse_reply(future);
+    // second hop: the other shards holding edges of the vids
+    replies.clear();
+    scatter_vids(QueryMessage::VERTEXADJ, in_edges, vids, adj_queries, replies);
+    for (size_t k = 0; k < replies.size(); ++k) {
+      std::vector<size_t>& ids = adj_queries[replies[k].first];
+      std::vector<vertex_adj_descriptor> results;
+      std::vector<int> errorcodes_k;
+      bool success_k = queryobj.parse_batch_reply(replies[k].second, &results, errorcodes_k);
+      if (!success_k && results.size() != ids.size()) {
+        errorcodes_k.resize(ids.size(), errorcodes_k[0]);
+        results.resize(ids.size());
+      }
+      for (size_t j = 0; j < ids.size(); ++j) {
+        int err = success_k ? 0 : errorcodes_k[j];
+        if (err == EINVID) {
+          // the shard holds no edges of the vid
+          continue;
+        } else if (err != 0) {
+          if (errorcodes[ids[j]] == 0) errorcodes[ids[j]] = err;
+          continue;
+        }
+        out[ids[j]] += results[j];
+      }
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < errorcodes.size(); ++i) {
+      success &= (errorcodes[i] == 0);
+    }
+    return success;
+  }
+
+  int graphdb_client::add_edge(graph_vid_t source, graph_vid_t dest, const graph_row& data) {
+    return async_add_edge(source, dest, data).wait();
   }
 
   int graphdb_client::add_vertex(graph_vid_t vid, const graph_row& data) {
-    QueryMessage qm(QueryMessage::ADD, QueryMessage::VERTEX);
-    qm << vid << data;
-    query_result future = queryobj.query(shard_manager.get_master(vid), 
-                                         qm.message(), qm.length());
-    return queryobj.parse_reply(future);
+    return async_add_vertex(vid, data).wait();
   }
 
   int graphdb_client::get_edge(graph_eid_t eid, graph_row& out) {
-    QueryMessage qm(QueryMessage::GET, QueryMessage::EDGE);
-    qm << eid;
-    query_result future = queryobj.query(split_eid(eid).first, qm.message(), qm.length());
-    return queryobj.parse_reply(future, out);
+    return async_get_edge(eid).get(out);
   }
 
   int graphdb_client::get_vertex(graph_vid_t vid, graph_row& out) {
-    QueryMessage qm(QueryMessage::GET, QueryMessage::VERTEX);
-    qm << vid;
-    query_result future = queryobj.query(shard_manager.get_master(vid), qm.message(), qm.length());
-    return queryobj.parse_reply(future, out);
+    if (coalescing()) {
+      return coalesce(vid, &out, NULL);
+    }
+    return async_get_vertex(vid).get(out);
   }
 
   int graphdb_client::get_vertex_adj(graph_vid_t vid, bool in_edges, vertex_adj_descriptor& out) {
-    QueryMessage qm(QueryMessage::GET, QueryMessage::VERTEXADJ);
-    qm << vid << in_edges;
-
-    // // find the shards we need query about vid's adj 
-    graph_shard_id_t master = shard_manager.get_master(vid);
-    std::vector<graph_shard_id_t> spans; 
-    shard_manager.get_neighbors(master, spans);
+    return async_get_vertex_adj(vid, in_edges).get(out);
+  }
 
+  int graphdb_client::find_vertices(size_t fieldpos, const graph_value& key,
+                                    std::vector<graph_vid_t>& out) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::VINDEX);
+    qm << fieldpos << key;
     std::vector<query_result> futures;
-    std::vector<int> errorcodes;
-
-    queryobj.query_multi(spans, qm.message(), qm.length(), futures);
-    queryobj.parse_and_aggregate(futures, out, errorcodes);
+    queryobj.query_all(qm.message(), qm.length(), futures);
 
-    for (size_t i = 0; i < errorcodes.size(); ++i) {
-      // Expect EINVID, queried shards may not have adj structure of the query vertex.
-      if (errorcodes[i] != 0 && errorcodes[i] != EINVID) {
-        return errorcodes[i];
+    // the shards hold disjoint sets of vertices, concatenate the replies
+    int errorcode = 0;
+    for (size_t i = 0; i < futures.size(); ++i) {
+      std::vector<graph_vid_t> vids;
+      int err = queryobj.parse_reply(futures[i], vids);
+      if (err != 0) {
+        if (errorcode == 0) errorcode = err;
+        continue;
       }
+      out.insert(out.end(), vids.begin(), vids.end());
     }
-    return 0;
+    return errorcode;
+  }
+
+  int graphdb_client::topk(bool is_vertex, size_t fieldpos, size_t k, bool largest,
+                           std::vector<id_value_pair>& out) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::TOPK);
+    qm << is_vertex << fieldpos << k << largest;
+    out.clear();
+    int errorcode = gather_id_values(qm, out);
+    // merge the top k of each shard
+    k = std::min(k, out.size());
+    std::partial_sort(out.begin(), out.begin() + k, out.end(),
+                      largest ? id_value_greater : id_value_less);
+    out.resize(k);
+    return errorcode;
+  }
+
+  int graphdb_client::range(bool is_vertex, size_t fieldpos,
+                            const graph_value& lo, const graph_value& hi,
+                            std::vector<id_value_pair>& out) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::RANGE);
+    qm << is_vertex << fieldpos << lo << hi;
+    out.clear();
+    int errorcode = gather_id_values(qm, out);
+    std::sort(out.begin(), out.end(), id_value_less);
+    return errorcode;
   }
 
   int graphdb_client::set_edge(graph_eid_t eid, const graph_row& data) {
-    QueryMessage qm(QueryMessage::SET, QueryMessage::EDGE);
-    qm << eid << data;
-    query_result future = queryobj.update(split_eid(eid).first, qm.message(), qm.length());
-    return queryobj.parse_reply(future);
+    return async_set_edge(eid, data).wait();
   }
 
   int graphdb_client::set_vertex(graph_vid_t vid, const graph_row& data) {
-    QueryMessage qm(QueryMessage::SET, QueryMessage::VERTEX);
-    qm << vid << data;
-    query_result future = queryobj.update(shard_manager.get_master(vid), qm.message(), qm.length());
-    return queryobj.parse_reply(future);
+    if (coalescing()) {
+      return coalesce(vid, NULL, &data);
+    }
+    return async_set_vertex(vid, data).wait();
   }
 
   uint64_t graphdb_client::num_vertices() {
-    QueryMessage qm(QueryMessage::GET, QueryMessage::NVERTS);
-    std::vector<query_result> futures;
-    std::vector<int> errorcodes;
-    queryobj.query_all(qm.message(), qm.length(), futures);
     uint64_t acc = 0;
-    ASSERT_TRUE(queryobj.parse_and_aggregate(futures, acc, errorcodes));
+    ASSERT_EQ(async_num_vertices().get(acc), 0);
     return acc;
   }
 
   uint64_t graphdb_client::num_edges() {
+    uint64_t acc = 0;
+    ASSERT_EQ(async_num_edges().get(acc), 0);
+    return acc;
+  }
+
+  // ----------------------------- Asynchronous Methods -------------------------------
+  graphdb_future<uint64_t> graphdb_client::async_num_vertices() {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::NVERTS);
+    std::vector<query_result> futures;
+    queryobj.query_all(qm.message(), qm.length(), futures);
+    return graphdb_future<uint64_t>(futures, boost::bind(&graphdb_client::parse_count, this, _1, _2));
+  }
+
+  graphdb_future<uint64_t> graphdb_client::async_num_edges() {
     QueryMessage qm(QueryMessage::GET, QueryMessage::NEDGES);
     std::vector<query_result> futures;
-    std::vector<int> errorcodes;
     queryobj.query_all(qm.message(), qm.length(), futures);
-    uint64_t acc = 0;
-    ASSERT_TRUE(queryobj.parse_and_aggregate(futures, acc, errorcodes));
-    return acc;
+    return graphdb_future<uint64_t>(futures, boost::bind(&graphdb_client::parse_count, this, _1, _2));
+  }
+
+  graphdb_future<graph_row> graphdb_client::async_get_vertex(graph_vid_t vid) {
+    boost::shared_ptr<graph_row_codec> rc = shared_row_codec();
+    QueryMessage qm(QueryMessage::header(QueryMessage::GET, QueryMessage::VERTEX, rc->version()));
+    qm << vid;
+    std::vector<query_result> futures(1, queryobj.query(shard_manager.get_master(vid),
+                                                        qm.message(), qm.length()));
+    return graphdb_future<graph_row>(futures, boost::bind(&graphdb_client::parse_row, this,
+                                                          rc, true, _1, _2));
+  }
+
+  graphdb_future<graph_row> graphdb_client::async_get_edge(graph_eid_t eid) {
+    boost::shared_ptr<graph_row_codec> rc = shared_row_codec();
+    QueryMessage qm(QueryMessage::header(QueryMessage::GET, QueryMessage::EDGE, rc->version()));
+    qm << eid;
+    std::vector<query_result> futures(1, queryobj.query(split_eid(eid).first,
+                                                        qm.message(), qm.length()));
+    return graphdb_future<graph_row>(futures, boost::bind(&graphdb_client::parse_row, this,
+                                                          rc, false, _1, _2));
+  }
+
+  graphdb_future<graphdb_client::vertex_adj_descriptor>
+  graphdb_client::async_get_vertex_adj(graph_vid_t vid, bool in_edges) {
+    std::vector<query_result> futures;
+    std::vector<graph_shard_id_t> mirrors;
+    mirror_lock.lock();
+    boost::unordered_map<graph_vid_t, std::vector<graph_shard_id_t> >::iterator it =
+        mirror_cache.find(vid);
+    bool cached = (it != mirror_cache.end());
+    if (cached) {
+      mirrors = it->second;
+    }
+    mirror_lock.unlock();
+    if (cached) {
+      // only the shards holding edges of vid
+      query_vertex_adj(vid, in_edges, mirrors, futures);
+      return graphdb_future<vertex_adj_descriptor>(
+          futures, boost::bind(&graphdb_client::parse_vertex_adj, this, _1, _2));
+    }
+    QueryMessage qm(QueryMessage::GET, QueryMessage::VMIRROR);
+    qm << vid << in_edges;
+    futures.push_back(queryobj.query(shard_manager.get_master(vid), qm.message(), qm.length()));
+    return graphdb_future<vertex_adj_descriptor>(
+        futures, boost::bind(&graphdb_client::parse_mirrors_and_adj, this, vid, in_edges, _1, _2));
+  }
+
+  graphdb_future<void> graphdb_client::async_set_vertex(graph_vid_t vid, const graph_row& data) {
+    QueryMessage qm(QueryMessage::SET, QueryMessage::VERTEX);
+    qm << vid << data;
+    std::vector<query_result> futures(1, queryobj.update(shard_manager.get_master(vid),
+                                                         qm.message(), qm.length()));
+    return graphdb_future<void>(futures, boost::bind(&graphdb_client::parse_replies, this, _1));
+  }
+
+  graphdb_future<void> graphdb_client::async_set_edge(graph_eid_t eid, const graph_row& data) {
+    QueryMessage qm(QueryMessage::SET, QueryMessage::EDGE);
+    qm << eid << data;
+    std::vector<query_result> futures(1, queryobj.update(split_eid(eid).first,
+                                                         qm.message(), qm.length()));
+    return graphdb_future<void>(futures, boost::bind(&graphdb_client::parse_replies, this, _1));
+  }
+
+  graphdb_future<void> graphdb_client::async_add_vertex(graph_vid_t vid, const graph_row& data) {
+    QueryMessage qm(QueryMessage::ADD, QueryMessage::VERTEX);
+    qm << vid << data;
+    std::vector<query_result> futures(1, queryobj.update(shard_manager.get_master(vid),
+                                                         qm.message(), qm.length()));
+    return graphdb_future<void>(futures, boost::bind(&graphdb_client::parse_replies, this, _1));
+  }
+
+  graphdb_future<void> graphdb_client::async_add_edge(graph_vid_t source, graph_vid_t dest,
+                                                      const graph_row& data) {
+    QueryMessage qm(QueryMessage::ADD, QueryMessage::EDGE);
+    qm << source << dest << data;
+    graph_shard_id_t target = shard_manager.get_master(source, dest);
+    std::vector<query_result> futures(1, queryobj.update(target, qm.message(), qm.length()));
+    mirror_lock.lock();
+    mirror_cache.erase(source);
+    mirror_cache.erase(dest);
+    mirror_lock.unlock();
+
+    // both ends are mirrored on the shard of the edge
+    std::vector<graph_shard_id_t> mirrors(1, target);
+    graph_vid_t ends[2] = {source, dest};
+    for (size_t i = 0; i < 2; ++i) {
+      QueryMessage mirror(QueryMessage::ADD, QueryMessage::VMIRROR);
+      mirror << ends[i] << mirrors;
+      futures.push_back(queryobj.update(shard_manager.get_master(ends[i]),
+                                        mirror.message(), mirror.length()));
+    }
+    return graphdb_future<void>(futures, boost::bind(&graphdb_client::parse_replies, this, _1));
+  }
+
+  // ------------------------------ Asynchronous Batch --------------------------------
+  template<typename T>
+  static int complete(graphdb_future<T> future, T* out, int* errorcode) {
+    int err = (out == NULL) ? future.wait() : future.get(*out);
+    if (errorcode != NULL) *errorcode = err;
+    return err;
+  }
+
+  static int complete_write(graphdb_future<void> future, int* errorcode) {
+    int err = future.wait();
+    if (errorcode != NULL) *errorcode = err;
+    return err;
+  }
+
+  graphdb_client::async_batch::async_batch(graphdb_client& client, size_t max_in_flight)
+      : client(client), max_in_flight(std::max<size_t>(max_in_flight, 1)), num_failed(0) { }
+
+  graphdb_client::async_batch::~async_batch() {
+    wait();
+  }
+
+  void graphdb_client::async_batch::get_vertex(graph_vid_t vid, graph_row* out, int* errorcode) {
+    push(boost::bind(complete<graph_row>, client.async_get_vertex(vid), out, errorcode));
+  }
+
+  void graphdb_client::async_batch::get_edge(graph_eid_t eid, graph_row* out, int* errorcode) {
+    push(boost::bind(complete<graph_row>, client.async_get_edge(eid), out, errorcode));
+  }
+
+  void graphdb_client::async_batch::set_vertex(graph_vid_t vid, const graph_row& data,
+                                               int* errorcode) {
+    push(boost::bind(complete_write, client.async_set_vertex(vid, data), errorcode));
+  }
+
+  void graphdb_client::async_batch::set_edge(graph_eid_t eid, const graph_row& data,
+                                             int* errorcode) {
+    push(boost::bind(complete_write, client.async_set_edge(eid, data), errorcode));
+  }
+
+  void graphdb_client::async_batch::add_vertex(graph_vid_t vid, const graph_row& data,
+                                               int* errorcode) {
+    push(boost::bind(complete_write, client.async_add_vertex(vid, data), errorcode));
+  }
+
+  void graphdb_client::async_batch::add_edge(graph_vid_t source, graph_vid_t target,
+                                             const graph_row& data, int* errorcode) {
+    push(boost::bind(complete_write, client.async_add_edge(source, target, data), errorcode));
+  }
+
+  size_t graphdb_client::async_batch::wait() {
+    while (!pending.empty()) {
+      pop();
+    }
+    size_t ret = num_failed;
+    num_failed = 0;
+    return ret;
+  }
+
+  void graphdb_client::async_batch::push(const boost::function<int ()>& completion) {
+    pending.push_back(completion);
+    while (pending.size() > max_in_flight) {
+      pop();
+    }
+  }
+
+  void graphdb_client::async_batch::pop() {
+    if (pending.front()() != 0) {
+      ++num_failed;
+    }
+    pending.pop_front();
   }
 
   int graphdb_client::add_edge_field(const graph_field& field) {
@@ -251,6 +674,125 @@ namespace graphlab {
   }
 
 
+  // ------------------------------ Request Coalescing --------------------------------
+  struct graphdb_client::coalesced_batch {
+    coalesced_batch(bool is_set) : is_set(is_set), closed(false), done(false) { }
+    bool is_set;
+    // the vids of the gets, or the vids and data of the sets
+    std::vector<graph_vid_t> vids;
+    std::vector<std::pair<graph_vid_t, graph_row> > pairs;
+    std::vector<graph_row> rows;
+    std::vector<int> errorcodes;
+    // set when the batch stops accepting calls
+    bool closed;
+    // set when the results are in
+    bool done;
+    conditional cond;
+  };
+
+  void graphdb_client::set_coalescing(size_t max_batch, size_t max_delay_us) {
+    coalesce_lock.lock();
+    coalesce_max_batch = max_batch;
+    coalesce_max_delay_us = max_delay_us;
+    coalesce_lock.unlock();
+  }
+
+  bool graphdb_client::coalescing() {
+    coalesce_lock.lock();
+    bool on = coalesce_max_batch > 1;
+    coalesce_lock.unlock();
+    return on;
+  }
+
+  size_t graphdb_client::num_coalesced_batches() {
+    coalesce_lock.lock();
+    size_t n = coalesced_batches;
+    coalesce_lock.unlock();
+    return n;
+  }
+
+  int graphdb_client::coalesce(graph_vid_t vid, graph_row* out, const graph_row* data) {
+    std::pair<graph_shard_id_t, bool> key(shard_manager.get_master(vid), data != NULL);
+    coalesce_lock.lock();
+    coalesced_batch_ptr& slot = open_batches[key];
+    if (!slot) {
+      slot.reset(new coalesced_batch(data != NULL));
+    }
+    coalesced_batch_ptr batch = slot;
+    mutex& send_lock = send_locks[key];
+    size_t idx;
+    if (data != NULL) {
+      idx = batch->pairs.size();
+      batch->pairs.push_back(std::make_pair(vid, *data));
+    } else {
+      idx = batch->vids.size();
+      batch->vids.push_back(vid);
+    }
+
+    if (idx == 0) {
+      // The first caller waits for others to join until the deadline, or
+      // until the batch fills up, then waits for the batch in flight to
+      // the same shard and sends this one. Calls keep joining until then.
+      timeval deadline;
+      gettimeofday(&deadline, NULL);
+      uint64_t deadline_us = deadline.tv_sec * 1000000ULL + deadline.tv_usec +
+          coalesce_max_delay_us;
+      while (!batch->closed) {
+        timeval now;
+        gettimeofday(&now, NULL);
+        uint64_t now_us = now.tv_sec * 1000000ULL + now.tv_usec;
+        if (now_us >= deadline_us) break;
+        batch->cond.timedwait_ns(coalesce_lock, (deadline_us - now_us) * 1000);
+      }
+      coalesce_lock.unlock();
+      send_lock.lock();
+      coalesce_lock.lock();
+      if (!batch->closed) {
+        batch->closed = true;
+        open_batches.erase(key);
+      }
+      ++coalesced_batches;
+      coalesce_lock.unlock();
+      send_batch(batch);
+      send_lock.unlock();
+      coalesce_lock.lock();
+    } else if (idx + 1 >= coalesce_max_batch && !batch->closed) {
+      // the batch is full, wake up its first caller to send it
+      batch->closed = true;
+      open_batches.erase(key);
+      batch->cond.broadcast();
+    }
+    while (!batch->done) {
+      batch->cond.wait(coalesce_lock);
+    }
+    int errorcode = batch->errorcodes[idx];
+    if (out != NULL) {
+      out->swap(batch->rows[idx]);
+    }
+    coalesce_lock.unlock();
+    return errorcode;
+  }
+
+  void graphdb_client::send_batch(coalesced_batch_ptr batch) {
+    std::vector<int> errorcodes;
+    std::vector<graph_row> rows;
+    if (batch->is_set) {
+      QueryMessage::header header(QueryMessage::BSET, QueryMessage::VERTEX);
+      scatter_messages<std::pair<graph_vid_t, graph_row>, char>(header, batch->pairs, boost::bind(&graphdb_client::vidpair2shard<graph_row>, this, _1), NULL, errorcodes);
+    } else {
+      boost::shared_ptr<graph_row_codec> rc = shared_row_codec();
+      QueryMessage::header header(QueryMessage::BGET, QueryMessage::VERTEX, rc->version());
+      scatter_messages<graph_vid_t, graph_row>(header, batch->vids, boost::bind(&graphdb_client::vid2shard, this, _1), &rows, errorcodes, rc);
+    }
+
+    coalesce_lock.lock();
+    batch->errorcodes.swap(errorcodes);
+    batch->rows.swap(rows);
+    batch->done = true;
+    batch->cond.broadcast();
+    coalesce_lock.unlock();
+  }
+
   // --------------- Helper functions -----------------------
   graph_shard_id_t graphdb_client::eid2shard(const graph_eid_t& eid) { 
     return split_eid(eid).first;
@@ -272,13 +814,390 @@ namespace graphlab {
     return shard_manager.get_master(des.src, des.dest);
   }
 
-  graphdb_client::mirror_table_type graphdb_client::mirror_table_from_edges (const std::vector<edge_insert_descriptor>& edges) {
-    mirror_table_type map;
+  int graphdb_client::gather_id_values(QueryMessage& qm, std::vector<id_value_pair>& out) {
+    std::vector<query_result> futures;
+    queryobj.query_all(qm.message(), qm.length(), futures);
+    int errorcode = 0;
+    for (size_t i = 0; i < futures.size(); ++i) {
+      std::vector<id_value_pair> values;
+      int err = queryobj.parse_reply(futures[i], values);
+      if (err != 0) {
+        if (errorcode == 0) errorcode = err;
+        continue;
+      }
+      out.insert(out.end(), values.begin(), values.end());
+    }
+    return errorcode;
+  }
+
+  boost::shared_ptr<graph_row_codec> graphdb_client::shared_row_codec() {
+    codec_lock.lock();
+    boost::shared_ptr<graph_row_codec> rc = codec;
+    bool fetch = (rc->version() == 0 || stale_schema);
+    codec_lock.unlock();
+    if (fetch) {
+      // the schema is read without the lock; callers racing here fetch it
+      // more than once, and keep the codec they fetched
+      rc.reset(new graph_row_codec(get_vertex_fields(), get_edge_fields()));
+      codec_lock.lock();
+      codec = rc;
+      stale_schema = false;
+      codec_lock.unlock();
+    }
+    return rc;
+  }
+
+  void graphdb_client::mark_schema_stale() {
+    codec_lock.lock();
+    stale_schema = true;
+    codec_lock.unlock();
+  }
+
+  int graphdb_client::parse_replies(std::vector<query_result>& replies) {
+    int errorcode = 0;
+    for (size_t i = 0; i < replies.size(); ++i) {
+      int err = queryobj.parse_reply(replies[i]);
+      if (errorcode == 0) errorcode = err;
+    }
+    return errorcode;
+  }
+
+  int graphdb_client::parse_row(boost::shared_ptr<graph_row_codec> rc, bool is_vertex,
+                                std::vector<query_result>& replies, graph_row& out) {
+    bool compact;
+    int errorcode = queryobj.parse_row_reply(replies[0], out, is_vertex, *rc, compact);
+    if (!compact) mark_schema_stale();
+    return errorcode;
+  }
+
+  int graphdb_client::parse_count(std::vector<query_result>& replies, uint64_t& out) {
+    std::vector<int> errorcodes;
+    out = 0;
+    queryobj.parse_and_aggregate(replies, out, errorcodes);
+    return errorcodes.empty() ? 0 : errorcodes[0];
+  }
+
+  int graphdb_client::parse_mirrors_and_adj(graph_vid_t vid, bool in_edges,
+                                            std::vector<query_result>& replies,
+                                            vertex_adj_descriptor& out) {
+    std::pair<std::vector<graph_shard_id_t>, vertex_adj_descriptor> reply;
+    int errorcode = queryobj.parse_reply(replies[0], reply);
+    if (errorcode == EINVID) {
+      // the master has no mirrors of the vertex: ask its neighborhood,
+      // in case edges were added without registering their mirrors
+      std::vector<graph_shard_id_t> spans;
+      shard_manager.get_neighbors(shard_manager.get_master(vid), spans);
+      std::vector<query_result> futures;
+      query_vertex_adj(vid, in_edges, spans, futures);
+      return parse_vertex_adj(futures, out);
+    } else if (errorcode != 0) {
+      return errorcode;
+    }
+    std::vector<graph_shard_id_t>& mirrors = reply.first;
+    cache_mirrors(vid, mirrors);
+    out.neighbor_ids.swap(reply.second.neighbor_ids);
+    out.eids.swap(reply.second.eids);
+
+    // the master already answered for its own edges
+    mirrors.erase(std::remove(mirrors.begin(), mirrors.end(), shard_manager.get_master(vid)),
+                  mirrors.end());
+    if (mirrors.empty()) {
+      return 0;
+    }
+    std::vector<query_result> futures;
+    query_vertex_adj(vid, in_edges, mirrors, futures);
+    return parse_vertex_adj(futures, out);
+  }
+
+  void graphdb_client::scatter_vids(QueryMessage::qm_obj_type obj, bool in_edges,
+                                    const std::vector<graph_vid_t>& vids,
+                                    std::map<graph_shard_id_t, std::vector<size_t> >& positions,
+                                    std::vector<std::pair<graph_shard_id_t, query_result> >& replies) {
+    typedef std::map<graph_shard_id_t, std::vector<size_t> >::iterator map_iter_type;
+    for (map_iter_type it = positions.begin(); it != positions.end(); ++it) {
+      std::vector<graph_vid_t> shard_vids(it->second.size());
+      for (size_t j = 0; j < it->second.size(); ++j) {
+        shard_vids[j] = vids[it->second[j]];
+      }
+      QueryMessage qm(QueryMessage::BGET, obj);
+      qm << in_edges << shard_vids;
+      replies.push_back(std::make_pair(it->first,
+                                       queryobj.query(it->first, qm.message(), qm.length())));
+    }
+  }
+
+  void graphdb_client::query_vertex_adj(graph_vid_t vid, bool in_edges,
+                                        std::vector<graph_shard_id_t>& shards,
+                                        std::vector<query_result>& futures) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::VERTEXADJ);
+    qm << vid << in_edges;
+    queryobj.query_multi(shards, qm.message(), qm.length(), futures);
+  }
+
+  void graphdb_client::set_mirror_cache_size(size_t max_vertices) {
+    mirror_lock.lock();
+    max_cached_mirrors = max_vertices;
+    mirror_cache.clear();
+    mirror_lock.unlock();
+  }
+
+  void graphdb_client::clear_mirror_cache() {
+    mirror_lock.lock();
+    mirror_cache.clear();
+    mirror_lock.unlock();
+  }
+
+  void graphdb_client::set_known_mirrors_bytes(size_t max_bytes) {
+    known_mirrors_lock.lock();
+    known_mirrors.resize(max_bytes);
+    known_mirrors_lock.unlock();
+  }
+
+  void graphdb_client::clear_known_mirrors() {
+    known_mirrors_lock.lock();
+    known_mirrors.clear();
+    known_mirrors_lock.unlock();
+  }
+
+  void graphdb_client::cache_mirrors(graph_vid_t vid,
+                                     const std::vector<graph_shard_id_t>& mirrors) {
+    mirror_lock.lock();
+    if (max_cached_mirrors > 0) {
+      if (mirror_cache.size() >= max_cached_mirrors) {
+        mirror_cache.clear();
+      }
+      // the master is not one of the mirrors, but may hold edges too
+      std::vector<graph_shard_id_t>& shards = mirror_cache[vid];
+      shards = mirrors;
+      graph_shard_id_t master = shard_manager.get_master(vid);
+      if (std::find(shards.begin(), shards.end(), master) == shards.end()) {
+        shards.push_back(master);
+      }
+    }
+    mirror_lock.unlock();
+  }
+
+  // ----------------------------- Scanner --------------------------------------
+  graphdb_client::scanner::scanner(graphdb_client& client, bool is_vertex,
+                                   const graph_row_filter& filter,
+                                   size_t rows_per_chunk, size_t bytes_per_chunk)
+      : client(client), is_vertex(is_vertex), filter(filter),
+        rows_per_chunk(std::max<size_t>(rows_per_chunk, 1)), bytes_per_chunk(bytes_per_chunk),
+        shards(client.shard_manager.num_shards()), started(false),
+        current(0), chunk_pos(0), errorcode(0) { }
+
+  graphdb_client::scanner::~scanner() {
+    std::map<graph_shard_id_t, query_result>::iterator it;
+    for (it = in_flight.begin(); it != in_flight.end(); ++it) {
+      it->second.get_status();
+    }
+  }
+
+  void graphdb_client::scanner::resume(const resume_token& token) {
+    ASSERT_FALSE(started);
+    ASSERT_EQ(token.size(), shards.size());
+    for (size_t i = 0; i < shards.size(); ++i) {
+      shards[i].position = token[i].first;
+      shards[i].skip = token[i].second;
+    }
+  }
+
+  graphdb_client::scanner::resume_token graphdb_client::scanner::token() const {
+    resume_token out(shards.size());
+    for (size_t i = 0; i < shards.size(); ++i) {
+      out[i] = std::make_pair(shards[i].position, shards[i].skip);
+    }
+    return out;
+  }
+
+  void graphdb_client::scanner::request(graph_shard_id_t shard, uint64_t position) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::SCAN);
+    qm << is_vertex << (size_t)position << rows_per_chunk << bytes_per_chunk << filter;
+    in_flight.insert(std::make_pair(shard, client.queryobj.query(shard, qm.message(), qm.length())));
+  }
+
+  bool graphdb_client::scanner::next(scan_descriptor& out) {
+    if (!started) {
+      started = true;
+      for (size_t i = 0; i < shards.size(); ++i) {
+        request(i, shards[i].position);
+      }
+    }
+    while (chunk_pos == chunk.size()) {
+      if (!load_chunk()) {
+        return false;
+      }
+    }
+    out.id = chunk[chunk_pos].id;
+    out.source = chunk[chunk_pos].source;
+    out.target = chunk[chunk_pos].target;
+    out.data.swap(chunk[chunk_pos].data);
+    ++chunk_pos;
+    ++shards[current].skip;
+    if (chunk_pos == chunk.size()) {
+      // the whole chunk was returned
+      shards[current].position = shards[current].next;
+      shards[current].skip = 0;
+    }
+    return true;
+  }
+
+  bool graphdb_client::scanner::load_chunk() {
+    if (errorcode != 0 || in_flight.empty()) {
+      return false;
+    }
+    // the shards take turns, starting after the last one
+    std::map<graph_shard_id_t, query_result>::iterator it = in_flight.upper_bound(current);
+    if (it == in_flight.end()) {
+      it = in_flight.begin();
+    }
+    current = it->first;
+    query_result reply = it->second;
+    in_flight.erase(it);
+
+    if (reply.get_status() != 0) {
+      logstream(LOG_ERROR) << glstrerr(ESRVUNREACH) << std::endl;
+      errorcode = ESRVUNREACH;
+      return false;
+    }
+    std::string msg = reply.get_reply();
+    iarchive iarc(msg.c_str(), msg.length());
+    iarc >> errorcode;
+    if (errorcode != 0) {
+      logstream(LOG_ERROR) << glstrerr(errorcode) << std::endl;
+      return false;
+    }
+    size_t next;
+    bool end;
+    chunk.clear();
+    iarc >> next >> end >> chunk;
+    shard_scan& shard = shards[current];
+    shard.next = next;
+    if (!end) {
+      request(current, next);
+    }
+    // rows already returned before the scan was stopped
+    chunk_pos = std::min<size_t>(shard.skip, chunk.size());
+    if (chunk_pos == chunk.size()) {
+      shard.position = shard.next;
+      shard.skip = 0;
+    }
+    return true;
+  }
+
+  // ----------------------------- Traversal --------------------------------------
+  int graphdb_client::traverse(const std::vector<graph_vid_t>& sources,
+                               const graph_traversal_spec& spec,
+                               std::vector<std::pair<graph_vid_t, size_t> >& out) {
+    uint64_t id = ((uint64_t)traversal_rng() << 32) | traversal_rng();
+    graph_traversal traversal(shard_manager,
+                              boost::bind(&graphdb_query_object::query_each, &queryobj, _1, _2));
+    return traversal.traverse(id, sources, spec, out);
+  }
+
+  int graphdb_client::count_traversal(const std::vector<graph_vid_t>& sources,
+                                      const graph_traversal_spec& spec, uint64_t& out) {
+    uint64_t id = ((uint64_t)traversal_rng() << 32) | traversal_rng();
+    graph_traversal traversal(shard_manager,
+                              boost::bind(&graphdb_query_object::query_each, &queryobj, _1, _2));
+    return traversal.count(id, sources, spec, out);
+  }
+
+  // ----------------------------- Aggregation --------------------------------------
+  int graphdb_client::aggregate_vertex_field(size_t fieldpos, bool distinct,
+                                             graph_field_aggregate& out) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::AGGREGATE);
+    qm << FIELD_AGGREGATE << true << fieldpos << distinct;
+    return aggregate_helper(qm, out);
+  }
+
+  int graphdb_client::aggregate_edge_field(size_t fieldpos, bool distinct,
+                                           graph_field_aggregate& out) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::AGGREGATE);
+    qm << FIELD_AGGREGATE << false << fieldpos << distinct;
+    return aggregate_helper(qm, out);
+  }
+
+  int graphdb_client::vertex_field_histogram(size_t fieldpos, double lo, double hi,
+                                             size_t nbins, graph_field_histogram& out) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::AGGREGATE);
+    qm << FIELD_HISTOGRAM << true << fieldpos << lo << hi << nbins;
+    int errorcode = aggregate_helper(qm, out);
+    // a shard replied with other bins
+    return (errorcode == 0 && out.mismatched) ? EINVHEAD : errorcode;
+  }
+
+  int graphdb_client::edge_field_histogram(size_t fieldpos, double lo, double hi,
+                                           size_t nbins, graph_field_histogram& out) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::AGGREGATE);
+    qm << FIELD_HISTOGRAM << false << fieldpos << lo << hi << nbins;
+    int errorcode = aggregate_helper(qm, out);
+    // a shard replied with other bins
+    return (errorcode == 0 && out.mismatched) ? EINVHEAD : errorcode;
+  }
+
+  int graphdb_client::degree_distribution(graph_traversal_spec::direction_type direction,
+                                          graph_degree_distribution& out) {
+    uint64_t id = ((uint64_t)traversal_rng() << 32) | traversal_rng();
+    graph_traversal traversal(shard_manager,
+                              boost::bind(&graphdb_query_object::query_each, &queryobj, _1, _2));
+    return traversal.degree_distribution(id, direction, out);
+  }
+
+  int graphdb_client::parse_vertex_adj(std::vector<query_result>& replies,
+                                       vertex_adj_descriptor& out) {
+    std::vector<int> errorcodes;
+    queryobj.parse_and_aggregate(replies, out, errorcodes);
+    for (size_t i = 0; i < errorcodes.size(); ++i) {
+      // Expect EINVID, queried shards may not have adj structure of the query vertex.
+      if (errorcodes[i] != 0 && errorcodes[i] != EINVID) {
+        return errorcodes[i];
+      }
+    }
+    return 0;
+  }
+
+  bool graphdb_client::parse_batch_reply(query_result& future, std::vector<graph_row>* out,
+                                         std::vector<int>& errorcodes,
+                                         const QueryMessage::header& query_header,
+                                         const graph_row_codec* rc) {
+    if (query_header.schema_version == 0 || rc == NULL) {
+      return queryobj.parse_batch_reply<graph_row>(future, out, errorcodes);
+    }
+    bool compact;
+    bool success = queryobj.parse_batch_row_reply(future, out, errorcodes,
+                                                  query_header.obj == QueryMessage::VERTEX,
+                                                  *rc, compact);
+    if (!compact) mark_schema_stale();
+    return success;
+  }
+
+  void graphdb_client::new_mirrors_of_edges(const std::vector<edge_insert_descriptor>& edges,
+                                            const graph_shard_id_t* shard,
+                                            std::vector<mirror_insert_descriptor>& out) {
+    std::vector<std::pair<graph_vid_t, graph_shard_id_t> > pairs;
+    known_mirrors_lock.lock();
     for (size_t i = 0; i < edges.size(); ++i) {
-      graph_shard_id_t target = ein2shard(edges[i]); 
-      map[edges[i].src].insert(target);
-      map[edges[i].dest].insert(target);
+      graph_shard_id_t target = (shard == NULL) ? ein2shard(edges[i]) : *shard;
+      if (!known_mirrors.contains(edges[i].src, target)) {
+        pairs.push_back(std::make_pair(edges[i].src, target));
+      }
+      if (!known_mirrors.contains(edges[i].dest, target)) {
+        pairs.push_back(std::make_pair(edges[i].dest, target));
+      }
+    }
+    known_mirrors_lock.unlock();
+
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    mirror_lock.lock();
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      if (out.empty() || out.back().first != pairs[i].first) {
+        out.push_back(mirror_insert_descriptor(pairs[i].first, std::vector<graph_shard_id_t>()));
+        mirror_cache.erase(pairs[i].first);
+      }
+      out.back().second.push_back(pairs[i].second);
     }
-    return map;
+    mirror_lock.unlock();
   }
 } // end of graphlab namespace
@@ -6,6 +6,15 @@
 #include<graphlab/database/graph_shard_manager.hpp>
 #include<graphlab/database/graphdb_query_object.hpp>
 #include<graphlab/database/query_message.hpp>
+#include<graphlab/database/graph_row_filter.hpp>
+#include<graphlab/database/graph_traversal.hpp>
+#include<graphlab/database/graph_aggregate.hpp>
+#include<graphlab/database/client/graphdb_future.hpp>
+#include<graphlab/database/client/graphdb_mirror_set.hpp>
+#include<graphlab/parallel/pthread_tools.hpp>
+#include<boost/unordered_map.hpp>
+#include<ctime>
+#include<deque>
 #include<map>
 #include<set>
 
@@ -16,13 +25,19 @@ namespace graphlab {
      typedef graph_database::vertex_insert_descriptor vertex_insert_descriptor;
      typedef graph_database::edge_insert_descriptor edge_insert_descriptor;
      typedef graph_database::mirror_insert_descriptor mirror_insert_descriptor;
+     typedef graph_database::id_value_pair id_value_pair;
+     typedef graph_database::scan_descriptor scan_descriptor;
 
-     typedef std::map<graph_vid_t, std::set<graph_shard_id_t> > mirror_table_type;
      typedef graphdb_query_object::query_result query_result;
 
    public:
      /// Creates server with empty fields.
-     graphdb_client(graphdb_config& config) : queryobj(config), shard_manager(config.get_nshards()) {} 
+     graphdb_client(graphdb_config& config)
+         : queryobj(config), shard_manager(config.get_nshards()),
+           codec(new graph_row_codec()), stale_schema(false),
+           coalesce_max_batch(0), coalesce_max_delay_us(0), coalesced_batches(0),
+           max_cached_mirrors(0),
+           traversal_rng((uint32_t)time(NULL) ^ (uint32_t)(size_t)this) {} 
      virtual ~graphdb_client() {};
 
      // --------------------- Basic Queries ----------------------------
@@ -31,6 +46,9 @@ namespace graphlab {
      const std::vector<graph_field> get_vertex_fields(); 
      const std::vector<graph_field> get_edge_fields();
 
+     /// Returns the placement of the vertices and edges on the shards.
+     inline const graph_shard_manager& get_shard_manager() const { return shard_manager; }
+
      // --------------------- Schema Modification API ----------------------
      /// Add a field to the vertex data schema
      int add_vertex_field(const graph_field& field);
@@ -47,15 +65,55 @@ namespace graphlab {
      bool add_vertices(const std::vector<vertex_insert_descriptor>& vertices,
                        std::vector<int>& errorcodes);
 
+     /// Same as add_vertices() for vertices all mastered by shard.
+     bool add_vertices_to_shard(graph_shard_id_t shard,
+                                const std::vector<vertex_insert_descriptor>& vertices,
+                                std::vector<int>& errorcodes);
+
      bool add_edges(const std::vector<edge_insert_descriptor>& edges,
                     std::vector<int>& errorcodes);
 
+     /**
+      * Same as add_edges() for edges all placed on shard, which are sent
+      * there without being partitioned by get_master(source, target).
+      */
+     bool add_edges_to_shard(graph_shard_id_t shard,
+                             const std::vector<edge_insert_descriptor>& edges,
+                             std::vector<int>& errorcodes);
+
      // --------------------- Single Query API -----------------------------------------
      // Read API
      int get_vertex(graph_vid_t vid, graph_row& out);
      int get_edge(graph_eid_t eid, graph_row& out);
      int get_vertex_adj(graph_vid_t vid, bool in_edges, vertex_adj_descriptor& out);
 
+     /**
+      * Appends to out the ids of the vertices whose field at fieldpos
+      * equals key, in no particular order. The lookup is sent to every
+      * shard and answered from their index on the field, which must be
+      * an indexed INT, VID or STRING field.
+      */
+     int find_vertices(size_t fieldpos, const graph_value& key,
+                       std::vector<graph_vid_t>& out);
+
+     /**
+      * Fills out with the ids and values of the k vertices (or edges) with
+      * the largest (or smallest) values of the ordered field at fieldpos,
+      * from the largest (or smallest) one. Each shard replies with its own
+      * top k, which are merged here.
+      */
+     int topk(bool is_vertex, size_t fieldpos, size_t k, bool largest,
+              std::vector<id_value_pair>& out);
+
+     /**
+      * Fills out with the ids and values of the vertices (or edges) whose
+      * ordered field at fieldpos is in [lo, hi], in ascending order of
+      * value. A NULL bound leaves that end open.
+      */
+     int range(bool is_vertex, size_t fieldpos,
+               const graph_value& lo, const graph_value& hi,
+               std::vector<id_value_pair>& out);
+
      // Write API
      int set_vertex(graph_vid_t vid, const graph_row& data);
      int set_edge(graph_eid_t eid, const graph_row& data);
@@ -73,6 +131,285 @@ namespace graphlab {
      bool set_vertices(const std::vector<std::pair<graph_vid_t, graph_row> >& pairs,
                        std::vector<int>& errorcodes);
 
+     /**
+      * Same as get_vertices(), but the servers only reply the vertices
+      * accepted by filter, with the fields it selects. out gets the vids
+      * and rows of these vertices, in the order of vids. errorcodes are set
+      * for all vids, whether filtered out or not.
+      */
+     bool get_vertices(const std::vector<graph_vid_t>& vids, const graph_row_filter& filter,
+                       std::vector<std::pair<graph_vid_t, graph_row> >& out,
+                       std::vector<int>& errorcodes);
+
+     /// Same as get_vertices() with a filter, for edges.
+     bool get_edges(const std::vector<graph_eid_t>& eids, const graph_row_filter& filter,
+                    std::vector<std::pair<graph_eid_t, graph_row> >& out,
+                    std::vector<int>& errorcodes);
+
+     /**
+      * Same as get_vertex_adj() for each of vids, with at most two
+      * messages per shard: one BGET VMIRROR to the masters of the vids
+      * whose mirrors are not cached, then one BGET VERTEXADJ to each of
+      * the other shards holding edges of the vids.
+      */
+     bool get_vertices_adj(const std::vector<graph_vid_t>& vids, bool in_edges,
+                           std::vector<vertex_adj_descriptor>& out,
+                           std::vector<int>& errorcodes);
+
+     // --------------------- Traversal -----------------------------------------
+     /**
+      * Runs the breadth first traversal spec from sources on the servers
+      * (see \ref graph_traversal), and fills out with the vertices reached
+      * and the hop they were first reached at. The frontier goes from shard
+      * to shard, the client only receives the number of new vertices of
+      * each hop, and the result. The servers need peers, see
+      * graphdb_server::set_peers().
+      */
+     int traverse(const std::vector<graph_vid_t>& sources, const graph_traversal_spec& spec,
+                  std::vector<std::pair<graph_vid_t, size_t> >& out);
+
+     /// Same as traverse(), but only the number of vertices reached is returned.
+     int count_traversal(const std::vector<graph_vid_t>& sources,
+                         const graph_traversal_spec& spec, uint64_t& out);
+
+     // --------------------- Aggregation ----------------------------
+     /**
+      * Aggregates the field at fieldpos of all the vertices into out: each
+      * server aggregates its shard in parallel, and the partials are merged
+      * here. The distinct values are counted approximately if distinct is
+      * true. Returns EINVID if the field does not exist.
+      */
+     int aggregate_vertex_field(size_t fieldpos, bool distinct, graph_field_aggregate& out);
+
+     /// Same as aggregate_vertex_field() for the edges.
+     int aggregate_edge_field(size_t fieldpos, bool distinct, graph_field_aggregate& out);
+
+     /**
+      * Fills out with the histogram of the INT or DOUBLE field at fieldpos
+      * of all the vertices, in nbins equal bins over [lo, hi). Returns
+      * EINVTYPE if the field is of another type, and EINVHEAD unless lo <
+      * hi and nbins is between 1 and graph_field_histogram::MAX_BINS, or
+      * if the shards reply with different bins.
+      */
+     int vertex_field_histogram(size_t fieldpos, double lo, double hi, size_t nbins,
+                                graph_field_histogram& out);
+
+     /// Same as vertex_field_histogram() for the edges.
+     int edge_field_histogram(size_t fieldpos, double lo, double hi, size_t nbins,
+                              graph_field_histogram& out);
+
+     /**
+      * Fills out with the number of vertices of each degree, counting the
+      * edges in the given direction. Each shard counts the degrees over its
+      * edges and sends them to the masters of the vertices, like the
+      * frontier of a traversal, so the servers need peers, see
+      * graphdb_server::set_peers().
+      */
+     int degree_distribution(graph_traversal_spec::direction_type direction,
+                             graph_degree_distribution& out);
+
+     // --------------------- Asynchronous API -----------------------------------------
+     /**
+      * The asynchronous versions of the single queries above send their
+      * request(s) and return at once. The result is parsed when the
+      * returned future is waited on, so many requests can be in flight
+      * from one thread. The synchronous calls wait on these futures.
+      */
+     graphdb_future<uint64_t> async_num_vertices();
+     graphdb_future<uint64_t> async_num_edges();
+
+     graphdb_future<graph_row> async_get_vertex(graph_vid_t vid);
+     graphdb_future<graph_row> async_get_edge(graph_eid_t eid);
+     /**
+      * The adjacency is asked to the master of the vertex together with
+      * its mirrors, the shards holding its edges, and then to the other
+      * mirrors only. If the mirror cache is enabled, the next lookups of
+      * the vertex go to the master and the mirrors at once. A vertex its
+      * master does not know is looked up on every shard of its
+      * neighborhood.
+      */
+     graphdb_future<vertex_adj_descriptor> async_get_vertex_adj(graph_vid_t vid, bool in_edges);
+
+     graphdb_future<void> async_set_vertex(graph_vid_t vid, const graph_row& data);
+     graphdb_future<void> async_set_edge(graph_eid_t eid, const graph_row& data);
+
+     graphdb_future<void> async_add_vertex(graph_vid_t vid, const graph_row& data);
+     /// The future also covers the mirror updates of source and target.
+     graphdb_future<void> async_add_edge(graph_vid_t source, graph_vid_t target,
+                                         const graph_row& data);
+
+     /**
+      * Pipelines single operations through a client. Each operation is
+      * sent when it is added, after which the oldest ones are waited for
+      * until no more than max_in_flight are outstanding.
+      * Results and error codes are written to the given locations, which
+      * must stay valid until the operation completed, at the latest in
+      * wait(). Not thread safe, like the client.
+      */
+     class async_batch {
+      public:
+       async_batch(graphdb_client& client, size_t max_in_flight = 1024);
+
+       /// Waits for the operations still in flight.
+       ~async_batch();
+
+       void get_vertex(graph_vid_t vid, graph_row* out, int* errorcode = NULL);
+       void get_edge(graph_eid_t eid, graph_row* out, int* errorcode = NULL);
+       void set_vertex(graph_vid_t vid, const graph_row& data, int* errorcode = NULL);
+       void set_edge(graph_eid_t eid, const graph_row& data, int* errorcode = NULL);
+       void add_vertex(graph_vid_t vid, const graph_row& data, int* errorcode = NULL);
+       void add_edge(graph_vid_t source, graph_vid_t target, const graph_row& data,
+                     int* errorcode = NULL);
+
+       /// Returns the number of operations sent and not completed yet.
+       inline size_t in_flight() const { return pending.size(); }
+
+       /**
+        * Waits for all operations. Returns the number of them which failed
+        * since the last call.
+        */
+       size_t wait();
+
+      private:
+       // Queues the completion of an operation, completing the oldest one
+       // first if the window is full.
+       void push(const boost::function<int ()>& completion);
+
+       // Completes the oldest operation.
+       void pop();
+
+       graphdb_client& client;
+       size_t max_in_flight;
+       std::deque<boost::function<int ()> > pending;
+       size_t num_failed;
+     };
+
+     /**
+      * Iterates over all the vertices or all the edges of the database,
+      * accepted by filter and with the fields it selects. Each shard is
+      * read in chunks of up to rows_per_chunk rows, or about
+      * bytes_per_chunk bytes of values, and the next chunk of a shard is
+      * requested as soon as its current one arrives. Chunks are returned
+      * from the shards in turn, so at most two chunks per shard are held
+      * at a time, and the servers keep no state for the scan. Rows added
+      * during the scan may or may not be returned. Not thread safe, like
+      * the client.
+      */
+     class scanner {
+      public:
+       /**
+        * Where the scan of each shard stands: the position of the chunk
+        * being returned, and the number of its rows already returned.
+        */
+       typedef std::vector<std::pair<uint64_t, uint64_t> > resume_token;
+
+       scanner(graphdb_client& client, bool is_vertex,
+               const graph_row_filter& filter = graph_row_filter(),
+               size_t rows_per_chunk = 4096, size_t bytes_per_chunk = 1 << 20);
+
+       /// Waits for the chunks still in flight.
+       ~scanner();
+
+       /**
+        * Continues a scan stopped at token, which must come from a scan of
+        * the same kind of rows with the same filter. Must be called before
+        * the first call to next().
+        */
+       void resume(const resume_token& token);
+
+       /**
+        * Moves the next row into out. Returns false once every row has been
+        * returned, or if a shard failed, see error().
+        */
+       bool next(scan_descriptor& out);
+
+       /// Returns the error of the shard which stopped the scan, or 0.
+       inline int error() const { return errorcode; }
+
+       /// Returns the token resuming the scan after the rows returned so far.
+       resume_token token() const;
+
+      private:
+       struct shard_scan {
+         shard_scan() : position(0), skip(0), next(0) { }
+         uint64_t position;
+         uint64_t skip;
+         // the position of the chunk following the one being returned
+         uint64_t next;
+       };
+
+       // Asks the chunk of shard at position.
+       void request(graph_shard_id_t shard, uint64_t position);
+
+       // Waits for the next chunk in turn. Returns false if there is none.
+       bool load_chunk();
+
+       graphdb_client& client;
+       bool is_vertex;
+       graph_row_filter filter;
+       size_t rows_per_chunk;
+       size_t bytes_per_chunk;
+       std::vector<shard_scan> shards;
+       // the chunk requested from each shard which is not done
+       std::map<graph_shard_id_t, query_result> in_flight;
+       bool started;
+       // the shard whose chunk is being returned
+       size_t current;
+       std::vector<scan_descriptor> chunk;
+       size_t chunk_pos;
+       int errorcode;
+     };
+
+     // --------------------- Request Coalescing -----------------------------------------
+     /**
+      * Opt-in coalescing of get_vertex() and set_vertex() calls made
+      * concurrently from several threads. Calls to the same shard are
+      * buffered for up to max_delay_us microseconds, or until max_batch of
+      * them are waiting, and sent as one BGET / BSET. Each caller then gets
+      * its own result. A longer delay or a larger batch trades the latency
+      * of a single call for throughput. max_batch <= 1 turns coalescing
+      * off, which is the default.
+      *
+      * Only these two calls may be made concurrently. The batches of a
+      * shard are sent one at a time, and calls keep coalescing while a
+      * batch is in flight, so that concurrent calls are batched even with
+      * max_delay_us = 0. Batches to different shards are sent in parallel.
+      */
+     void set_coalescing(size_t max_batch, size_t max_delay_us);
+
+     /// Returns the number of batches sent by coalesced calls so far.
+     size_t num_coalesced_batches();
+
+     // --------------------- Mirror Cache -----------------------------------------------
+     /**
+      * Sets the number of vertices whose mirrors are cached for
+      * get_vertex_adj(). 0, the default, disables the cache. The cache
+      * forgets the vertices of the edges added through this client, but
+      * edges other clients add on new shards are missed until
+      * clear_mirror_cache() is called. Only enable it when this client is
+      * the only writer.
+      */
+     void set_mirror_cache_size(size_t max_vertices);
+
+     /// Forgets all cached mirrors.
+     void clear_mirror_cache();
+
+     /**
+      * Sets the memory remembering the mirrors registered by add_edges(),
+      * which sends only the mirrors of a batch it does not remember. 0,
+      * the default, sends all of them. Mirrors are forgotten when the
+      * memory is full, and then sent again. \ref graph_loader enables it
+      * for the duration of a load.
+      *
+      * The mirrors are remembered only once registered. They no longer
+      * are after the shards are RESET or LOADed, which must be followed
+      * by clear_known_mirrors().
+      */
+     void set_known_mirrors_bytes(size_t max_bytes);
+
+     /// Forgets the mirrors remembered by add_edges().
+     void clear_known_mirrors();
+
    private:
      // ---------------------- Helper functions ---------------------------------------
      int add_vertex_mirror(graph_vid_t, const std::vector<graph_shard_id_t>& mirrors);
@@ -80,27 +417,136 @@ namespace graphlab {
      bool add_vertex_mirrors(const std::vector<mirror_insert_descriptor>& vmirrors,
                              std::vector<int>& errorcodes);
 
-     mirror_table_type mirror_table_from_edges (const std::vector<edge_insert_descriptor>& edges);
+     // Sends the edges and their new mirrors, to shard if not NULL.
+     bool add_edges_helper(const std::vector<edge_insert_descriptor>& edges,
+                           const graph_shard_id_t* shard, std::vector<int>& errorcodes);
 
-     template<typename Tin, typename Tout>
-     bool scatter_messages (QueryMessage::header query_header, 
-                            const std::vector<Tin>& in_values,
-                            boost::function<graph_shard_id_t (const Tin&)> get_shard,
-                            std::vector<Tout>* out_values, std::vector<int>& errorcodes) {
+     // Puts in out the mirrors added by edges which are not in known_mirrors,
+     // by vertex. The edges are on shard if not NULL.
+     void new_mirrors_of_edges(const std::vector<edge_insert_descriptor>& edges,
+                               const graph_shard_id_t* shard,
+                               std::vector<mirror_insert_descriptor>& out);
 
-       bool success = true;
+     // Records the mirrors of vid in mirror_cache, if it is enabled.
+     void cache_mirrors(graph_vid_t vid, const std::vector<graph_shard_id_t>& mirrors);
+
+     // Sends the GET AGGREGATE query qm to every shard and adds up their replies into out.
+     template<typename T>
+     int aggregate_helper(QueryMessage& qm, T& out) {
+       out = T();
+       std::vector<query_result> futures;
+       queryobj.query_all(qm.message(), qm.length(), futures);
+       std::vector<int> errorcodes;
+       queryobj.parse_and_aggregate(futures, out, errorcodes);
+       return errorcodes.empty() ? 0 : errorcodes[0];
+     }
+
+     // Sends BGET FILTER for the ids to their shards, see get_vertices().
+     bool filter_helper(bool is_vertex, const std::vector<uint64_t>& ids,
+                        const graph_row_filter& filter,
+                        boost::function<graph_shard_id_t (const uint64_t&)> get_shard,
+                        std::vector<std::pair<uint64_t, graph_row> >& out,
+                        std::vector<int>& errorcodes);
+
+     // ---------------------- Reply parsers of the asynchronous API ---------------------
+     // Returns the first error code of replies without content.
+     int parse_replies(std::vector<query_result>& replies);
+
+     // Parses the reply to GET VERTEX/EDGE sent with rc.
+     int parse_row(boost::shared_ptr<graph_row_codec> rc, bool is_vertex,
+                   std::vector<query_result>& replies, graph_row& out);
+
+     // Sums the counts of all shards.
+     int parse_count(std::vector<query_result>& replies, uint64_t& out);
+
+     // Merges the adjacency of a vertex from the shards it spans.
+     int parse_vertex_adj(std::vector<query_result>& replies, vertex_adj_descriptor& out);
+
+     // Parses the mirrors and local adjacency of vid from its master, then
+     // queries and merges the adjacency held by the other mirrors.
+     int parse_mirrors_and_adj(graph_vid_t vid, bool in_edges,
+                               std::vector<query_result>& replies, vertex_adj_descriptor& out);
+
+     // Sends one BGET of obj with in_edges and the vids at the listed
+     // positions to each shard, appending (shard, reply) to replies.
+     void scatter_vids(QueryMessage::qm_obj_type obj, bool in_edges,
+                       const std::vector<graph_vid_t>& vids,
+                       std::map<graph_shard_id_t, std::vector<size_t> >& positions,
+                       std::vector<std::pair<graph_shard_id_t, query_result> >& replies);
+
+     // Sends the adjacency query of vid to shards.
+     void query_vertex_adj(graph_vid_t vid, bool in_edges,
+                           std::vector<graph_shard_id_t>& shards,
+                           std::vector<query_result>& futures);
+
+     // ---------------------- Request coalescing ---------------------------------------
+     struct coalesced_batch;
+     typedef boost::shared_ptr<coalesced_batch> coalesced_batch_ptr;
+
+     // Returns true if get_vertex() and set_vertex() are coalesced.
+     bool coalescing();
+
+     // Adds a get of vid into out, or a set of vid to data if data is not
+     // NULL, to the open batch of its shard and waits for its result.
+     int coalesce(graph_vid_t vid, graph_row* out, const graph_row* data);
+
+     // Sends a closed batch and completes its callers, with the send lock
+     // of its key held.
+     void send_batch(coalesced_batch_ptr batch);
+
+     // Sends qm to all shards and concatenates their lists of id_value_pair.
+     int gather_id_values(QueryMessage& qm, std::vector<id_value_pair>& out);
+
+     // Returns the codec of the rows read from the servers, fetching the
+     // schema if it is unknown or a server replied with another one. The
+     // codec is shared with the replies still to be parsed with it.
+     boost::shared_ptr<graph_row_codec> shared_row_codec();
+
+     // Makes the next shared_row_codec() fetch the schema again, after a
+     // server did not use the compact encoding of a request.
+     void mark_schema_stale();
+
+     // Parses the reply of scatter_messages() to a request without rows.
+     template<typename Tout>
+     bool parse_batch_reply(query_result& future, std::vector<Tout>* out,
+                            std::vector<int>& errorcodes,
+                            const QueryMessage::header& query_header,
+                            const graph_row_codec* rc) {
+       return queryobj.parse_batch_reply<Tout>(future, out, errorcodes);
+     }
+
+     // Parses the reply of scatter_messages() to BGET VERTEX/EDGE, sent
+     // with the schema version of rc if it is not NULL.
+     bool parse_batch_reply(query_result& future, std::vector<graph_row>* out,
+                            std::vector<int>& errorcodes,
+                            const QueryMessage::header& query_header,
+                            const graph_row_codec* rc);
+
+     // The requests sent by scatter_send(), and the values of each shard.
+     struct scatter_requests {
+       std::map<graph_shard_id_t, std::vector<size_t> > shard2valueid;
+       std::vector<std::pair<graph_shard_id_t, query_result> > replies;
+       // the codec of the schema version in the header, if any
+       boost::shared_ptr<graph_row_codec> codec;
+     };
+
+     // Groups in_values by shard and sends them, without waiting for the
+     // replies; query is true for requests with a reply other than errors.
+     template<typename Tin>
+     void scatter_send(const QueryMessage::header& query_header,
+                       const std::vector<Tin>& in_values,
+                       boost::function<graph_shard_id_t (const Tin&)> get_shard,
+                       bool query, scatter_requests& requests) {
        typedef std::map<graph_shard_id_t, std::vector<size_t> >::iterator map_iter_type;
        // group values by the shard id
-       std::map<graph_shard_id_t, std::vector<size_t> > shard2valueid; 
        for (size_t i = 0; i < in_values.size(); i++) {
          graph_shard_id_t key = get_shard(in_values[i]);
-         shard2valueid[key].push_back(i);
+         requests.shard2valueid[key].push_back(i);
        }
 
-       std::vector< std::pair<graph_shard_id_t, query_result> > replies;
-
        // for each shard send out the query
-       for (map_iter_type it = shard2valueid.begin(); it != shard2valueid.end(); ++it) {
+       for (map_iter_type it = requests.shard2valueid.begin();
+            it != requests.shard2valueid.end(); ++it) {
          graph_shard_id_t shardid = it->first;
          std::vector<size_t>& ids = it->second;
 
@@ -112,17 +558,25 @@ namespace graphlab {
          }
          qm << valuevec;
          query_result future = 
-             (out_values == NULL) ? queryobj.update(shardid, qm.message(), qm.length())
-                                  : queryobj.query(shardid, qm.message(), qm.length());
-         replies.push_back(std::pair<graph_shard_id_t, query_result> (shardid, future));
+             query ? queryobj.query(shardid, qm.message(), qm.length())
+                   : queryobj.update(shardid, qm.message(), qm.length());
+         requests.replies.push_back(std::pair<graph_shard_id_t, query_result> (shardid, future));
        }
+     }
 
-
-       errorcodes.resize(in_values.size(), 0);
+     // Waits for the replies of scatter_send() to nvalues values, and puts
+     // the results and errorcodes back in the order of the values.
+     template<typename Tout>
+     bool scatter_gather(const QueryMessage::header& query_header,
+                         scatter_requests& requests, size_t nvalues,
+                         std::vector<Tout>* out_values, std::vector<int>& errorcodes) {
+       bool success = true;
+       errorcodes.resize(nvalues, 0);
        if (out_values != NULL)
-         out_values->resize(in_values.size());
+         out_values->resize(nvalues);
 
        // parse the reply 
+       std::vector< std::pair<graph_shard_id_t, query_result> >& replies = requests.replies;
        for (size_t i = 0; i < replies.size(); i++) {
          std::vector<int> errorcodes_i;
          std::vector<Tout> results_i;
@@ -131,10 +585,11 @@ namespace graphlab {
          if (out_values == NULL) {
             success_i = queryobj.parse_batch_reply<char>(replies[i].second, NULL, errorcodes_i);
          } else {
-            success_i = queryobj.parse_batch_reply<Tout>(replies[i].second, &results_i, errorcodes_i);
+            success_i = parse_batch_reply(replies[i].second, &results_i, errorcodes_i,
+                                          query_header, requests.codec.get());
          }
 
-         std::vector<size_t>& ids = shard2valueid[shardid];
+         std::vector<size_t>& ids = requests.shard2valueid[shardid];
          // If query succeeds, generates a vector of 0 error codes
          if (success_i) { 
            errorcodes_i.resize(ids.size());
@@ -161,6 +616,21 @@ namespace graphlab {
        return success;
     }
      
+     // Sends in_values to their shards and waits for the replies. The rows
+     // read are decoded with rc, which gave the schema version of the header.
+     template<typename Tin, typename Tout>
+     bool scatter_messages (QueryMessage::header query_header, 
+                            const std::vector<Tin>& in_values,
+                            boost::function<graph_shard_id_t (const Tin&)> get_shard,
+                            std::vector<Tout>* out_values, std::vector<int>& errorcodes,
+                            boost::shared_ptr<graph_row_codec> rc =
+                              boost::shared_ptr<graph_row_codec>()) {
+       scatter_requests requests;
+       requests.codec = rc;
+       scatter_send(query_header, in_values, get_shard, out_values != NULL, requests);
+       return scatter_gather(query_header, requests, in_values.size(), out_values, errorcodes);
+     }
+
      // Compute shard id from different types 
      graph_shard_id_t eid2shard(const graph_eid_t& eid);
      graph_shard_id_t vid2shard(const graph_vid_t& vid);
@@ -181,6 +651,37 @@ namespace graphlab {
    private:
      graphdb_query_object queryobj;
      graph_shard_manager shard_manager;
+
+     // replaced, never modified, when the schema changes
+     boost::shared_ptr<graph_row_codec> codec;
+     // set when a server did not use the compact encoding of codec
+     bool stale_schema;
+     // guards codec and stale_schema
+     mutex codec_lock;
+
+     size_t coalesce_max_batch;
+     size_t coalesce_max_delay_us;
+     // batches sent so far
+     size_t coalesced_batches;
+     // protects open_batches, the batches and the settings above
+     mutex coalesce_lock;
+     // batches still accepting calls, by shard and by get (false) or set (true)
+     std::map<std::pair<graph_shard_id_t, bool>, coalesced_batch_ptr> open_batches;
+     // serialize the requests of the coalesced batches of each key of
+     // open_batches. Created under coalesce_lock, never removed.
+     std::map<std::pair<graph_shard_id_t, bool>, mutex> send_locks;
+
+     size_t max_cached_mirrors;
+     // the mirrors of recently queried vertices, guarded by mirror_lock
+     mutex mirror_lock;
+     boost::unordered_map<graph_vid_t, std::vector<graph_shard_id_t> > mirror_cache;
+
+     // guards known_mirrors, shared by the threads adding edges
+     mutex known_mirrors_lock;
+     graphdb_mirror_set known_mirrors;
+
+     // picks the ids of traversals, which must not collide across clients
+     boost::random::mt19937 traversal_rng;
   };
 }
 #endif
@@ -0,0 +1,114 @@
+#ifndef GRAPHLAB_DATABASE_GRAPHDB_FUTURE_HPP
+#define GRAPHLAB_DATABASE_GRAPHDB_FUTURE_HPP
+#include <vector>
+#include <graphlab/database/graphdb_query_object.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * The result of an asynchronous graphdb_client operation.
+ *
+ * Holds the replies of the requests sent for the operation and parses them
+ * on the first call to wait() or get(), which block until the replies have
+ * arrived. Copies share the same result, so the replies are parsed once.
+ * The future must not outlive the client which created it.
+ */
+template<typename T>
+class graphdb_future {
+ public:
+  typedef graphdb_query_object::query_result query_result;
+  typedef boost::function<int (std::vector<query_result>&, T&)> parser_type;
+
+  /// Creates a future with no request, which fails with EINVHEAD.
+  graphdb_future() { }
+
+  /// Creates a future parsing replies with parser.
+  graphdb_future(const std::vector<query_result>& replies, const parser_type& parser)
+      : state(new state_type(replies, parser)) { }
+
+  /// Blocks until the operation completed, returns its error code.
+  int wait() {
+    if (!state) {
+      return EINVHEAD;
+    }
+    if (!state->done) {
+      state->errorcode = state->parser(state->replies, state->value);
+      state->done = true;
+      // the parsed value is all that is needed from now on
+      std::vector<query_result>().swap(state->replies);
+    }
+    return state->errorcode;
+  }
+
+  /// Same as wait(), and copies the result of the operation into out.
+  int get(T& out) {
+    int errorcode = wait();
+    if (state) {
+      out = state->value;
+    }
+    return errorcode;
+  }
+
+ private:
+  struct state_type {
+    state_type(const std::vector<query_result>& replies, const parser_type& parser)
+        : replies(replies), parser(parser), done(false), errorcode(0) { }
+    std::vector<query_result> replies;
+    parser_type parser;
+    bool done;
+    int errorcode;
+    T value;
+  };
+  boost::shared_ptr<state_type> state;
+};
+
+/**
+ * \ingroup group_graph_database
+ * The result of an asynchronous operation with no content, such as a write.
+ */
+template<>
+class graphdb_future<void> {
+ public:
+  typedef graphdb_query_object::query_result query_result;
+  typedef boost::function<int (std::vector<query_result>&)> parser_type;
+
+  /// Creates a future with no request, which fails with EINVHEAD.
+  graphdb_future() { }
+
+  /// Creates a future parsing replies with parser.
+  graphdb_future(const std::vector<query_result>& replies, const parser_type& parser)
+      : state(new state_type(replies, parser)) { }
+
+  /// Blocks until the operation completed, returns its error code.
+  int wait() {
+    if (!state) {
+      return EINVHEAD;
+    }
+    if (!state->done) {
+      state->errorcode = state->parser(state->replies);
+      state->done = true;
+      std::vector<query_result>().swap(state->replies);
+    }
+    return state->errorcode;
+  }
+
+  /// Same as wait().
+  int get() {
+    return wait();
+  }
+
+ private:
+  struct state_type {
+    state_type(const std::vector<query_result>& replies, const parser_type& parser)
+        : replies(replies), parser(parser), done(false), errorcode(0) { }
+    std::vector<query_result> replies;
+    parser_type parser;
+    bool done;
+    int errorcode;
+  };
+  boost::shared_ptr<state_type> state;
+};
+} // namespace graphlab
+#endif
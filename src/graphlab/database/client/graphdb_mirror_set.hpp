@@ -0,0 +1,131 @@
+#ifndef GRAPHLAB_DATABASE_GRAPHDB_MIRROR_SET_HPP
+#define GRAPHLAB_DATABASE_GRAPHDB_MIRROR_SET_HPP
+#include <graphlab/database/basic_types.hpp>
+#include <vector>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * The (vertex, shard) mirror pairs a client knows are registered, in a
+ * fixed amount of memory.
+ *
+ * Blocked like a bloom filter: a pair hashes to one block of a cache
+ * line, and is looked up only there. Unlike a bloom filter the set has
+ * no false positives, since a pair wrongly believed registered would
+ * never be sent. It forgets instead: a pair inserted into a full block
+ * evicts another one, which is sent again the next time it is seen.
+ * Registering a mirror twice is harmless. Not thread safe.
+ */
+class graphdb_mirror_set {
+ public:
+  /// Creates a set holding at most about max_bytes of pairs, none by default.
+  explicit graphdb_mirror_set(size_t max_bytes = 0) { resize(max_bytes); }
+
+  /**
+   * Drops all the pairs, and holds at most about max_bytes of them from
+   * now on. Below the size of a block the set holds nothing, and frees
+   * its memory.
+   */
+  void resize(size_t max_bytes) {
+    size_t nblocks = 1;
+    while (2 * nblocks * sizeof(block) <= max_bytes) {
+      nblocks *= 2;
+    }
+    std::vector<block>(max_bytes < sizeof(block) ? 0 : nblocks).swap(blocks);
+  }
+
+  /// Returns the memory held by the set.
+  inline size_t bytes() const { return blocks.size() * sizeof(block); }
+
+  /// Drops all the pairs.
+  void clear() {
+    blocks.assign(blocks.size(), block());
+  }
+
+  /// Returns true if the pair is in the set; always false when it holds nothing.
+  bool contains(graph_vid_t vid, graph_shard_id_t shard) const {
+    if (blocks.empty()) {
+      return false;
+    }
+    const block& b = blocks[hash(vid, shard) & (blocks.size() - 1)];
+    uint32_t key = (uint32_t)shard + 1;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+      if (b.entries[i].shard == key && b.entries[i].vid == vid) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Adds the pair, which is registered. Returns true if it was not in the
+   * set; always true when the set holds nothing.
+   */
+  bool insert(graph_vid_t vid, graph_shard_id_t shard) {
+    if (blocks.empty()) {
+      return true;
+    }
+    uint64_t h = hash(vid, shard);
+    block& b = blocks[h & (blocks.size() - 1)];
+    uint32_t key = (uint32_t)shard + 1;
+    size_t empty = BLOCK_SIZE;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+      if (b.entries[i].shard == key) {
+        if (b.entries[i].vid == vid) {
+          return false;
+        }
+      } else if (b.entries[i].shard == 0 && empty == BLOCK_SIZE) {
+        empty = i;
+      }
+    }
+    // a full block evicts an entry picked by the high bits of the hash
+    entry& e = b.entries[empty < BLOCK_SIZE ? empty : (h >> 62) % BLOCK_SIZE];
+    e.vid = vid;
+    e.shard = key;
+    return true;
+  }
+
+  /// Forgets the pair.
+  void erase(graph_vid_t vid, graph_shard_id_t shard) {
+    if (blocks.empty()) {
+      return;
+    }
+    block& b = blocks[hash(vid, shard) & (blocks.size() - 1)];
+    uint32_t key = (uint32_t)shard + 1;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+      if (b.entries[i].shard == key && b.entries[i].vid == vid) {
+        b.entries[i].shard = 0;
+      }
+    }
+  }
+
+ private:
+  static const size_t BLOCK_SIZE = 4;
+
+  struct entry {
+    graph_vid_t vid;
+    // shard + 1, 0 for an empty entry
+    uint32_t shard;
+    entry() : vid(0), shard(0) { }
+  };
+
+  // BLOCK_SIZE entries of 16 bytes, one cache line
+  struct block {
+    entry entries[BLOCK_SIZE];
+  };
+
+  // The finalizer of MurmurHash3 over the pair.
+  static inline uint64_t hash(graph_vid_t vid, graph_shard_id_t shard) {
+    uint64_t x = vid ^ ((uint64_t)shard << 48) ^ ((uint64_t)shard * 0x9e3779b97f4a7c13ULL);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+  }
+
+  std::vector<block> blocks;
+};
+} // namespace graphlab
+#endif
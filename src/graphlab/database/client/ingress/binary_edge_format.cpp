@@ -0,0 +1,124 @@
+#include <graphlab/database/client/ingress/binary_edge_format.hpp>
+#include <cstring>
+#include <limits>
+
+namespace graphlab {
+  // the trailing '\0' is part of the magic
+  static const char BINARY_EDGE_MAGIC[8] = "GLEDGES";
+
+  // Integers are copied as they are in memory, on little endian hosts.
+  template<typename T>
+  static inline void append(std::string& out, T x) {
+    out.append((const char*)&x, sizeof(x));
+  }
+
+  template<typename T>
+  static inline T decode(const char* p) {
+    T x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+  }
+
+  void binary_edge_header::write(std::string& out) const {
+    out.append(BINARY_EDGE_MAGIC, sizeof(BINARY_EDGE_MAGIC));
+    append<uint32_t>(out, VERSION);
+    append<uint32_t>(out, flags);
+    append<uint32_t>(out, num_shards);
+    append<uint32_t>(out, shard);
+    append<uint64_t>(out, num_edges);
+    append<uint32_t>(out, columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+      append<uint32_t>(out, columns[i]);
+    }
+  }
+
+  size_t binary_edge_header::read(const char* begin, const char* end) {
+    if (end - begin < 36 || memcmp(begin, BINARY_EDGE_MAGIC, sizeof(BINARY_EDGE_MAGIC)) != 0 ||
+        decode<uint32_t>(begin + 8) != VERSION) {
+      return 0;
+    }
+    flags = decode<uint32_t>(begin + 12);
+    num_shards = decode<uint32_t>(begin + 16);
+    shard = decode<uint32_t>(begin + 20);
+    num_edges = decode<uint64_t>(begin + 24);
+    size_t num_columns = decode<uint32_t>(begin + 32);
+    if ((size_t)(end - begin - 36) / 4 < num_columns) {
+      return 0;
+    }
+    columns.resize(num_columns);
+    for (size_t i = 0; i < num_columns; ++i) {
+      uint32_t type = decode<uint32_t>(begin + 36 + 4 * i);
+      if (type != INT_TYPE && type != DOUBLE_TYPE && type != VID_TYPE) {
+        return 0;
+      }
+      columns[i] = (graph_datatypes_enum)type;
+    }
+    return header_bytes();
+  }
+
+  bool binary_edge_writer::open(const std::string& filename,
+                                const binary_edge_header& _header) {
+    close();
+    header = _header;
+    header.num_edges = 0;
+    fp = fopen(filename.c_str(), "wb");
+    if (fp == NULL) {
+      return false;
+    }
+    record.clear();
+    header.write(record);
+    return fwrite(record.data(), 1, record.size(), fp) == record.size();
+  }
+
+  bool binary_edge_writer::add_edge(graph_vid_t source, graph_vid_t target,
+                                    const graph_row* data) {
+    if (fp == NULL) {
+      return false;
+    }
+    record.clear();
+    if (header.vid_bytes() == 4) {
+      // the file would hold other vertices
+      if (source > std::numeric_limits<uint32_t>::max() ||
+          target > std::numeric_limits<uint32_t>::max()) {
+        return false;
+      }
+      append<uint32_t>(record, source);
+      append<uint32_t>(record, target);
+    } else {
+      append<uint64_t>(record, source);
+      append<uint64_t>(record, target);
+    }
+    if (!header.columns.empty() &&
+        (data == NULL || data->num_fields() != header.columns.size())) {
+      return false;
+    }
+    for (size_t i = 0; i < header.columns.size(); ++i) {
+      const graph_value* value = data->get_field(i);
+      if (value->type() != header.columns[i]) {
+        return false;
+      }
+      // NULL values are written as 0
+      char bytes[8] = {0};
+      if (!value->is_null()) {
+        memcpy(bytes, value->get_raw_pointer(), sizeof(bytes));
+      }
+      record.append(bytes, sizeof(bytes));
+    }
+    if (fwrite(record.data(), 1, record.size(), fp) != record.size()) {
+      return false;
+    }
+    ++header.num_edges;
+    return true;
+  }
+
+  bool binary_edge_writer::close() {
+    if (fp == NULL) {
+      return true;
+    }
+    bool success = (fseek(fp, 24, SEEK_SET) == 0) &&
+        fwrite(&header.num_edges, sizeof(header.num_edges), 1, fp) == 1;
+    success &= (fclose(fp) == 0);
+    fp = NULL;
+    return success;
+  }
+} // namespace graphlab
@@ -0,0 +1,101 @@
+#ifndef GRAPHLAB_DATABASE_BINARY_EDGE_FORMAT_HPP
+#define GRAPHLAB_DATABASE_BINARY_EDGE_FORMAT_HPP
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/database/graph_row.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace graphlab {
+  /**
+   * The header of a file in the binary edge list format, loaded as
+   * format "bin". All integers are little endian.
+   *
+   * \verbatim
+   *  offset  size  field
+   *       0     8  magic "GLEDGES\0"
+   *       8     4  version, 1
+   *      12     4  flags, VID32 if the vids take 4 bytes instead of 8
+   *      16     4  num_shards, of the placement the shard tag refers to
+   *      20     4  shard, the shard of all the edges, or UNTAGGED
+   *      24     8  num_edges
+   *      32     4  num_columns
+   *      36   4*n  the type of each column, a graph_datatypes_enum
+   * \endverbatim
+   *
+   * The records follow: the source and target vids, then the value of
+   * each column in 8 bytes, an int64 (INT_TYPE), a double (DOUBLE_TYPE)
+   * or a uint64 (VID_TYPE). The columns are the edge fields of the
+   * schema, in order, or none for edges without data.
+   *
+   * A file is tagged with a shard when all its edges belong there, as
+   * graph_shard_manager::get_master(source, target) with num_shards
+   * shards places them. Its edges go to that shard without being
+   * partitioned again. As a tag the placement does not agree with would
+   * put the edges where lookups do not find them, a sample of the edges
+   * is checked, and the edges are partitioned if it disagrees.
+   */
+  struct binary_edge_header {
+    static const uint32_t VERSION = 1;
+    static const uint32_t VID32 = 1;
+    static const uint32_t UNTAGGED = 0xffffffff;
+
+    uint32_t flags;
+    uint32_t num_shards;
+    uint32_t shard;
+    uint64_t num_edges;
+    std::vector<graph_datatypes_enum> columns;
+
+    binary_edge_header() : flags(0), num_shards(0), shard(UNTAGGED), num_edges(0) { }
+
+    inline bool is_tagged() const { return shard != UNTAGGED; }
+
+    inline size_t vid_bytes() const { return (flags & VID32) ? 4 : 8; }
+
+    /// Bytes of a record.
+    inline size_t record_bytes() const { return 2 * vid_bytes() + 8 * columns.size(); }
+
+    /// Bytes of the header, where the records start.
+    inline size_t header_bytes() const { return 36 + 4 * columns.size(); }
+
+    /// Appends the encoded header to out.
+    void write(std::string& out) const;
+
+    /**
+     * Decodes the header at the start of [begin, end). Returns its size,
+     * or 0 if it is truncated, not a header, or has a column of a type
+     * without a fixed width.
+     */
+    size_t read(const char* begin, const char* end);
+  };
+
+  /**
+   * Writes edges to a file in the binary edge list format, and sets the
+   * number of edges of its header when closed.
+   */
+  class binary_edge_writer {
+   public:
+    binary_edge_writer() : fp(NULL) { }
+    ~binary_edge_writer() { close(); }
+
+    /// Creates filename and writes header. Returns false on failure.
+    bool open(const std::string& filename, const binary_edge_header& header);
+
+    /**
+     * Writes an edge. data holds the values of the columns, and may be
+     * NULL if there is none. Returns false if the edge cannot be written,
+     * a vid does not fit in the vids of the file, or data does not match
+     * the columns.
+     */
+    bool add_edge(graph_vid_t source, graph_vid_t target, const graph_row* data = NULL);
+
+    /// Writes the number of edges, and closes the file. Returns false on failure.
+    bool close();
+
+   private:
+    FILE* fp;
+    binary_edge_header header;
+    std::string record;
+  };
+} // namespace graphlab
+#endif
@@ -25,6 +25,8 @@
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <cstring>
 
 #if defined(__cplusplus) && __cplusplus >= 201103L
 // do not include spirit
@@ -92,6 +94,124 @@ namespace graphlab {
 
 
 
+    /**
+     * Parses the decimal integer at the start of [p, end), after any blanks
+     * or commas, into out. Returns the position after its last digit, or
+     * NULL if there is no digit there or the integer does not fit in 64
+     * bits, leading zeros included. Runs of eight digits are converted a
+     * word at a time.
+     */
+    inline const char* parse_uint(const char* p, const char* end, uint64_t& out) {
+      while (p != end && (*p == ' ' || *p == '\t' || *p == ',')) ++p;
+      if (p == end || (unsigned char)(*p - '0') > 9) return NULL;
+      const char* begin = p;
+      uint64_t value = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      while (end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        // each byte is in '0'..'9' iff its high nibble is 3, and still is plus 6
+        if (((word & 0xF0F0F0F0F0F0F0F0ULL) |
+             (((word + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+            != 0x3333333333333333ULL) break;
+        // combine the digits into pairs, then fours, then eight
+        word -= 0x3030303030303030ULL;
+        word = (word * 10) + (word >> 8);
+        word = (((word & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                (((word >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+        value = value * 100000000 + word;
+        p += 8;
+      }
+#endif
+      while (p != end && (unsigned char)(*p - '0') <= 9) {
+        value = value * 10 + (*p - '0');
+        ++p;
+      }
+      // 19 digits always fit, 20 digits fit up to 2^64 - 1
+      if (p - begin > 19 &&
+          (p - begin > 20 || memcmp(begin, "18446744073709551615", 20) > 0)) {
+        return NULL;
+      }
+      out = value;
+      return p;
+    }
+
+    /// Returns true if [p, end) holds only blanks, commas or a '\r'.
+    inline bool only_separators(const char* p, const char* end) {
+      while (p != end && (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r')) ++p;
+      return p == end;
+    }
+
+    /**
+     * Splits [begin, end) into ranges of about chunk_bytes each ending
+     * after a newline (or at end), appended to out.
+     */
+    inline void split_lines(const char* begin, const char* end, size_t chunk_bytes,
+                            std::vector<std::pair<const char*, const char*> >& out) {
+      while (begin != end) {
+        const char* stop = end;
+        if ((size_t)(end - begin) > chunk_bytes) {
+          const char* nl = (const char*)memchr(begin + chunk_bytes, '\n',
+                                               end - begin - chunk_bytes);
+          if (nl != NULL) stop = nl + 1;
+        }
+        out.push_back(std::make_pair(begin, stop));
+        begin = stop;
+      }
+    }
+
+    /**
+     * Same as snap_parser() on the line [begin, end) without its line
+     * terminator, parsed in place.
+     */
+    template <typename Graph>
+    bool snap_range_parser(Graph& graph, const char* begin, const char* end) {
+      if (begin == end) return true;
+      else if (*begin == '#') {
+        std::cout.write(begin, end - begin) << std::endl;
+      } else {
+        uint64_t source, target;
+        begin = parse_uint(begin, end, source);
+        if (begin == NULL) return false;
+        begin = parse_uint(begin, end, target);
+        if (begin == NULL) return false;
+        if(source != target) graph.add_edge(source, target);
+      }
+      return true;
+    }
+
+    /// Same as tsv_parser() on the line [begin, end), parsed in place.
+    template <typename Graph>
+    bool tsv_range_parser(Graph& graph, const char* begin, const char* end) {
+      if (begin == end) return true;
+      uint64_t source, target;
+      begin = parse_uint(begin, end, source);
+      if (begin == NULL) return false;
+      begin = parse_uint(begin, end, target);
+      if (begin == NULL) return false;
+      if(source != target) graph.add_edge(source, target);
+      return true;
+    }
+
+    /// Same as adj_parser() on the line [begin, end), parsed in place.
+    template <typename Graph>
+    bool adj_range_parser(Graph& graph, const char* begin, const char* end) {
+      if (begin == end) return true;
+      uint64_t source, n, target;
+      begin = parse_uint(begin, end, source);
+      if (begin == NULL) return false;
+      const char* p = parse_uint(begin, end, n);
+      if (p == NULL) return only_separators(begin, end);
+      size_t nadded = 0;
+      while ((begin = parse_uint(p, end, target)) != NULL) {
+        if (source != target) graph.add_edge(source, target);
+        ++nadded;
+        p = begin;
+      }
+      // a target that is not a vid fails the line
+      return n == nadded && only_separators(p, end);
+    }
+
 #if defined(__cplusplus) && __cplusplus >= 201103L
     // The spirit parser seems to have issues when compiling under
     // C++11. Temporary workaround with a hard coded parser. TOFIX
@@ -0,0 +1,113 @@
+#include <graphlab/database/client/ingress/delimited_format.hpp>
+#include <graphlab/database/client/ingress/builtin_parsers.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <cstdlib>
+#include <limits>
+
+namespace graphlab {
+  delimited_format::delimited_format(bool is_vertex, const std::vector<graph_field>& fields,
+                                     char delimiter) :
+      _is_vertex(is_vertex), fields(fields), delimiter(delimiter),
+      num_ids(is_vertex ? 1 : 2), _row(fields, is_vertex) { }
+
+  bool delimited_format::set_columns(const std::vector<std::string>& names) {
+    columns.clear();
+    size_t found[2] = {0, 0};
+    for (size_t i = 0; i < names.size(); ++i) {
+      const std::string& name = names[i];
+      if (name.empty()) {
+        columns.push_back(column(SKIP, 0));
+      } else if ((_is_vertex && name == "id") || (!_is_vertex && name == "source")) {
+        columns.push_back(column(ID, 0));
+        ++found[0];
+      } else if (!_is_vertex && name == "target") {
+        columns.push_back(column(ID, 1));
+        ++found[1];
+      } else {
+        size_t pos = 0;
+        while (pos < fields.size() && fields[pos].name != name) ++pos;
+        if (pos == fields.size()) {
+          logstream(LOG_ERROR) << "Column " << name << " is not a field of the "
+                               << (_is_vertex ? "vertices" : "edges") << std::endl;
+          return false;
+        }
+        if (fields[pos].type == DOUBLE_VEC_TYPE) {
+          logstream(LOG_ERROR) << "Field " << name
+                               << " cannot be parsed from delimited text" << std::endl;
+          return false;
+        }
+        columns.push_back(column(FIELD, pos));
+      }
+    }
+    if (found[0] != 1 || (!_is_vertex && found[1] != 1)) {
+      logstream(LOG_ERROR) << "The columns need one "
+                           << (_is_vertex ? "id" : "source and one target") << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool delimited_format::set_columns(const std::string& header) {
+    std::vector<std::string> names;
+    size_t begin = 0;
+    while (true) {
+      size_t stop = header.find(delimiter, begin);
+      names.push_back(header.substr(begin, stop - begin));
+      if (stop == std::string::npos) break;
+      begin = stop + 1;
+    }
+    return set_columns(names);
+  }
+
+  // Returns true if [p, end) holds only blanks.
+  static inline bool blank(const char* p, const char* end) {
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p == end;
+  }
+
+  bool delimited_format::parse_vid(const char* begin, const char* end, graph_vid_t& out) {
+    uint64_t value;
+    const char* p = builtin_parsers::parse_uint(begin, end, value);
+    if (p == NULL || !blank(p, end)) return false;
+    out = value;
+    return true;
+  }
+
+  bool delimited_format::parse_value(const char* begin, const char* end, graph_value& value) {
+    switch (value.type()) {
+     case INT_TYPE: {
+       while (begin != end && *begin == ' ') ++begin;
+       bool negative = (begin != end && *begin == '-');
+       if (negative || (begin != end && *begin == '+')) ++begin;
+       uint64_t x;
+       const char* p = builtin_parsers::parse_uint(begin, end, x);
+       if (p == NULL || !blank(p, end)) return false;
+       // up to 2^63 - 1, or 2^63 negated
+       if (x > (uint64_t)std::numeric_limits<graph_int_t>::max() + negative) return false;
+       if (negative && x > 0) return value.set_integer(-(graph_int_t)(x - 1) - 1);
+       return value.set_integer((graph_int_t)x);
+     }
+     case VID_TYPE: {
+       graph_vid_t x;
+       return parse_vid(begin, end, x) && value.set_vid(x);
+     }
+     case DOUBLE_TYPE: {
+       // strtod needs a terminated string, the field is not
+       char buf[64];
+       size_t len = end - begin;
+       if (len >= sizeof(buf)) return false;
+       memcpy(buf, begin, len);
+       buf[len] = '\0';
+       char* stop;
+       graph_double_t x = strtod(buf, &stop);
+       if (stop == buf || !blank(stop, buf + len)) return false;
+       return value.set_double(x);
+     }
+     case STRING_TYPE:
+     case BLOB_TYPE:
+       return value.set_val(begin, end - begin);
+     default:
+       return false;
+    }
+  }
+} // namespace graphlab
@@ -0,0 +1,111 @@
+#ifndef GRAPHLAB_DATABASE_DELIMITED_FORMAT_HPP
+#define GRAPHLAB_DATABASE_DELIMITED_FORMAT_HPP
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/database/graph_field.hpp>
+#include <graphlab/database/graph_row.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace graphlab {
+  /**
+   * Lines of delimited text holding vertices or edges with their data,
+   * such as
+   *
+   * \verbatim
+   *  # id  name   age
+   *  1     alice  30
+   *  2     bob
+   * \endverbatim
+   *
+   * Each column is mapped to the vertex id, the source or target of an
+   * edge, a field of the schema, or skipped. The values are parsed into
+   * the row of the vertex or edge in place: INT and VID fields as
+   * decimal integers, DOUBLE fields with strtod, STRING and BLOB fields
+   * as the bytes between the delimiters. An integer out of the range of
+   * its field fails the line. An empty or missing value leaves the field
+   * NULL, and values past the last column are ignored. Lines starting
+   * with '#' are comments, and a trailing '\r' is ignored.
+   */
+  class delimited_format {
+   public:
+    /// Lines of vertices if is_vertex, of edges otherwise, with the given schema.
+    delimited_format(bool is_vertex, const std::vector<graph_field>& fields,
+                     char delimiter = '\t');
+
+    /**
+     * Maps the columns, in order, to "id" for a vertex, "source" and
+     * "target" for an edge, the name of a field, or "" to skip the
+     * column. Returns false, and logs why, if a name is not a field, the
+     * ids are missing, or a field has no text encoding.
+     */
+    bool set_columns(const std::vector<std::string>& names);
+
+    /// Same as set_columns() on the names of header, split at the delimiter.
+    bool set_columns(const std::string& header);
+
+    inline bool is_vertex() const { return _is_vertex; }
+
+    /**
+     * Parses the line [begin, end) into a vertex or an edge added to
+     * graph, with graph.add_vertex(vid, row) or graph.add_edge(source,
+     * target, row), which may take the row by swapping. Returns false if
+     * the line is invalid. Self edges are dropped.
+     */
+    template <typename Graph>
+    bool parse(Graph& graph, const char* begin, const char* end) const {
+      if (begin != end && end[-1] == '\r') --end;
+      if (begin == end || *begin == '#') return true;
+      graph_row row(_row);
+      graph_vid_t ids[2] = {0, 0};
+      size_t nids = 0;
+      const char* p = begin;
+      for (size_t i = 0; i < columns.size(); ++i) {
+        const char* stop = (const char*)memchr(p, delimiter, end - p);
+        if (stop == NULL) stop = end;
+        const column& col = columns[i];
+        if (col.kind == ID) {
+          if (!parse_vid(p, stop, ids[col.pos])) return false;
+          ++nids;
+        } else if (col.kind == FIELD && p != stop) {
+          if (!parse_value(p, stop, *row.get_field(col.pos))) return false;
+        }
+        if (stop == end) break;
+        p = stop + 1;
+      }
+      if (nids != num_ids) return false;
+      if (_is_vertex) {
+        graph.add_vertex(ids[0], row);
+      } else if (ids[0] != ids[1]) {
+        graph.add_edge(ids[0], ids[1], row);
+      }
+      return true;
+    }
+
+   private:
+    enum column_kind {SKIP, ID, FIELD};
+
+    struct column {
+      column_kind kind;
+      // 0 for the vertex id and the source, 1 for the target, or the field
+      size_t pos;
+      column(column_kind kind, size_t pos) : kind(kind), pos(pos) { }
+    };
+
+    // Parses a decimal vid padded with blanks.
+    static bool parse_vid(const char* begin, const char* end, graph_vid_t& out);
+
+    // Parses the text of a value of the type of value into it.
+    static bool parse_value(const char* begin, const char* end, graph_value& value);
+
+    bool _is_vertex;
+    std::vector<graph_field> fields;
+    char delimiter;
+    std::vector<column> columns;
+    // ids to find on each line, 1 for a vertex and 2 for an edge
+    size_t num_ids;
+    // the row of the schema, with all fields NULL
+    graph_row _row;
+  };
+} // namespace graphlab
+#endif
@@ -1,7 +1,9 @@
 #include <graphlab/database/client/ingress/graph_loader.hpp>
+#include <graphlab/database/client/graphdb_client.hpp>
 #include <graphlab/util/fs_util.hpp>
 
 #include <boost/functional.hpp>
+#include <boost/bind.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/iostreams/filtering_streambuf.hpp>
@@ -19,8 +21,8 @@
 
 namespace graphlab {
   graph_loader::graph_loader(graphdb_client* client,
-                             size_t max_buffer) : client(client),
-    max_buffer(max_buffer), pool(4) { }
+                             const ingress_options& options) : client(client),
+    options(options) { }
 
   /**
    *  \brief Load a graph from a collection of files in stored on
@@ -29,6 +31,29 @@ namespace graphlab {
    *  but only loads from the filesystem. 
    */
   void graph_loader::load_from_posixfs(std::string prefix, const std::string& format) {
+    ingress_pipeline pipeline(client->get_shard_manager(),
+                              boost::bind(&graphdb_client::add_edges_to_shard, client, _1, _2, _3),
+                              format, options);
+    if (format == "bin") {
+      std::vector<graph_field> fields = client->get_edge_fields();
+      std::vector<graph_datatypes_enum> types;
+      for (size_t i = 0; i < fields.size(); ++i) {
+        types.push_back(fields[i].type);
+      }
+      pipeline.set_edge_columns(types);
+    }
+    load_files(prefix, pipeline);
+  }
+
+  void graph_loader::load_delimited(std::string prefix, const delimited_format& format) {
+    ingress_pipeline pipeline(client->get_shard_manager(),
+                              boost::bind(&graphdb_client::add_edges_to_shard, client, _1, _2, _3),
+                              boost::bind(&graphdb_client::add_vertices_to_shard, client, _1, _2, _3),
+                              format, options);
+    load_files(prefix, pipeline);
+  }
+
+  void graph_loader::load_files(std::string prefix, ingress_pipeline& pipeline) {
     std::string directory_name; std::string original_path(prefix);
     boost::filesystem::path path(prefix);
     std::string search_prefix;
@@ -45,17 +70,25 @@ namespace graphlab {
       directory_name = (directory_name.empty() ? "." : directory_name);
     }
 
+    // the mirrors registered by earlier loads may have been dropped by a
+    // RESET or LOAD of the shards since, so only this load's are remembered
+    client->set_known_mirrors_bytes(options.known_mirrors_bytes);
+
     std::vector<std::string> graph_files;
     fs_util::list_files_with_prefix(directory_name, search_prefix, graph_files);
     if (graph_files.size() == 0) {
       logstream(LOG_WARNING) << "No files found matching " << original_path << std::endl;
     }
 
-    timer ti; ti.start();
     for(size_t i = 0; i < graph_files.size(); ++i) {
       logstream(LOG_EMPH) << "Loading graph from file: " << graph_files[i] << std::endl;
       // is it a gzip file ?
       const bool gzip = boost::ends_with(graph_files[i], ".gz");
+      // uncompressed files are parsed in place
+      if (!gzip && boost::filesystem::file_size(graph_files[i]) > 0 &&
+          pipeline.read_mapped(graph_files[i])) {
+        continue;
+      }
       // open the stream
       std::ifstream in_file(graph_files[i].c_str(), 
                             std::ios_base::in | std::ios_base::binary);
@@ -64,15 +97,19 @@ namespace graphlab {
       // Using gzip filter
       if (gzip) fin.push(boost::iostreams::gzip_decompressor());
       fin.push(in_file);
-      const bool success = load_from_stream(graph_files[i], fin, format);
-      if(!success) {
+      pipeline.read_stream(graph_files[i], fin);
+      if(fin.bad()) {
         logstream(LOG_FATAL) 
             << "\n\tError parsing file: " << graph_files[i] << std::endl;
       }
       fin.pop();
       if (gzip) fin.pop();
     }
-    logstream(LOG_EMPH) << "Finish loading. Total time: " << ti.current_time()
-                        << " secs." << std::endl;
-  } // end of load from posixfs
+    last_stats = pipeline.finish();
+    client->set_known_mirrors_bytes(0);
+    std::ostringstream report;
+    last_stats.print(report);
+    logstream(LOG_EMPH) << "Finish loading. Total time: " << last_stats.total_secs
+                        << " secs.\n" << report.str() << std::endl;
+  } // end of load files
 } // end of namespace
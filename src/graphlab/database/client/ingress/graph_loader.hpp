@@ -1,72 +1,42 @@
 #ifndef GRAPHLAB_DATABASE_GRAPH_LOADER_HPP
 #define GRAPHLAB_DATABASE_GRAPH_LOADER_HPP
-#include <graphlab/database/client/ingress/ingress_worker.hpp>
+#include <graphlab/database/client/ingress/ingress_pipeline.hpp>
 #include <graphlab/database/graph_database.hpp>
-#include <graphlab/parallel/thread_pool.hpp>
 
-#include <boost/bind.hpp>
 #include <string>
 
 namespace graphlab {
   class graphdb_client;
   class graph_loader {
    public:
-     graph_loader(graphdb_client* client, size_t max_buffer = 500000);
+     graph_loader(graphdb_client* client,
+                  const ingress_options& options = ingress_options());
 
+     /**
+      * Loads the edges of the files matching prefix through an \ref
+      * ingress_pipeline. Uncompressed files are mapped and parsed in place,
+      * gzip files are read as a stream. format is "snap", "tsv", "adj", or
+      * "bin" for the binary edge format of \ref binary_edge_header.
+      */
      void load_from_posixfs(std::string prefix, const std::string& format);
 
-   private:
      /**
-       \internal
-       This internal function is used to load a single line from an input stream
-       */
-     template<typename Fstream>
-         bool load_from_stream(const std::string& filename, Fstream& fin, 
-                               const std::string& format) {
-           size_t linecount = 0;
-           std::vector< std::vector<std::string> > line_buffers;
-           std::vector<std::string> buffer;
-           buffer.reserve(max_buffer);
-
-           timer ti; ti.start();
-           while(fin.good() && !fin.eof()) {
-             std::string line;
-             std::getline(fin, line);
-             if(line.empty()) continue;
-             if(fin.fail()) break;
-
-             buffer.push_back(line);
-             ++linecount;      
-
-             if (buffer.size() == max_buffer) {
-               // add a worker
-               line_buffers.push_back(std::vector<std::string>());
-               line_buffers.back().swap(buffer);
-               pool.launch(boost::bind(&graph_loader::process_lines, this, line_buffers.back(), format, filename, linecount-buffer.size()+1));
-             }
-           }
+      * Same as load_from_posixfs() for lines of vertices or edges with
+      * data, in format. Vertices are added in batches to their shards,
+      * through the same pipeline as edges.
+      */
+     void load_delimited(std::string prefix, const delimited_format& format);
 
-           // add the last worker
-           line_buffers.push_back(std::vector<std::string>());
-           line_buffers.back().swap(buffer);
-           pool.launch(boost::bind(&graph_loader::process_lines, this, line_buffers.back(), format, filename, linecount-buffer.size()+1));
-           pool.join();
-           line_buffers.clear();
-           return true;
-         }
+     /// Returns the stats of the last load.
+     inline const ingress_stats& stats() const { return last_stats; }
 
    private:
-     void process_lines(std::vector<std::string>& lines,
-                        const std::string& format,
-                        const std::string& fname,
-                        size_t line_count_begin) {
-       ingress_worker worker(client, format);
-       worker.process_lines(lines, fname, line_count_begin);
-     }
+     // Reads the files matching prefix into pipeline, and waits for the load.
+     void load_files(std::string prefix, ingress_pipeline& pipeline);
 
      graphdb_client* client;
-     size_t max_buffer;
-     thread_pool pool;
+     ingress_options options;
+     ingress_stats last_stats;
   };
 }
 #endif
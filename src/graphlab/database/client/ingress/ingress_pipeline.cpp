@@ -0,0 +1,431 @@
+#include <graphlab/database/client/ingress/ingress_pipeline.hpp>
+#include <graphlab/database/client/ingress/ingress_worker.hpp>
+#include <graphlab/database/client/ingress/builtin_parsers.hpp>
+#include <graphlab/database/graph_shard_image.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+namespace graphlab {
+  static void print_stage(std::ostream& out, const char* name, const char* unit,
+                          const ingress_stats::stage& stage, double total_secs) {
+    double threads_secs = stage.threads * total_secs;
+    out << std::setw(8) << name << std::setw(6) << stage.threads
+        << std::setw(14) << stage.amount / total_secs << " " << std::setw(8) << std::left << unit
+        << std::right << std::setw(8) << 100 * stage.busy_secs / threads_secs << "%"
+        << std::setw(8) << 100 * stage.idle_secs / threads_secs << "%"
+        << std::setw(8) << 100 * stage.blocked_secs / threads_secs << "%" << std::endl;
+  }
+
+  void ingress_stats::print(std::ostream& out) const {
+    double secs = total_secs > 0 ? total_secs : 1e-9;
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(1);
+    out << std::setw(8) << "stage" << std::setw(6) << "thr"
+        << std::setw(23) << "throughput" << std::setw(9) << "busy"
+        << std::setw(9) << "idle" << std::setw(9) << "blocked" << std::endl;
+    ingress_stats::stage read_mb = read, parse_mb = parse;
+    read_mb.amount /= 1 << 20;
+    parse_mb.amount /= 1 << 20;
+    print_stage(out, "read", "MB/s", read_mb, secs);
+    print_stage(out, "parse", "MB/s", parse_mb, secs);
+    print_stage(out, "send", "rows/s", send, secs);
+    out << send.amount - vertices_sent << " edges and " << vertices_sent
+        << " vertices in " << batches_sent << " batches, "
+        << send_errors << " errors, " << total_secs << " secs" << std::endl;
+    out.flags(flags);
+  }
+
+  ingress_pipeline::ingress_pipeline(const graph_shard_manager& manager,
+                                     const send_function& send,
+                                     const std::string& format,
+                                     const ingress_options& options) :
+      manager(manager), send(send), format(format), options(options),
+      check_columns(false), chunks(options.max_read_bytes), batches(options.max_queued_edges),
+      finished(false) {
+    start();
+  }
+
+  ingress_pipeline::ingress_pipeline(const graph_shard_manager& manager,
+                                     const send_function& send,
+                                     const vertex_send_function& send_vertices,
+                                     const delimited_format& format,
+                                     const ingress_options& options) :
+      manager(manager), send(send), send_vertices(send_vertices), format("delimited"),
+      delimited(new delimited_format(format)), options(options),
+      check_columns(false), chunks(options.max_read_bytes), batches(options.max_queued_edges),
+      finished(false) {
+    start();
+  }
+
+  void ingress_pipeline::start() {
+    ti.start();
+    stats.read.threads = 1;
+    stats.parse.threads = options.parse_threads;
+    stats.send.threads = options.send_threads;
+    for (size_t i = 0; i < options.parse_threads; ++i) {
+      parsers.launch(boost::bind(&ingress_pipeline::parse_loop, this));
+    }
+    for (size_t i = 0; i < options.send_threads; ++i) {
+      senders.launch(boost::bind(&ingress_pipeline::send_loop, this));
+    }
+  }
+
+  ingress_pipeline::~ingress_pipeline() {
+    finish();
+  }
+
+  void ingress_pipeline::set_edge_columns(const std::vector<graph_datatypes_enum>& types) {
+    check_columns = true;
+    edge_columns = types;
+  }
+
+  boost::shared_ptr<binary_edge_header>
+  ingress_pipeline::read_header(const std::string& filename, const char* begin, const char* end) {
+    boost::shared_ptr<binary_edge_header> header(new binary_edge_header());
+    if (header->read(begin, end) == 0) {
+      logstream(LOG_ERROR) << "Skipping " << filename
+                           << ": not in the binary edge format" << std::endl;
+      return boost::shared_ptr<binary_edge_header>();
+    }
+    if (check_columns && !header->columns.empty() && header->columns != edge_columns) {
+      logstream(LOG_ERROR) << "Skipping " << filename
+                           << ": the columns do not match the edge fields" << std::endl;
+      return boost::shared_ptr<binary_edge_header>();
+    }
+    if (header->is_tagged() &&
+        (header->num_shards != manager.num_shards() || header->shard >= header->num_shards)) {
+      logstream(LOG_WARNING) << filename << " is tagged with shard " << header->shard
+                             << " of " << header->num_shards << ", partitioning its edges over "
+                             << manager.num_shards() << " shards" << std::endl;
+      header->shard = binary_edge_header::UNTAGGED;
+    }
+    return header;
+  }
+
+  bool ingress_pipeline::read_mapped(const std::string& filename) {
+    // the reader only maps and splits the file, the parsers fault its pages in
+    timer reading;
+    reading.start();
+    boost::shared_ptr<graph_image_mapping> mapping(new graph_image_mapping());
+    bool success = mapping->open(filename);
+    std::vector<std::pair<const char*, const char*> > ranges;
+    chunk c;
+    if (success) {
+      const char* begin = mapping->data();
+      const char* end = begin + mapping->size();
+      if (format == "bin") {
+        c.header = read_header(filename, begin, end);
+        if (c.header) {
+          // chunks of whole records
+          size_t record_bytes = c.header->record_bytes();
+          size_t chunk_bytes = std::max<size_t>(options.chunk_bytes / record_bytes, 1) *
+              record_bytes;
+          for (const char* p = begin + c.header->header_bytes(); p < end; p += chunk_bytes) {
+            ranges.push_back(std::make_pair(p, p + std::min<size_t>(chunk_bytes, end - p)));
+          }
+        }
+      } else {
+        builtin_parsers::split_lines(begin, end, options.chunk_bytes, ranges);
+      }
+    }
+    stats_lock.lock();
+    stats.read.busy_secs += reading.current_time();
+    stats_lock.unlock();
+    if (!success) {
+      return false;
+    }
+    // unmapped once the last chunk is parsed
+    c.owner = mapping;
+    c.filename = filename;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      c.begin = ranges[i].first;
+      c.end = ranges[i].second;
+      c.offset = ranges[i].first - mapping->data();
+      push_chunk(c);
+    }
+    return true;
+  }
+
+  void ingress_pipeline::read_stream(const std::string& filename, std::istream& in) {
+    boost::shared_ptr<binary_edge_header> header;
+    size_t chunk_bytes = options.chunk_bytes;
+    size_t offset = 0;
+    if (format == "bin") {
+      // the fixed part of the header has the number of columns
+      std::string bytes(36, '\0');
+      in.read(&bytes[0], bytes.size());
+      uint32_t num_columns = 0;
+      if (in.gcount() == 36) {
+        memcpy(&num_columns, &bytes[32], sizeof(num_columns));
+        bytes.resize(36 + 4 * (size_t)num_columns);
+        in.read(&bytes[36], bytes.size() - 36);
+        bytes.resize(36 + in.gcount());
+      }
+      header = read_header(filename, bytes.data(), bytes.data() + bytes.size());
+      if (!header) {
+        return;
+      }
+      offset = bytes.size();
+      size_t record_bytes = header->record_bytes();
+      chunk_bytes = std::max<size_t>(chunk_bytes / record_bytes, 1) * record_bytes;
+    }
+    // the partial last line of a block, which starts the next chunk
+    std::string carry;
+    while (in.good()) {
+      timer reading;
+      reading.start();
+      boost::shared_ptr<std::string> buffer(new std::string());
+      buffer->swap(carry);
+      size_t len = buffer->size();
+      buffer->resize(len + chunk_bytes);
+      in.read(&(*buffer)[len], chunk_bytes);
+      buffer->resize(len + in.gcount());
+      // records are whole in each chunk, lines are cut after the last newline
+      if (in.good() && !header) {
+        size_t nl = buffer->rfind('\n');
+        if (nl == std::string::npos) {
+          // a line longer than the chunk
+          carry.swap(*buffer);
+          continue;
+        }
+        carry.assign(*buffer, nl + 1, std::string::npos);
+        buffer->resize(nl + 1);
+      }
+      stats_lock.lock();
+      stats.read.busy_secs += reading.current_time();
+      stats_lock.unlock();
+      if (buffer->empty()) {
+        continue;
+      }
+      chunk c;
+      c.owner = buffer;
+      c.begin = buffer->data();
+      c.end = c.begin + buffer->size();
+      c.filename = filename;
+      c.offset = offset;
+      c.header = header;
+      offset += buffer->size();
+      push_chunk(c);
+    }
+  }
+
+  void ingress_pipeline::push_chunk(const chunk& c) {
+    timer waiting;
+    waiting.start();
+    chunks.push(c, c.end - c.begin);
+    stats_lock.lock();
+    stats.read.amount += c.end - c.begin;
+    stats.read.blocked_secs += waiting.current_time();
+    stats_lock.unlock();
+  }
+
+  const ingress_stats& ingress_pipeline::finish() {
+    if (!finished) {
+      finished = true;
+      // each parser sends its last partial batches before it stops
+      chunks.close();
+      parsers.join();
+      batches.close();
+      senders.join();
+      stats.total_secs = ti.current_time();
+      // the reader ran on the caller, and was idle outside of the reads
+      stats.read.idle_secs = std::max(0.0, stats.total_secs - stats.read.busy_secs
+                                      - stats.read.blocked_secs);
+    }
+    return stats;
+  }
+
+  void ingress_pipeline::parse_loop() {
+    parser_state state;
+    state.shards.resize(manager.num_shards());
+    state.vertex_shards.resize(manager.num_shards());
+    state.tagged = false;
+    state.tag = 0;
+    state.mistagged = false;
+    ingress_stats::stage& stage = state.stage;
+    ingress_worker worker(boost::bind(&ingress_pipeline::partition, this, _1, &state),
+                          format, options.batch_edges);
+    if (delimited) {
+      worker.set_format(*delimited);
+      worker.set_vertex_sink(boost::bind(&ingress_pipeline::partition_vertices, this, _1, &state));
+    }
+    timer waiting, parsing;
+    chunk c;
+    while (true) {
+      waiting.start();
+      bool success = chunks.pop(c);
+      stage.idle_secs += waiting.current_time();
+      if (!success) {
+        break;
+      }
+      parsing.start();
+      double blocked = stage.blocked_secs;
+      if (c.header) {
+        state.tagged = c.header->is_tagged();
+        state.tag = c.header->shard;
+        worker.process_records(*c.header, c.begin, c.end, c.filename, c.offset);
+      } else {
+        state.tagged = false;
+        worker.process_range(c.begin, c.end, c.filename, c.offset);
+      }
+      stage.busy_secs += parsing.current_time() - (stage.blocked_secs - blocked);
+      stage.amount += c.end - c.begin;
+      // drop the buffer before waiting for the next one
+      c = chunk();
+    }
+    for (size_t i = 0; i < state.shards.size(); ++i) {
+      if (!state.shards[i].empty()) {
+        push_batch(i, state.shards[i], &stage);
+      }
+      if (!state.vertex_shards[i].empty()) {
+        push_batch(i, state.vertex_shards[i], &stage);
+      }
+    }
+    stats_lock.lock();
+    stats.parse.amount += stage.amount;
+    stats.parse.busy_secs += stage.busy_secs;
+    stats.parse.idle_secs += stage.idle_secs;
+    stats.parse.blocked_secs += stage.blocked_secs;
+    stats_lock.unlock();
+  }
+
+  const size_t ingress_pipeline::TAG_CHECK_STRIDE;
+
+  bool ingress_pipeline::tag_agrees(const std::vector<edge_insert_descriptor>& edges,
+                                    graph_shard_id_t shard) const {
+    for (size_t i = 0; i < edges.size(); i += TAG_CHECK_STRIDE) {
+      if (manager.get_master(edges[i].src, edges[i].dest) != shard) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void ingress_pipeline::partition(std::vector<edge_insert_descriptor>& edges,
+                                   parser_state* state) {
+    if (state->tagged && !tag_agrees(edges, state->tag)) {
+      if (!state->mistagged) {
+        logstream(LOG_ERROR) << "Edges of a file tagged with shard " << state->tag
+                             << " belong to other shards, partitioning them" << std::endl;
+        state->mistagged = true;
+      }
+      // the rest of the chunk too
+      state->tagged = false;
+    }
+    if (state->tagged) {
+      // all the edges go to the shard of the file
+      std::vector<edge_insert_descriptor>& buffer = state->shards[state->tag];
+      if (buffer.empty()) {
+        buffer.swap(edges);
+      } else {
+        buffer.insert(buffer.end(), edges.begin(), edges.end());
+      }
+      if (buffer.size() >= options.batch_edges) {
+        push_batch(state->tag, buffer, &state->stage);
+      }
+      return;
+    }
+    for (size_t i = 0; i < edges.size(); ++i) {
+      graph_shard_id_t shard = manager.get_master(edges[i].src, edges[i].dest);
+      std::vector<edge_insert_descriptor>& buffer = state->shards[shard];
+      buffer.push_back(edge_insert_descriptor());
+      buffer.back().src = edges[i].src;
+      buffer.back().dest = edges[i].dest;
+      buffer.back().data.swap(edges[i].data);
+      if (buffer.size() >= options.batch_edges) {
+        push_batch(shard, buffer, &state->stage);
+      }
+    }
+  }
+
+  void ingress_pipeline::partition_vertices(std::vector<vertex_insert_descriptor>& vertices,
+                                            parser_state* state) {
+    for (size_t i = 0; i < vertices.size(); ++i) {
+      graph_shard_id_t shard = manager.get_master(vertices[i].vid);
+      std::vector<vertex_insert_descriptor>& buffer = state->vertex_shards[shard];
+      buffer.push_back(vertex_insert_descriptor());
+      buffer.back().vid = vertices[i].vid;
+      buffer.back().data.swap(vertices[i].data);
+      if (buffer.size() >= options.batch_edges) {
+        push_batch(shard, buffer, &state->stage);
+      }
+    }
+  }
+
+  void ingress_pipeline::push_batch(graph_shard_id_t shard,
+                                    std::vector<edge_insert_descriptor>& edges,
+                                    ingress_stats::stage* stage) {
+    batch b;
+    b.shard = shard;
+    b.edges.reset(new std::vector<edge_insert_descriptor>());
+    b.edges->swap(edges);
+    edges.reserve(b.edges->size());
+    push_batch(b, b.edges->size(), stage);
+  }
+
+  void ingress_pipeline::push_batch(graph_shard_id_t shard,
+                                    std::vector<vertex_insert_descriptor>& vertices,
+                                    ingress_stats::stage* stage) {
+    batch b;
+    b.shard = shard;
+    b.vertices.reset(new std::vector<vertex_insert_descriptor>());
+    b.vertices->swap(vertices);
+    vertices.reserve(b.vertices->size());
+    push_batch(b, b.vertices->size(), stage);
+  }
+
+  void ingress_pipeline::push_batch(const batch& b, size_t rows, ingress_stats::stage* stage) {
+    timer waiting;
+    waiting.start();
+    batches.push(b, rows);
+    stage->blocked_secs += waiting.current_time();
+  }
+
+  void ingress_pipeline::send_loop() {
+    ingress_stats::stage stage;
+    size_t nbatches = 0, nerrors = 0, nvertices = 0;
+    timer waiting, sending;
+    batch b;
+    std::vector<int> errorcodes;
+    while (true) {
+      waiting.start();
+      bool success = batches.pop(b);
+      stage.idle_secs += waiting.current_time();
+      if (!success) {
+        break;
+      }
+      sending.start();
+      errorcodes.clear();
+      size_t rows;
+      if (b.vertices) {
+        rows = b.vertices->size();
+        nvertices += rows;
+        success = send_vertices(b.shard, *b.vertices, errorcodes);
+      } else {
+        rows = b.edges->size();
+        success = send(b.shard, *b.edges, errorcodes);
+      }
+      if (!success) {
+        ++nerrors;
+      }
+      for (size_t i = 0; i < errorcodes.size(); ++i) {
+        nerrors += (errorcodes[i] != 0);
+      }
+      stage.busy_secs += sending.current_time();
+      stage.amount += rows;
+      ++nbatches;
+      b = batch();
+    }
+    stats_lock.lock();
+    stats.send.amount += stage.amount;
+    stats.send.busy_secs += stage.busy_secs;
+    stats.send.idle_secs += stage.idle_secs;
+    stats.vertices_sent += nvertices;
+    stats.batches_sent += nbatches;
+    stats.send_errors += nerrors;
+    stats_lock.unlock();
+  }
+} // namespace graphlab
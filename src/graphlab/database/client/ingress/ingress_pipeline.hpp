@@ -0,0 +1,292 @@
+#ifndef GRAPHLAB_DATABASE_INGRESS_PIPELINE_HPP
+#define GRAPHLAB_DATABASE_INGRESS_PIPELINE_HPP
+#include <graphlab/database/graph_database.hpp>
+#include <graphlab/database/graph_shard_manager.hpp>
+#include <graphlab/database/client/ingress/binary_edge_format.hpp>
+#include <graphlab/database/client/ingress/delimited_format.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/util/timer.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace graphlab {
+  /**
+   * The parallelism and memory caps of an \ref ingress_pipeline. Besides
+   * max_read_bytes of input and max_queued_edges edges between the
+   * stages, each parser holds a chunk and up to batch_edges edges per
+   * shard, and each sender a batch.
+   */
+  struct ingress_options {
+    /// Threads parsing chunks of the input.
+    size_t parse_threads;
+    /// Threads sending batches of edges.
+    size_t send_threads;
+    /// Bytes of input parsed at a time.
+    size_t chunk_bytes;
+    /// Bytes of input read and not yet parsed, beyond which the reader waits.
+    size_t max_read_bytes;
+    /// Edges, or vertices, of one shard sent together.
+    size_t batch_edges;
+    /// Edges and vertices in batches waiting to be sent, beyond which the parsers wait.
+    size_t max_queued_edges;
+    /**
+     * Memory of the client remembering the mirrors it registered during a
+     * load of \ref graph_loader, see graphdb_client::set_known_mirrors_bytes().
+     */
+    size_t known_mirrors_bytes;
+
+    ingress_options() : parse_threads(4), send_threads(4), chunk_bytes(8 << 20),
+        max_read_bytes(64 << 20), batch_edges(1 << 14), max_queued_edges(1 << 20),
+        known_mirrors_bytes(64 << 20) { }
+  };
+
+  /**
+   * The work done by each stage of an \ref ingress_pipeline, and where its
+   * threads spent their time. The bottleneck is the stage whose threads
+   * are busy most of the time, while the others are idle (waiting for
+   * input) or blocked (waiting for room in the next stage).
+   */
+  struct ingress_stats {
+    struct stage {
+      size_t threads;
+      // bytes for the reader and the parsers, rows for the senders
+      size_t amount;
+      // seconds summed over the threads of the stage
+      double busy_secs;
+      double idle_secs;
+      double blocked_secs;
+      stage() : threads(0), amount(0), busy_secs(0), idle_secs(0), blocked_secs(0) { }
+    };
+    // the send amount counts vertices and edges
+    stage read, parse, send;
+    size_t vertices_sent;
+    size_t batches_sent;
+    size_t send_errors;
+    double total_secs;
+
+    ingress_stats() : vertices_sent(0), batches_sent(0), send_errors(0), total_secs(0) { }
+
+    /// Prints the throughput and utilization of each stage.
+    void print(std::ostream& out) const;
+  };
+
+  /**
+   * A queue of items of a given weight, such as bytes, which holds at
+   * most capacity of them. An item heavier than capacity still enters an
+   * empty queue.
+   */
+  template<typename T>
+  class ingress_queue {
+   public:
+    explicit ingress_queue(size_t capacity) :
+        capacity(capacity), weight(0), closed(false) { }
+
+    /// Waits for room, then adds item.
+    void push(const T& item, size_t item_weight) {
+      lock.lock();
+      while (!items.empty() && weight + item_weight > capacity) {
+        not_full.wait(lock);
+      }
+      items.push_back(std::make_pair(item, item_weight));
+      weight += item_weight;
+      not_empty.signal();
+      lock.unlock();
+    }
+
+    /// Waits for an item. Returns false once the queue is closed and empty.
+    bool pop(T& item) {
+      lock.lock();
+      while (items.empty() && !closed) {
+        not_empty.wait(lock);
+      }
+      bool success = !items.empty();
+      if (success) {
+        item = items.front().first;
+        weight -= items.front().second;
+        items.pop_front();
+        not_full.broadcast();
+      }
+      lock.unlock();
+      return success;
+    }
+
+    /// No more items are pushed: pop() returns false once the queue is empty.
+    void close() {
+      lock.lock();
+      closed = true;
+      not_empty.broadcast();
+      lock.unlock();
+    }
+
+   private:
+    size_t capacity;
+    size_t weight;
+    bool closed;
+    std::deque<std::pair<T, size_t> > items;
+    mutex lock;
+    conditional not_empty, not_full;
+  };
+
+  /**
+   * Loads edges in stages connected by bounded queues, so reading,
+   * parsing and sending overlap and a load of any size runs in constant
+   * memory. The caller reads the input in chunks of newline aligned
+   * lines; the parse threads turn them into edges partitioned by shard;
+   * the send threads send each full batch of edges of a shard.
+   *
+   * Files in format "bin" are split into chunks of whole records. The
+   * edges of a file tagged with its shard go to that shard without being
+   * partitioned, unless a sample of them belongs elsewhere. Lines of a
+   * \ref delimited_format become vertices or edges with data, and the
+   * vertices are batched by shard as the edges.
+   */
+  class ingress_pipeline {
+   public:
+    typedef graph_database::edge_insert_descriptor edge_insert_descriptor;
+    typedef graph_database::vertex_insert_descriptor vertex_insert_descriptor;
+
+    /// Adds a batch of edges of one shard, see graphdb_client::add_edges_to_shard().
+    typedef boost::function<bool(graph_shard_id_t, const std::vector<edge_insert_descriptor>&,
+                                 std::vector<int>&)> send_function;
+
+    /// Adds a batch of vertices of one shard, see graphdb_client::add_vertices_to_shard().
+    typedef boost::function<bool(graph_shard_id_t, const std::vector<vertex_insert_descriptor>&,
+                                 std::vector<int>&)> vertex_send_function;
+
+    /// Starts the parse and send threads.
+    ingress_pipeline(const graph_shard_manager& manager, const send_function& send,
+                     const std::string& format, const ingress_options& options);
+
+    /**
+     * Starts the parse and send threads, for lines in format. Vertices
+     * are sent with send_vertices, edges with send.
+     */
+    ingress_pipeline(const graph_shard_manager& manager, const send_function& send,
+                     const vertex_send_function& send_vertices,
+                     const delimited_format& format, const ingress_options& options);
+
+    /// Calls finish() if it was not.
+    ~ingress_pipeline();
+
+    /**
+     * Maps an uncompressed file and queues its chunks, which the parsers
+     * read in place. Returns false if the file cannot be mapped.
+     */
+    bool read_mapped(const std::string& filename);
+
+    /// Reads the stream of filename into chunks, and queues them.
+    void read_stream(const std::string& filename, std::istream& in);
+
+    /**
+     * Sets the types of the edge fields, which the columns of "bin" files
+     * must match. Files with other columns are skipped; files without
+     * columns are loaded. Unset, the columns are not checked.
+     */
+    void set_edge_columns(const std::vector<graph_datatypes_enum>& types);
+
+    /**
+     * Waits until everything read is parsed and sent, stops the threads
+     * and returns the stats of the load.
+     */
+    const ingress_stats& finish();
+
+   private:
+    struct chunk {
+      // the mapping or the buffer holding [begin, end)
+      boost::shared_ptr<void> owner;
+      const char* begin;
+      const char* end;
+      // where the chunk starts in the file
+      std::string filename;
+      size_t offset;
+      // the header of a "bin" file, NULL for lines of text
+      boost::shared_ptr<binary_edge_header> header;
+    };
+
+    // The edges and vertices a parser holds, and its stats.
+    struct parser_state {
+      // the edges of each shard not yet batched
+      std::vector<std::vector<edge_insert_descriptor> > shards;
+      // the vertices of each shard not yet batched
+      std::vector<std::vector<vertex_insert_descriptor> > vertex_shards;
+      ingress_stats::stage stage;
+      // set while parsing a file tagged with the shard of its edges
+      bool tagged;
+      graph_shard_id_t tag;
+      // set once edges disagreed with the tag of their file
+      bool mistagged;
+    };
+
+    // a batch of edges or of vertices, and the shard they go to
+    struct batch {
+      graph_shard_id_t shard;
+      boost::shared_ptr<std::vector<edge_insert_descriptor> > edges;
+      boost::shared_ptr<std::vector<vertex_insert_descriptor> > vertices;
+    };
+
+    // Starts the threads.
+    void start();
+
+    // Queues a chunk, counting the time the reader waits for room.
+    void push_chunk(const chunk& c);
+
+    // Decodes the header of a "bin" file from [begin, end), and checks it
+    // against the edge columns. Returns NULL if the file is to be skipped.
+    boost::shared_ptr<binary_edge_header> read_header(const std::string& filename,
+                                                      const char* begin, const char* end);
+
+    void parse_loop();
+    void send_loop();
+
+    /**
+     * Returns true if every TAG_CHECK_STRIDE-th edge of edges belongs to
+     * shard. A wrong tag would put the edges where lookups do not find them.
+     */
+    bool tag_agrees(const std::vector<edge_insert_descriptor>& edges,
+                    graph_shard_id_t shard) const;
+
+    static const size_t TAG_CHECK_STRIDE = 64;
+
+    // Adds the parsed edges to the buffer of their shard, queueing the full ones.
+    void partition(std::vector<edge_insert_descriptor>& edges, parser_state* state);
+
+    // Adds the parsed vertices to the buffer of their shard, queueing the full ones.
+    void partition_vertices(std::vector<vertex_insert_descriptor>& vertices,
+                            parser_state* state);
+
+    // Queues the edges of shard as a batch.
+    void push_batch(graph_shard_id_t shard, std::vector<edge_insert_descriptor>& edges,
+                    ingress_stats::stage* stage);
+
+    // Queues the vertices of shard as a batch.
+    void push_batch(graph_shard_id_t shard, std::vector<vertex_insert_descriptor>& vertices,
+                    ingress_stats::stage* stage);
+
+    // Queues b of weight rows, counting the time the parser waits for room.
+    void push_batch(const batch& b, size_t rows, ingress_stats::stage* stage);
+
+    graph_shard_manager manager;
+    send_function send;
+    vertex_send_function send_vertices;
+    std::string format;
+    // the format of lines of vertices or edges with data, if format is "delimited"
+    boost::shared_ptr<delimited_format> delimited;
+    ingress_options options;
+    bool check_columns;
+    std::vector<graph_datatypes_enum> edge_columns;
+    ingress_queue<chunk> chunks;
+    ingress_queue<batch> batches;
+    thread_group parsers;
+    thread_group senders;
+    timer ti;
+    bool finished;
+    // guards stats
+    mutex stats_lock;
+    ingress_stats stats;
+  };
+} // namespace graphlab
+#endif
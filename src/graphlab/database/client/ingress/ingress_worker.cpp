@@ -2,39 +2,111 @@
 #include<graphlab/database/client/ingress/builtin_parsers.hpp>
 #include<graphlab/database/client/graphdb_client.hpp>
 #include<graphlab/logger/assertions.hpp>
+#include<boost/bind.hpp>
+#include<boost/ref.hpp>
+#include<cstring>
 
 namespace graphlab {
   ingress_worker::ingress_worker(graphdb_client* _client, 
-                                 const std::string& format) : client(_client) { 
+                                 const std::string& format) :
+      client(_client), max_buffer(0) { 
+    set_parsers(format);
+  }
+
+  ingress_worker::ingress_worker(const edge_sink_type& _sink,
+                                 const std::string& format,
+                                 size_t _max_buffer) :
+      client(NULL), sink(_sink), max_buffer(_max_buffer) {
+    set_parsers(format);
+  }
+
+  void ingress_worker::set_parsers(const std::string& format) {
     if (format == "snap") {
       line_parser = builtin_parsers::snap_parser<ingress_worker>;
+      range_parser = builtin_parsers::snap_range_parser<ingress_worker>;
     } else if (format == "adj") {
       line_parser = builtin_parsers::adj_parser<ingress_worker>;
+      range_parser = builtin_parsers::adj_range_parser<ingress_worker>;
     } else if (format == "tsv") {
       line_parser = builtin_parsers::tsv_parser<ingress_worker>;
+      range_parser = builtin_parsers::tsv_range_parser<ingress_worker>;
+    } else if (format == "bin") {
+      // parsed by process_records()
+    } else if (format == "delimited") {
+      // parsed by the format of set_format()
     } else {
       logstream(LOG_ERROR)
           << "Unrecognized Format \"" << format << "\"!" << std::endl;
     }
   }
 
+  void ingress_worker::set_format(const delimited_format& format) {
+    delimited.reset(new delimited_format(format));
+    line_parser = boost::bind(&ingress_worker::parse_delimited_line, _1,
+                              boost::cref(*delimited), _2);
+    range_parser = boost::bind(&delimited_format::parse<ingress_worker>,
+                               boost::cref(*delimited), _1, _2, _3);
+  }
+
+  void ingress_worker::set_vertex_sink(const vertex_sink_type& _sink) {
+    vertex_sink = _sink;
+  }
+
+  bool ingress_worker::parse_delimited_line(ingress_worker& worker,
+                                            const delimited_format& format,
+                                            const std::string& line) {
+    return format.parse(worker, line.data(), line.data() + line.size());
+  }
+
+  void ingress_worker::add_edge(graph_vid_t source, graph_vid_t dest, graph_row& data) {
+    edge_ingress_buffer.push_back(edge_insert_descriptor());
+    edge_insert_descriptor& e = edge_ingress_buffer.back();
+    e.src = source;
+    e.dest = dest;
+    e.data.swap(data);
+    e.data._is_vertex = false;
+  }
+
+  void ingress_worker::add_vertex(graph_vid_t vid, graph_row& data) {
+    vertex_ingress_buffer.push_back(vertex_insert_descriptor());
+    vertex_insert_descriptor& v = vertex_ingress_buffer.back();
+    v.vid = vid;
+    v.data.swap(data);
+    v.data._is_vertex = true;
+  }
+
   void ingress_worker::add_edge(graph_vid_t source, graph_vid_t dest) {
-    graph_row row;
-    row._is_vertex = false;
-    edge_insert_descriptor e;
+    // construct the descriptor in place to avoid copying the row
+    edge_ingress_buffer.push_back(edge_insert_descriptor());
+    edge_insert_descriptor& e = edge_ingress_buffer.back();
     e.src = source; 
     e.dest = dest;
-    e.data = row;
-    edge_ingress_buffer.push_back(e);
+    e.data._is_vertex = false;
   }
 
   void ingress_worker::flush() {
+    if (sink) {
+      sink(edge_ingress_buffer);
+      edge_ingress_buffer.clear();
+      if (vertex_sink) {
+        vertex_sink(vertex_ingress_buffer);
+      }
+      vertex_ingress_buffer.clear();
+      return;
+    }
     logstream(LOG_EMPH) << "Flush ... " << std::endl;
     std::vector<int> errorcodes;
-    bool success = client->add_edges(edge_ingress_buffer, errorcodes);
+    bool success = true;
+    if (!edge_ingress_buffer.empty()) {
+      success &= client->add_edges(edge_ingress_buffer, errorcodes);
+    }
+    if (!vertex_ingress_buffer.empty()) {
+      success &= client->add_vertices(vertex_ingress_buffer, errorcodes);
+    }
     // TODO: add error handling....
     ASSERT_TRUE(success);
     edge_ingress_buffer.clear();
+    vertex_ingress_buffer.clear();
   }
 
   void ingress_worker::process_lines(std::vector<std::string>& lines,
@@ -53,4 +125,90 @@ namespace graphlab {
     flush();
     lines.clear();
   }
+
+  void ingress_worker::process_range(const char* begin, const char* end,
+                                     const std::string& filename,
+                                     size_t offset) {
+    const char* p = begin;
+    while (p != end) {
+      const char* nl = (const char*)memchr(p, '\n', end - p);
+      const char* eol = (nl == NULL) ? end : nl;
+      const char* next = (nl == NULL) ? end : nl + 1;
+      if (eol != p && eol[-1] == '\r') --eol;
+      if (eol != p && !range_parser(*this, p, eol)) {
+        logstream(LOG_WARNING)
+            << "Error parsing line at byte " << (offset + (p - begin)) << " in "
+            << filename << ": " << std::endl
+            << "\t\"" << std::string(p, eol) << "\"" << std::endl;
+      }
+      if (max_buffer > 0 && edge_ingress_buffer.size() + vertex_ingress_buffer.size() >= max_buffer) {
+        flush();
+      }
+      p = next;
+    }
+    flush();
+  }
+
+  void ingress_worker::process_records(const binary_edge_header& header,
+                                       const char* begin, const char* end,
+                                       const std::string& filename,
+                                       size_t offset) {
+    size_t record_bytes = header.record_bytes();
+    size_t partial = (end - begin) % record_bytes;
+    if (partial != 0) {
+      end -= partial;
+      logstream(LOG_WARNING)
+          << "Ignoring the partial record at byte " << (offset + (end - begin))
+          << " in " << filename << std::endl;
+    }
+    // the row of the columns, with the values of each record
+    graph_row row;
+    row._is_vertex = false;
+    for (size_t i = 0; i < header.columns.size(); ++i) {
+      graph_field field("", header.columns[i]);
+      row.add_field(field);
+    }
+    const bool vid32 = (header.vid_bytes() == 4);
+    for (const char* p = begin; p != end; p += record_bytes) {
+      graph_vid_t source, target;
+      if (vid32) {
+        uint32_t vids[2];
+        memcpy(vids, p, sizeof(vids));
+        source = vids[0];
+        target = vids[1];
+      } else {
+        memcpy(&source, p, sizeof(source));
+        memcpy(&target, p + sizeof(source), sizeof(target));
+      }
+      // self edges are dropped, as by the text parsers
+      if (source == target) {
+        continue;
+      }
+      add_edge(source, target);
+      if (!header.columns.empty()) {
+        graph_row& data = edge_ingress_buffer.back().data;
+        data = row;
+        const char* value = p + 2 * header.vid_bytes();
+        for (size_t i = 0; i < header.columns.size(); ++i, value += 8) {
+          if (header.columns[i] == INT_TYPE) {
+            graph_int_t x;
+            memcpy(&x, value, sizeof(x));
+            data.get_field(i)->set_integer(x);
+          } else if (header.columns[i] == DOUBLE_TYPE) {
+            graph_double_t x;
+            memcpy(&x, value, sizeof(x));
+            data.get_field(i)->set_double(x);
+          } else {
+            graph_vid_t x;
+            memcpy(&x, value, sizeof(x));
+            data.get_field(i)->set_vid(x);
+          }
+        }
+      }
+      if (max_buffer > 0 && edge_ingress_buffer.size() >= max_buffer) {
+        flush();
+      }
+    }
+    flush();
+  }
 }
@@ -1,8 +1,11 @@
 #ifndef GRAPHLAB_DATABASE_INGRESS_WORKER_HPP
 #define GRAPHLAB_DATABASE_INGRESS_WORKER_HPP
 #include <graphlab/database/graph_database.hpp>
+#include <graphlab/database/client/ingress/binary_edge_format.hpp>
+#include <graphlab/database/client/ingress/delimited_format.hpp>
 #include <vector>
 #include <boost/functional.hpp>
+#include <boost/shared_ptr.hpp>
 
 namespace graphlab {
   class graphdb_client;
@@ -10,25 +13,89 @@ namespace graphlab {
   class ingress_worker {
 
    typedef graph_database::edge_insert_descriptor edge_insert_descriptor;
+   typedef graph_database::vertex_insert_descriptor vertex_insert_descriptor;
 
    typedef boost::function<bool(ingress_worker&, const std::string&)> line_parser_type;
+   typedef boost::function<bool(ingress_worker&, const char*, const char*)> range_parser_type;
    public:
+     /// Receives the parsed edges, and may take them by swapping the vector.
+     typedef boost::function<void(std::vector<edge_insert_descriptor>&)> edge_sink_type;
+
+     /// Receives the parsed vertices, and may take them by swapping the vector.
+     typedef boost::function<void(std::vector<vertex_insert_descriptor>&)> vertex_sink_type;
+
      ingress_worker(graphdb_client* client,
                     const std::string& format);
 
+     /**
+      * Hands the parsed edges to sink instead of adding them through a
+      * client, every max_buffer edges and at the end of each range.
+      */
+     ingress_worker(const edge_sink_type& sink,
+                    const std::string& format,
+                    size_t max_buffer);
+
+     /**
+      * Parses the lines with format instead of the parsers of the format
+      * given to the constructor, which should be "delimited".
+      */
+     void set_format(const delimited_format& format);
+
+     /**
+      * Hands the parsed vertices to sink, when the edges are handed to
+      * the edge sink, instead of adding them through the client.
+      */
+     void set_vertex_sink(const vertex_sink_type& sink);
+
      void process_lines(std::vector<std::string>& lines,
                         const std::string& fname,
                         size_t line_count_begin);
 
+     /**
+      * Same as process_lines() on the lines of [begin, end), which are
+      * parsed in place. offset is the position of begin in the file.
+      */
+     void process_range(const char* begin, const char* end,
+                        const std::string& fname, size_t offset);
+
+     /**
+      * Parses the records of [begin, end) in the binary edge format
+      * described by header, for format "bin". offset is the position of
+      * begin in the file.
+      */
+     void process_records(const binary_edge_header& header,
+                          const char* begin, const char* end,
+                          const std::string& fname, size_t offset);
+
      void add_edge(graph_vid_t source, graph_vid_t dest);
 
+     /// Adds an edge with data, taken by swapping.
+     void add_edge(graph_vid_t source, graph_vid_t dest, graph_row& data);
+
+     /// Adds a vertex with data, taken by swapping.
+     void add_vertex(graph_vid_t vid, graph_row& data);
+
    private:
      void flush();
 
+   private:
+     void set_parsers(const std::string& format);
+
+     // The line parser of a delimited format.
+     static bool parse_delimited_line(ingress_worker& worker, const delimited_format& format,
+                                      const std::string& line);
+
    private:
      graphdb_client* client;
+     edge_sink_type sink;
+     vertex_sink_type vertex_sink;
+     size_t max_buffer;
      line_parser_type line_parser;
+     range_parser_type range_parser;
      std::vector<edge_insert_descriptor> edge_ingress_buffer; 
+     std::vector<vertex_insert_descriptor> vertex_ingress_buffer;
+     // the format set by set_format(), kept alive for the parsers
+     boost::shared_ptr<delimited_format> delimited;
   };
 }
 #endif
@@ -8,6 +8,7 @@
 #define EDUP 1003 /* Duplicate objects (vertex already exists) */
 #define EINVHEAD 1004 /* Invalid query header */
 #define EINVCMD 1005 /* Invalid command */
+#define ENOINDEX 1006 /* Field is not indexed */
 namespace graphlab {
   inline std::string glstrerr (int errorno) {
     switch (errorno) {
@@ -17,6 +18,7 @@ namespace graphlab {
      case EDUP: return "Duplicate objects (vertex/field already exists)";
      case EINVHEAD: return "Invalid query header";
      case EINVCMD: return "Invalid command";
+     case ENOINDEX: return "Field is not indexed";
      default: return strerror(errorno);
     }
   }
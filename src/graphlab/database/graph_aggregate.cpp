@@ -0,0 +1,213 @@
+#include <graphlab/database/graph_aggregate.hpp>
+#include <graphlab/database/graph_ordered_index.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace graphlab {
+  const size_t graph_hyperloglog::PRECISION;
+
+  // The finalizer of MurmurHash3, spreads the bits of x over the hash.
+  static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+  }
+
+  uint64_t graph_hyperloglog::hash(const graph_value& value) {
+    const unsigned char* bytes = (const unsigned char*)value.get_raw_pointer();
+    if (bytes == NULL) {
+      return 0;
+    }
+    if (is_scalar_graph_datatype(value.type())) {
+      uint64_t x;
+      memcpy(&x, bytes, sizeof(x));
+      return mix64(x);
+    }
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < value.data_length(); ++i) {
+      h = (h ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return mix64(h);
+  }
+
+  void graph_hyperloglog::add(uint64_t hash) {
+    if (registers.empty()) {
+      registers.resize((size_t)1 << PRECISION, 0);
+    }
+    size_t index = hash >> (64 - PRECISION);
+    uint64_t rest = hash << PRECISION;
+    unsigned char rank = (rest == 0) ? (64 - PRECISION + 1) : (__builtin_clzll(rest) + 1);
+    if (rank > registers[index]) {
+      registers[index] = rank;
+    }
+  }
+
+  double graph_hyperloglog::estimate() const {
+    if (registers.empty()) {
+      return 0;
+    }
+    double m = registers.size();
+    double sum = 0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < registers.size(); ++i) {
+      sum += ldexp(1.0, -registers[i]);
+      zeros += (registers[i] == 0);
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    // small cardinalities are counted from the empty registers
+    if (e <= 2.5 * m && zeros > 0) {
+      e = m * log(m / zeros);
+    }
+    return e;
+  }
+
+  graph_hyperloglog& graph_hyperloglog::operator+=(const graph_hyperloglog& other) {
+    if (other.registers.empty()) {
+      return *this;
+    }
+    if (registers.empty()) {
+      registers = other.registers;
+      return *this;
+    }
+    for (size_t i = 0; i < registers.size(); ++i) {
+      registers[i] = std::max(registers[i], other.registers[i]);
+    }
+    return *this;
+  }
+
+  // Returns true if lhs orders before rhs, both INT or both DOUBLE.
+  static inline bool value_less(const graph_value& lhs, const graph_value& rhs) {
+    return graph_ordered_index::encode(lhs.type(), (const char*)lhs.get_raw_pointer()) <
+        graph_ordered_index::encode(rhs.type(), (const char*)rhs.get_raw_pointer());
+  }
+
+  // Adds x to sum, or returns false, leaving sum unchanged, if it overflows.
+  static inline bool add_int(graph_int_t& sum, graph_int_t x) {
+    if ((x > 0 && sum > std::numeric_limits<graph_int_t>::max() - x) ||
+        (x < 0 && sum < std::numeric_limits<graph_int_t>::min() - x)) {
+      return false;
+    }
+    sum += x;
+    return true;
+  }
+
+  void graph_field_aggregate::add(const graph_value& value, bool with_distinct) {
+    if (value.is_null()) {
+      return;
+    }
+    ++count;
+    if (with_distinct) {
+      distinct.add(graph_hyperloglog::hash(value));
+    }
+    if (!graph_ordered_index::supports(value.type())) {
+      return;
+    }
+    if (value.type() == INT_TYPE) {
+      graph_int_t x;
+      value.get_integer(&x);
+      if (int_overflow) {
+        sum += x;
+      } else if (!add_int(int_sum, x)) {
+        // carry on in sum, rounded
+        sum += (double)int_sum + (double)x;
+        int_sum = 0;
+        int_overflow = true;
+      }
+    } else {
+      graph_double_t x;
+      value.get_double(&x);
+      sum += x;
+    }
+    if (min.is_null() || value_less(value, min)) {
+      min = value;
+    }
+    if (max.is_null() || value_less(max, value)) {
+      max = value;
+    }
+  }
+
+  graph_field_aggregate& graph_field_aggregate::operator+=(const graph_field_aggregate& other) {
+    count += other.count;
+    sum += other.sum;
+    if (int_overflow || other.int_overflow || !add_int(int_sum, other.int_sum)) {
+      sum += (double)int_sum + (double)other.int_sum;
+      int_sum = 0;
+      int_overflow = true;
+    }
+    if (!other.min.is_null() && (min.is_null() || value_less(other.min, min))) {
+      min = other.min;
+    }
+    if (!other.max.is_null() && (max.is_null() || value_less(max, other.max))) {
+      max = other.max;
+    }
+    distinct += other.distinct;
+    return *this;
+  }
+
+  const size_t graph_field_histogram::MAX_BINS;
+
+  bool graph_field_histogram::valid() const {
+    return std::isfinite(lo) && std::isfinite(hi) && lo < hi &&
+        !bins.empty() && bins.size() <= MAX_BINS;
+  }
+
+  void graph_field_histogram::add(const graph_value& value) {
+    if (value.is_null() || bins.empty()) {
+      return;
+    }
+    double x;
+    if (value.type() == INT_TYPE) {
+      graph_int_t i;
+      value.get_integer(&i);
+      x = i;
+    } else if (value.type() == DOUBLE_TYPE) {
+      graph_double_t d;
+      value.get_double(&d);
+      x = d;
+    } else {
+      return;
+    }
+    if (x != x) {
+      return;
+    }
+    if (x < lo) {
+      ++below;
+    } else if (x >= hi) {
+      ++above;
+    } else {
+      // rounding may put a value just below hi past the last bin
+      size_t i = (size_t)((x - lo) / (hi - lo) * bins.size());
+      ++bins[std::min(i, bins.size() - 1)];
+    }
+  }
+
+  graph_field_histogram& graph_field_histogram::operator+=(const graph_field_histogram& other) {
+    if (other.bins.empty()) {
+      return *this;
+    }
+    if (bins.empty()) {
+      lo = other.lo;
+      hi = other.hi;
+      bins.assign(other.bins.size(), 0);
+    }
+    // the partials come from the servers, do not trust them to agree
+    if (bins.size() != other.bins.size() || lo != other.lo || hi != other.hi) {
+      mismatched = true;
+      return *this;
+    }
+    for (size_t i = 0; i < bins.size(); ++i) {
+      bins[i] += other.bins[i];
+    }
+    below += other.below;
+    above += other.above;
+    return *this;
+  }
+} // namespace graphlab
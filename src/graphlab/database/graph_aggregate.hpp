@@ -0,0 +1,160 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_AGGREGATE_HPP
+#define GRAPHLAB_DATABASE_GRAPH_AGGREGATE_HPP
+#include <map>
+#include <vector>
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/database/graph_value.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+
+namespace graphlab {
+/// \ingroup group_graph_database
+/// The kinds of GET AGGREGATE queries.
+enum graph_aggregate_type {
+  // is_vertex, fieldpos, distinct -> graph_field_aggregate
+  FIELD_AGGREGATE,
+  // is_vertex, fieldpos, lo, hi, nbins -> graph_field_histogram
+  FIELD_HISTOGRAM
+};
+
+/**
+ * \ingroup group_graph_database
+ * A HyperLogLog sketch estimating the number of distinct hashes added,
+ * within about 1.6% using 4KB. Sketches merge by keeping the larger
+ * register, so the sketches of disjoint sets of rows add up to the sketch
+ * of their union.
+ */
+class graph_hyperloglog {
+ public:
+  static const size_t PRECISION = 12;
+
+  /// Returns the hash of a value, used to add it.
+  static uint64_t hash(const graph_value& value);
+
+  /// Adds a hash. Creates the registers on the first call.
+  void add(uint64_t hash);
+
+  /// Returns the estimated number of distinct hashes added.
+  double estimate() const;
+
+  /// Returns true if nothing was added.
+  inline bool empty() const { return registers.empty(); }
+
+  graph_hyperloglog& operator+=(const graph_hyperloglog& other);
+
+  void save(oarchive& oarc) const { oarc << registers; }
+  void load(iarchive& iarc) { iarc >> registers; }
+
+ private:
+  std::vector<unsigned char> registers;
+};
+
+/**
+ * \ingroup group_graph_database
+ * The count, sum, minimum and maximum of the non NULL values of a field,
+ * and optionally a sketch of their distinct values. Partial aggregates of
+ * disjoint sets of rows add up with +=. The sum, minimum and maximum are
+ * only kept for INT and DOUBLE fields. INT values are summed exactly into
+ * int_sum, and DOUBLE values into sum. If int_sum would overflow,
+ * int_overflow is set and the INT values go into sum as well, so that
+ * sum + int_sum is the total either way, rounded in the latter case.
+ */
+struct graph_field_aggregate {
+  uint64_t count;
+  // the sum of the DOUBLE values, and of the INT values once int_overflow
+  double sum;
+  // the sum of the INT values until int_overflow
+  graph_int_t int_sum;
+  bool int_overflow;
+  // NULL until a value is added
+  graph_value min, max;
+  graph_hyperloglog distinct;
+
+  graph_field_aggregate() : count(0), sum(0), int_sum(0), int_overflow(false) { }
+
+  /// Adds a value, and its hash to distinct if with_distinct is true.
+  void add(const graph_value& value, bool with_distinct);
+
+  /// Returns the mean of the values, or 0 if there is none. The mean of
+  /// an INT field is rounded to a double, and more so if int_overflow.
+  inline double mean() const {
+    return count == 0 ? 0 : (sum + (double)int_sum) / count;
+  }
+
+  /// Returns the estimated number of distinct values, if they were counted.
+  inline double distinct_count() const { return distinct.estimate(); }
+
+  graph_field_aggregate& operator+=(const graph_field_aggregate& other);
+
+  void save(oarchive& oarc) const {
+    oarc << count << sum << int_sum << int_overflow << min << max << distinct;
+  }
+
+  void load(iarchive& iarc) {
+    iarc >> count >> sum >> int_sum >> int_overflow >> min >> max >> distinct;
+  }
+};
+
+/**
+ * \ingroup group_graph_database
+ * The number of non NULL values of an INT or DOUBLE field in each of
+ * nbins equal bins covering [lo, hi), and the number of values below lo
+ * and from hi on. Histograms of disjoint sets of rows with the same bins
+ * add up with +=.
+ */
+struct graph_field_histogram {
+  double lo, hi;
+  std::vector<uint64_t> bins;
+  uint64_t below, above;
+  // set by += when other has different bins, whose counts are dropped.
+  // Not serialized.
+  bool mismatched;
+
+  static const size_t MAX_BINS = 1 << 16;
+
+  graph_field_histogram(double lo = 0, double hi = 0, size_t nbins = 0)
+      : lo(lo), hi(hi), bins(nbins, 0), below(0), above(0), mismatched(false) { }
+
+  /// Returns true if lo < hi are finite and there are 1 to MAX_BINS bins.
+  bool valid() const;
+
+  /// Adds a value. NULL, NaN and values of other types are skipped.
+  void add(const graph_value& value);
+
+  /// Returns the lower bound of bin i.
+  inline double bin_lo(size_t i) const { return lo + (hi - lo) * i / bins.size(); }
+
+  /// Adds the counts of other. A histogram without bins takes those of
+  /// other. Sets mismatched instead if the bins differ.
+  graph_field_histogram& operator+=(const graph_field_histogram& other);
+
+  void save(oarchive& oarc) const {
+    oarc << lo << hi << bins << below << above;
+  }
+
+  void load(iarchive& iarc) {
+    iarc >> lo >> hi >> bins >> below >> above;
+  }
+};
+
+/**
+ * \ingroup group_graph_database
+ * The number of vertices of each degree. Distributions of disjoint sets of
+ * vertices add up with +=.
+ */
+struct graph_degree_distribution {
+  std::map<uint64_t, uint64_t> counts;
+
+  graph_degree_distribution& operator+=(const graph_degree_distribution& other) {
+    std::map<uint64_t, uint64_t>::const_iterator it;
+    for (it = other.counts.begin(); it != other.counts.end(); ++it) {
+      counts[it->first] += it->second;
+    }
+    return *this;
+  }
+
+  void save(oarchive& oarc) const { oarc << counts; }
+  void load(iarchive& iarc) { iarc >> counts; }
+};
+} // namespace graphlab
+#endif
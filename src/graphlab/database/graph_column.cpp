@@ -0,0 +1,429 @@
+#include <graphlab/database/graph_column.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace graphlab {
+  graph_column::graph_column() : _type(INT_TYPE), _size(0), arena(NULL),
+                                 indexed(false), ordered(false) { }
+
+  graph_column::graph_column(graph_datatypes_enum type, size_t n,
+                             graph_payload_arena* arena) :
+      _type(type), _size(0), arena(arena), indexed(false), ordered(false) {
+    resize(n);
+  }
+
+  bool graph_column::all_null() const {
+    for (size_t i = 0; i < _size; ++i) {
+      if (!nulls.get(i))
+        return false;
+    }
+    return true;
+  }
+
+  size_t graph_column::data_length(size_t i) const {
+    DCHECK_LT(i, _size);
+    switch(_type) {
+     case STRING_TYPE:
+     case BLOB_TYPE: return slots[i].len;
+     case DOUBLE_TYPE: return sizeof(graph_double_t);
+     case INT_TYPE: return sizeof(graph_int_t);
+     case VID_TYPE: return sizeof(graph_vid_t);
+     default: return 0;
+    }
+  }
+
+  const char* graph_column::get_raw_pointer(size_t i) const {
+    if (is_null(i)) {
+      return NULL;
+    } else if (is_scalar_graph_datatype(_type)) {
+      return reinterpret_cast<const char*>(&scalars[i]);
+    } else {
+      return payload(slots[i]);
+    }
+  }
+
+  void graph_column::reserve_nulls(size_t n) {
+    if (n > nulls.size()) {
+      nulls.resize(std::max(n, std::max(nulls.size() * 2, (size_t)64)));
+    }
+  }
+
+  void graph_column::release_payload(size_t i) {
+    payload_slot& slot = slots[i];
+    if (!slot.is_inline()) {
+      arena->release(slot.len);
+    }
+    slot.len = 0;
+  }
+
+  void graph_column::index_insert(size_t i) {
+    if (nulls.get(i))
+      return;
+    if (indexed) {
+      index.insert(get_raw_pointer(i), data_length(i), i);
+    }
+    if (ordered) {
+      ordered_index.insert(get_raw_pointer(i), i);
+    }
+  }
+
+  void graph_column::index_erase(size_t i) {
+    if (nulls.get(i))
+      return;
+    if (indexed) {
+      index.erase(get_raw_pointer(i), data_length(i), i);
+    }
+    if (ordered) {
+      ordered_index.erase(get_raw_pointer(i), i);
+    }
+  }
+
+  void graph_column::push_back_null() {
+    reserve_nulls(_size + 1);
+    nulls.set_bit_unsync(_size);
+    if (is_scalar_graph_datatype(_type)) {
+      scalar_type zero;
+      memset(&zero, 0, sizeof(zero));
+      scalars.push_back(zero);
+    } else {
+      payload_slot empty;
+      memset(&empty, 0, sizeof(empty));
+      slots.push_back(empty);
+    }
+    ++_size;
+  }
+
+  bool graph_column::push_back(const graph_value& val) {
+    push_back_null();
+    return set(_size - 1, val);
+  }
+
+  void graph_column::get(size_t i, graph_value& out) const {
+    DCHECK_LT(i, _size);
+    out.free_data();
+    out.init(_type);
+    if (is_null(i))
+      return;
+    if (is_scalar_graph_datatype(_type)) {
+      out._data = scalars[i];
+      out._null_value = false;
+    } else {
+      out.set_val(payload(slots[i]), slots[i].len);
+    }
+  }
+
+  void graph_column::get_ref(size_t i, graph_value& out) const {
+    DCHECK_LT(i, _size);
+    if (is_scalar_graph_datatype(_type) || is_null(i)) {
+      get(i, out);
+    } else {
+      out.free_data();
+      out.init(_type);
+      out.borrow(payload(slots[i]), slots[i].len);
+    }
+  }
+
+  bool graph_column::set(size_t i, const graph_value& val) {
+    DCHECK_LT(i, _size);
+    if (val.type() != _type) {
+      return false;
+    }
+    if (val.is_null()) {
+      set_null(i);
+      return true;
+    }
+    index_erase(i);
+    if (is_scalar_graph_datatype(_type)) {
+      scalars[i] = val._data;
+    } else {
+      ASSERT_LE(val._len, (size_t)0xffffffffu);
+      release_payload(i);
+      payload_slot& slot = slots[i];
+      slot.len = val._len;
+      if (slot.is_inline()) {
+        memmove(slot.data, val._data.bytes, val._len);
+      } else {
+        ASSERT_TRUE(arena != NULL);
+        slot.set_handle(arena->allocate(val._data.bytes, val._len));
+      }
+    }
+    nulls.clear_bit_unsync(i);
+    index_insert(i);
+    return true;
+  }
+
+  void graph_column::set_null(size_t i) {
+    DCHECK_LT(i, _size);
+    index_erase(i);
+    if (!is_scalar_graph_datatype(_type) && !nulls.get(i)) {
+      release_payload(i);
+    }
+    nulls.set_bit_unsync(i);
+  }
+
+  bool graph_column::fill(const graph_value& val) {
+    if (val.type() != _type) {
+      return false;
+    }
+    for (size_t i = 0; i < _size; ++i) {
+      set(i, val);
+    }
+    return true;
+  }
+
+  void graph_column::resize(size_t n) {
+    if (n < _size) {
+      if (indexed || ordered || !is_scalar_graph_datatype(_type)) {
+        for (size_t i = n; i < _size; ++i) {
+          set_null(i);
+        }
+      }
+      if (is_scalar_graph_datatype(_type)) {
+        scalars.resize(n);
+      } else {
+        slots.resize(n);
+      }
+      _size = n;
+    } else {
+      if (is_scalar_graph_datatype(_type)) {
+        scalars.reserve(n);
+      } else {
+        slots.reserve(n);
+      }
+      while (_size < n) {
+        push_back_null();
+      }
+    }
+  }
+
+  void graph_column::clear() {
+    index.clear();
+    ordered_index.clear();
+    resize(0);
+    nulls = dense_bitset();
+    scalars.clear();
+    slots.clear();
+  }
+
+  bool graph_column::enable_index() {
+    if (!graph_field_index::supports(_type)) {
+      return false;
+    }
+    indexed = true;
+    index = graph_field_index(_type);
+    for (size_t i = 0; i < _size; ++i) {
+      index_insert(i);
+    }
+    return true;
+  }
+
+  bool graph_column::enable_ordered_index() {
+    if (!graph_ordered_index::supports(_type)) {
+      return false;
+    }
+    ordered = true;
+    ordered_index = graph_ordered_index(_type);
+    std::vector<graph_ordered_index::entry_type> entries;
+    entries.reserve(_size);
+    for (size_t i = 0; i < _size; ++i) {
+      if (!nulls.get(i)) {
+        entries.push_back(graph_ordered_index::entry_type(
+            graph_ordered_index::encode(_type, get_raw_pointer(i)), i));
+      }
+    }
+    ordered_index.assign(entries);
+    return true;
+  }
+
+  void graph_column::rebuild_indexes() {
+    if (indexed) {
+      enable_index();
+    }
+    if (ordered) {
+      enable_ordered_index();
+    }
+  }
+
+  bool graph_column::find(const graph_value& key, std::vector<size_t>& out) const {
+    if (!indexed || key.type() != _type) {
+      return false;
+    }
+    if (key.is_null()) {
+      return true;
+    }
+    const char* data = reinterpret_cast<const char*>(key.get_raw_pointer());
+    size_t len = key.data_length();
+    size_t first = out.size();
+    index.find(data, len, out);
+    if (index.is_hashed()) {
+      // drop the rows of other values with the same hash
+      size_t kept = first;
+      for (size_t i = first; i < out.size(); ++i) {
+        if (data_length(out[i]) == len && memcmp(get_raw_pointer(out[i]), data, len) == 0) {
+          out[kept++] = out[i];
+        }
+      }
+      out.resize(kept);
+    }
+    return true;
+  }
+
+  bool graph_column::range(const graph_value& lo, const graph_value& hi,
+                           std::vector<size_t>& out) const {
+    if (!ordered || lo.type() != _type || hi.type() != _type) {
+      return false;
+    }
+    ordered_index.range(reinterpret_cast<const char*>(lo.get_raw_pointer()),
+                        reinterpret_cast<const char*>(hi.get_raw_pointer()),
+                        out);
+    return true;
+  }
+
+  bool graph_column::topk(size_t k, bool largest, std::vector<size_t>& out) const {
+    if (!ordered) {
+      return false;
+    }
+    ordered_index.topk(k, largest, out);
+    return true;
+  }
+
+  void graph_column::relocate(graph_payload_arena& to) {
+    for (size_t i = 0; i < slots.size(); ++i) {
+      payload_slot& slot = slots[i];
+      if (!nulls.get(i) && !slot.is_inline()) {
+        slot.set_handle(to.allocate(arena->get(slot.handle()), slot.len));
+      }
+    }
+  }
+
+  void graph_column::region_slots(size_t& region_offset,
+                                  std::vector<payload_slot>& out) const {
+    out.assign(slots.begin(), slots.begin() + _size);
+    for (size_t i = 0; i < _size; ++i) {
+      payload_slot& slot = out[i];
+      if (!nulls.get(i) && !slot.is_inline()) {
+        slot.set_handle(region_offset);
+        region_offset += slot.len;
+      }
+    }
+  }
+
+  void graph_column::save(oarchive& oarc, size_t& region_offset) const {
+    oarc << _type << indexed << ordered << _size << nulls;
+    if (is_scalar_graph_datatype(_type)) {
+      if (_size > 0) {
+        oarc.write(reinterpret_cast<const char*>(&scalars[0]),
+                   sizeof(scalar_type) * _size);
+      }
+    } else {
+      std::vector<payload_slot> relative;
+      region_slots(region_offset, relative);
+      if (_size > 0) {
+        oarc.write(reinterpret_cast<const char*>(&relative[0]),
+                   sizeof(payload_slot) * _size);
+      }
+    }
+  }
+
+  void graph_column::save_image(graph_image_writer& writer, size_t& region_offset) const {
+    writer.write<int32_t>(_type);
+    writer.write<uint8_t>(indexed);
+    writer.write<uint8_t>(ordered);
+    writer.write<uint64_t>(_size);
+    writer.write_archived(nulls);
+    if (is_scalar_graph_datatype(_type)) {
+      writer.write_vector(scalars);
+    } else {
+      std::vector<payload_slot> relative;
+      region_slots(region_offset, relative);
+      writer.write_vector(relative);
+    }
+  }
+
+  void graph_column::save_payloads(graph_image_writer& writer) const {
+    if (is_scalar_graph_datatype(_type))
+      return;
+    for (size_t i = 0; i < _size; ++i) {
+      const payload_slot& slot = slots[i];
+      if (!nulls.get(i) && !slot.is_inline()) {
+        writer.write_raw(arena->get(slot.handle()), slot.len);
+      }
+    }
+  }
+
+  bool graph_column::load_image(graph_image_reader& reader) {
+    clear();
+    int32_t type;
+    uint8_t is_indexed, is_ordered;
+    uint64_t size;
+    reader.read(type);
+    reader.read(is_indexed);
+    reader.read(is_ordered);
+    reader.read(size);
+    _type = (graph_datatypes_enum)type;
+    indexed = is_indexed;
+    ordered = is_ordered;
+    _size = size;
+    reader.read_archived(nulls);
+    if (type < 0 || type >= UNKNOWN_TYPE) {
+      return false;
+    }
+    // the null flags may cover more than _size values, see reserve_nulls()
+    if (is_scalar_graph_datatype(_type)) {
+      reader.read_vector(scalars);
+      return reader.good() && scalars.size() == _size && nulls.size() >= _size;
+    } else {
+      reader.read_vector(slots);
+      return reader.good() && slots.size() == _size && nulls.size() >= _size;
+    }
+  }
+
+  bool graph_column::payloads_within(size_t region_size) const {
+    for (size_t i = 0; i < slots.size(); ++i) {
+      const payload_slot& slot = slots[i];
+      if (!nulls.get(i) && !slot.is_inline() &&
+          (slot.handle() > region_size || slot.len > region_size - slot.handle())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void graph_column::save_payloads(oarchive& oarc) const {
+    if (is_scalar_graph_datatype(_type))
+      return;
+    for (size_t i = 0; i < _size; ++i) {
+      const payload_slot& slot = slots[i];
+      if (!nulls.get(i) && !slot.is_inline()) {
+        oarc.write(arena->get(slot.handle()), slot.len);
+      }
+    }
+  }
+
+  void graph_column::load(iarchive& iarc) {
+    clear();
+    iarc >> _type >> indexed >> ordered >> _size >> nulls;
+    if (is_scalar_graph_datatype(_type)) {
+      scalars.resize(_size);
+      if (_size > 0) {
+        iarc.read(reinterpret_cast<char*>(&scalars[0]),
+                  sizeof(scalar_type) * _size);
+      }
+    } else {
+      slots.resize(_size);
+      if (_size > 0) {
+        iarc.read(reinterpret_cast<char*>(&slots[0]),
+                  sizeof(payload_slot) * _size);
+      }
+    }
+  }
+
+  void graph_column::rebase(graph_payload_arena::handle_type base) {
+    for (size_t i = 0; i < slots.size(); ++i) {
+      payload_slot& slot = slots[i];
+      if (!nulls.get(i) && !slot.is_inline()) {
+        slot.set_handle(slot.handle() + base);
+      }
+    }
+  }
+} // namespace graphlab
@@ -0,0 +1,323 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_COLUMN_HPP
+#define GRAPHLAB_DATABASE_GRAPH_COLUMN_HPP
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/database/graph_value.hpp>
+#include <graphlab/database/graph_payload_arena.hpp>
+#include <graphlab/database/graph_field_index.hpp>
+#include <graphlab/database/graph_ordered_index.hpp>
+#include <graphlab/database/graph_shard_image.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/logger/assertions.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * Stores the values of a single field for all the vertices (or edges)
+ * of a shard.
+ *
+ * Scalar fields (VID/INT/DOUBLE) are stored in one contiguous array of
+ * 8 byte slots. String and blob fields are stored in an array of fixed
+ * size slots: payloads of up to <code>INLINE_SIZE</code> bytes live in the
+ * slot itself, longer ones are copied into a \ref graph_payload_arena
+ * shared by all the columns of a shard, and the slot keeps their handle.
+ * The null flags of all values are kept in a separate bitmap, so a column
+ * costs one bit of metadata per value instead of the type/length/null
+ * header carried by every <code>graph_value</code>.
+ *
+ * String and blob columns must be given an arena (see set_arena())
+ * before storing values longer than <code>INLINE_SIZE</code>.
+ *
+ * INT, VID and STRING columns may keep a \ref graph_field_index of their
+ * values (see enable_index()), and INT and DOUBLE columns a
+ * \ref graph_ordered_index (see enable_ordered_index()). Indexes are
+ * updated by every modification of the column.
+ *
+ * \note
+ *  This object is not thread safe.
+ */
+class graph_column {
+ public:
+  typedef graph_value::value_union_type scalar_type;
+
+  /// Payloads up to this length are stored without using the arena.
+  static const size_t INLINE_SIZE = 16;
+
+  /// Creates an empty INT column.
+  graph_column();
+
+  /// Creates a column of the given type holding n NULL values.
+  explicit graph_column(graph_datatypes_enum type, size_t n = 0,
+                        graph_payload_arena* arena = NULL);
+
+  /// Sets the arena storing the long payloads of this column.
+  inline void set_arena(graph_payload_arena* arena) {
+    this->arena = arena;
+  }
+
+  /// Returns the datatype of the column.
+  inline graph_datatypes_enum type() const {
+    return _type;
+  }
+
+  /// Returns the number of values in the column.
+  inline size_t size() const {
+    return _size;
+  }
+
+  /// Returns true if the i'th value is NULL.
+  inline bool is_null(size_t i) const {
+    DCHECK_LT(i, _size);
+    return nulls.get(i);
+  }
+
+  /// Returns true if all values in the column are NULL.
+  bool all_null() const;
+
+  /**
+   * Returns the number of bytes of the i'th value. Scalars have fixed
+   * width, strings and blobs return the payload length.
+   */
+  size_t data_length(size_t i) const;
+
+  /**
+   * Returns a pointer to the payload of the i'th value, or NULL if the value
+   * is NULL. The pointer is invalidated by any modification of the column.
+   */
+  const char* get_raw_pointer(size_t i) const;
+
+  /// Appends a NULL value to the end of the column.
+  void push_back_null();
+
+  /**
+   * Appends a copy of val to the end of the column. Returns false if the
+   * type of val does not match the column, in which case a NULL is appended.
+   */
+  bool push_back(const graph_value& val);
+
+  /**
+   * Copies the i'th value into out. out is re-initialized with the type
+   * of the column.
+   */
+  void get(size_t i, graph_value& out) const;
+
+  /**
+   * Same as get(), but string and blob values in out borrow the payload
+   * from the column instead of copying it (see graph_value::borrow()).
+   * out is only valid until the column or its arena is modified.
+   */
+  void get_ref(size_t i, graph_value& out) const;
+
+  /**
+   * Overwrites the i'th value with val. NULL values are copied as well.
+   * Returns false if the type of val does not match the column.
+   */
+  bool set(size_t i, const graph_value& val);
+
+  /// Sets the i'th value to NULL.
+  void set_null(size_t i);
+
+  /// Sets every value in the column to a copy of val.
+  bool fill(const graph_value& val);
+
+  /// Resizes the column to n values. New values are NULL.
+  void resize(size_t n);
+
+  /// Removes all values. The type of the column is preserved.
+  void clear();
+
+  // ----------- Secondary Index API ----------------
+  /**
+   * Builds a hash index on the values of the column, and keeps it up to
+   * date from then on. Returns false if the type of the column cannot
+   * be indexed (see graph_field_index::supports()).
+   */
+  bool enable_index();
+
+  /// Returns true if the column keeps an index of its values.
+  inline bool is_indexed() const {
+    return indexed;
+  }
+
+  /**
+   * Appends to out the positions of the values equal to key. Returns
+   * false if the column is not indexed or key has a different type.
+   * A NULL key matches nothing.
+   */
+  bool find(const graph_value& key, std::vector<size_t>& out) const;
+
+  /**
+   * Builds an ordered index on the values of the column, and keeps it up
+   * to date from then on. Returns false if the type of the column cannot
+   * be ordered (see graph_ordered_index::supports()).
+   */
+  bool enable_ordered_index();
+
+  /// Returns true if the column keeps an ordered index of its values.
+  inline bool is_ordered() const {
+    return ordered;
+  }
+
+  /**
+   * Appends to out the positions of the values in [lo, hi] in ascending
+   * order. A NULL bound leaves that end open. Returns false if the column
+   * is not ordered or a bound has a different type.
+   */
+  bool range(const graph_value& lo, const graph_value& hi,
+             std::vector<size_t>& out) const;
+
+  /**
+   * Appends to out the positions of the k largest (or smallest) values,
+   * from the largest (or smallest) one. Returns false if the column is
+   * not ordered.
+   */
+  bool topk(size_t k, bool largest, std::vector<size_t>& out) const;
+
+  /// Rebuilds the indexes enabled on the column. See load().
+  void rebuild_indexes();
+
+  // ----------- Column scan API ----------------
+  /**
+   * Returns the dense array of scalar slots. Only valid for scalar columns.
+   * Slots of NULL values have unspecified contents.
+   */
+  inline scalar_type* scalar_data() {
+    ASSERT_TRUE(is_scalar_graph_datatype(_type));
+    return _size == 0 ? NULL : &scalars[0];
+  }
+
+  inline const scalar_type* scalar_data() const {
+    ASSERT_TRUE(is_scalar_graph_datatype(_type));
+    return _size == 0 ? NULL : &scalars[0];
+  }
+
+  /// Returns the null bitmap. Bit i is set when value i is NULL.
+  inline const dense_bitset& null_bitmap() const {
+    return nulls;
+  }
+
+  // ----------- Payload Management API ----------------
+  /**
+   * Copies the long payloads of this column into the arena to, and
+   * points the column to the copies. The caller is responsible for
+   * swapping the arenas afterwards.
+   */
+  void relocate(graph_payload_arena& to);
+
+  // ----------- Serialization API ----------------
+  /**
+   * Saves the column without the long payloads. Handles are replaced by
+   * offsets into a region starting at region_offset, which is advanced by
+   * the total length of the payloads of the column. The payloads are
+   * written by save_payloads() in the same order.
+   */
+  void save(oarchive& oarc, size_t& region_offset) const;
+
+  /// Writes the long payloads in the order expected by save().
+  void save_payloads(oarchive& oarc) const;
+
+  /**
+   * Loads a column written by save(). The long payloads are addressed by
+   * their offset in the region until rebase() is called with the handle
+   * of the region. The indexes of the column are empty until
+   * rebuild_indexes() is called, once the payloads are in place.
+   */
+  void load(iarchive& iarc);
+
+  /// Adds base to the handles of all long payloads.
+  void rebase(graph_payload_arena::handle_type base);
+
+  /// Same as save(), into a shard image.
+  void save_image(graph_image_writer& writer, size_t& region_offset) const;
+
+  /// Same as save_payloads(), into a shard image.
+  void save_payloads(graph_image_writer& writer) const;
+
+  /// Same as load(), from a shard image. Returns false if the image is
+  /// truncated, the type is unknown, or the values, slots and null flags
+  /// of the column disagree in number.
+  bool load_image(graph_image_reader& reader);
+
+  /// Returns true if the long payloads of a loaded column, before
+  /// rebase(), all lie in a region of region_size bytes.
+  bool payloads_within(size_t region_size) const;
+
+ private:
+  /**
+   * Storage of a string / blob value. The payload is in data if len is at
+   * most INLINE_SIZE, otherwise data holds its handle in the arena.
+   */
+  struct payload_slot {
+    uint32_t len;
+    char data[INLINE_SIZE];
+
+    inline bool is_inline() const {
+      return len <= INLINE_SIZE;
+    }
+
+    inline graph_payload_arena::handle_type handle() const {
+      graph_payload_arena::handle_type ret;
+      memcpy(&ret, data, sizeof(ret));
+      return ret;
+    }
+
+    inline void set_handle(graph_payload_arena::handle_type h) {
+      memcpy(data, &h, sizeof(h));
+    }
+  };
+
+  /**
+   * Copies the slots into out, replacing the handles of long payloads
+   * by offsets into a region starting at region_offset. See save().
+   */
+  void region_slots(size_t& region_offset, std::vector<payload_slot>& out) const;
+
+  /// Grows the null bitmap geometrically so that it covers n bits.
+  void reserve_nulls(size_t n);
+
+  /// Returns a pointer to the payload of slot.
+  inline const char* payload(const payload_slot& slot) const {
+    return slot.is_inline() ? slot.data : arena->get(slot.handle());
+  }
+
+  /// Releases the arena space used by the payload of slot i.
+  void release_payload(size_t i);
+
+  /// Adds (resp. removes) the non NULL value i to (resp. from) the indexes.
+  void index_insert(size_t i);
+  void index_erase(size_t i);
+
+  graph_datatypes_enum _type;
+
+  size_t _size;
+
+  /// Bit i is set if the i'th value is NULL. May be longer than _size.
+  dense_bitset nulls;
+
+  /// Payload of scalar columns.
+  std::vector<scalar_type> scalars;
+
+  /// Payload of string and blob columns.
+  std::vector<payload_slot> slots;
+
+  /// Storage of the long payloads. Not owned.
+  graph_payload_arena* arena;
+
+  /// True if index is maintained.
+  bool indexed;
+
+  /// Positions of the values, by value.
+  graph_field_index index;
+
+  /// True if ordered_index is maintained.
+  bool ordered;
+
+  /// Positions of the values, in order of value.
+  graph_ordered_index ordered_index;
+};
+} // namespace graphlab
+#endif
@@ -61,9 +61,31 @@ class graph_database {
      }
    };
   
+   /**
+    * A vertex or an edge returned by a scan. id is the vid or the eid;
+    * source and target are the ends of an edge.
+    */
+   struct scan_descriptor {
+     uint64_t id;
+     graph_vid_t source, target;
+     graph_row data;
+     void save (oarchive& oarc) const {
+       oarc << id << data;
+       if (!data.is_vertex()) oarc << source << target;
+     }
+     void load (iarchive& iarc)  {
+       iarc >> id >> data;
+       if (!data.is_vertex()) iarc >> source >> target;
+       else source = target = id;
+     }
+   };
+
    // TODO: Internal struct between client and server holding vertex mirror information. This type should be moved to somewhere else, hidden from the public graph database interface.
    typedef std::pair<graph_vid_t, std::vector<graph_shard_id_t> > mirror_insert_descriptor;
 
+   /// A (vid or eid, field value) pair returned by range and top-k queries.
+   typedef std::pair<uint64_t, graph_value> id_value_pair;
+
  public:
   virtual ~graph_database() { }
 
@@ -124,6 +146,27 @@ class graph_database {
   virtual bool set_edges (const std::vector< std::pair<graph_eid_t, graph_row> >& pairs,
                           std::vector<int>& errorcodes) = 0;
 
+  /**
+   * Fills out[i] with the adjacency of vids[i]. Returns false if any
+   * lookup failed, in which case errorcodes[i] holds its error code.
+   *
+   * \note For database implementors: A default implementation calling
+   * \ref get_vertex_adj() for each vid is provided.
+   */
+  virtual bool get_vertices_adj(const std::vector<graph_vid_t>& vids, bool in_edges,
+                                std::vector<vertex_adj_descriptor>& out,
+                                std::vector<int>& errorcodes) {
+    bool success = true;
+    out.clear();
+    out.resize(vids.size());
+    errorcodes.resize(vids.size());
+    for (size_t i = 0; i < vids.size(); ++i) {
+      errorcodes[i] = get_vertex_adj(vids[i], in_edges, out[i]);
+      success &= (errorcodes[i] == 0);
+    }
+    return success;
+  }
+
   // ---------------------- Base Utility Function -------------------------
   /**
    * Returns the index of the vertex column with the given field name. 
@@ -1,80 +1,397 @@
 #ifndef GRAPHLAB_DATABASE_GRAPH_EDGE_INDEX
 #define GRAPHLAB_DATABASE_GRAPH_EDGE_INDEX
 #include <vector>
+#include <algorithm>
 #include <graphlab/database/basic_types.hpp>
 #include <graphlab/database/graph_vertex.hpp>
 #include <graphlab/database/graph_edge.hpp>
+#include <graphlab/database/graph_shard_image.hpp>
 #include <graphlab/serialization/iarchive.hpp>
 #include <graphlab/serialization/oarchive.hpp>
 #include <boost/unordered_map.hpp>
 #include <graphlab/macros_def.hpp>
 namespace graphlab {
-  /** 
+  /**
+   * \ingroup group_graph_database
+   * A non-owning view of a contiguous list of local edge ids.
+   * The view is invalidated when the index it points into is modified.
+   */
+  struct graph_leid_span {
+    const graph_leid_t* ptr;
+    size_t len;
+
+    graph_leid_span() : ptr(NULL), len(0) { }
+    graph_leid_span(const graph_leid_t* ptr, size_t len) : ptr(ptr), len(len) { }
+
+    inline size_t size() const { return len; }
+    inline bool empty() const { return len == 0; }
+    inline const graph_leid_t* begin() const { return ptr; }
+    inline const graph_leid_t* end() const { return ptr + len; }
+    inline graph_leid_t operator[](size_t i) const { return ptr[i]; }
+  };
+
+  /**
    * \ingroup group_graph_database_sharedmem
-   * An index on edge id. 
+   * An index on edge id.
    *
    * This class provides adjacency look up in one shard.
+   *
+   * The index has two parts. The mutable part is a hash map from vid to
+   * a vector of edge ids, which is cheap to append to during ingress.
+   * Calling <code>freeze()</code> moves everything into compressed
+   * sparse row (out edges) and column (in edges) arrays: the sorted vids,
+   * an offset array and one flat array of edge ids. Edges added after a
+   * freeze go into the mutable part again, which then acts as a delta
+   * until the next freeze.
+   *
+   * An index loaded from a shard image serves the compressed arrays
+   * directly from the mapped image. They are copied into owned memory at
+   * the next freeze.
    */
   class graph_edge_index {
    public:
      /**
-      * Fills in the query vid's incoming and outgoing edge index (in this shard)
-      * into <code>in</code> and <code>out</code> vectors.
-      * Skip the incoming (or outgoing) edge if getIn(or getOut) is false.
+      * Fills in the query vid's incoming or outgoing edge index (in this shard)
+      * into <code>out</code>. Gets the incoming edges if getIn is true, and
+      * outgoing edges otherwise.
       */
      void get_vertex_adj (std::vector<graph_leid_t>& out,
                           graph_vid_t vid, bool getIn) const {
-       if (getIn && inEdges.find(vid) != inEdges.end()) {
-           out = inEdges.find(vid)->second;
+       graph_leid_span frozen, delta;
+       get_vertex_adj_spans(vid, getIn, frozen, delta);
+       out.clear();
+       out.reserve(frozen.size() + delta.size());
+       out.insert(out.end(), frozen.begin(), frozen.end());
+       out.insert(out.end(), delta.begin(), delta.end());
+     }
+
+     /**
+      * Returns the query vid's incoming or outgoing edge index without
+      * copying. <code>frozen</code> points into the compressed arrays, and
+      * <code>delta</code> to the edges added since the last freeze.
+      */
+     void get_vertex_adj_spans (graph_vid_t vid, bool getIn,
+                                graph_leid_span& frozen,
+                                graph_leid_span& delta) const {
+       if (getIn) {
+         frozen = frozen_in.find(vid);
+         delta = find_delta(inEdges, vid);
+       } else {
+         frozen = frozen_out.find(vid);
+         delta = find_delta(outEdges, vid);
        }
-       if (!getIn && outEdges.find(vid) != outEdges.end()) {
-           out = outEdges.find(vid)->second;
+     }
+
+     /**
+      * Same as get_vertex_adj_spans() for n vids in ascending order. The
+      * compressed arrays are walked once, forward, instead of being
+      * searched from the start for every vid.
+      */
+     void get_vertices_adj_spans (const graph_vid_t* vids, size_t n, bool getIn,
+                                  graph_leid_span* frozen,
+                                  graph_leid_span* delta) const {
+       const compressed_adjacency& index = getIn ? frozen_in : frozen_out;
+       const delta_map_type& deltas = getIn ? inEdges : outEdges;
+       index.find_sorted(vids, n, frozen);
+       for (size_t i = 0; i < n; ++i) {
+         delta[i] = find_delta(deltas, vids[i]);
        }
-    }
+     }
 
      size_t num_in_edges(graph_vid_t vid) const {
-       if (inEdges.find(vid) != inEdges.end()) {
-         return inEdges.find(vid)->second.size();
-       } else {
-         return 0;
-       }
+       return frozen_in.find(vid).size() + find_delta(inEdges, vid).size();
      }
 
      size_t num_out_edges(graph_vid_t vid) const {
-       if (outEdges.find(vid) != outEdges.end()) {
-         return outEdges.find(vid)->second.size();
-       } else {
-         return 0;
-       }
+       return frozen_out.find(vid).size() + find_delta(outEdges, vid).size();
      }
 
      /**
-      * Update the index by adding an edge with (source, target, pos) in this shard. 
+      * Update the index by adding an edge with (source, target, pos) in this shard.
       */
     inline void add_edge(graph_vid_t source, graph_vid_t target, graph_leid_t pos) {
       outEdges[source].push_back(pos);
       inEdges[target].push_back(pos);
     }
 
+    /**
+     * Merge all the edges added since the last freeze into the compressed
+     * arrays, and release the mutable part of the index.
+     */
+    inline void freeze() {
+      frozen_in.merge(inEdges);
+      frozen_out.merge(outEdges);
+      boost::unordered_map<graph_vid_t, std::vector<graph_leid_t> >().swap(inEdges);
+      boost::unordered_map<graph_vid_t, std::vector<graph_leid_t> >().swap(outEdges);
+    }
+
+    /// Returns true if there are no edges added since the last freeze.
+    inline bool is_frozen() const {
+      return inEdges.empty() && outEdges.empty();
+    }
+
     inline void save (oarchive& oarc) const {
-       oarc << inEdges << outEdges;
+       oarc << inEdges << outEdges << frozen_in << frozen_out;
      }
 
     inline void load (iarchive& iarc) {
-       iarc >> inEdges >> outEdges;
+       iarc >> inEdges >> outEdges >> frozen_in >> frozen_out;
      }
 
     inline void clear() {
       inEdges.clear();
       outEdges.clear();
+      frozen_in.clear();
+      frozen_out.clear();
+    }
+
+    /**
+     * Writes the index into a shard image. The edges added since the last
+     * freeze are merged into the written arrays, so the loaded index is
+     * frozen.
+     */
+    inline void save_image(graph_image_writer& writer) const {
+      save_image_helper(writer, frozen_in, inEdges);
+      save_image_helper(writer, frozen_out, outEdges);
+    }
+
+    /**
+     * Loads an index written by save_image(), pointing into the mapped
+     * image. Returns false, leaving the index empty, if the image is
+     * truncated or inconsistent, or refers to edges past num_edges.
+     */
+    inline bool load_image(graph_image_reader& reader, size_t num_edges) {
+      clear();
+      if (!frozen_in.load_image(reader, num_edges) ||
+          !frozen_out.load_image(reader, num_edges)) {
+        clear();
+        return false;
+      }
+      return true;
     }
 
    private:
+    typedef boost::unordered_map<graph_vid_t, std::vector<graph_leid_t> > delta_map_type;
+
+    /**
+     * Compressed adjacency arrays. The edges of vids[i] are
+     * leids[offsets[i]] ... leids[offsets[i+1]-1].
+     *
+     * When mapped is set, the arrays are read from a mapped shard image
+     * instead of the vectors, which are empty.
+     */
+    struct compressed_adjacency {
+      std::vector<graph_vid_t> vids;
+      std::vector<graph_leid_t> offsets;
+      std::vector<graph_leid_t> leids;
+
+      bool mapped;
+      const graph_vid_t* mapped_vids;
+      const graph_leid_t* mapped_offsets;
+      const graph_leid_t* mapped_leids;
+      size_t mapped_nvids;
+      size_t mapped_nleids;
+
+      compressed_adjacency() : mapped(false), mapped_vids(NULL), mapped_offsets(NULL),
+                               mapped_leids(NULL), mapped_nvids(0), mapped_nleids(0) { }
+
+      inline size_t num_vids() const {
+        return mapped ? mapped_nvids : vids.size();
+      }
+      inline size_t num_leids() const {
+        return mapped ? mapped_nleids : leids.size();
+      }
+      inline const graph_vid_t* vid_data() const {
+        return mapped ? mapped_vids : (vids.empty() ? NULL : &vids[0]);
+      }
+      inline const graph_leid_t* offset_data() const {
+        return mapped ? mapped_offsets : (offsets.empty() ? NULL : &offsets[0]);
+      }
+      inline const graph_leid_t* leid_data() const {
+        return mapped ? mapped_leids : (leids.empty() ? NULL : &leids[0]);
+      }
+
+      inline graph_leid_span find(graph_vid_t vid) const {
+        const graph_vid_t* begin = vid_data();
+        const graph_vid_t* end = begin + num_vids();
+        const graph_vid_t* it = std::lower_bound(begin, end, vid);
+        if (it == end || *it != vid) {
+          return graph_leid_span();
+        }
+        size_t i = it - begin;
+        const graph_leid_t* off = offset_data();
+        return graph_leid_span(leid_data() + off[i], off[i+1] - off[i]);
+      }
+
+      /// Same as find() for n vids in ascending order, into out.
+      inline void find_sorted(const graph_vid_t* query, size_t n,
+                              graph_leid_span* out) const {
+        const graph_vid_t* begin = vid_data();
+        const graph_vid_t* end = begin + num_vids();
+        const graph_vid_t* it = begin;
+        const graph_leid_t* off = offset_data();
+        for (size_t k = 0; k < n; ++k) {
+          it = std::lower_bound(it, end, query[k]);
+          if (it == end || *it != query[k]) {
+            out[k] = graph_leid_span();
+            continue;
+          }
+          size_t i = it - begin;
+          out[k] = graph_leid_span(leid_data() + off[i], off[i+1] - off[i]);
+        }
+      }
+
+      /// Copies mapped arrays into the vectors.
+      void promote() {
+        if (!mapped) return;
+        vids.assign(mapped_vids, mapped_vids + mapped_nvids);
+        offsets.assign(mapped_offsets, mapped_offsets + (mapped_nvids > 0 ? mapped_nvids + 1 : 0));
+        leids.assign(mapped_leids, mapped_leids + mapped_nleids);
+        mapped = false;
+      }
+
+      /**
+       * Rebuild the arrays with the edges in delta appended to the
+       * existing edges of each vertex.
+       */
+      void merge(const delta_map_type& delta) {
+        if (delta.empty()) return;
+        promote();
+        std::vector<graph_vid_t> delta_vids;
+        delta_vids.reserve(delta.size());
+        foreach(const delta_map_type::value_type& kv, delta) {
+          delta_vids.push_back(kv.first);
+        }
+        std::sort(delta_vids.begin(), delta_vids.end());
+
+        size_t nedges = leids.size();
+        foreach(const delta_map_type::value_type& kv, delta) {
+          nedges += kv.second.size();
+        }
+
+        compressed_adjacency ret;
+        ret.vids.reserve(vids.size() + delta_vids.size());
+        ret.offsets.reserve(vids.size() + delta_vids.size() + 1);
+        ret.leids.reserve(nedges);
+        ret.offsets.push_back(0);
+        size_t i = 0, j = 0;
+        while (i < vids.size() || j < delta_vids.size()) {
+          graph_vid_t vid;
+          if (j == delta_vids.size() || (i < vids.size() && vids[i] <= delta_vids[j])) {
+            vid = vids[i];
+          } else {
+            vid = delta_vids[j];
+          }
+          if (i < vids.size() && vids[i] == vid) {
+            ret.leids.insert(ret.leids.end(), leids.begin() + offsets[i],
+                             leids.begin() + offsets[i+1]);
+            ++i;
+          }
+          if (j < delta_vids.size() && delta_vids[j] == vid) {
+            const std::vector<graph_leid_t>& adj = delta.find(vid)->second;
+            ret.leids.insert(ret.leids.end(), adj.begin(), adj.end());
+            ++j;
+          }
+          ret.vids.push_back(vid);
+          ret.offsets.push_back(ret.leids.size());
+        }
+        vids.swap(ret.vids);
+        offsets.swap(ret.offsets);
+        leids.swap(ret.leids);
+      }
+
+      inline void clear() {
+        vids.clear();
+        offsets.clear();
+        leids.clear();
+        mapped = false;
+      }
+
+      inline void save(oarchive& oarc) const {
+        if (mapped) {
+          compressed_adjacency copy(*this);
+          copy.promote();
+          copy.save(oarc);
+        } else {
+          oarc << vids << offsets << leids;
+        }
+      }
+
+      inline void load(iarchive& iarc) {
+        clear();
+        iarc >> vids >> offsets >> leids;
+      }
+
+      inline void save_image(graph_image_writer& writer) const {
+        writer.write_array(vid_data(), num_vids());
+        writer.write_array(offset_data(), num_vids() > 0 ? num_vids() + 1 : 0);
+        writer.write_array(leid_data(), num_leids());
+      }
+
+      // Returns false if the arrays are truncated, their sizes disagree,
+      // the vids are not strictly ascending, the offsets decrease, or a
+      // leid is not below num_edges. This reads every array once.
+      inline bool load_image(graph_image_reader& reader, size_t num_edges) {
+        clear();
+        size_t noffsets;
+        mapped_vids = reader.read_array<graph_vid_t>(mapped_nvids);
+        mapped_offsets = reader.read_array<graph_leid_t>(noffsets);
+        mapped_leids = reader.read_array<graph_leid_t>(mapped_nleids);
+        mapped = true;
+        bool valid = reader.good() &&
+            noffsets == (mapped_nvids > 0 ? mapped_nvids + 1 : 0) &&
+            (noffsets == 0 || (mapped_offsets[0] == 0 &&
+                               mapped_offsets[noffsets - 1] == mapped_nleids));
+        // find() searches the vids by bisection
+        for (size_t i = 1; valid && i < mapped_nvids; ++i) {
+          valid = mapped_vids[i - 1] < mapped_vids[i];
+        }
+        for (size_t i = 1; valid && i < noffsets; ++i) {
+          valid = mapped_offsets[i - 1] <= mapped_offsets[i];
+        }
+        for (size_t i = 0; valid && i < mapped_nleids; ++i) {
+          valid = mapped_leids[i] < num_edges;
+        }
+        if (!valid) {
+          clear();
+        }
+        return valid;
+      }
+    };
+
+    static inline void save_image_helper(graph_image_writer& writer,
+                                         const compressed_adjacency& frozen,
+                                         const delta_map_type& delta) {
+      if (delta.empty()) {
+        frozen.save_image(writer);
+      } else {
+        compressed_adjacency merged(frozen);
+        merged.merge(delta);
+        merged.save_image(writer);
+      }
+    }
+
+    static inline graph_leid_span find_delta(const delta_map_type& map, graph_vid_t vid) {
+      delta_map_type::const_iterator it = map.find(vid);
+      if (it == map.end() || it->second.empty()) {
+        return graph_leid_span();
+      }
+      return graph_leid_span(&(it->second[0]), it->second.size());
+    }
+
     // A vector where each element is a map from vid to a list of in edge ids on a shard.
-    boost::unordered_map<graph_vid_t, std::vector<graph_leid_t> > inEdges;
+    // Only holds the edges added since the last freeze.
+    delta_map_type inEdges;
 
     // A vector where each element is a map from vid to a list of out edge ids on a shard.
-    boost::unordered_map<graph_vid_t, std::vector<graph_leid_t> > outEdges;
+    // Only holds the edges added since the last freeze.
+    delta_map_type outEdges;
+
+    // Compressed in edges (CSC).
+    compressed_adjacency frozen_in;
+
+    // Compressed out edges (CSR).
+    compressed_adjacency frozen_out;
   };
 } // namespace graphlab
 #include <graphlab/macros_undef.hpp>
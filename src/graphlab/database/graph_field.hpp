@@ -15,7 +15,10 @@ namespace graphlab {
  */
 struct graph_field {
   std::string name;
+  /// Keep a hash index for lookups by value (INT/VID/STRING), on vertex fields.
   bool is_indexed;
+  /// Keep an ordered index for range and top-k queries (INT/DOUBLE).
+  bool is_ordered;
   graph_datatypes_enum type;
   // not used yet... TODO: check max_data_length for graph_value.
   size_t max_data_length; 
@@ -23,19 +26,22 @@ struct graph_field {
   inline graph_field() {}
 
   inline graph_field(std::string name, graph_datatypes_enum type) :
-     name(name), is_indexed(false), type(type), max_data_length(0) {} 
+     name(name), is_indexed(false), is_ordered(false), type(type),
+     max_data_length(0) {} 
 
   inline void save(oarchive &oarc) const {
-    oarc << name << is_indexed << type << max_data_length;
+    oarc << name << is_indexed << is_ordered << type << max_data_length;
   }
   inline void load(iarchive &iarc) {
-    iarc >> name >> is_indexed >> type >> max_data_length;
+    iarc >> name >> is_indexed >> is_ordered >> type >> max_data_length;
   }
 
   friend std::ostream& operator<<(std::ostream &strm, const graph_field& field) {
-    // TODO add is_indexed and max_data_length
+    // TODO add max_data_length
     return strm << field.name << ": "
-                << graph_datatypes_string[field.type];
+                << graph_datatypes_string[field.type]
+                << (field.is_indexed ? " (indexed)" : "")
+                << (field.is_ordered ? " (ordered)" : "");
   }
 };
 } // namespace graphlab
@@ -0,0 +1,106 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_FIELD_INDEX_HPP
+#define GRAPHLAB_DATABASE_GRAPH_FIELD_INDEX_HPP
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace graphlab {
+  /**
+   * \ingroup group_graph_database
+   * A secondary hash index on the values of one field of a shard.
+   *
+   * Maps a value to the positions of the rows holding it. INT and VID
+   * values are keyed by their 8 bytes, STRING values by a hash of their
+   * content, which stays in the column only. Lookups of a STRING value
+   * may then find rows whose value has the same hash, which the column
+   * filters out. NULL values are not indexed.
+   *
+   * The index is maintained by the \ref graph_column it belongs to, see
+   * <code>graph_column::enable_index()</code>.
+   *
+   * \note
+   *  Removing a row scans the rows sharing its value, so fields with few
+   *  distinct values are cheap to look up but costly to update.
+   */
+  class graph_field_index {
+   public:
+     /// Returns true if fields of the given type can be indexed.
+     static inline bool supports(graph_datatypes_enum type) {
+       return type == INT_TYPE || type == VID_TYPE || type == STRING_TYPE;
+     }
+
+     inline graph_field_index() : scalar(true) { }
+
+     explicit inline graph_field_index(graph_datatypes_enum type) :
+         scalar(type != STRING_TYPE) {
+       ASSERT_TRUE(supports(type));
+     }
+
+     /// Records that the row at pos holds the value in data[0, len).
+     inline void insert(const char* data, size_t len, size_t pos) {
+       map.insert(std::make_pair(key(data, len), pos));
+     }
+
+     /// Removes the record of the row at pos holding the value in data[0, len).
+     inline void erase(const char* data, size_t len, size_t pos) {
+       std::pair<map_type::iterator, map_type::iterator> range =
+           map.equal_range(key(data, len));
+       for (map_type::iterator it = range.first; it != range.second; ++it) {
+         if (it->second == pos) {
+           map.erase(it);
+           return;
+         }
+       }
+     }
+
+     /**
+      * Appends to out the positions of the rows holding the value
+      * in data[0, len), in no particular order. For STRING fields, out
+      * also gets the rows of other values with the same hash.
+      */
+     inline void find(const char* data, size_t len, std::vector<size_t>& out) const {
+       std::pair<map_type::const_iterator, map_type::const_iterator> range =
+           map.equal_range(key(data, len));
+       for (map_type::const_iterator it = range.first; it != range.second; ++it) {
+         out.push_back(it->second);
+       }
+     }
+
+     /// Returns true if the rows found may hold other values than the one looked up.
+     inline bool is_hashed() const {
+       return !scalar;
+     }
+
+     /// Returns the number of indexed (non NULL) values.
+     inline size_t size() const {
+       return map.size();
+     }
+
+     inline void clear() {
+       map.clear();
+     }
+
+   private:
+     typedef boost::unordered_multimap<uint64_t, size_t> map_type;
+
+     inline uint64_t key(const char* data, size_t len) const {
+       if (scalar) {
+         uint64_t key;
+         memcpy(&key, data, sizeof(key));
+         return key;
+       }
+       return boost::hash_range(data, data + len);
+     }
+
+     // true for INT/VID fields, false for STRING fields
+     bool scalar;
+
+     map_type map;
+  };
+} // namespace graphlab
+#endif
@@ -0,0 +1,200 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_ORDERED_INDEX_HPP
+#define GRAPHLAB_DATABASE_GRAPH_ORDERED_INDEX_HPP
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/logger/assertions.hpp>
+
+namespace graphlab {
+  /**
+   * \ingroup group_graph_database
+   * An ordered index on the values of one INT or DOUBLE field of a shard,
+   * answering range and top-k queries.
+   *
+   * Values are encoded into unsigned 64 bit keys with the same order
+   * (see encode()), and the index keeps (key, position) entries in two
+   * parts, similar to the frozen \ref graph_edge_index:
+   *  - a sorted run, where removed entries are only flagged as dead;
+   *  - an ordered delta holding the entries inserted since the run was
+   *    built.
+   * Once the delta and the dead entries exceed an eighth of the run (and
+   * at least <code>MIN_DELTA</code>), both are merged into a new run.
+   * Queries walk the run and the delta side by side.
+   *
+   * The index is maintained by the \ref graph_column it belongs to, see
+   * <code>graph_column::enable_ordered_index()</code>. NULL values are
+   * not indexed.
+   */
+  class graph_ordered_index {
+   public:
+     /// (encoded value, position of the row)
+     typedef std::pair<uint64_t, size_t> entry_type;
+
+     /// Minimum number of pending changes before the run is rebuilt.
+     static const size_t MIN_DELTA = 1024;
+
+     /// Returns true if fields of the given type can be ordered.
+     static inline bool supports(graph_datatypes_enum type) {
+       return type == INT_TYPE || type == DOUBLE_TYPE;
+     }
+
+     /**
+      * Encodes the 8 byte value of the given type into a key such that
+      * the keys compare as unsigned integers like the values do. Doubles
+      * are ordered as by IEEE totalOrder, i.e. -0 before +0 and NaN last.
+      */
+     static inline uint64_t encode(graph_datatypes_enum type, const char* data) {
+       const uint64_t sign = (uint64_t)1 << 63;
+       uint64_t bits;
+       memcpy(&bits, data, sizeof(bits));
+       if (type == DOUBLE_TYPE) {
+         return (bits & sign) ? ~bits : (bits | sign);
+       }
+       return bits ^ sign;
+     }
+
+     inline graph_ordered_index() : type(INT_TYPE), ndead(0) { }
+
+     explicit inline graph_ordered_index(graph_datatypes_enum type) :
+         type(type), ndead(0) {
+       ASSERT_TRUE(supports(type));
+     }
+
+     /// Replaces the content of the index by entries, in any order.
+     inline void assign(std::vector<entry_type>& entries) {
+       std::sort(entries.begin(), entries.end());
+       run.swap(entries);
+       dead.assign(run.size(), false);
+       ndead = 0;
+       delta.clear();
+     }
+
+     /// Records that the row at pos holds the value data.
+     inline void insert(const char* data, size_t pos) {
+       delta.insert(entry_type(encode(type, data), pos));
+       maybe_merge();
+     }
+
+     /// Removes the record of the row at pos holding the value data.
+     inline void erase(const char* data, size_t pos) {
+       entry_type e(encode(type, data), pos);
+       if (delta.erase(e) > 0) {
+         return;
+       }
+       std::vector<entry_type>::iterator it =
+           std::lower_bound(run.begin(), run.end(), e);
+       if (it != run.end() && *it == e && !dead[it - run.begin()]) {
+         dead[it - run.begin()] = true;
+         ++ndead;
+         maybe_merge();
+       }
+     }
+
+     /**
+      * Appends to out the positions of the rows with value in [lo, hi],
+      * in ascending order of value. A NULL bound leaves that end open.
+      */
+     inline void range(const char* lo, const char* hi,
+                       std::vector<size_t>& out) const {
+       entry_type first(lo == NULL ? 0 : encode(type, lo), 0);
+       uint64_t last = (hi == NULL) ? (uint64_t)(-1) : encode(type, hi);
+       scan(first, last, (size_t)(-1), out);
+     }
+
+     /**
+      * Appends to out the positions of the k rows with the largest (or
+      * smallest) values, ordered from the largest (or smallest) one.
+      */
+     inline void topk(size_t k, bool largest, std::vector<size_t>& out) const {
+       if (!largest) {
+         scan(entry_type(0, 0), (uint64_t)(-1), k, out);
+         return;
+       }
+       size_t i = run.size();
+       std::set<entry_type>::const_reverse_iterator d = delta.rbegin();
+       for (size_t n = 0; n < k; ++n) {
+         while (i > 0 && dead[i - 1]) --i;
+         bool has_run = (i > 0);
+         bool has_delta = (d != delta.rend());
+         if (!has_run && !has_delta) break;
+         if (has_run && (!has_delta || *d < run[i - 1])) {
+           out.push_back(run[--i].second);
+         } else {
+           out.push_back((d++)->second);
+         }
+       }
+     }
+
+     /// Returns the number of indexed (non NULL) values.
+     inline size_t size() const {
+       return run.size() - ndead + delta.size();
+     }
+
+     inline void clear() {
+       run.clear();
+       dead.clear();
+       ndead = 0;
+       delta.clear();
+     }
+
+   private:
+     // Appends the positions of up to limit entries from first, while the
+     // key is at most last, in ascending order.
+     inline void scan(const entry_type& first, uint64_t last, size_t limit,
+                      std::vector<size_t>& out) const {
+       size_t i = std::lower_bound(run.begin(), run.end(), first) - run.begin();
+       std::set<entry_type>::const_iterator d = delta.lower_bound(first);
+       for (size_t n = 0; n < limit; ++n) {
+         while (i < run.size() && dead[i]) ++i;
+         bool has_run = (i < run.size() && run[i].first <= last);
+         bool has_delta = (d != delta.end() && d->first <= last);
+         if (!has_run && !has_delta) break;
+         if (has_run && (!has_delta || run[i] < *d)) {
+           out.push_back(run[i++].second);
+         } else {
+           out.push_back((d++)->second);
+         }
+       }
+     }
+
+     inline void maybe_merge() {
+       size_t pending = delta.size() + ndead;
+       if (pending >= MIN_DELTA && pending * 8 >= run.size()) {
+         merge();
+       }
+     }
+
+     // Merges the live entries of the run with the delta into a new run.
+     inline void merge() {
+       std::vector<entry_type> merged;
+       merged.reserve(size());
+       std::set<entry_type>::const_iterator d = delta.begin();
+       for (size_t i = 0; i < run.size(); ++i) {
+         if (dead[i]) continue;
+         while (d != delta.end() && *d < run[i]) {
+           merged.push_back(*d++);
+         }
+         merged.push_back(run[i]);
+       }
+       merged.insert(merged.end(), d, delta.end());
+       run.swap(merged);
+       dead.assign(run.size(), false);
+       ndead = 0;
+       delta.clear();
+     }
+
+     graph_datatypes_enum type;
+
+     // sorted entries, dead[i] is set if run[i] was removed
+     std::vector<entry_type> run;
+     std::vector<bool> dead;
+     size_t ndead;
+
+     // entries inserted since the run was built
+     std::set<entry_type> delta;
+  };
+} // namespace graphlab
+#endif
@@ -0,0 +1,167 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_PAYLOAD_ARENA_HPP
+#define GRAPHLAB_DATABASE_GRAPH_PAYLOAD_ARENA_HPP
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <graphlab/logger/assertions.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * Append-only storage for the string/blob payloads of a shard.
+ *
+ * Payloads are bump-allocated from large blocks, so storing a value costs
+ * a memcpy instead of a malloc, and the payloads of a shard stay packed
+ * in a few contiguous regions. A payload is identified by a 64 bit handle
+ * (block id in the high bits, offset in the low bits). Pointers returned
+ * by get() stay valid until the arena is cleared or swapped.
+ *
+ * Payloads are never freed individually. When a value is overwritten the
+ * owner calls release() so the arena can track how many bytes are dead;
+ * the owner then decides when to compact by copying the live payloads
+ * into a fresh arena (see graph_shard_impl::compact_payloads()).
+ *
+ * A block may also be borrowed from a mapped shard image (see
+ * adopt_region()). Such blocks are never written nor freed by the arena.
+ *
+ * \note
+ *  This object is not thread safe and may not be copied.
+ */
+class graph_payload_arena {
+ public:
+  typedef uint64_t handle_type;
+
+  /// Size of the blocks used for small payloads.
+  static const size_t BLOCK_SIZE = 1 << 20;
+
+  inline graph_payload_arena() : live(0), dead(0), current(0), tail(0) { }
+
+  inline ~graph_payload_arena() {
+    clear();
+  }
+
+  /// Copies len bytes of data into the arena and returns its handle.
+  inline handle_type allocate(const char* data, size_t len) {
+    live += len;
+    if (len > BLOCK_SIZE / 4) {
+      // large payloads get a block of their own
+      push_block((char*)malloc(len), true);
+      memcpy(blocks.back(), data, len);
+      return make_handle(blocks.size() - 1, 0);
+    }
+    if (blocks.empty() || tail + len > BLOCK_SIZE) {
+      push_block((char*)malloc(BLOCK_SIZE), true);
+      current = blocks.size() - 1;
+      tail = 0;
+    }
+    handle_type ret = make_handle(current, tail);
+    memcpy(blocks[current] + tail, data, len);
+    tail += len;
+    return ret;
+  }
+
+  /// Returns a pointer to the payload with the given handle.
+  inline const char* get(handle_type h) const {
+    DCHECK_LT((size_t)(h >> OFFSET_BITS), blocks.size());
+    return blocks[h >> OFFSET_BITS] + (h & OFFSET_MASK);
+  }
+
+  /// Marks len bytes of a previously allocated payload as dead.
+  inline void release(size_t len) {
+    live -= len;
+    dead += len;
+  }
+
+  /// Number of bytes referenced by live payloads.
+  inline size_t live_bytes() const { return live; }
+
+  /// Number of bytes of payloads which have been released.
+  inline size_t dead_bytes() const { return dead; }
+
+  /**
+   * Returns true if the dead payloads take more room than the live ones
+   * and are worth reclaiming.
+   */
+  inline bool needs_compaction() const {
+    return dead > BLOCK_SIZE && dead > live;
+  }
+
+  /**
+   * Reads a region of len bytes from iarc as a single block.
+   * Returns the handle of the beginning of the region. Payloads within
+   * the region are addressed by adding their offset to the handle.
+   */
+  inline handle_type load_region(iarchive& iarc, size_t len) {
+    char* region = (char*)malloc(len > 0 ? len : 1);
+    if (len > 0) iarc.read(region, len);
+    return add_region(region, len, true);
+  }
+
+  /**
+   * Uses the len bytes at data as a block, without copying. The memory
+   * must stay valid until the arena is cleared, and is never written.
+   * Returns the handle of the beginning of the region.
+   */
+  inline handle_type adopt_region(const char* data, size_t len) {
+    return add_region(const_cast<char*>(data), len, false);
+  }
+
+  /// Frees all the payloads.
+  inline void clear() {
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      if (owned[i]) free(blocks[i]);
+    }
+    blocks.clear();
+    owned.clear();
+    live = dead = current = tail = 0;
+  }
+
+  /// Exchanges the content of two arenas.
+  inline void swap(graph_payload_arena& other) {
+    blocks.swap(other.blocks);
+    owned.swap(other.owned);
+    std::swap(live, other.live);
+    std::swap(dead, other.dead);
+    std::swap(current, other.current);
+    std::swap(tail, other.tail);
+  }
+
+ private:
+  static const size_t OFFSET_BITS = 40;
+  static const handle_type OFFSET_MASK = (handle_type(1) << OFFSET_BITS) - 1;
+
+  static inline handle_type make_handle(size_t block, size_t offset) {
+    return (handle_type(block) << OFFSET_BITS) | handle_type(offset);
+  }
+
+  inline void push_block(char* block, bool is_owned) {
+    blocks.push_back(block);
+    owned.push_back(is_owned);
+  }
+
+  inline handle_type add_region(char* region, size_t len, bool is_owned) {
+    push_block(region, is_owned);
+    // the region is full, start a new block on the next allocation.
+    current = blocks.size() - 1;
+    tail = BLOCK_SIZE;
+    live += len;
+    return make_handle(blocks.size() - 1, 0);
+  }
+
+  std::vector<char*> blocks;
+  // owned[i] is false if blocks[i] is borrowed from a shard image
+  std::vector<bool> owned;
+  size_t live;
+  size_t dead;
+  // block receiving the small payloads, and the write position in it
+  size_t current;
+  size_t tail;
+
+  // not copyable
+  graph_payload_arena(const graph_payload_arena&);
+  graph_payload_arena& operator=(const graph_payload_arena&);
+};
+} // namespace graphlab
+#endif
@@ -1,6 +1,7 @@
 #ifndef GRAPHLAB_DATABASE_GRAPH_ROW_HPP
 #define GRAPHLAB_DATABASE_GRAPH_ROW_HPP
 #include <vector>
+#include <algorithm>
 #include <graphlab/database/basic_types.hpp>
 #include <graphlab/database/graph_field.hpp>
 #include <graphlab/database/graph_value.hpp>
@@ -36,9 +37,23 @@ class graph_row {
   /// Given fields metadata, creates a row with NULL values in the given fields.
   graph_row(const std::vector<graph_field>& fields, bool is_vertex); 
   
-  /// Destructor. Frees the values if <code>_own_data</code> is true.
+  /// Destructor. Frees the values.
   inline ~graph_row() { }
 
+#if defined(__cplusplus) && __cplusplus >= 201103L
+  // The user declared destructor suppresses the implicit move operations.
+  graph_row(const graph_row&) = default;
+  graph_row& operator=(const graph_row&) = default;
+  graph_row(graph_row&&) noexcept = default;
+  graph_row& operator=(graph_row&&) noexcept = default;
+#endif
+
+  /// Exchanges the contents of two rows without copying the values.
+  inline void swap(graph_row& other) {
+    _data.swap(other._data);
+    std::swap(_is_vertex, other._is_vertex);
+  }
+
   /// add a new field into row with NULL value.
   void add_field(graph_field& field);
 
@@ -113,6 +128,19 @@ class graph_row {
     iarc >> _is_vertex >> _data;
   }
 
+  /**
+   * Same as load(), but the string and blob values borrow their payloads
+   * from the archive buffer when it reads from memory (see
+   * graph_value::load_borrowed()). The existing values are reused.
+   */
+  void load_borrowed (iarchive& iarc) {
+    iarc >> _is_vertex;
+    _data.resize(archive_detail::deserialize_vector_length(iarc));
+    for (size_t i = 0; i < _data.size(); ++i) {
+      _data[i].load_borrowed(iarc);
+    }
+  }
+
  private:
   
   /**
@@ -0,0 +1,178 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_ROW_CODEC_HPP
+#define GRAPHLAB_DATABASE_GRAPH_ROW_CODEC_HPP
+#include <vector>
+#include <stdint.h>
+#include <graphlab/database/graph_row.hpp>
+#include <graphlab/database/graph_field.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <boost/functional/hash.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * Compact wire encoding of graph_row for peers sharing the same schema.
+ *
+ * graph_row::save() writes the type, the null flag and the length of
+ * every value. When both ends know the fields, a row is written as the
+ * number of fields (varint), a bitmap of the non-NULL fields, then the
+ * non-NULL values in field order: scalars at their fixed width, strings
+ * and blobs as a varint length followed by the bytes.
+ *
+ * The schema is identified by version(), a fingerprint of the names and
+ * types of the vertex and edge fields. A request carrying the version of
+ * the client (see QueryMessage::header) gets rows in this encoding if it
+ * matches the one of the server, and in the graph_row::save() encoding
+ * otherwise. Version 0 means no schema.
+ */
+class graph_row_codec {
+ public:
+  /// Creates a codec with no schema.
+  graph_row_codec() : _version(0) { }
+
+  /// Creates a codec for the given vertex and edge fields.
+  graph_row_codec(const std::vector<graph_field>& vertex_fields,
+                  const std::vector<graph_field>& edge_fields) :
+      vertex_fields(vertex_fields), edge_fields(edge_fields),
+      _version(schema_version(vertex_fields, edge_fields)) { }
+
+  /// Returns the fingerprint of the schema, or 0 if there is none.
+  inline uint64_t version() const { return _version; }
+
+  /// Returns the fingerprint of a schema. Never 0.
+  static uint64_t schema_version(const std::vector<graph_field>& vertex_fields,
+                                 const std::vector<graph_field>& edge_fields) {
+    size_t seed = vertex_fields.size();
+    for (size_t i = 0; i < vertex_fields.size(); ++i) {
+      boost::hash_combine(seed, vertex_fields[i].name);
+      boost::hash_combine(seed, (int)vertex_fields[i].type);
+    }
+    boost::hash_combine(seed, edge_fields.size());
+    for (size_t i = 0; i < edge_fields.size(); ++i) {
+      boost::hash_combine(seed, edge_fields[i].name);
+      boost::hash_combine(seed, (int)edge_fields[i].type);
+    }
+    return seed == 0 ? 1 : seed;
+  }
+
+  /// Writes row, which must have no fields or the fields of the schema.
+  void save(oarchive& oarc, const graph_row& row) const {
+    const std::vector<graph_field>& fields = row.is_vertex() ? vertex_fields : edge_fields;
+    size_t n = row.num_fields();
+    ASSERT_TRUE(n == 0 || n == fields.size());
+    write_varint(oarc, n);
+    if (n == 0) {
+      return;
+    }
+    std::vector<char> bitmap((n + 7) / 8, 0);
+    for (size_t i = 0; i < n; ++i) {
+      if (!row.get_field(i)->is_null()) {
+        bitmap[i / 8] |= (1 << (i % 8));
+      }
+    }
+    oarc.write(&bitmap[0], bitmap.size());
+    for (size_t i = 0; i < n; ++i) {
+      const graph_value& val = *row.get_field(i);
+      if (val.is_null()) {
+        continue;
+      }
+      if (is_scalar_graph_datatype(val.type())) {
+        oarc.write(reinterpret_cast<const char*>(val.get_raw_pointer()),
+                   scalar_width(val.type()));
+      } else {
+        write_varint(oarc, val.data_length());
+        oarc.write(reinterpret_cast<const char*>(val.get_raw_pointer()),
+                   val.data_length());
+      }
+    }
+  }
+
+  /// Reads a row written by save().
+  void load(iarchive& iarc, graph_row& row, bool is_vertex) const {
+    const std::vector<graph_field>& fields = is_vertex ? vertex_fields : edge_fields;
+    size_t n = read_varint(iarc);
+    if (n == 0) {
+      graph_row empty;
+      empty._is_vertex = is_vertex;
+      row.swap(empty);
+      return;
+    }
+    ASSERT_EQ(n, fields.size());
+    graph_row out(fields, is_vertex);
+    std::vector<char> bitmap((n + 7) / 8);
+    iarc.read(&bitmap[0], bitmap.size());
+    std::vector<char> bytes;
+    for (size_t i = 0; i < n; ++i) {
+      if (!(bitmap[i / 8] & (1 << (i % 8)))) {
+        continue;
+      }
+      graph_value& val = *out.get_field(i);
+      size_t len = is_scalar_graph_datatype(fields[i].type) ?
+          scalar_width(fields[i].type) : read_varint(iarc);
+      bytes.resize(std::max<size_t>(len, 1));
+      iarc.read(&bytes[0], len);
+      val.set_val(&bytes[0], len);
+    }
+    row.swap(out);
+  }
+
+  /// Writes the number of rows, then each row.
+  void save_rows(oarchive& oarc, const std::vector<graph_row>& rows) const {
+    oarc << rows.size();
+    for (size_t i = 0; i < rows.size(); ++i) {
+      save(oarc, rows[i]);
+    }
+  }
+
+  /// Reads rows written by save_rows().
+  void load_rows(iarchive& iarc, std::vector<graph_row>& rows, bool is_vertex) const {
+    size_t n;
+    iarc >> n;
+    rows.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      load(iarc, rows[i], is_vertex);
+    }
+  }
+
+  /// Writes x in 7 bit groups, least significant first.
+  static void write_varint(oarchive& oarc, uint64_t x) {
+    char buf[10];
+    size_t len = 0;
+    while (x >= 0x80) {
+      buf[len++] = (char)((x & 0x7f) | 0x80);
+      x >>= 7;
+    }
+    buf[len++] = (char)x;
+    oarc.write(buf, len);
+  }
+
+  /// Reads an integer written by write_varint().
+  static uint64_t read_varint(iarchive& iarc) {
+    uint64_t x = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+      unsigned char c = iarc.read_char();
+      x |= (uint64_t)(c & 0x7f) << shift;
+      if (!(c & 0x80)) {
+        break;
+      }
+    }
+    return x;
+  }
+
+ private:
+  static size_t scalar_width(graph_datatypes_enum type) {
+    switch (type) {
+     case VID_TYPE: return sizeof(graph_vid_t);
+     case INT_TYPE: return sizeof(graph_int_t);
+     case DOUBLE_TYPE: return sizeof(graph_double_t);
+     default: return 0;
+    }
+  }
+
+  std::vector<graph_field> vertex_fields;
+  std::vector<graph_field> edge_fields;
+  uint64_t _version;
+};
+} // namespace graphlab
+#endif
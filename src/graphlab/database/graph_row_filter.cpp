@@ -0,0 +1,101 @@
+#include <graphlab/database/graph_row_filter.hpp>
+#include <graphlab/database/graph_ordered_index.hpp>
+#include <graphlab/database/errno.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace graphlab {
+  bool graph_condition::accepts(const graph_value& field) const {
+    if (op == ANY) {
+      return true;
+    }
+    if (field.is_null() || value.is_null() || field.type() != value.type()) {
+      return false;
+    }
+    int cmp;
+    if (graph_ordered_index::supports(value.type())) {
+      uint64_t lhs = graph_ordered_index::encode(field.type(),
+                                                 (const char*)field.get_raw_pointer());
+      uint64_t rhs = graph_ordered_index::encode(value.type(),
+                                                 (const char*)value.get_raw_pointer());
+      cmp = (lhs < rhs) ? -1 : (lhs > rhs);
+    } else if (value.type() == VID_TYPE) {
+      graph_vid_t lhs, rhs;
+      field.get_vid(&lhs);
+      value.get_vid(&rhs);
+      cmp = (lhs < rhs) ? -1 : (lhs > rhs);
+    } else {
+      size_t len = std::min(field.data_length(), value.data_length());
+      cmp = len > 0 ? memcmp(field.get_raw_pointer(), value.get_raw_pointer(), len) : 0;
+      if (cmp == 0) {
+        cmp = (field.data_length() < value.data_length()) ? -1 :
+            (field.data_length() > value.data_length());
+      }
+    }
+    switch (op) {
+     case EQ: return cmp == 0;
+     case NE: return cmp != 0;
+     case LT: return cmp < 0;
+     case LE: return cmp <= 0;
+     case GT: return cmp > 0;
+     case GE: return cmp >= 0;
+     default: return true;
+    }
+  }
+
+  int graph_row_filter::check(const std::vector<graph_field>& schema) const {
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (fields[i] >= schema.size()) {
+        return EINVID;
+      }
+    }
+    for (size_t i = 0; i < clauses.size(); ++i) {
+      for (size_t j = 0; j < clauses[i].size(); ++j) {
+        const graph_condition& cond = clauses[i][j];
+        if (cond.op == graph_condition::ANY) {
+          continue;
+        }
+        if (cond.fieldpos >= schema.size()) {
+          return EINVID;
+        }
+        if (cond.value.type() != schema[cond.fieldpos].type) {
+          return EINVTYPE;
+        }
+      }
+    }
+    return 0;
+  }
+
+  bool graph_row_filter::accepts(const graph_row_ref& row) const {
+    if (clauses.empty()) {
+      return true;
+    }
+    // local, so that threads can share the filter
+    graph_value field;
+    for (size_t i = 0; i < clauses.size(); ++i) {
+      bool match = true;
+      for (size_t j = 0; j < clauses[i].size() && match; ++j) {
+        const graph_condition& cond = clauses[i][j];
+        if (cond.op != graph_condition::ANY) {
+          match = row.get_field_ref(cond.fieldpos, field) && cond.accepts(field);
+        }
+      }
+      if (match) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void graph_row_filter::project(const graph_row_ref& row, graph_row& out) const {
+    if (fields.empty()) {
+      row.borrow_to(out);
+      return;
+    }
+    out._is_vertex = row.is_vertex();
+    out._data.resize(fields.size());
+    for (size_t i = 0; i < fields.size(); ++i) {
+      row.get_field_ref(fields[i], out._data[i]);
+    }
+  }
+} // namespace graphlab
@@ -0,0 +1,117 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_ROW_FILTER_HPP
+#define GRAPHLAB_DATABASE_GRAPH_ROW_FILTER_HPP
+#include <vector>
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/database/graph_field.hpp>
+#include <graphlab/database/graph_value.hpp>
+#include <graphlab/database/graph_row.hpp>
+#include <graphlab/database/graph_row_ref.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * Compares the field at fieldpos of a row to a value.
+ */
+struct graph_condition {
+  enum op_type { ANY, EQ, NE, LT, LE, GT, GE };
+
+  size_t fieldpos;
+  op_type op;
+  graph_value value;
+
+  /// Accepts any row.
+  graph_condition() : fieldpos(0), op(ANY) { }
+
+  graph_condition(size_t fieldpos, op_type op, const graph_value& value)
+      : fieldpos(fieldpos), op(op), value(value) { }
+
+  /**
+   * Returns true if field compares to value as op. NULL fields and fields
+   * of another type than value are only accepted by ANY. Numbers compare
+   * by value, strings and blobs byte by byte.
+   */
+  bool accepts(const graph_value& field) const;
+
+  void save(oarchive& oarc) const {
+    oarc << fieldpos << op << value;
+  }
+
+  void load(iarchive& iarc) {
+    iarc >> fieldpos >> op >> value;
+  }
+};
+
+/**
+ * \ingroup group_graph_database
+ * Selects rows and fields of a batch read on the shards, so that only the
+ * requested part of the matching rows is sent back.
+ *
+ * The predicate is an OR of clauses, each an AND of conditions:
+ * \code
+ *   graph_row_filter filter;
+ *   filter.select(3);                                  // only field 3
+ *   filter.where(0, graph_condition::GT, lo);          // 0 > lo AND 1 == s
+ *   filter.where(1, graph_condition::EQ, s);
+ *   filter.or_where(0, graph_condition::LT, hi);       // OR 0 < hi
+ * \endcode
+ * A filter with no condition accepts every row, and one with no selected
+ * field keeps all fields. Threads can share a filter to read rows.
+ */
+class graph_row_filter {
+ public:
+  graph_row_filter() { }
+
+  /// Adds the field at fieldpos to the fields returned, in this order.
+  void select(size_t fieldpos) {
+    fields.push_back(fieldpos);
+  }
+
+  /// ANDs the condition with the last clause, or starts the first one.
+  void where(size_t fieldpos, graph_condition::op_type op, const graph_value& value) {
+    if (clauses.empty()) {
+      clauses.resize(1);
+    }
+    clauses.back().push_back(graph_condition(fieldpos, op, value));
+  }
+
+  /// ORs a new clause made of the condition.
+  void or_where(size_t fieldpos, graph_condition::op_type op, const graph_value& value) {
+    clauses.resize(clauses.size() + 1);
+    clauses.back().push_back(graph_condition(fieldpos, op, value));
+  }
+
+  /// Returns the selected fields. Empty if all fields are kept.
+  inline const std::vector<size_t>& selected() const { return fields; }
+
+  /**
+   * Returns 0 if the filter applies to rows with the given schema,
+   * EINVID if it names a field which does not exist, or EINVTYPE if a
+   * condition compares a field to a value of another type.
+   */
+  int check(const std::vector<graph_field>& schema) const;
+
+  /// Returns true if the row matches the predicate.
+  bool accepts(const graph_row_ref& row) const;
+
+  /**
+   * Fills out with the selected fields of row. String and blob values
+   * borrow their payload from the table (see graph_row_ref::borrow_to()).
+   */
+  void project(const graph_row_ref& row, graph_row& out) const;
+
+  void save(oarchive& oarc) const {
+    oarc << fields << clauses;
+  }
+
+  void load(iarchive& iarc) {
+    iarc >> fields >> clauses;
+  }
+
+ private:
+  std::vector<size_t> fields;
+  std::vector<std::vector<graph_condition> > clauses;
+};
+} // namespace graphlab
+#endif
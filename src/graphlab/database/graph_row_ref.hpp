@@ -0,0 +1,167 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_ROW_REF_HPP
+#define GRAPHLAB_DATABASE_GRAPH_ROW_REF_HPP
+#include <vector>
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/database/graph_row.hpp>
+#include <graphlab/database/graph_column.hpp>
+#include <graphlab/logger/assertions.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * A light weight handle to the i'th row of a columnar table
+ * (see \ref graph_column).
+ *
+ * The handle does not own any data. It stays valid as long as the
+ * table it points to is not destroyed, but values read through it
+ * reflect the current content of the table.
+ *
+ * A default constructed graph_row_ref does not point to any row, and
+ * plays the role of a NULL <code>graph_row*</code>.
+ */
+class graph_row_ref {
+ public:
+  /// Creates an invalid reference.
+  inline graph_row_ref() : columns(NULL), pos(0), _is_vertex(true) { }
+
+  /// Creates a reference to row pos of the table columns.
+  inline graph_row_ref(std::vector<graph_column>* columns,
+                       size_t pos, bool is_vertex) :
+      columns(columns), pos(pos), _is_vertex(is_vertex) { }
+
+  /// Returns true if this reference points to a row.
+  inline bool is_valid() const {
+    return columns != NULL;
+  }
+
+  /// Returns the position of the row in its table.
+  inline size_t position() const {
+    return pos;
+  }
+
+  /// Returns the number of fields on this row.
+  inline size_t num_fields() const {
+    return columns->size();
+  }
+
+  /// Returns true if this row represents a vertex. false otherwise.
+  inline bool is_vertex() const {
+    return _is_vertex;
+  }
+
+  /// Returns true if this row represents an edge. false otherwise.
+  inline bool is_edge() const {
+    return !_is_vertex;
+  }
+
+  /// Returns true if all entries in the row are NULL.
+  inline bool is_null() const {
+    for (size_t i = 0; i < num_fields(); ++i) {
+      if (!(*columns)[i].is_null(pos))
+        return false;
+    }
+    return true;
+  }
+
+  /// Returns the datatype of the field at fieldpos.
+  inline graph_datatypes_enum field_type(size_t fieldpos) const {
+    ASSERT_LT(fieldpos, num_fields());
+    return (*columns)[fieldpos].type();
+  }
+
+  /// Returns true if the field at fieldpos is NULL.
+  inline bool field_is_null(size_t fieldpos) const {
+    ASSERT_LT(fieldpos, num_fields());
+    return (*columns)[fieldpos].is_null(pos);
+  }
+
+  /**
+   * Copies the value at fieldpos into out. Returns false if the position
+   * is invalid.
+   */
+  inline bool get_field(size_t fieldpos, graph_value& out) const {
+    if (fieldpos >= num_fields())
+      return false;
+    (*columns)[fieldpos].get(pos, out);
+    return true;
+  }
+
+  /**
+   * Same as get_field(), but a string or blob value in out borrows its
+   * payload from the table, and is only valid until the table is modified.
+   */
+  inline bool get_field_ref(size_t fieldpos, graph_value& out) const {
+    if (fieldpos >= num_fields())
+      return false;
+    (*columns)[fieldpos].get_ref(pos, out);
+    return true;
+  }
+
+  /**
+   * Overwrites the value at fieldpos with val. Returns false if the
+   * position is invalid or the type does not match.
+   */
+  inline bool set_field(size_t fieldpos, const graph_value& val) {
+    if (fieldpos >= num_fields())
+      return false;
+    return (*columns)[fieldpos].set(pos, val);
+  }
+
+  /**
+   * Returns true if row can be stored in this row: either row has no
+   * fields, or it has the same number of fields with matching types.
+   */
+  inline bool accepts(const graph_row& row) const {
+    if (row.num_fields() == 0)
+      return true;
+    if (row.num_fields() != num_fields())
+      return false;
+    for (size_t i = 0; i < num_fields(); ++i) {
+      if (row.get_field(i)->type() != field_type(i))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Overwrites the whole row with the content of row.
+   * A row with no fields leaves the values untouched.
+   * Returns false if the row is not accepted.
+   */
+  inline bool assign(const graph_row& row) {
+    if (!accepts(row))
+      return false;
+    for (size_t i = 0; i < row.num_fields(); ++i) {
+      (*columns)[i].set(pos, *row.get_field(i));
+    }
+    return true;
+  }
+
+  /// Materializes the row into out.
+  inline void copy_to(graph_row& out) const {
+    out._is_vertex = _is_vertex;
+    out._data.resize(num_fields());
+    for (size_t i = 0; i < num_fields(); ++i) {
+      (*columns)[i].get(pos, out._data[i]);
+    }
+  }
+
+  /**
+   * Same as copy_to(), but string and blob values in out borrow their
+   * payload from the table. out is only valid until the table is modified.
+   */
+  inline void borrow_to(graph_row& out) const {
+    out._is_vertex = _is_vertex;
+    out._data.resize(num_fields());
+    for (size_t i = 0; i < num_fields(); ++i) {
+      (*columns)[i].get_ref(pos, out._data[i]);
+    }
+  }
+
+ private:
+  std::vector<graph_column>* columns;
+  size_t pos;
+  bool _is_vertex;
+};
+} // namespace graphlab
+#endif
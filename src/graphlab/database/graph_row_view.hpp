@@ -0,0 +1,52 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_ROW_VIEW_HPP
+#define GRAPHLAB_DATABASE_GRAPH_ROW_VIEW_HPP
+#include <graphlab/database/graph_row.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * A read-only row decoded from a serialized message without copying its
+ * payloads.
+ *
+ * load() reads a row written by graph_row::save(). When the archive reads
+ * from memory, the string and blob values of row() point into its buffer
+ * (see graph_value::borrow()), so a request row is copied only once: into
+ * the storage of the shard. The view is only valid while that buffer is
+ * alive and unchanged.
+ *
+ * Loading into the same view again reuses its values, which makes decoding
+ * a batch of rows allocation free once the first one has been read.
+ */
+class graph_row_view : boost::noncopyable {
+ public:
+  graph_row_view() { }
+
+  /// Returns the row. Its string and blob values may be borrowed.
+  inline const graph_row& row() const { return _row; }
+
+  /// Returns the number of fields.
+  inline size_t num_fields() const { return _row.num_fields(); }
+
+  /// Returns true if the row is vertex data.
+  inline bool is_vertex() const { return _row.is_vertex(); }
+
+  /// Returns the value at fieldpos, or NULL if out of range.
+  inline const graph_value* get_field(size_t fieldpos) const {
+    return _row.get_field(fieldpos);
+  }
+
+  /**
+   * Reads a row written by graph_row::save(). Payloads are borrowed from
+   * the archive buffer, or copied if the archive reads from a stream.
+   */
+  void load(iarchive& iarc) {
+    _row.load_borrowed(iarc);
+  }
+
+ private:
+  graph_row _row;
+};
+} // namespace graphlab
+#endif
@@ -78,9 +78,8 @@ class graph_shard {
    * vertex_data(i) corresponds to the data on the vertex with ID vertex(i)
    * i must range from 0 to num_vertices() - 1 inclusive.
    */
-  inline graph_row* vertex_data(size_t i) { 
-    ASSERT_LT(i, num_vertices()); 
-    return &(shard_impl.vertex_data[0])+i;
+  inline graph_row_ref vertex_data(size_t i) { 
+    return shard_impl.vertex_row(i);
   }
 
    /**
@@ -108,14 +107,15 @@ class graph_shard {
    }
 
    /**
-    * Returns the data of vertex with vid. Return NULL if there is no vertex 
-    * data associated with vid in this shard.
+    * Returns the data of vertex with vid. Return an invalid reference
+    * if there is no vertex data associated with vid in this shard.
     */
-   inline graph_row* vertex_data_by_id (const graph_vid_t& vid) {
-     if (has_vertex(vid)) {
-       return vertex_data(shard_impl.vertex_index.get_index(vid));
+   inline graph_row_ref vertex_data_by_id (const graph_vid_t& vid) {
+     size_t pos = shard_impl.vertex_index.find(vid);
+     if (pos != graph_vertex_index::npos) {
+       return vertex_data(pos);
      } else {
-       return NULL;
+       return graph_row_ref();
      }
    }
 
@@ -131,8 +131,34 @@ class graph_shard {
    * edge_data(i) corresponds to the data on the edge edge(i)
    * i must range from 0 to num_edges() - 1 inclusive.
    */
-  inline graph_row* edge_data(size_t i) {
-    return &(shard_impl.edge_data[0]) + i; 
+  inline graph_row_ref edge_data(size_t i) {
+    return shard_impl.edge_row(i);
+  }
+
+  /**
+   * Returns the column storing the vertex field at fieldpos.
+   */
+  inline graph_column& vertex_column(size_t fieldpos) {
+    ASSERT_LT(fieldpos, shard_impl.vertex_columns.size());
+    return shard_impl.vertex_columns[fieldpos];
+  }
+
+  /**
+   * Returns the column storing the edge field at fieldpos.
+   */
+  inline graph_column& edge_column(size_t fieldpos) {
+    ASSERT_LT(fieldpos, shard_impl.edge_columns.size());
+    return shard_impl.edge_columns[fieldpos];
+  }
+
+  /**
+   * Appends to out the ids of the vertices in this shard whose field at
+   * fieldpos equals key, using the index of the field. Returns false if
+   * the field is not indexed or key has the wrong type.
+   */
+  inline bool find_vertices(size_t fieldpos, const graph_value& key,
+                            std::vector<graph_vid_t>& out) const {
+    return shard_impl.find_vertices(fieldpos, key, out);
   }
 
   /**
@@ -143,28 +169,85 @@ class graph_shard {
     shard_impl.edge_index.get_vertex_adj(outids, vid, is_in_edges);
   }
 
+  /**
+   * Returns the adjacency structure of given vertex withvid without copying.
+   * The edge ids are the concatenation of frozen and delta.
+   * The spans are invalidated by any modification of the shard.
+   */
+  inline void vertex_adj_spans (graph_vid_t vid, bool is_in_edges,
+                                graph_leid_span& frozen,
+                                graph_leid_span& delta) const {
+    shard_impl.edge_index.get_vertex_adj_spans(vid, is_in_edges, frozen, delta);
+  }
+
+  /**
+   * Same as vertex_adj_spans() for n vids in ascending order, in one pass
+   * over the adjacency index.
+   */
+  inline void vertices_adj_spans (const graph_vid_t* vids, size_t n, bool is_in_edges,
+                                  graph_leid_span* frozen,
+                                  graph_leid_span* delta) const {
+    shard_impl.edge_index.get_vertices_adj_spans(vids, n, is_in_edges, frozen, delta);
+  }
+
   /**
    * Returns the adjacency data of given vertex withvid.
    */
   inline void vertex_adj (std::vector<graph_vid_t>& out, 
                           graph_vid_t vid, bool is_in_edges) const { 
-    std::vector<graph_leid_t> ids;
-    shard_impl.edge_index.get_vertex_adj(ids, is_in_edges, vid);
-    if (is_in_edges) {
-      for (size_t i = 0; i < ids.size(); i++) {
-        out.push_back(shard_impl.edge[ids[i]].first);
-      }
-    } else {
-      for (size_t i = 0; i < ids.size(); i++) {
-        out.push_back(shard_impl.edge[ids[i]].second);
+    graph_leid_span spans[2];
+    shard_impl.edge_index.get_vertex_adj_spans(vid, is_in_edges, spans[0], spans[1]);
+    out.reserve(out.size() + spans[0].size() + spans[1].size());
+    for (size_t k = 0; k < 2; ++k) {
+      for (size_t i = 0; i < spans[k].size(); i++) {
+        const std::pair<graph_vid_t, graph_vid_t>& e = shard_impl.edge[spans[k][i]];
+        out.push_back(is_in_edges ? e.first : e.second);
       }
     }
   }
 
+  /**
+   * Compress the adjacency index of the shard for read-heavy serving.
+   * Edges added afterwards are kept in a delta until the next call.
+   */
+  inline void freeze_index() {
+    shard_impl.edge_index.freeze();
+  }
+
+  /**
+   * Returns true if overwritten string/blob values hold enough memory to
+   * be worth a call to compact_payloads().
+   */
+  inline bool needs_compaction() const {
+    return shard_impl.needs_compaction();
+  }
+
+  /**
+   * Reclaims the memory of overwritten string/blob values.
+   * Invalidates the values borrowed from the shard.
+   */
+  inline void compact_payloads() {
+    shard_impl.compact_payloads();
+  }
+
+  // ----------- Schema Modification API ----------
+  /**
+   * Add a field to the vertex data. Existing vertices get a NULL value. 
+   */
+  void add_vertex_field(const graph_field& field) {
+    shard_impl.add_vertex_field(field);
+  }
+
+  /**
+   * Add a field to the edge data. Existing edges get a NULL value. 
+   */
+  void add_edge_field(const graph_field& field) {
+    shard_impl.add_edge_field(field);
+  }
+
   // ----------- Modification API -----------------
   /**
    * Insert a (vid, row) into the shard. Return the position of the vertex in the shard.
-   * For optimization, take over the row pointer.
    */
   size_t add_vertex(graph_vid_t vid, const graph_row& row) {
     return shard_impl.add_vertex(vid, row);
@@ -179,7 +262,6 @@ class graph_shard {
 
   /**
    * Insert a (source, target, row) into the shard. Return the position of the edge in the shard.
-   * For optimization purpose, the data ownership of row is transfered.
    */
   size_t add_edge(graph_vid_t source, graph_vid_t target, const graph_row& row) {
     return shard_impl.add_edge(source, target, row);
@@ -194,6 +276,22 @@ class graph_shard {
     iarc >> shard_impl;
   }
 
+  /// Writes the shard into a shard image.
+  inline void save_image(graph_image_writer& writer) const {
+    shard_impl.save_image(writer);
+  }
+
+  /// Loads the shard from a mapped shard image. Returns false, leaving the
+  /// shard unchanged, if it is corrupt.
+  inline bool load_image(graph_image_reader& reader) {
+    return shard_impl.load_image(reader);
+  }
+
+  /// Exchanges the content of two shards, ids included.
+  inline void swap(graph_shard& other) {
+    shard_impl.swap(other.shard_impl);
+  }
+
 
   // Print the shard summary
   friend std::ostream& operator<<(std::ostream &strm, const graph_shard& shard) {
@@ -0,0 +1,114 @@
+#include <graphlab/database/graph_shard_image.hpp>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace graphlab {
+  // ----------- graph_image_mapping ----------------
+  bool graph_image_mapping::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      logstream(LOG_ERROR) << "Unable to open " << path << ": "
+                           << strerror(errno) << std::endl;
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      logstream(LOG_ERROR) << "Unable to stat " << path << std::endl;
+      ::close(fd);
+      return false;
+    }
+    void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the file is closed
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      logstream(LOG_ERROR) << "Unable to map " << path << ": "
+                           << strerror(errno) << std::endl;
+      return false;
+    }
+    base = (char*)addr;
+    len = st.st_size;
+    return true;
+  }
+
+  void graph_image_mapping::close() {
+    if (base != NULL) {
+      munmap(base, len);
+      base = NULL;
+      len = 0;
+    }
+  }
+
+  // ----------- graph_image_writer ----------------
+  bool graph_image_writer::open(const std::string& path) {
+    close();
+    fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) {
+      logstream(LOG_ERROR) << "Unable to create " << path << ": "
+                           << strerror(errno) << std::endl;
+      return false;
+    }
+    off = 0;
+    failed = false;
+    // the magic number is written in native byte order, so images
+    // of a platform with a different byte order are rejected too.
+    uint64_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t word_size = sizeof(size_t);
+    write(magic);
+    write_raw(reinterpret_cast<const char*>(&version), sizeof(version));
+    write_raw(reinterpret_cast<const char*>(&word_size), sizeof(word_size));
+    align();
+    return true;
+  }
+
+  bool graph_image_writer::close() {
+    if (fp == NULL) {
+      return !failed;
+    }
+    failed |= (fclose(fp) != 0);
+    fp = NULL;
+    return !failed;
+  }
+
+  void graph_image_writer::write_raw(const char* data, size_t len) {
+    ASSERT_TRUE(fp != NULL);
+    if (len > 0 && fwrite(data, 1, len, fp) != len) {
+      failed = true;
+    }
+    off += len;
+  }
+
+  void graph_image_writer::align() {
+    static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    size_t pad = (8 - (off & 7)) & 7;
+    write_raw(zeros, pad);
+  }
+
+  // ----------- graph_image_reader ----------------
+  bool graph_image_reader::read_header() {
+    off = 0;
+    if (image->size() < 2 * sizeof(uint64_t)) {
+      return false;
+    }
+    uint64_t magic;
+    uint32_t version, word_size;
+    read(magic);
+    memcpy(&version, read_raw(sizeof(version)), sizeof(version));
+    memcpy(&word_size, read_raw(sizeof(word_size)), sizeof(word_size));
+    align();
+    if (magic != graph_image_writer::MAGIC) {
+      logstream(LOG_ERROR) << "Not a shard image" << std::endl;
+      return false;
+    }
+    if (version != graph_image_writer::VERSION || word_size != sizeof(size_t)) {
+      logstream(LOG_ERROR) << "Unsupported shard image version " << version
+                           << " (word size " << word_size << ")" << std::endl;
+      return false;
+    }
+    return true;
+  }
+} // namespace graphlab
@@ -0,0 +1,228 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_SHARD_IMAGE_HPP
+#define GRAPHLAB_DATABASE_GRAPH_SHARD_IMAGE_HPP
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/logger/assertions.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * A read-only private memory mapping of a shard image file.
+ *
+ * Pages are loaded lazily by the kernel, and any page written by the
+ * process would be copied, never reaching the file. Structures serving
+ * from the mapping copy their arrays into owned memory before the first
+ * modification (see graph_edge_index::freeze() and
+ * graph_shard_impl::compact_payloads()).
+ */
+class graph_image_mapping {
+ public:
+  inline graph_image_mapping() : base(NULL), len(0) { }
+
+  inline ~graph_image_mapping() {
+    close();
+  }
+
+  /// Maps the file at path. Returns false on failure.
+  bool open(const std::string& path);
+
+  /// Unmaps the file.
+  void close();
+
+  inline const char* data() const { return base; }
+
+  inline size_t size() const { return len; }
+
+ private:
+  char* base;
+  size_t len;
+
+  // not copyable
+  graph_image_mapping(const graph_image_mapping&);
+  graph_image_mapping& operator=(const graph_image_mapping&);
+};
+
+/**
+ * \ingroup group_graph_database
+ * Writes a shard image: a versioned, position independent sequence of
+ * flat sections which \ref graph_image_reader can use in place.
+ *
+ * Every section starts at a multiple of 8 bytes from the beginning of
+ * the file, so arrays of 8 byte values can be read directly from a
+ * mapping of the file. Arrays are prefixed by their number of elements.
+ * Only plain old data may be written with write() and write_array();
+ * other objects go through write_archived().
+ */
+class graph_image_writer {
+ public:
+  /// Identifies shard image files.
+  static const uint64_t MAGIC = 0x314452414853474cULL; // "LGSHARD1"
+
+  /// Incremented when the layout of the image changes.
+  static const uint32_t VERSION = 1;
+
+  inline graph_image_writer() : fp(NULL), off(0), failed(false) { }
+
+  inline ~graph_image_writer() {
+    close();
+  }
+
+  /// Creates the file at path and writes the header. Returns false on failure.
+  bool open(const std::string& path);
+
+  /// Closes the file. Returns false if any write failed.
+  bool close();
+
+  /// Writes a single value.
+  template<typename T>
+  inline void write(const T& value) {
+    write_raw(reinterpret_cast<const char*>(&value), sizeof(T));
+    align();
+  }
+
+  /// Writes n values starting at data.
+  template<typename T>
+  inline void write_array(const T* data, size_t n) {
+    write<uint64_t>(n);
+    if (n > 0) write_raw(reinterpret_cast<const char*>(data), n * sizeof(T));
+    align();
+  }
+
+  template<typename T>
+  inline void write_vector(const std::vector<T>& vec) {
+    write_array(vec.empty() ? (const T*)NULL : &vec[0], vec.size());
+  }
+
+  /// Writes an object through its oarchive serializer.
+  template<typename T>
+  inline void write_archived(const T& obj) {
+    oarchive oarc;
+    oarc << obj;
+    write_array(oarc.buf, oarc.off);
+    free(oarc.buf);
+  }
+
+  /// Appends len bytes without alignment. Call align() to end the section.
+  void write_raw(const char* data, size_t len);
+
+  /// Pads the file to the next multiple of 8 bytes.
+  void align();
+
+ private:
+  FILE* fp;
+  size_t off;
+  bool failed;
+};
+
+/**
+ * \ingroup group_graph_database
+ * Reads the sections of a mapped shard image in the order they were
+ * written by \ref graph_image_writer. Arrays can be used in place, and
+ * stay valid as long as the mapping is alive.
+ *
+ * Reading past the end of a truncated or corrupt image does not fail
+ * right away: values read as 0 and arrays as empty from then on, and
+ * good() returns false. Check it before using what was read.
+ */
+class graph_image_reader {
+ public:
+  explicit inline graph_image_reader(boost::shared_ptr<graph_image_mapping> mapping) :
+      image(mapping), off(0), failed(false) { }
+
+  /**
+   * Checks the header of the image. Returns false if this is not a shard
+   * image, or if it was written by a different version or platform.
+   */
+  bool read_header();
+
+  /// Returns false if a read went past the end of the image.
+  inline bool good() const { return !failed; }
+
+  /// Returns the mapping the reader points into.
+  inline const boost::shared_ptr<graph_image_mapping>& mapping() const {
+    return image;
+  }
+
+  template<typename T>
+  inline void read(T& value) {
+    memcpy(&value, read_raw(sizeof(T)), sizeof(T));
+    align();
+  }
+
+  /// Returns a pointer to an array in the mapping, and its length in n.
+  template<typename T>
+  inline const T* read_array(size_t& n) {
+    uint64_t len;
+    read(len);
+    if (len > remaining() / sizeof(T)) {
+      fail();
+      n = 0;
+      return NULL;
+    }
+    n = len;
+    const T* ret = reinterpret_cast<const T*>(read_raw(n * sizeof(T)));
+    align();
+    return ret;
+  }
+
+  /// Copies an array into vec.
+  template<typename T>
+  inline void read_vector(std::vector<T>& vec) {
+    size_t n;
+    const T* data = read_array<T>(n);
+    vec.assign(data, data + n);
+  }
+
+  /// Reads an object written by graph_image_writer::write_archived().
+  template<typename T>
+  inline void read_archived(T& obj) {
+    size_t n;
+    const char* data = read_array<char>(n);
+    if (failed) return;
+    iarchive iarc(data, n);
+    iarc >> obj;
+  }
+
+  /**
+   * Returns a pointer to the next len bytes, without alignment. Past the
+   * end of the image, returns zeros if len is at most 8, or NULL.
+   */
+  inline const char* read_raw(size_t len) {
+    static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    if (len > remaining()) {
+      fail();
+      return len <= sizeof(zeros) ? zeros : NULL;
+    }
+    const char* ret = image->data() + off;
+    off += len;
+    return ret;
+  }
+
+  /// Skips to the next multiple of 8 bytes.
+  inline void align() {
+    off = (off + 7) & ~(size_t)7;
+  }
+
+ private:
+  boost::shared_ptr<graph_image_mapping> image;
+  size_t off;
+  bool failed;
+
+  // the bytes left after off, which may be past the end once aligned
+  inline size_t remaining() const {
+    return off < image->size() ? image->size() - off : 0;
+  }
+
+  inline void fail() {
+    failed = true;
+    off = image->size();
+  }
+};
+} // namespace graphlab
+#endif
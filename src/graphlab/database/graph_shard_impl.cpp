@@ -4,13 +4,29 @@ namespace graphlab {
   size_t graph_shard_impl::add_vertex(graph_vid_t vid, const graph_row& row) {
     vertex.push_back(vid);
     vertex_mirrors.push_back(boost::unordered_set<graph_shard_id_t>());
-    vertex_data.push_back(row);
+    append_row(vertex_columns, row);
     size_t pos = vertex.size()-1;
     // update vertex index
-    vertex_index.add_vertex(vid, &vertex_data[pos], pos);
+    vertex_index.add_vertex(vid, pos);
     return pos; 
   }
 
+  bool graph_shard_impl::find_vertices(size_t fieldpos, const graph_value& key,
+                                       std::vector<graph_vid_t>& out) const {
+    if (fieldpos >= vertex_columns.size()) {
+      return false;
+    }
+    std::vector<size_t> positions;
+    if (!vertex_columns[fieldpos].find(key, positions)) {
+      return false;
+    }
+    out.reserve(out.size() + positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+      out.push_back(vertex[positions[i]]);
+    }
+    return true;
+  }
+
   void graph_shard_impl::add_vertex_mirror(graph_vid_t v, graph_shard_id_t mirror_id) {
     if (mirror_id == shard_id)
       return;
@@ -20,27 +36,282 @@ namespace graphlab {
 
   size_t graph_shard_impl::add_edge(graph_vid_t source, graph_vid_t target, const graph_row& row) {
     edge.push_back(std::pair<graph_vid_t, graph_vid_t>(source, target));
-    edge_data.push_back(row);
+    append_row(edge_columns, row);
     size_t pos = edge.size()-1; 
     edge_index.add_edge(source,target, pos);
     return pos;
   }
 
+  void graph_shard_impl::add_vertex_field(const graph_field& field) {
+    vertex_columns.push_back(graph_column(field.type, vertex.size(), &payload_arena));
+    enable_indexes(vertex_columns.back(), field.is_indexed, field.is_ordered);
+  }
+
+  void graph_shard_impl::add_edge_field(const graph_field& field) {
+    edge_columns.push_back(graph_column(field.type, edge.size(), &payload_arena));
+    // no query looks edges up by value, a hash index would only cost memory
+    enable_indexes(edge_columns.back(), false, field.is_ordered);
+  }
+
+  void graph_shard_impl::enable_indexes(graph_column& column, bool hashed, bool ordered) {
+    if (hashed) {
+      bool success = column.enable_index();
+      ASSERT_TRUE(success);
+    }
+    if (ordered) {
+      bool success = column.enable_ordered_index();
+      ASSERT_TRUE(success);
+    }
+  }
+
+  void graph_shard_impl::append_row(std::vector<graph_column>& columns,
+                                    const graph_row& row) {
+    if (row.num_fields() == 0) {
+      for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i].push_back_null();
+      }
+    } else {
+      ASSERT_EQ(row.num_fields(), columns.size());
+      for (size_t i = 0; i < columns.size(); ++i) {
+        bool success = columns[i].push_back(*row.get_field(i));
+        ASSERT_TRUE(success);
+      }
+    }
+  }
+
+  void graph_shard_impl::compact_payloads() {
+    graph_payload_arena compacted;
+    for (size_t i = 0; i < vertex_columns.size(); ++i) {
+      vertex_columns[i].relocate(compacted);
+    }
+    for (size_t i = 0; i < edge_columns.size(); ++i) {
+      edge_columns[i].relocate(compacted);
+    }
+    payload_arena.swap(compacted);
+  }
+
+  void graph_shard_impl::save_columns(oarchive& oarc,
+                                      const std::vector<graph_column>& columns,
+                                      size_t& region_offset) {
+    oarc << columns.size();
+    for (size_t i = 0; i < columns.size(); ++i) {
+      columns[i].save(oarc, region_offset);
+    }
+  }
+
+  void graph_shard_impl::load_columns(iarchive& iarc,
+                                      std::vector<graph_column>& columns) {
+    size_t ncolumns;
+    iarc >> ncolumns;
+    columns.resize(ncolumns);
+    for (size_t i = 0; i < ncolumns; ++i) {
+      columns[i].set_arena(&payload_arena);
+      columns[i].load(iarc);
+    }
+  }
+
   void graph_shard_impl::load(iarchive& iarc) {
+    clear();
     iarc >> shard_id;
     iarc >> vertex;
-    iarc >> vertex_data;
+    load_columns(iarc, vertex_columns);
     iarc >> edgeid >> edge;
-    iarc >> edge_data;
+    load_columns(iarc, edge_columns);
+
+    size_t region_size;
+    iarc >> region_size;
+    rebase_columns(payload_arena.load_region(iarc, region_size));
+
     iarc >> vertex_index >> edge_index >> vertex_mirrors;
   }
 
+  void graph_shard_impl::rebase_columns(graph_payload_arena::handle_type base) {
+    for (size_t i = 0; i < vertex_columns.size(); ++i) {
+      vertex_columns[i].rebase(base);
+      // the field indexes are not saved, rebuild them
+      vertex_columns[i].rebuild_indexes();
+    }
+    for (size_t i = 0; i < edge_columns.size(); ++i) {
+      edge_columns[i].rebase(base);
+      edge_columns[i].rebuild_indexes();
+    }
+  }
+
+  void graph_shard_impl::save_image_columns(graph_image_writer& writer,
+                                            const std::vector<graph_column>& columns,
+                                            size_t& region_offset) {
+    writer.write<uint64_t>(columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+      columns[i].save_image(writer, region_offset);
+    }
+  }
+
+  bool graph_shard_impl::load_image_columns(graph_image_reader& reader,
+                                            std::vector<graph_column>& columns,
+                                            size_t nrows) {
+    uint64_t ncolumns;
+    reader.read(ncolumns);
+    // each column takes more than 8 bytes of the image
+    if (!reader.good() || ncolumns > reader.mapping()->size() / 8) {
+      return false;
+    }
+    columns.resize(ncolumns);
+    for (size_t i = 0; i < ncolumns; ++i) {
+      columns[i].set_arena(&payload_arena);
+      if (!columns[i].load_image(reader) || columns[i].size() != nrows) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool graph_shard_impl::payloads_within(size_t region_size) const {
+    for (size_t i = 0; i < vertex_columns.size(); ++i) {
+      if (!vertex_columns[i].payloads_within(region_size)) return false;
+    }
+    for (size_t i = 0; i < edge_columns.size(); ++i) {
+      if (!edge_columns[i].payloads_within(region_size)) return false;
+    }
+    return true;
+  }
+
+  void graph_shard_impl::save_image(graph_image_writer& writer) const {
+    size_t region_size = 0;
+    writer.write(shard_id);
+    writer.write_vector(vertex);
+    save_image_columns(writer, vertex_columns, region_size);
+    writer.write_vector(edgeid);
+    writer.write_vector(edge);
+    save_image_columns(writer, edge_columns, region_size);
+
+    writer.write<uint64_t>(region_size);
+    for (size_t i = 0; i < vertex_columns.size(); ++i) {
+      vertex_columns[i].save_payloads(writer);
+    }
+    for (size_t i = 0; i < edge_columns.size(); ++i) {
+      edge_columns[i].save_payloads(writer);
+    }
+    writer.align();
+
+    vertex_index.save_image(writer);
+    edge_index.save_image(writer);
+
+    // mirrors in compressed form: the mirrors of vertex[i] are
+    // mirror_ids[mirror_offsets[i]] ... mirror_ids[mirror_offsets[i+1]-1]
+    std::vector<uint64_t> mirror_offsets(1, 0);
+    std::vector<graph_shard_id_t> mirror_ids;
+    for (size_t i = 0; i < vertex_mirrors.size(); ++i) {
+      mirror_ids.insert(mirror_ids.end(), vertex_mirrors[i].begin(), vertex_mirrors[i].end());
+      mirror_offsets.push_back(mirror_ids.size());
+    }
+    writer.write_vector(mirror_offsets);
+    writer.write_vector(mirror_ids);
+  }
+
+  bool graph_shard_impl::load_image(graph_image_reader& reader) {
+    // the live content is kept until the image is known to be good
+    graph_shard_impl loaded;
+    if (!loaded.read_image(reader)) {
+      return false;
+    }
+    swap(loaded);
+    return true;
+  }
+
+  void graph_shard_impl::swap(graph_shard_impl& other) {
+    std::swap(shard_id, other.shard_id);
+    image.swap(other.image);
+    vertex.swap(other.vertex);
+    vertex_columns.swap(other.vertex_columns);
+    edgeid.swap(other.edgeid);
+    edge.swap(other.edge);
+    edge_columns.swap(other.edge_columns);
+    payload_arena.swap(other.payload_arena);
+    std::swap(edge_index, other.edge_index);
+    std::swap(vertex_index, other.vertex_index);
+    vertex_mirrors.swap(other.vertex_mirrors);
+    attach_columns();
+    other.attach_columns();
+  }
+
+  void graph_shard_impl::attach_columns() {
+    for (size_t i = 0; i < vertex_columns.size(); ++i) {
+      vertex_columns[i].set_arena(&payload_arena);
+    }
+    for (size_t i = 0; i < edge_columns.size(); ++i) {
+      edge_columns[i].set_arena(&payload_arena);
+    }
+  }
+
+  bool graph_shard_impl::read_image(graph_image_reader& reader) {
+    image = reader.mapping();
+    reader.read(shard_id);
+    reader.read_vector(vertex);
+    if (!load_image_columns(reader, vertex_columns, vertex.size())) {
+      clear();
+      return false;
+    }
+    reader.read_vector(edgeid);
+    reader.read_vector(edge);
+    if (!load_image_columns(reader, edge_columns, edge.size()) ||
+        (!edgeid.empty() && edgeid.size() != edge.size())) {
+      clear();
+      return false;
+    }
+
+    uint64_t region_size;
+    reader.read(region_size);
+    const char* region = reader.read_raw(region_size);
+    reader.align();
+    if (!reader.good() || !payloads_within(region_size)) {
+      clear();
+      return false;
+    }
+
+    if (!vertex_index.load_image(reader, vertex) ||
+        !edge_index.load_image(reader, edge.size())) {
+      clear();
+      return false;
+    }
+
+    size_t noffsets, nids;
+    const uint64_t* mirror_offsets = reader.read_array<uint64_t>(noffsets);
+    const graph_shard_id_t* mirror_ids = reader.read_array<graph_shard_id_t>(nids);
+    if (!reader.good() || noffsets != vertex.size() + 1) {
+      clear();
+      return false;
+    }
+    vertex_mirrors.resize(vertex.size());
+    for (size_t i = 0; i < vertex.size(); ++i) {
+      if (mirror_offsets[i] > mirror_offsets[i + 1] || mirror_offsets[i + 1] > nids) {
+        clear();
+        return false;
+      }
+      vertex_mirrors[i].insert(mirror_ids + mirror_offsets[i],
+                               mirror_ids + mirror_offsets[i + 1]);
+    }
+
+    // the image is consistent, the indexes may read the payloads
+    rebase_columns(payload_arena.adopt_region(region, region_size));
+    return true;
+  }
+
   void graph_shard_impl::save(oarchive& oarc) const {
+    size_t region_size = 0;
     oarc << shard_id;
     oarc << vertex;
-    oarc << vertex_data;
+    save_columns(oarc, vertex_columns, region_size);
     oarc << edgeid << edge;
-    oarc << edge_data;
+    save_columns(oarc, edge_columns, region_size);
+
+    oarc << region_size;
+    for (size_t i = 0; i < vertex_columns.size(); ++i) {
+      vertex_columns[i].save_payloads(oarc);
+    }
+    for (size_t i = 0; i < edge_columns.size(); ++i) {
+      edge_columns[i].save_payloads(oarc);
+    }
+
     oarc << vertex_index << edge_index << vertex_mirrors;
   }
 }
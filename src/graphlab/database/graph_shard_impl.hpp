@@ -2,9 +2,14 @@
 #define GRAPHLAB_DATABASE_GRAPH_SHARD_IMPL_HPP 
 #include <graphlab/database/basic_types.hpp>
 #include <graphlab/database/graph_row.hpp>
+#include <graphlab/database/graph_column.hpp>
+#include <graphlab/database/graph_payload_arena.hpp>
+#include <graphlab/database/graph_row_ref.hpp>
 #include <graphlab/database/graph_vertex_index.hpp>
 #include <graphlab/database/graph_edge_index.hpp>
+#include <graphlab/database/graph_shard_image.hpp>
 #include <boost/unordered_set.hpp>
+#include <boost/shared_ptr.hpp>
 
 namespace graphlab {
 /**
@@ -14,6 +19,12 @@ namespace graphlab {
  * This object is responsible for allocating and deleting
  * the edge data as well as the vertex data it masters.
  *
+ * Vertex and edge data are stored column-wise: one \ref graph_column
+ * per field. <code>vertex_row(i)</code> and <code>edge_row(i)</code>
+ * return a \ref graph_row_ref to the i'th row. String and blob payloads
+ * longer than <code>graph_column::INLINE_SIZE</code> are kept in one
+ * \ref graph_payload_arena shared by all the columns of the shard.
+ *
  * \note
  *  This object is not thread safe and may not be copied.
  *
@@ -40,13 +51,15 @@ struct graph_shard_impl {
 
   void clear() {
     vertex.clear();
-    vertex_data.clear();
+    vertex_columns.clear();
     edge.clear();
-    edge_data.clear();
+    edge_columns.clear();
+    payload_arena.clear();
     edgeid.clear();
     vertex_mirrors.clear();
     edge_index.clear();
     vertex_index.clear();
+    image.reset();
   }
 
   /** 
@@ -54,6 +67,12 @@ struct graph_shard_impl {
    */
   graph_shard_id_t shard_id;
 
+  /**
+   * The shard image the shard was loaded from, if any. The payload arena
+   * and the edge index may point into it.
+   */
+  boost::shared_ptr<graph_image_mapping> image;
+
   /**
    * An array of the vertex IDs in this shard. 
    * The array has num_vertices elements
@@ -61,10 +80,10 @@ struct graph_shard_impl {
   std::vector<graph_vid_t> vertex;
 
   /**
-   * An array of all the vertex data in this shard.
-   * The array has num_edges elements
+   * The vertex data in this shard, one column per vertex field.
+   * Each column has num_vertices elements.
    */
-  std::vector<graph_row> vertex_data;
+  std::vector<graph_column> vertex_columns;
 
   /**
    * An array of length num_edges where edgeid[i] is the internal edge id (relevant to shard)
@@ -80,10 +99,17 @@ struct graph_shard_impl {
   std::vector< std::pair<graph_vid_t, graph_vid_t> > edge;
 
   /**
-   * An array of length num_edges of all the edge data in the shard. 
-   * This array has a 1-1 corresponding to the edges array.
+   * The edge data in this shard, one column per edge field.
+   * Each column has num_edges elements, in 1-1 correspondence with
+   * the edges array.
+   */
+  std::vector<graph_column> edge_columns;
+
+  /**
+   * Storage of the long string/blob payloads of all the vertex and edge
+   * columns.
    */
-  std::vector<graph_row> edge_data;
+  graph_payload_arena payload_arena;
 
   /**
    * Index for adjacency structure lookup.
@@ -103,16 +129,98 @@ struct graph_shard_impl {
 
 
 // ----------- Serialization API ----------------
+  /**
+   * Saves the shard. The long payloads of all the columns are written
+   * last, as one region without the space of overwritten values.
+   */
   void save(oarchive& oarc) const;
   
+  /**
+   * Loads the shard. All the long payloads are read into a single
+   * contiguous block of the payload arena.
+   */
   void load(iarchive& iarc);
 
   void deepcopy(graph_shard_impl& out) const;
+
+  /**
+   * Writes the shard into a shard image (see \ref graph_image_writer).
+   * Fixed width arrays are written flat, the long payloads as a single
+   * region, and the edge index as frozen CSR/CSC arrays.
+   */
+  void save_image(graph_image_writer& writer) const;
+
+  /**
+   * Loads the shard from a mapped shard image. Fixed width arrays are
+   * copied with one memcpy each. The payloads and the compressed edge
+   * index are used in place, and the shard keeps the mapping alive.
+   * Hash indexes are rebuilt. Returns false, leaving the shard unchanged,
+   * if the image is truncated or its sections disagree.
+   */
+  bool load_image(graph_image_reader& reader);
+
+  /// Exchanges the content of two shards, ids included.
+  void swap(graph_shard_impl& other);
+
+// ----------- Data Access API ------------------
+  /**
+   * Returns a reference to the data of the vertex in the i'th position.
+   */
+  inline graph_row_ref vertex_row(size_t i) {
+    ASSERT_LT(i, vertex.size());
+    return graph_row_ref(&vertex_columns, i, true);
+  }
+
+  /**
+   * Returns a reference to the data of the edge in the i'th position.
+   */
+  inline graph_row_ref edge_row(size_t i) {
+    ASSERT_LT(i, edge.size());
+    return graph_row_ref(&edge_columns, i, false);
+  }
+
+// ----------- Schema Modification API ----------
+  /**
+   * Appends a column for field to the vertex data. All existing vertices
+   * get a NULL value in the new field. The column keeps a hash index of
+   * its values if the field is indexed, and an ordered index if the field
+   * is ordered.
+   */
+  void add_vertex_field(const graph_field& field);
+
+  /**
+   * Appends a column for field to the edge data. All existing edges
+   * get a NULL value in the new field. The column keeps an ordered index
+   * if the field is ordered.
+   */
+  void add_edge_field(const graph_field& field);
+
+// ----------- Secondary Index API ----------
+  /**
+   * Appends to out the ids of the vertices whose field at fieldpos equals
+   * key. Returns false if the field does not exist, is not indexed, or
+   * key has a different type.
+   */
+  bool find_vertices(size_t fieldpos, const graph_value& key,
+                     std::vector<graph_vid_t>& out) const;
+
+// ----------- Payload Management API ----------
+  /// Returns true if overwritten payloads take enough room to compact.
+  inline bool needs_compaction() const {
+    return payload_arena.needs_compaction();
+  }
+
+  /**
+   * Copies the live payloads into a fresh arena and frees the old one.
+   * Invalidates all the values borrowed from the columns.
+   */
+  void compact_payloads();
   
 // ----------- Modification API -----------------
   /**
    * Insert a (vid, row) into the shard. Return the position of the vertex in the shard.
-   * For optimization, take over the row pointer. 
+   * The row must either have no fields (all values are NULL) or match the 
+   * vertex columns.
    * */
   size_t add_vertex(graph_vid_t vid, const graph_row& row);
 
@@ -123,9 +231,47 @@ struct graph_shard_impl {
 
   /**
    * Insert a (source, target, row) into the shard. Return the position of the edge in the shard.
-   * For optimization purpose, the data ownership of row is transfered.
+   * The row must either have no fields (all values are NULL) or match the 
+   * edge columns.
    * */
   size_t add_edge(graph_vid_t source, graph_vid_t target, const graph_row& row);
+
+ private:
+  // Enables a hash index and an ordered index on column, as requested.
+  static void enable_indexes(graph_column& column, bool hashed, bool ordered);
+
+  // Append row to the end of the given columns.
+  static void append_row(std::vector<graph_column>& columns, const graph_row& row);
+
+  // Saves the columns, see graph_column::save().
+  static void save_columns(oarchive& oarc, const std::vector<graph_column>& columns,
+                           size_t& region_offset);
+
+  // Loads the columns and points them to the payload arena.
+  void load_columns(iarchive& iarc, std::vector<graph_column>& columns);
+
+  // Same as save_columns() and load_columns(), for shard images. Returns
+  // false unless every loaded column holds nrows values.
+  static void save_image_columns(graph_image_writer& writer,
+                                 const std::vector<graph_column>& columns,
+                                 size_t& region_offset);
+  bool load_image_columns(graph_image_reader& reader, std::vector<graph_column>& columns,
+                          size_t nrows);
+
+  // Returns true if the long payloads of the loaded columns all lie in a
+  // region of region_size bytes.
+  bool payloads_within(size_t region_size) const;
+
+  // Loads an image into this empty shard, see load_image(). Returns false,
+  // leaving the shard empty, if the image is corrupt.
+  bool read_image(graph_image_reader& reader);
+
+  // Points all the columns to the payload arena of this shard.
+  void attach_columns();
+
+  // Points the loaded columns to the payload region at base, and
+  // rebuilds their indexes.
+  void rebase_columns(graph_payload_arena::handle_type base);
 };
 } // namespace graphlab
 #endif
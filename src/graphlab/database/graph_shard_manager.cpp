@@ -9,8 +9,14 @@ namespace graphlab {
 
   graph_shard_id_t graph_shard_manager::get_master(graph_vid_t source,
                                                    graph_vid_t target) const {
-    std::vector<graph_shard_id_t> candidates;
-    get_joint_neighbors(get_master(source), get_master(target), candidates);
+    graph_shard_id_t shardi = get_master(source);
+    graph_shard_id_t shardj = get_master(target);
+    // read the candidates in place, this is called for every edge loaded
+    std::pair<graph_shard_id_t, graph_shard_id_t> key(std::min(shardi, shardj), std::max(shardi, shardj));
+    boost::unordered_map<std::pair<graph_shard_id_t, graph_shard_id_t>,
+        std::vector<graph_shard_id_t> >::const_iterator it = joint_map.find(key);
+    ASSERT_TRUE(it != joint_map.end());
+    const std::vector<graph_shard_id_t>& candidates = it->second;
     ASSERT_GT(candidates.size(), 0);
     return candidates[edge_hash(std::pair<graph_vid_t, graph_vid_t>(source, target)) % candidates.size()];
   }
@@ -0,0 +1,175 @@
+#include <graphlab/database/graph_traversal.hpp>
+#include <algorithm>
+#include <unistd.h>
+
+namespace graphlab {
+  int graph_traversal::traverse(uint64_t id, const std::vector<graph_vid_t>& sources,
+                                const graph_traversal_spec& spec,
+                                std::vector<std::pair<graph_vid_t, size_t> >& out) {
+    out.clear();
+    return run(id, sources, spec, &out, NULL);
+  }
+
+  int graph_traversal::count(uint64_t id, const std::vector<graph_vid_t>& sources,
+                             const graph_traversal_spec& spec, uint64_t& out) {
+    out = 0;
+    return run(id, sources, spec, NULL, &out);
+  }
+
+  int graph_traversal::degree_distribution(uint64_t id,
+                                           graph_traversal_spec::direction_type direction,
+                                           graph_degree_distribution& out) {
+    out = graph_degree_distribution();
+    request_list started;
+    int errorcode = start(id, graph_traversal_spec(0, direction), started);
+    if (errorcode == 0) {
+      errorcode = broadcast(request(DEGREES, id), NULL);
+    }
+    if (errorcode == 0) {
+      errorcode = sync(id);
+    }
+    if (errorcode == 0) {
+      request_list requests;
+      std::string msg = request(DEGREE_RESULT, id);
+      for (size_t i = 0; i < manager.num_shards(); ++i) {
+        requests.push_back(std::make_pair(i, msg));
+      }
+      std::vector<std::string> replies;
+      scatter(requests, replies);
+      for (size_t i = 0; i < replies.size() && errorcode == 0; ++i) {
+        graph_degree_distribution partial;
+        errorcode = parse_reply(replies[i], &partial);
+        out += partial;
+      }
+    }
+    std::vector<std::string> replies;
+    scatter(started, replies);
+    return errorcode;
+  }
+
+  int graph_traversal::start(uint64_t id, const graph_traversal_spec& spec,
+                             request_list& started) {
+    std::string msg = request(START, id, spec);
+    std::string end = request(END, id);
+    request_list requests;
+    for (size_t i = 0; i < manager.num_shards(); ++i) {
+      requests.push_back(std::make_pair(i, msg));
+    }
+    std::vector<std::string> replies;
+    scatter(requests, replies);
+    int errorcode = 0;
+    for (size_t i = 0; i < replies.size(); ++i) {
+      int err = parse_reply<int>(replies[i], NULL);
+      if (err == 0) {
+        started.push_back(std::make_pair(requests[i].first, end));
+      } else if (errorcode == 0) {
+        errorcode = err;
+      }
+    }
+    return errorcode;
+  }
+
+  int graph_traversal::run(uint64_t id, const std::vector<graph_vid_t>& sources,
+                           const graph_traversal_spec& spec,
+                           std::vector<std::pair<graph_vid_t, size_t> >* out,
+                           uint64_t* count) {
+    // the shards which started the traversal, and end it, unless the id
+    // was taken by another traversal
+    request_list started;
+    int errorcode = start(id, spec, started);
+
+    if (errorcode == 0) {
+      // each source starts on its master
+      std::vector<std::vector<graph_vid_t> > seeds(manager.num_shards());
+      for (size_t i = 0; i < sources.size(); ++i) {
+        seeds[manager.get_master(sources[i])].push_back(sources[i]);
+      }
+      request_list requests;
+      for (size_t i = 0; i < seeds.size(); ++i) {
+        if (!seeds[i].empty()) {
+          requests.push_back(std::make_pair(i, request(SEED, id, seeds[i])));
+        }
+      }
+      std::vector<std::string> replies;
+      scatter(requests, replies);
+      for (size_t i = 0; i < replies.size() && errorcode == 0; ++i) {
+        errorcode = parse_reply<int>(replies[i], NULL);
+      }
+    }
+
+    // the shards visit and expand the frontier of a hop before the next one
+    for (size_t hop = 0; errorcode == 0; ++hop) {
+      uint64_t nvisited = 0;
+      errorcode = broadcast(request(VISIT, id), &nvisited);
+      if (errorcode != 0 || nvisited == 0 || hop == spec.max_hops) {
+        break;
+      }
+      errorcode = sync(id);
+      if (errorcode == 0) {
+        errorcode = broadcast(request(EXPAND, id), NULL);
+      }
+      if (errorcode == 0) {
+        errorcode = sync(id);
+      }
+    }
+
+    if (errorcode == 0) {
+      request_list requests;
+      std::string msg = request(RESULT, id, out == NULL);
+      for (size_t i = 0; i < manager.num_shards(); ++i) {
+        requests.push_back(std::make_pair(i, msg));
+      }
+      std::vector<std::string> replies;
+      scatter(requests, replies);
+      for (size_t i = 0; i < replies.size() && errorcode == 0; ++i) {
+        if (out == NULL) {
+          uint64_t n = 0;
+          errorcode = parse_reply(replies[i], &n);
+          *count += n;
+        } else {
+          std::vector<std::pair<graph_vid_t, size_t> > vertices;
+          errorcode = parse_reply(replies[i], &vertices);
+          out->insert(out->end(), vertices.begin(), vertices.end());
+        }
+      }
+    }
+
+    // the state is dropped even if the traversal failed
+    std::vector<std::string> replies;
+    scatter(started, replies);
+    return errorcode;
+  }
+
+  int graph_traversal::sync(uint64_t id) {
+    std::string msg = request(SYNC, id);
+    for (size_t delay_us = 50; ; delay_us = std::min(2 * delay_us, (size_t)MAX_SYNC_DELAY_US)) {
+      uint64_t pending = 0;
+      int errorcode = broadcast(msg, &pending);
+      if (errorcode != 0 || pending == 0) {
+        return errorcode;
+      }
+      usleep(delay_us);
+    }
+  }
+
+  int graph_traversal::broadcast(const std::string& msg, uint64_t* sum) {
+    request_list requests;
+    for (size_t i = 0; i < manager.num_shards(); ++i) {
+      requests.push_back(std::make_pair(i, msg));
+    }
+    std::vector<std::string> replies;
+    scatter(requests, replies);
+    int errorcode = 0;
+    for (size_t i = 0; i < replies.size(); ++i) {
+      uint64_t n = 0;
+      int err = parse_reply(replies[i], sum == NULL ? NULL : &n);
+      if (err != 0 && errorcode == 0) {
+        errorcode = err;
+      }
+      if (sum != NULL) {
+        *sum += n;
+      }
+    }
+    return errorcode;
+  }
+} // namespace graphlab
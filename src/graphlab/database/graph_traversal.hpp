@@ -0,0 +1,196 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_TRAVERSAL_HPP
+#define GRAPHLAB_DATABASE_GRAPH_TRAVERSAL_HPP
+#include <string>
+#include <vector>
+#include <graphlab/database/basic_types.hpp>
+#include <graphlab/database/graph_value.hpp>
+#include <graphlab/database/graph_row_filter.hpp>
+#include <graphlab/database/graph_aggregate.hpp>
+#include <graphlab/database/graph_shard_manager.hpp>
+#include <graphlab/database/query_message.hpp>
+#include <graphlab/database/errno.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <boost/function.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * Describes a breadth first traversal from a set of source vertices.
+ *
+ * The sources are at hop 0. Each hop follows the edges in the given
+ * direction from the vertices first reached in the previous hop, up to
+ * max_hops hops. An edge is only followed if its data is accepted by
+ * predicate. Vertices first reached in fewer than min_hops hops are not
+ * part of the result.
+ */
+struct graph_traversal_spec {
+  enum direction_type { OUT_EDGES, IN_EDGES, ALL_EDGES };
+
+  size_t min_hops;
+  size_t max_hops;
+  direction_type direction;
+  graph_condition predicate;
+
+  /// Follows all out edges up to max_hops hops.
+  graph_traversal_spec(size_t max_hops = 1, direction_type direction = OUT_EDGES)
+      : min_hops(0), max_hops(max_hops), direction(direction) { }
+
+  /// Only follows the edges whose field at fieldpos compares to value as op.
+  void set_predicate(size_t fieldpos, graph_condition::op_type op, const graph_value& value) {
+    predicate = graph_condition(fieldpos, op, value);
+  }
+
+  /// Returns true if edges are followed regardless of their data.
+  inline bool follows_all() const { return predicate.op == graph_condition::ANY; }
+
+  void save(oarchive& oarc) const {
+    oarc << min_hops << max_hops << direction << predicate;
+  }
+
+  void load(iarchive& iarc) {
+    iarc >> min_hops >> max_hops >> direction >> predicate;
+  }
+};
+
+/**
+ * \ingroup group_graph_database
+ * Runs a \ref graph_traversal_spec on the shards, which exchange the
+ * frontier among themselves.
+ *
+ * Every message is a GET TRAVERSE query starting with an op_type and the
+ * id of the traversal. A hop takes two rounds. In VISIT, the master of each
+ * vertex reached drops the ones it already visited, and forwards the new
+ * ones to the FRONTIER of the shards holding their edges, i.e. itself and
+ * the mirrors of the vertex. In EXPAND, each shard follows the local edges
+ * of its frontier and sends the neighbors to the CANDIDATES of their
+ * masters. The driver only sees the number of new vertices of each hop,
+ * and the result once the traversal is over.
+ *
+ * The shards send to each other in the background, so that no shard
+ * waits for another while serving a request. After each round, the
+ * driver polls them with SYNC until all they sent has arrived.
+ *
+ * The degree distribution uses the same state and rounds. In DEGREES,
+ * each shard counts the degrees over its edges, and sends those of the
+ * vertices mastered elsewhere to their master, which adds them up.
+ */
+class graph_traversal {
+ public:
+  enum op_type {
+    START,       // spec: creates the traversal state, EDUP if the id is taken
+    SEED,        // vids: sources mastered by the shard
+    VISIT,       // -> number of vertices first reached in this hop
+    EXPAND,      // follows the edges of the frontier
+    FRONTIER,    // vids: vertices to expand on the shard
+    CANDIDATES,  // vids: vertices reached on another shard
+    SYNC,        // -> number of vertices sent to other shards not arrived yet
+    RESULT,      // count_only -> count, or vector of (vid, hop)
+    END,         // drops the traversal state
+    DEGREES,     // counts the degrees over the local edges, in the spec direction
+    PARTIAL_DEGREES,  // (vid, degree) pairs counted on another shard
+    DEGREE_RESULT     // -> graph_degree_distribution of the vertices mastered
+  };
+
+  /// Requests to send, and the shards to send them to.
+  typedef std::vector<std::pair<graph_shard_id_t, std::string> > request_list;
+
+  /**
+   * Sends each request and fills replies with the reply of each, in the
+   * same order. The reply of a shard which cannot be reached is empty.
+   */
+  typedef boost::function<void (const request_list&, std::vector<std::string>&)> scatter_function;
+
+  /// Returns the message for op on the traversal id.
+  static std::string request(op_type op, uint64_t id) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::TRAVERSE);
+    qm << op << id;
+    return take_message(qm);
+  }
+
+  /// Same as request(), with an argument.
+  template<typename T>
+  static std::string request(op_type op, uint64_t id, const T& arg) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::TRAVERSE);
+    qm << op << id << arg;
+    return take_message(qm);
+  }
+
+  /**
+   * Parses the error code of a reply, then its content into out unless
+   * out is NULL. An empty reply means the shard could not be reached.
+   */
+  template<typename T>
+  static int parse_reply(const std::string& reply, T* out) {
+    if (reply.empty()) {
+      return ESRVUNREACH;
+    }
+    iarchive iarc(reply.c_str(), reply.length());
+    int errorcode = 0;
+    iarc >> errorcode;
+    if (errorcode == 0 && out != NULL) {
+      iarc >> *out;
+    }
+    return errorcode;
+  }
+
+  /// Drives traversals over the shards of manager, reached with scatter.
+  graph_traversal(const graph_shard_manager& manager, const scatter_function& scatter)
+      : manager(manager), scatter(scatter) { }
+
+  /**
+   * Runs the traversal id of spec from sources, and fills out with the
+   * vertices reached and the hop they were first reached at, in no
+   * particular order. Returns 0 on success, or the first error a shard
+   * replied.
+   */
+  int traverse(uint64_t id, const std::vector<graph_vid_t>& sources,
+               const graph_traversal_spec& spec,
+               std::vector<std::pair<graph_vid_t, size_t> >& out);
+
+  /// Same as traverse(), but only the number of vertices reached is returned.
+  int count(uint64_t id, const std::vector<graph_vid_t>& sources,
+            const graph_traversal_spec& spec, uint64_t& out);
+
+  /**
+   * Fills out with the number of vertices of each degree over the edges
+   * in direction, using the state of traversal id. Returns 0 on success,
+   * or the first error a shard replied.
+   */
+  int degree_distribution(uint64_t id, graph_traversal_spec::direction_type direction,
+                          graph_degree_distribution& out);
+
+ private:
+  static std::string take_message(QueryMessage& qm) {
+    std::string msg(qm.message(), qm.length());
+    free(qm.message());
+    return msg;
+  }
+
+  /**
+   * Sends START of spec to every shard, and adds the END of id to started
+   * for those which started. Returns the first error.
+   */
+  int start(uint64_t id, const graph_traversal_spec& spec, request_list& started);
+
+  int run(uint64_t id, const std::vector<graph_vid_t>& sources,
+          const graph_traversal_spec& spec,
+          std::vector<std::pair<graph_vid_t, size_t> >* out, uint64_t* count);
+
+  /**
+   * Sends msg to every shard and sums the uint64_t replies into sum if it
+   * is not NULL. Returns the first error.
+   */
+  int broadcast(const std::string& msg, uint64_t* sum);
+
+  // Waits until the shards have nothing left to send in the round of id.
+  int sync(uint64_t id);
+
+  // the longest wait between two SYNC of a round, in microseconds
+  static const size_t MAX_SYNC_DELAY_US = 10000;
+
+  const graph_shard_manager& manager;
+  scatter_function scatter;
+};
+} // namespace graphlab
+#endif
@@ -1,11 +1,14 @@
 #include <graphlab/database/graph_value.hpp>
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
+#include <utility>
 namespace graphlab {
   graph_value::graph_value(): 
       _len(sizeof(graph_int_t)), 
       _type(INT_TYPE), 
-      _null_value(true) {
+      _null_value(true),
+      _own_data(true) {
         memset(&_data, 0, sizeof(_data));
       }
 
@@ -14,7 +17,8 @@ namespace graphlab {
   }
 
   graph_value::graph_value(const graph_value& other) :
-      _len(other._len), _type(other._type), _null_value(other._null_value) {
+      _len(other._len), _type(other._type), _null_value(other._null_value),
+      _own_data(true) {
         if (is_scalar_graph_datatype(_type)) {
           _data = other._data;
         } else {
@@ -24,26 +28,52 @@ namespace graphlab {
       }
 
   graph_value& graph_value::operator=(const graph_value& other) { 
+    if (this == &other) {
+      return *this;
+    }
+    char* old_bytes = release_owned_bytes();
     _type = other._type;
     _len = other._len;
     _null_value = other._null_value;
     if (is_scalar_graph_datatype(_type)) {
+      free(old_bytes);
       _data = other._data;
     } else {
-      if(_data.bytes != NULL) {
-        _data.bytes = (char*) realloc(_data.bytes, _len);
-      } else {
-        _data.bytes = (char*) malloc(_len);
-      }
+      _data.bytes = (char*) realloc(old_bytes, _len > 0 ? _len : 1);
       memcpy(_data.bytes, other._data.bytes, _len);
     }
     return *this; 
   }
 
 
+#if defined(__cplusplus) && __cplusplus >= 201103L
+  graph_value::graph_value(graph_value&& other) noexcept :
+      _data(other._data), _len(other._len), _type(other._type),
+      _null_value(other._null_value), _own_data(other._own_data) {
+        other.init(other._type);
+      }
+
+  graph_value& graph_value::operator=(graph_value&& other) noexcept {
+    if (this != &other) {
+      graph_value tmp(std::move(other));
+      swap(tmp);
+    }
+    return *this;
+  }
+#endif
+
+  void graph_value::swap(graph_value& other) {
+    std::swap(_data, other._data);
+    std::swap(_len, other._len);
+    std::swap(_type, other._type);
+    std::swap(_null_value, other._null_value);
+    std::swap(_own_data, other._own_data);
+  }
+
   void graph_value::init(graph_datatypes_enum type) {
     _type = type; 
     _null_value = true;
+    _own_data = true;
     memset(&_data, 0, sizeof(_data));
     switch(type) {
      case STRING_TYPE:
@@ -62,13 +92,61 @@ namespace graphlab {
   void graph_value::free_data() {
     if ((_type == STRING_TYPE || _type == BLOB_TYPE)) { 
       if (_data.bytes != NULL) {
-        free(_data.bytes);
-        _data.bytes = NULL;
+        free(release_owned_bytes());
         _len = 0;
       }
     }
   }
 
+  char* graph_value::release_owned_bytes() {
+    char* ret = NULL;
+    if (!is_scalar_graph_datatype(_type)) {
+      if (_own_data) {
+        ret = _data.bytes;
+      }
+      _data.bytes = NULL;
+    }
+    _own_data = true;
+    return ret;
+  }
+
+  bool graph_value::borrow(const char* data, size_t len) {
+    if (is_scalar_graph_datatype(_type)) {
+      return false;
+    }
+    free(release_owned_bytes());
+    _data.bytes = const_cast<char*>(data);
+    _len = len;
+    _null_value = false;
+    _own_data = false;
+    return true;
+  }
+
+  void graph_value::make_owned() {
+    if (!_own_data && !is_scalar_graph_datatype(_type)) {
+      char* copy = (char*)malloc(_len > 0 ? _len : 1);
+      memcpy(copy, _data.bytes, _len);
+      _data.bytes = copy;
+      _own_data = true;
+    }
+  }
+
+  void graph_value::assign_bytes(const char* val, size_t length) {
+    _null_value = false;
+    if (!_own_data) {
+      _data.bytes = NULL;
+      _own_data = true;
+    }
+    if (_data.bytes == NULL || length != _len) {
+      _data.bytes = reinterpret_cast<char*>(realloc(_data.bytes,
+                                                    length > 0 ? length : 1));
+    }
+    _len = length;
+    if (val != _data.bytes) {
+      memcpy(_data.bytes, val, _len);
+    }
+  }
+
   const void* graph_value::get_raw_pointer() const {
     if (is_null()) {
       return NULL;
@@ -80,6 +158,7 @@ namespace graphlab {
   }
 
   void* graph_value::get_mutable_raw_pointer() {
+    make_owned();
     if (is_null()) {
       return NULL;
     } else if (is_scalar_graph_datatype(_type)) {
@@ -167,9 +246,9 @@ namespace graphlab {
      case VID_TYPE:
        return set_vid(*((graph_vid_t*)val));
      case STRING_TYPE:
-       return set_string(std::string(val, length));
      case BLOB_TYPE:
-       return set_blob(val, length);
+       assign_bytes(val, length);
+       return true;
      default:
        return false;
     }
@@ -251,16 +330,7 @@ namespace graphlab {
 
   bool graph_value::set_string(const graph_string_t& val){
     if (type() == STRING_TYPE) {
-      // if we need to resize.
-      _null_value = false;
-      if (val.length() != _len) {
-        _len = val.length();
-        _data.bytes = reinterpret_cast<char*>(realloc(_data.bytes, _len));
-        memcpy(_data.bytes, val.c_str(), _len);
-      }
-      else if (memcmp(_data.bytes, val.c_str(), _len) != 0) {
-        memcpy(_data.bytes, val.c_str(), _len);
-      }
+      assign_bytes(val.c_str(), val.length());
       return true;
     } else {
       return false;
@@ -273,16 +343,7 @@ namespace graphlab {
 
   bool graph_value::set_blob(const char* val, size_t length) {
     if (type() == BLOB_TYPE) {
-      // if we need to resize.
-      _null_value = false;
-      if (length != _len) {
-        _len = length;
-        _data.bytes = reinterpret_cast<char*>(realloc(_data.bytes, _len));
-        memcpy(_data.bytes, val, _len);
-      } else {
-        if (val != _data.bytes) 
-          memcpy(_data.bytes, val, _len);
-      } 
+      assign_bytes(val, length);
       return true;
     } else {
       return false;
@@ -32,6 +32,17 @@ class graph_value {
   /// Copy assignment 
   graph_value& operator=(const graph_value& other); 
 
+#if defined(__cplusplus) && __cplusplus >= 201103L
+  /// Move constructor. Takes over the payload, other becomes NULL.
+  graph_value(graph_value&& other) noexcept;
+
+  /// Move assignment. Takes over the payload, other becomes NULL.
+  graph_value& operator=(graph_value&& other) noexcept;
+#endif
+
+  /// Exchanges the contents of two values without copying payloads.
+  void swap(graph_value& other);
+
 
       
   /// Initialize the data with given type and NULL value.
@@ -69,6 +80,12 @@ class graph_value {
   /// If true, this is a null value and the data field is ignored
   bool _null_value;
 
+  /** If false, the "bytes" field of a string / blob points to memory owned
+   *  by someone else (typically the payload arena of a shard), and is
+   *  neither freed nor modified in place by this object.
+   */
+  bool _own_data;
+
   
   /// Frees the data pointer resetting it to NULL if it is a string / blob.
   void free_data();
@@ -87,6 +104,23 @@ class graph_value {
     return _null_value;
   }
 
+  /// Returns false if the string / blob payload is borrowed from elsewhere.
+  inline bool owns_data() const {
+    return _own_data;
+  }
+
+  /**
+   * Makes a string / blob value point to len bytes at data without
+   * copying them. The caller must keep the memory alive and unchanged
+   * for as long as the value is in use. Any modification of the value
+   * first copies the payload into memory owned by the value.
+   * Returns false if the value is not a string or blob.
+   */
+  bool borrow(const char* data, size_t len);
+
+  /// Copies a borrowed payload into memory owned by this object.
+  void make_owned();
+
   /** Returns a constant raw pointer to the data. Returns NULL if data is NULL.
    *  Realloc or free should not be called on the returned pointer.
    *  Modifications to the data also should not be made.
@@ -241,21 +275,52 @@ class graph_value {
    * Serialization interface.
    */
   inline void load(iarchive& iarc) {
+    char* old_bytes = release_owned_bytes();
     iarc >> _type >> _null_value >> _len;
-     if (!_null_value) {
-       if (is_scalar_graph_datatype(_type)) {
-          iarc.read((char*)(&_data), _len);
-       } else {
-         if (_data.bytes == NULL) {
-            _data.bytes = (char*)malloc(_len);
-         } else {
-            _data.bytes = (char*)realloc(_data.bytes, _len);
-         }
-          iarc.read(_data.bytes, _len);
-       }
-     }
+    if (_null_value) {
+      free(old_bytes);
+      memset(&_data, 0, sizeof(_data));
+    } else if (is_scalar_graph_datatype(_type)) {
+      free(old_bytes);
+      iarc.read((char*)(&_data), _len);
+    } else {
+      _data.bytes = (char*)realloc(old_bytes, _len > 0 ? _len : 1);
+      iarc.read(_data.bytes, _len);
+    }
   }
 
+  /**
+   * Same as load(), but a string or blob payload is borrowed from the
+   * buffer of the archive (see borrow()) when it reads from memory.
+   */
+  inline void load_borrowed(iarchive& iarc) {
+    if (iarc.buf == NULL) {
+      load(iarc);
+      return;
+    }
+    free(release_owned_bytes());
+    iarc >> _type >> _null_value >> _len;
+    if (_null_value) {
+      memset(&_data, 0, sizeof(_data));
+    } else if (is_scalar_graph_datatype(_type)) {
+      iarc.read((char*)(&_data), _len);
+    } else {
+      _data.bytes = const_cast<char*>(iarc.buf + iarc.off);
+      _own_data = false;
+      iarc.off += _len;
+    }
+  }
+
+ private:
+  /**
+   * Returns the heap buffer owned by this value, or NULL if there is none,
+   * and forgets about it. The caller takes over the buffer.
+   */
+  char* release_owned_bytes();
+
+  /// Replaces the payload of a string / blob with a copy of val.
+  void assign_bytes(const char* val, size_t length);
+
  private:
   // output the string format to ostream.
   friend std::ostream& operator<<(std::ostream &strm, const graph_value& v) {
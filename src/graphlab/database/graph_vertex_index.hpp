@@ -3,10 +3,13 @@
 #include <vector>
 #include <graphlab/database/basic_types.hpp>
 #include <graphlab/database/graph_field.hpp>
+#include <graphlab/database/graph_shard_image.hpp>
 #include <graphlab/serialization/iarchive.hpp>
 #include <graphlab/serialization/oarchive.hpp>
 #include <graphlab/logger/assertions.hpp>
 #include <boost/unordered_map.hpp>
+#include <graphlab/util/hopscotch_map.hpp>
+#include <algorithm>
 #include <graphlab/macros_def.hpp>
 namespace graphlab {
   /** 
@@ -14,87 +17,248 @@ namespace graphlab {
    * An index on vertex id. 
    *
    * This class provide lookup for the vertex locations in a shard. 
-   * The primary key is the vid. TODO: add support for secondary keys specified in the 
-   * <code>graph_field</code>.
+   * The primary key is the vid. Secondary keys on indexed fields are
+   * kept by the columns of the shard, see \ref graph_field_index.
+   *
+   * The index has two modes. While the vids of the shard fall in a range
+   * at most <code>DENSE_FACTOR</code> times larger than the number of
+   * vertices, positions are kept in an array indexed by
+   * <code>vid - dense_base</code>. Otherwise the index uses an open
+   * addressing hopscotch table, where a lookup touches a single
+   * neighborhood of the table. Either way, <code>find()</code> answers
+   * both "is it here" and "where" with one probe.
+   *
+   * Vids usually arrive in random order during ingress, so the range of a
+   * contiguous shard fills up before its vertices do. The hash table is
+   * therefore checked for density each time the number of vertices
+   * reaches a power of two, and converted to the dense array when it fits.
    */
   class graph_vertex_index {
    public:
+     /// Returned by find() when the vid is not in the index.
+     static const size_t npos = (size_t)(-1);
+
+     /// The dense array may span up to DENSE_FACTOR slots per vertex.
+     static const size_t DENSE_FACTOR = 2;
+
+     /// Slack allowing small shards to stay dense.
+     static const size_t DENSE_SLACK = 1024;
+
+     inline graph_vertex_index() : dense(true), dense_base(0), count(0),
+                                   vid_min(0), vid_max(0) { }
+
+     /// Returns the position of the vertex in the shard, or npos if absent.
+     inline size_t find(graph_vid_t vid) const {
+       if (dense) {
+         graph_vid_t offset = vid - dense_base;
+         return offset < dense_pos.size() ? dense_pos[offset] : size_t(npos);
+       }
+       map_type::const_iterator it = index_map.find(vid);
+       return it == index_map.end() ? size_t(npos) : (*it).second;
+     }
 
      // Return the existence of a vertex with given id.
      inline bool has_vertex(graph_vid_t vid) const {
-       return !(index_map.find(vid) == index_map.end());
+       return find(vid) != npos;
      };
 
      // Return the index of a vertex in a shard.
      inline size_t get_index (graph_vid_t vid) const {
-       ASSERT_TRUE(has_vertex(vid));
-       return index_map.find(vid)->second;
+       size_t pos = find(vid);
+       ASSERT_NE(pos, size_t(npos));
+       return pos;
      }
 
      // Update the index by adding a vertex
-     inline bool add_vertex(graph_vid_t vid, graph_row* value, size_t pos) {
-       if (has_vertex(vid)) {
+     inline bool add_vertex(graph_vid_t vid, size_t pos) {
+       if (dense && !reserve_dense(vid)) {
+         to_hash();
+       }
+       if (dense) {
+         size_t& slot = dense_pos[vid - dense_base];
+         if (slot != npos) return false;
+         slot = pos;
+       } else if (!index_map.insert(std::make_pair(vid, pos)).second) {
          return false;
        }
-
-       // Add vertex to primary index
-       index_map[vid] = pos;
-
-       // Add vertex to all existing index
-       // typedef boost::unordered_map<std::string, size_t>::iterator indexiterator;
-       // indexiterator iter;
-       // while (iter != field_name_map.end()) {
-       //   graph_int_t key = -1;
-       //   if (value->get_field(iter->first.c_str())->get_integer(&key)) {
-       //     (int_key_map[iter->second])[key] = vid;
-       //   }
-       //   iter++;
-       // } 
+       vid_min = (count == 0) ? vid : std::min(vid_min, vid);
+       vid_max = (count == 0) ? vid : std::max(vid_max, vid);
+       ++count;
+       // check if the hash table has become dense enough
+       if (!dense && (count & (count - 1)) == 0 &&
+           vid_max - vid_min < DENSE_FACTOR * count) {
+         to_dense();
+       }
        return true;
      }
 
+     /// Returns the number of vertices in the index.
+     inline size_t size() const {
+       return count;
+     }
+
+     /// Returns true if the index is a direct-address array.
+     inline bool is_dense() const {
+       return dense;
+     }
+
      inline void clear() {
+       dense = true;
+       dense_base = 0;
+       count = vid_min = vid_max = 0;
+       std::vector<size_t>().swap(dense_pos);
        index_map.clear();
      }
 
      inline void save (oarchive& oarc) const {
-       oarc << index_map;
+       oarc << dense << count << vid_min << vid_max;
+       if (dense) {
+         oarc << dense_base << dense_pos;
+       } else {
+         oarc << index_map;
+       }
      }
      inline void load (iarchive& iarc) {
-       iarc >> index_map;
+       clear();
+       iarc >> dense >> count >> vid_min >> vid_max;
+       if (dense) {
+         iarc >> dense_base >> dense_pos;
+       } else {
+         iarc >> index_map;
+       }
+     }
+
+     /**
+      * Writes the index into a shard image. The dense array is written as
+      * is; the hash table is rebuilt from the vertex array on load.
+      */
+     inline void save_image(graph_image_writer& writer) const {
+       writer.write<uint8_t>(dense);
+       writer.write(count);
+       writer.write(vid_min);
+       writer.write(vid_max);
+       writer.write(dense_base);
+       writer.write_vector(dense_pos);
+     }
+
+     /**
+      * Loads an index written by save_image() for the given vertex array.
+      * Returns false, leaving the index empty, if the image is truncated
+      * or the index does not map each vid of vertex to its position.
+      */
+     inline bool load_image(graph_image_reader& reader,
+                            const std::vector<graph_vid_t>& vertex) {
+       clear();
+       uint8_t is_dense;
+       reader.read(is_dense);
+       reader.read(count);
+       reader.read(vid_min);
+       reader.read(vid_max);
+       reader.read(dense_base);
+       reader.read_vector(dense_pos);
+       dense = is_dense;
+       bool valid = reader.good() && count == vertex.size();
+       if (valid && dense) {
+         size_t found = 0;
+         for (size_t i = 0; valid && i < dense_pos.size(); ++i) {
+           if (dense_pos[i] != npos) {
+             valid = dense_pos[i] < vertex.size() &&
+                 vertex[dense_pos[i]] == graph_vid_t(dense_base + i);
+             ++found;
+           }
+         }
+         valid = valid && found == count;
+       } else if (valid) {
+         index_map.rehash(2 * count);
+         for (size_t i = 0; valid && i < vertex.size(); ++i) {
+           valid = index_map.insert(std::make_pair(vertex[i], i)).second;
+         }
+       }
+       if (!valid) {
+         clear();
+       }
+       return valid;
      }
 
+    private:
+      typedef hopscotch_map<graph_vid_t, size_t, false> map_type;
+
+      /**
+       * Grows the dense array so that it covers vid. The array grows
+       * geometrically in either direction. Returns false if the array
+       * would become too sparse.
+       */
+      inline bool reserve_dense(graph_vid_t vid) {
+        if (dense_pos.empty()) {
+          dense_base = vid;
+          dense_pos.resize(1, size_t(npos));
+          return true;
+        }
+        graph_vid_t end = dense_base + dense_pos.size();
+        if (vid >= dense_base && vid < end) {
+          return true;
+        }
+        size_t limit = DENSE_FACTOR * (count + 1) + DENSE_SLACK;
+        if (vid >= end) {
+          size_t newsize = std::max((size_t)(vid - dense_base) + 1,
+                                    std::min(dense_pos.size() * 2, limit));
+          if (newsize > limit) return false;
+          dense_pos.resize(newsize, size_t(npos));
+        } else {
+          size_t grow = std::max((size_t)(dense_base - vid),
+                                 std::min(dense_pos.size(), limit - dense_pos.size()));
+          // do not wrap around below 0
+          grow = std::min(grow, (size_t)dense_base);
+          if (dense_pos.size() + grow > limit) return false;
+          dense_pos.insert(dense_pos.begin(), grow, size_t(npos));
+          dense_base -= grow;
+        }
+        return true;
+      }
+
+      /// Moves the content of the dense array into the hash table.
+      inline void to_hash() {
+        index_map.clear();
+        index_map.rehash(2 * count);
+        for (size_t i = 0; i < dense_pos.size(); ++i) {
+          if (dense_pos[i] != npos) {
+            index_map.insert(std::make_pair(graph_vid_t(dense_base + i), dense_pos[i]));
+          }
+        }
+        std::vector<size_t>().swap(dense_pos);
+        dense = false;
+      }
 
-     // bool build_index(graph_field& field, const std::vector<graph_row*> vertices) {
-     //   if (field.type != INT_TYPE || field.is_indexed) {
-     //     return false;
-     //   } else {
-     //     boost::unordered_map<graph_int_t, graph_vid_t>  newindex;
-     //     typedef boost::unordered_map<graph_vid_t, size_t>::iterator iterator;
-     //     iterator iter = index_map.begin(); 
-     //     while (iter != index_map.end()) {
-     //       graph_row* row = vertices[iter->second];
-     //       graph_int_t key = -1;
-     //       if (row->get_field(field.name.c_str())->get_integer(&key)) {
-     //         newindex[key] = iter->first;
-     //       }
-     //       iter++;
-     //     }
-     //     int_key_map.push_back(newindex);
-     //     field_name_map[field.name] = int_key_map.size()-1;
-     //     return true;
-     //   }
-     // }
+      /// Moves the content of the hash table into a dense array.
+      inline void to_dense() {
+        dense_base = vid_min;
+        dense_pos.assign(vid_max - vid_min + 1, size_t(npos));
+        for (map_type::const_iterator it = index_map.begin();
+             it != index_map.end(); ++it) {
+          dense_pos[(*it).first - dense_base] = (*it).second;
+        }
+        index_map.clear();
+        dense = true;
+      }
 
     private:
-      // map from vid -> index in the vertex_store 
-      boost::unordered_map<graph_vid_t, size_t> index_map; 
+      // true if the positions are stored in dense_pos
+      bool dense;
+
+      // dense_pos[i] is the position of vertex dense_base + i, or npos.
+      graph_vid_t dense_base;
+      std::vector<size_t> dense_pos;
+
+      // map from vid -> index in the vertex_store, when not dense
+      map_type index_map; 
+
+      // number of vertices in the index
+      size_t count;
 
-      // // map from int key -> index in the vertex_store 
-      // std::vector< boost::unordered_map<graph_int_t, graph_vid_t> > int_key_map; 
+      // smallest and largest vid in the index
+      graph_vid_t vid_min;
+      graph_vid_t vid_max;
 
-      // // map from field to the index location
-      // boost::unordered_map<std::string, size_t> field_name_map;
   };
 } // namespace graphlab
 #include <graphlab/macros_undef.hpp>
@@ -62,6 +62,22 @@ namespace graphlab {
     free(msg);
   }
 
+  void graphdb_query_object::query_each (
+      const std::vector<std::pair<graph_shard_id_t, std::string> >& requests,
+      std::vector<std::string>& replies) {
+    std::vector<query_result> futures;
+    for (size_t i = 0; i < requests.size(); ++i) {
+      const std::string& msg = requests[i].second;
+      char* msg_copy = (char*)malloc(msg.length());
+      memcpy(msg_copy, msg.data(), msg.length());
+      futures.push_back(query(requests[i].first, msg_copy, msg.length()));
+    }
+    replies.resize(futures.size());
+    for (size_t i = 0; i < futures.size(); ++i) {
+      replies[i] = (futures[i].get_status() == 0) ? futures[i].get_reply() : std::string();
+    }
+  }
+
   // query a random shard server
   query_result graphdb_query_object::query_any (char* msg, size_t msg_len) {
     boost::random::uniform_int_distribution<> runif(0,shard_list.size()-1);
@@ -87,4 +103,54 @@ namespace graphlab {
       return err;
     }
   }
+
+  int graphdb_query_object::parse_row_reply(query_result& future, graph_row& out,
+                                            bool is_vertex, const graph_row_codec& codec,
+                                            bool& compact) {
+    compact = true;
+    if (future.get_status() != 0) {
+      logstream(LOG_ERROR) << glstrerr(ESRVUNREACH) << std::endl;
+      return ESRVUNREACH;
+    }
+    std::string reply = future.get_reply();
+    iarchive iarc(reply.c_str(), reply.length());
+    int err = 0;
+    iarc >> compact >> err;
+    if (err != 0) {
+      logstream(LOG_ERROR) << glstrerr(err) << std::endl;
+    } else if (compact) {
+      codec.load(iarc, out, is_vertex);
+    } else {
+      iarc >> out;
+    }
+    return err;
+  }
+
+  bool graphdb_query_object::parse_batch_row_reply(query_result& future,
+                                                   std::vector<graph_row>* out,
+                                                   std::vector<int>& errorcodes,
+                                                   bool is_vertex,
+                                                   const graph_row_codec& codec,
+                                                   bool& compact) {
+    compact = true;
+    if (future.get_status() != 0) {
+      logstream(LOG_ERROR) << glstrerr(ESRVUNREACH) << std::endl;
+      errorcodes.push_back(ESRVUNREACH);
+      return false;
+    }
+    std::string reply = future.get_reply();
+    iarchive iarc(reply.c_str(), reply.length());
+    bool success = false;
+    iarc >> compact >> success;
+    if (compact) {
+      codec.load_rows(iarc, *out, is_vertex);
+    } else {
+      iarc >> *out;
+    }
+    if (!success) {
+      iarc >> errorcodes;
+      ASSERT_EQ(errorcodes.size(), out->size());
+    }
+    return success;
+  }
 }
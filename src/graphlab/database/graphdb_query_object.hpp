@@ -3,6 +3,7 @@
 #include <graphlab/database/basic_types.hpp>
 #include <graphlab/database/graphdb_config.hpp>
 #include <graphlab/database/errno.hpp>
+#include <graphlab/database/graph_row_codec.hpp>
 
 #include <fault/query_object_client.hpp>
 #include <boost/random/mersenne_twister.hpp>
@@ -46,6 +47,14 @@ namespace graphlab {
                              char* msg, size_t msg_len,
                              std::vector<query_result>& reply_queue); 
 
+    /**
+     * Queries each shard with its message, and fills replies with their
+     * replies in the same order, leaving the reply of an unreachable shard
+     * empty.
+     */
+    void query_each (const std::vector<std::pair<graph_shard_id_t, std::string> >& requests,
+                     std::vector<std::string>& replies);
+
     // ----------- Reply Parsing Interface --------------------
      /**
       * Parse a reply that has no content. 
@@ -99,6 +108,22 @@ namespace graphlab {
        return success;
      }
 
+     /**
+      * Same as parse_reply() with a row, for a request carrying the
+      * schema version of codec. Sets compact to false if the server has
+      * another schema, in which case the row uses graph_row::save().
+      */
+     int parse_row_reply(query_result& future, graph_row& out, bool is_vertex,
+                         const graph_row_codec& codec, bool& compact);
+
+     /**
+      * Same as parse_batch_reply() with rows, for a request carrying the
+      * schema version of codec. Sets compact as parse_row_reply().
+      */
+     bool parse_batch_row_reply(query_result& future, std::vector<graph_row>* out,
+                                std::vector<int>& errorcodes, bool is_vertex,
+                                const graph_row_codec& codec, bool& compact);
+
      /// Parse a list of futures and aggregate the result into acc.
      /// The content of the result must be of the same type and supports +=.
      template<typename T>
@@ -6,11 +6,16 @@ namespace graphlab {
 
   const char* QueryMessage::qm_obj_type_str[NUM_OBJ_TYPE] = {
     "vertex", "edge", "vertex_adj", "vertex_mirror", "shard",
-    "num_vertices", "num_edges", "vertex_field", "edge_field", "reset", "undefined"
+    "num_vertices", "num_edges", "vertex_field", "edge_field", "reset", "freeze",
+    "save", "load", "vertex_index", "topk", "range", "traverse", "filter", "scan", "aggregate", "undefined"
   };
 
   QueryMessage::QueryMessage(header h) : h(h), iarc(NULL) {
-    oarc << h.cmd << h.obj;
+    if (h.schema_version == 0) {
+      oarc << h.cmd << h.obj;
+    } else {
+      oarc << (qm_cmd_type)(h.cmd | SCHEMA_VERSION_FLAG) << h.obj << h.schema_version;
+    }
   }
 
   QueryMessage::QueryMessage(qm_cmd_type cmd, qm_obj_type obj) : h(cmd, obj), iarc(NULL) {
@@ -20,6 +25,12 @@ namespace graphlab {
   QueryMessage::QueryMessage(char* msg, size_t len) { 
     iarc = new iarchive(msg, len);
     *iarc >> h.cmd >> h.obj;
+    if (h.cmd & SCHEMA_VERSION_FLAG) {
+      h.cmd = (qm_cmd_type)(h.cmd & ~SCHEMA_VERSION_FLAG);
+      *iarc >> h.schema_version;
+    } else {
+      h.schema_version = 0;
+    }
   }
 
   QueryMessage::~QueryMessage() {
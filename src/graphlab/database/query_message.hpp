@@ -2,6 +2,7 @@
 #define GRAPHLAB_DATABASE_QUERY_MESSAGE_HPP
 #include<graphlab/serialization/iarchive.hpp>
 #include<graphlab/serialization/oarchive.hpp>
+#include<graphlab/serialization/vector.hpp>
 namespace graphlab {
   /**
    * This class defines the query message protocol from 
@@ -41,23 +42,48 @@ namespace graphlab {
      enum qm_obj_type{ 
        VERTEX, EDGE, VERTEXADJ, VMIRROR, SHARD, 
        NVERTS, NEDGES, VFIELD, EFIELD, 
-       RESET,
+       RESET, FREEZE,
+       // shard image
+       SAVE, LOAD,
+       // secondary index lookup
+       VINDEX, TOPK, RANGE,
+       // traversal run by the shards, see graph_traversal
+       TRAVERSE,
+       // batch read through a graph_row_filter
+       FILTER,
+       // chunk of a full scan of the vertices or edges
+       SCAN,
+       // per shard partial aggregates, see graph_aggregate_type
+       AGGREGATE,
        UNDEFINED
      };
 
      static const size_t NUM_CMD_TYPE = 7;
-     static const size_t NUM_OBJ_TYPE = 11;
+     static const size_t NUM_OBJ_TYPE = 21;
 
      static const char* qm_cmd_type_str[NUM_CMD_TYPE]; 
 
      static const char* qm_obj_type_str[NUM_OBJ_TYPE];
 
+     /**
+      * Set in the serialized command when the header carries a schema
+      * version. Messages without it have the layout of older clients.
+      */
+     static const int SCHEMA_VERSION_FLAG = 1 << 16;
+
      struct header {
        qm_cmd_type cmd;
        qm_obj_type obj;
+       /**
+        * The schema version of the sender (see \ref graph_row_codec), or
+        * 0 if absent. A request with a version gets a reply starting with
+        * whether its rows use the compact encoding of that version.
+        */
+       uint64_t schema_version;
 
-       header() { }
-       header(qm_cmd_type cmd, qm_obj_type obj) : cmd(cmd), obj(obj) { }
+       header() : schema_version(0) { }
+       header(qm_cmd_type cmd, qm_obj_type obj, uint64_t schema_version = 0)
+           : cmd(cmd), obj(obj), schema_version(schema_version) { }
 
        friend std::ostream& operator<<(std::ostream &strm, const header& h) {
           strm << qm_cmd_type_str[h.cmd] << " " << qm_obj_type_str[h.obj];
@@ -100,6 +126,15 @@ namespace graphlab {
        *iarc >> value; 
        return *this;
      }
+
+     /**
+      * Reads the length of a vector of non-POD values serialized into the
+      * message, leaving it at the first value, so that the values can be
+      * read one at a time.
+      */
+     inline size_t read_vector_length() {
+       return archive_detail::deserialize_vector_length(*iarc);
+     }
    private:
     header h;
     oarchive oarc;
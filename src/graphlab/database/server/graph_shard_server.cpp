@@ -1,23 +1,161 @@
 #include<graphlab/database/server/graph_shard_server.hpp>
 #include<graphlab/database/errno.hpp>
+#include<graphlab/database/graph_shard_image.hpp>
+#include<graphlab/parallel/pthread_tools.hpp>
+#include<algorithm>
+#include<fstream>
+#include<cstdio>
+#include<cstring>
+#include<fcntl.h>
+#include<unistd.h>
 #include<graphlab/logger/assertions.hpp>
 #include<boost/functional.hpp>
 #include<boost/bind.hpp>
 namespace graphlab {
 
+  graph_shard_server::graph_shard_server(graph_shard_id_t shardid,
+                                         const std::vector<graph_field>& vertex_fields,
+                                         const std::vector<graph_field>& edge_fields) : 
+      shard(shardid), vertex_fields(vertex_fields), edge_fields(edge_fields) { 
+    for (size_t i = 0; i < vertex_fields.size(); ++i) {
+      shard.add_vertex_field(vertex_fields[i]);
+    }
+    for (size_t i = 0; i < edge_fields.size(); ++i) {
+      shard.add_edge_field(edge_fields[i]);
+    }
+  }
+
   void graph_shard_server::clear() {
     shard.clear();
     vertex_fields.clear();
     edge_fields.clear();
   }
 
+  void graph_shard_server::freeze_index() {
+    shard.freeze_index();
+  }
+
+  void graph_shard_server::compact_payloads() {
+    shard.compact_payloads();
+  }
+
+  // Syncs the file at tmppath, renames it to path, and syncs the directory
+  // so that the rename is durable. Returns false on failure.
+  static bool replace_file(const std::string& tmppath, const std::string& path) {
+    int fd = ::open(tmppath.c_str(), O_RDONLY);
+    bool ok = (fd >= 0 && fsync(fd) == 0);
+    if (fd >= 0) ::close(fd);
+    ok = ok && (rename(tmppath.c_str(), path.c_str()) == 0);
+    if (!ok) {
+      logstream(LOG_ERROR) << "Unable to write " << path << ": "
+                           << strerror(errno) << std::endl;
+      return false;
+    }
+    std::string dir = path.substr(0, path.find_last_of('/') + 1);
+    fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      fsync(fd);
+      ::close(fd);
+    }
+    return true;
+  }
+
+  int graph_shard_server::save_image(const std::string& path) {
+    // write a temporary file, and rename it once it is on disk
+    std::string tmppath = path + ".tmp";
+    graph_image_writer writer;
+    if (!writer.open(tmppath)) {
+      return EIO;
+    }
+    writer.write(shard.id());
+    writer.write_archived(vertex_fields);
+    writer.write_archived(edge_fields);
+    shard.save_image(writer);
+    if (!writer.close()) {
+      logstream(LOG_ERROR) << "Unable to write shard image " << tmppath << std::endl;
+      remove(tmppath.c_str());
+      return EIO;
+    }
+    return replace_file(tmppath, path) ? 0 : EIO;
+  }
+
+  int graph_shard_server::load_image(const std::string& path) {
+    boost::shared_ptr<graph_image_mapping> mapping(new graph_image_mapping());
+    if (!mapping->open(path)) {
+      return EIO;
+    }
+    graph_image_reader reader(mapping);
+    if (!reader.read_header()) {
+      return EINVHEAD;
+    }
+    graph_shard_id_t shardid;
+    reader.read(shardid);
+    if (shardid != shard.id()) {
+      return EINVID;
+    }
+    // the served shard and schema are kept if the image is corrupt
+    std::vector<graph_field> image_vertex_fields, image_edge_fields;
+    reader.read_archived(image_vertex_fields);
+    reader.read_archived(image_edge_fields);
+    if (!reader.good() || !shard.load_image(reader)) {
+      logstream(LOG_ERROR) << "Shard image " << path << " is truncated or corrupt" << std::endl;
+      return EINVHEAD;
+    }
+    vertex_fields.swap(image_vertex_fields);
+    edge_fields.swap(image_edge_fields);
+    return 0;
+  }
+
+  void graph_shard_server::save(oarchive& oarc) const {
+    oarc << vertex_fields << edge_fields << shard;
+  }
+
+  void graph_shard_server::load(iarchive& iarc) {
+    clear();
+    iarc >> vertex_fields >> edge_fields >> shard;
+  }
+
+  int graph_shard_server::save_checkpoint(const std::string& path, uint64_t lsn) {
+    // write a temporary file, and rename it once it is on disk
+    std::string tmppath = path + ".tmp";
+    {
+      std::ofstream out(tmppath.c_str(), std::ios::binary | std::ios::trunc);
+      oarchive oarc(out);
+      oarc << lsn;
+      save(oarc);
+      out.flush();
+      if (out.fail()) {
+        logstream(LOG_ERROR) << "Unable to write checkpoint " << tmppath << std::endl;
+        return EIO;
+      }
+    }
+    return replace_file(tmppath, path) ? 0 : EIO;
+  }
+
+  int graph_shard_server::load_checkpoint(const std::string& path, uint64_t& lsn) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in.good()) {
+      return ENOENT;
+    }
+    iarchive iarc(in);
+    iarc >> lsn;
+    load(iarc);
+    if (in.fail()) {
+      logstream(LOG_ERROR) << "Unable to read checkpoint " << path << std::endl;
+      clear();
+      return EIO;
+    }
+    return 0;
+  }
+
   // -------------------- Query API -----------------------
   // Read API
   int graph_shard_server::graph_shard_server::get_vertex(graph_vid_t vid, graph_row& out) {
-    if (!shard.has_vertex(vid)) {
+    graph_row_ref row = shard.vertex_data_by_id(vid);
+    if (!row.is_valid()) {
       return EINVID;
     }
-    out = *shard.vertex_data_by_id(vid);
+    row.copy_to(out);
     return 0;
   }
 
@@ -26,30 +164,339 @@ namespace graphlab {
     if (pair.first != shard.id() || pair.second >= shard.num_edges()) {
       return EINVID;
     }
-    out = *shard.edge_data(pair.second);
+    shard.edge_data(pair.second).copy_to(out);
+    return 0;
+  }
+
+  int graph_shard_server::get_vertex_ref(graph_vid_t vid, graph_row& out) {
+    graph_row_ref row = shard.vertex_data_by_id(vid);
+    if (!row.is_valid()) {
+      return EINVID;
+    }
+    row.borrow_to(out);
+    return 0;
+  }
+
+  int graph_shard_server::get_edge_ref(graph_eid_t eid, graph_row& out) {
+    std::pair<graph_shard_id_t, graph_leid_t> pair = split_eid(eid);
+    if (pair.first != shard.id() || pair.second >= shard.num_edges()) {
+      return EINVID;
+    }
+    shard.edge_data(pair.second).borrow_to(out);
+    return 0;
+  }
+
+  int graph_shard_server::find_vertices(size_t fieldpos, const graph_value& key,
+                                        std::vector<graph_vid_t>& out) {
+    if (fieldpos >= vertex_fields.size()) {
+      return EINVID;
+    }
+    if (!vertex_fields[fieldpos].is_indexed) {
+      return ENOINDEX;
+    }
+    if (!shard.find_vertices(fieldpos, key, out)) {
+      return EINVTYPE;
+    }
+    return 0;
+  }
+
+  int graph_shard_server::topk(bool is_vertex, size_t fieldpos, size_t k,
+                               bool largest, std::vector<id_value_pair>& out) {
+    int errorcode = 0;
+    graph_column* column = ordered_column_helper(is_vertex, fieldpos, errorcode);
+    if (column == NULL) {
+      return errorcode;
+    }
+    std::vector<size_t> positions;
+    column->topk(k, largest, positions);
+    id_value_helper(is_vertex, *column, positions, out);
+    return 0;
+  }
+
+  int graph_shard_server::range(bool is_vertex, size_t fieldpos,
+                                const graph_value& lo, const graph_value& hi,
+                                std::vector<id_value_pair>& out) {
+    int errorcode = 0;
+    graph_column* column = ordered_column_helper(is_vertex, fieldpos, errorcode);
+    if (column == NULL) {
+      return errorcode;
+    }
+    std::vector<size_t> positions;
+    if (!column->range(lo, hi, positions)) {
+      return EINVTYPE;
+    }
+    id_value_helper(is_vertex, *column, positions, out);
     return 0;
   }
 
   int graph_shard_server::get_vertex_adj(graph_vid_t vid, bool is_in_edges, vertex_adj_descriptor& out) {
-    // internal index of the adjacency edges
-    std::vector<graph_leid_t> internal_ids;
-    shard.vertex_adj_ids(internal_ids, vid, is_in_edges);
-    if (is_in_edges) {
-      for (size_t i = 0; i < internal_ids.size(); ++i) {
-        out.neighbor_ids.push_back(shard.edge(internal_ids[i]).first);
+    // internal index of the adjacency edges, without copying
+    graph_leid_span spans[2];
+    shard.vertex_adj_spans(vid, is_in_edges, spans[0], spans[1]);
+    adj_helper(spans, is_in_edges, out);
+    return 0;
+  }
+
+  bool graph_shard_server::get_vertices_adj(const std::vector<graph_vid_t>& vids, bool in_edges,
+                                            std::vector<vertex_adj_descriptor>& out,
+                                            std::vector<int>& errorcodes) {
+    out.clear();
+    out.resize(vids.size());
+    errorcodes.resize(vids.size(), 0);
+    if (vids.empty()) {
+      return true;
+    }
+    // positions of the vids in ascending order of vid
+    std::vector<std::pair<graph_vid_t, size_t> > order(vids.size());
+    for (size_t i = 0; i < vids.size(); ++i) {
+      order[i] = std::make_pair(vids[i], i);
+    }
+    std::sort(order.begin(), order.end());
+    std::vector<graph_vid_t> sorted(vids.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      sorted[i] = order[i].first;
+    }
+    std::vector<graph_leid_span> frozen(vids.size()), delta(vids.size());
+    shard.vertices_adj_spans(&sorted[0], sorted.size(), in_edges, &frozen[0], &delta[0]);
+    for (size_t i = 0; i < order.size(); ++i) {
+      graph_leid_span spans[2] = {frozen[i], delta[i]};
+      adj_helper(spans, in_edges, out[order[i].second]);
+    }
+    return true;
+  }
+
+  bool graph_shard_server::filter_vertices(const std::vector<graph_vid_t>& vids,
+                                           const graph_row_filter& filter,
+                                           std::vector<std::pair<size_t, graph_row> >& out,
+                                           std::vector<int>& errorcodes) {
+    int errorcode = filter.check(vertex_fields);
+    errorcodes.assign(vids.size(), errorcode);
+    if (errorcode != 0) {
+      return false;
+    }
+    bool success = true;
+    for (size_t i = 0; i < vids.size(); ++i) {
+      graph_row_ref row = shard.vertex_data_by_id(vids[i]);
+      if (!row.is_valid()) {
+        errorcodes[i] = EINVID;
+        success = false;
+      } else if (filter.accepts(row)) {
+        out.push_back(std::make_pair(i, graph_row()));
+        filter.project(row, out.back().second);
       }
-    } else {
-      for (size_t i = 0; i < internal_ids.size(); ++i) {
-        out.neighbor_ids.push_back(shard.edge(internal_ids[i]).second);
+    }
+    return success;
+  }
+
+  bool graph_shard_server::filter_edges(const std::vector<graph_eid_t>& eids,
+                                        const graph_row_filter& filter,
+                                        std::vector<std::pair<size_t, graph_row> >& out,
+                                        std::vector<int>& errorcodes) {
+    int errorcode = filter.check(edge_fields);
+    errorcodes.assign(eids.size(), errorcode);
+    if (errorcode != 0) {
+      return false;
+    }
+    bool success = true;
+    for (size_t i = 0; i < eids.size(); ++i) {
+      std::pair<graph_shard_id_t, graph_leid_t> pair = split_eid(eids[i]);
+      if (pair.first != shard.id() || pair.second >= shard.num_edges()) {
+        errorcodes[i] = EINVID;
+        success = false;
+        continue;
+      }
+      graph_row_ref row = shard.edge_data(pair.second);
+      if (filter.accepts(row)) {
+        out.push_back(std::make_pair(i, graph_row()));
+        filter.project(row, out.back().second);
+      }
+    }
+    return success;
+  }
+
+  const size_t graph_shard_server::SCAN_MAX_READ;
+
+  int graph_shard_server::scan(bool is_vertex, size_t position, size_t max_rows,
+                               size_t max_bytes, const graph_row_filter& filter,
+                               std::vector<scan_descriptor>& out, size_t& next) {
+    int errorcode = filter.check(is_vertex ? vertex_fields : edge_fields);
+    if (errorcode != 0) {
+      return errorcode;
+    }
+    size_t end = is_vertex ? shard.num_vertices() : shard.num_edges();
+    size_t i = std::min(position, end);
+    size_t last = std::min(end, i + SCAN_MAX_READ);
+    size_t bytes = 0;
+    for (; i < last && (out.empty() || (out.size() < max_rows && bytes < max_bytes)); ++i) {
+      graph_row_ref row = is_vertex ? shard.vertex_data(i) : shard.edge_data(i);
+      if (!filter.accepts(row)) {
+        continue;
+      }
+      out.push_back(scan_descriptor());
+      scan_descriptor& desc = out.back();
+      filter.project(row, desc.data);
+      if (is_vertex) {
+        desc.id = desc.source = desc.target = shard.vertex(i);
+      } else {
+        desc.id = make_eid(shard.id(), i);
+        desc.source = shard.edge(i).first;
+        desc.target = shard.edge(i).second;
+      }
+      for (size_t j = 0; j < desc.data.num_fields(); ++j) {
+        bytes += desc.data.get_field(j)->data_length();
+      }
+    }
+    next = i;
+    return 0;
+  }
+
+  int graph_shard_server::expand_vertices(const std::vector<graph_vid_t>& vids,
+                                          const graph_traversal_spec& spec,
+                                          std::vector<graph_vid_t>& out) {
+    if (!spec.follows_all() && spec.predicate.fieldpos >= edge_fields.size()) {
+      return EINVID;
+    }
+    if (vids.empty()) {
+      return 0;
+    }
+    std::vector<graph_vid_t> sorted(vids);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<graph_leid_span> frozen(sorted.size()), delta(sorted.size());
+    graph_value field;
+    for (size_t k = 0; k < 2; ++k) {
+      bool in_edges = (k == 1);
+      if ((in_edges && spec.direction == graph_traversal_spec::OUT_EDGES) ||
+          (!in_edges && spec.direction == graph_traversal_spec::IN_EDGES)) {
+        continue;
       }
+      shard.vertices_adj_spans(&sorted[0], sorted.size(), in_edges, &frozen[0], &delta[0]);
+      for (size_t i = 0; i < sorted.size(); ++i) {
+        const graph_leid_span spans[2] = {frozen[i], delta[i]};
+        for (size_t j = 0; j < 2; ++j) {
+          for (size_t e = 0; e < spans[j].size(); ++e) {
+            graph_leid_t leid = spans[j][e];
+            if (!spec.follows_all()) {
+              shard.edge_data(leid).get_field_ref(spec.predicate.fieldpos, field);
+              if (!spec.predicate.accepts(field)) {
+                continue;
+              }
+            }
+            const std::pair<graph_vid_t, graph_vid_t> edge = shard.edge(leid);
+            out.push_back(in_edges ? edge.first : edge.second);
+          }
+        }
+      }
+    }
+    return 0;
+  }
+
+  const size_t graph_shard_server::AGGREGATE_MAX_READ;
+  const size_t graph_shard_server::AGGREGATE_MIN_ROWS;
+
+  // Adds a value to a graph_field_aggregate, and its hash if distinct.
+  struct field_adder {
+    bool distinct;
+    void operator()(graph_field_aggregate& out, const graph_value& value) const {
+      out.add(value, distinct);
+    }
+  };
+
+  // Adds a value to a graph_field_histogram.
+  struct histogram_adder {
+    void operator()(graph_field_histogram& out, const graph_value& value) const {
+      out.add(value);
+    }
+  };
+
+  // Adds the field at fieldpos of the rows [begin, end) to out.
+  template<typename Aggregate, typename Adder>
+  static void aggregate_rows(graph_shard* shard, bool is_vertex, size_t fieldpos,
+                             Adder add, size_t begin, size_t end, Aggregate* out) {
+    graph_value field;
+    for (size_t i = begin; i < end; ++i) {
+      graph_row_ref row = is_vertex ? shard->vertex_data(i) : shard->edge_data(i);
+      row.get_field_ref(fieldpos, field);
+      add(*out, field);
+    }
+  }
+
+  // Adds the field at fieldpos of up to AGGREGATE_MAX_READ rows from
+  // position to out, and returns the position to continue from. The
+  // partial of each thread starts as a copy of empty.
+  template<typename Aggregate, typename Adder>
+  static size_t aggregate_slice(graph_shard& shard, bool is_vertex, size_t fieldpos,
+                                Adder add, size_t position, const Aggregate& empty,
+                                Aggregate& out) {
+    size_t nrows = is_vertex ? shard.num_vertices() : shard.num_edges();
+    size_t begin = std::min(position, nrows);
+    size_t end = std::min(nrows, begin + graph_shard_server::AGGREGATE_MAX_READ);
+    size_t nthreads = std::min(thread::cpu_count(),
+                               (end - begin) / graph_shard_server::AGGREGATE_MIN_ROWS);
+    if (nthreads <= 1) {
+      aggregate_rows(&shard, is_vertex, fieldpos, add, begin, end, &out);
+      return end;
+    }
+    // each thread aggregates a range of rows, the partials are merged after
+    std::vector<Aggregate> partials(nthreads, empty);
+    thread_group threads;
+    for (size_t i = 0; i < nthreads; ++i) {
+      threads.launch(boost::bind(aggregate_rows<Aggregate, Adder>, &shard, is_vertex,
+                                 fieldpos, add,
+                                 begin + (end - begin) * i / nthreads,
+                                 begin + (end - begin) * (i + 1) / nthreads,
+                                 &partials[i]));
+    }
+    threads.join();
+    for (size_t i = 0; i < nthreads; ++i) {
+      out += partials[i];
+    }
+    return end;
+  }
+
+  int graph_shard_server::aggregate_field(bool is_vertex, size_t fieldpos, bool distinct,
+                                          size_t position, graph_field_aggregate& out,
+                                          size_t& next) {
+    if (fieldpos >= (is_vertex ? vertex_fields.size() : edge_fields.size())) {
+      return EINVID;
+    }
+    field_adder add = {distinct};
+    next = aggregate_slice(shard, is_vertex, fieldpos, add, position,
+                           graph_field_aggregate(), out);
+    return 0;
+  }
+
+  int graph_shard_server::histogram_field(bool is_vertex, size_t fieldpos, size_t position,
+                                          graph_field_histogram& out, size_t& next) {
+    const std::vector<graph_field>& fields = is_vertex ? vertex_fields : edge_fields;
+    if (fieldpos >= fields.size()) {
+      return EINVID;
     }
-    // make the internal id into global eids
-    for (size_t i = 0; i < internal_ids.size(); i++) {
-      out.eids.push_back(make_eid(shard.id(), internal_ids[i])); 
+    if (fields[fieldpos].type != INT_TYPE && fields[fieldpos].type != DOUBLE_TYPE) {
+      return EINVTYPE;
     }
+    next = aggregate_slice(shard, is_vertex, fieldpos, histogram_adder(), position,
+                           graph_field_histogram(out.lo, out.hi, out.bins.size()), out);
     return 0;
   }
 
+  size_t graph_shard_server::count_degrees(graph_traversal_spec::direction_type direction,
+                                           size_t position,
+                                           boost::unordered_map<graph_vid_t, uint64_t>& out) {
+    size_t nedges = shard.num_edges();
+    size_t begin = std::min(position, nedges);
+    size_t end = std::min(nedges, begin + AGGREGATE_MAX_READ);
+    for (size_t i = begin; i < end; ++i) {
+      const std::pair<graph_vid_t, graph_vid_t> edge = shard.edge(i);
+      if (direction != graph_traversal_spec::IN_EDGES) {
+        ++out[edge.first];
+      }
+      if (direction != graph_traversal_spec::OUT_EDGES) {
+        ++out[edge.second];
+      }
+    }
+    return end;
+  }
+
   // Write API
   int graph_shard_server::set_vertex(const graph_vid_t vid, const graph_row& data) {
     return set_data_helper(shard.vertex_data_by_id(vid), data);
@@ -57,12 +504,36 @@ namespace graphlab {
 
   int graph_shard_server::set_edge(const graph_eid_t eid, const graph_row& data) {
     std::pair<graph_shard_id_t, graph_leid_t> pair = split_eid(eid);
-    if (pair.first != shard.id()) {
+    if (pair.first != shard.id() || pair.second >= shard.num_edges()) {
       return EINVID;
     }
     return set_data_helper(shard.edge_data(pair.second), data);
   }
 
+  int graph_shard_server::reset_vertex_field(size_t fieldpos, const std::string& value_str) {
+    if (fieldpos >= vertex_fields.size()) {
+      return EINVID;
+    }
+    if (!transform_vertices(fieldpos, boost::bind(reset_field_helper, _1,
+                                                  boost::cref(value_str)))) {
+      return EINVTYPE;
+    }
+    maybe_compact_payloads();
+    return 0;
+  }
+
+  int graph_shard_server::reset_edge_field(size_t fieldpos, const std::string& value_str) {
+    if (fieldpos >= edge_fields.size()) {
+      return EINVID;
+    }
+    if (!transform_edges(fieldpos, boost::bind(reset_field_helper, _1,
+                                               boost::cref(value_str)))) {
+      return EINVTYPE;
+    }
+    maybe_compact_payloads();
+    return 0;
+  }
+
   // ------------------- Batch Query API -------------------- 
   bool graph_shard_server::get_vertices(const std::vector<graph_vid_t>& vids,
                                         std::vector<graph_row>& out,
@@ -119,9 +590,11 @@ namespace graphlab {
   int graph_shard_server::add_vertex_field(const graph_field& field) {
     if (find_vertex_field(field.name.c_str()) >= 0) {
       return EDUP;
+    } else if ((field.is_indexed && !graph_field_index::supports(field.type))
+               || (field.is_ordered && !graph_ordered_index::supports(field.type))) {
+      return EINVTYPE;
     } else {
-      boost::function<void (graph_row& row)> fun(boost::bind(&graph_shard_server::add_field_helper, this, _1, field));
-      transform_vertices(fun);
+      shard.add_vertex_field(field);
       vertex_fields.push_back(field);
       return 0;
     }
@@ -130,9 +603,10 @@ namespace graphlab {
   int graph_shard_server::add_edge_field(const graph_field& field) {
     if (find_edge_field(field.name.c_str()) >= 0) {
       return EDUP;
+    } else if (field.is_ordered && !graph_ordered_index::supports(field.type)) {
+      return EINVTYPE;
     } else {
-      boost::function<void (graph_row& row)> fun(boost::bind(&graph_shard_server::add_field_helper, this, _1, field));
-      transform_edges(fun);
+      shard.add_edge_field(field);
       edge_fields.push_back(field);
       return 0;
     }
@@ -142,19 +616,17 @@ namespace graphlab {
   // -------- Modification API --------------
   int graph_shard_server::add_vertex(graph_vid_t vid, const graph_row& data) {
     int errorcode = 0;
-    if (shard.has_vertex(vid)) { // vertex has already been inserted 
-        graph_row* row =  shard.vertex_data_by_id(vid);
-        if (row->is_null()) { // existing vertex has no value, update with new value
-          *row = data;
+    graph_row_ref row = shard.vertex_data_by_id(vid);
+    if (!data.is_vertex() || !check_schema(data, vertex_fields)) {
+      errorcode = EINVTYPE;
+    } else if (row.is_valid()) { // vertex has already been inserted 
+        if (row.is_null()) { // existing vertex has no value, update with new value
+          row.assign(data);
         } else { // existing vertex has value, cannot overwrite, return false
           errorcode = EDUP;
         }
     } else {
-      if (data.is_vertex()) {
-        shard.add_vertex(vid, data);
-      } else {
-        errorcode = EINVTYPE;
-      }
+      shard.add_vertex(vid, data);
     }
     if (errorcode != 0) {
       logstream(LOG_WARNING) << "Error code: " << errorcode << ". " << glstrerr(errorcode) 
@@ -164,7 +636,7 @@ namespace graphlab {
   }
 
   int graph_shard_server::add_edge(graph_vid_t source, graph_vid_t target, const graph_row& data) {
-    if (data.is_edge()) {
+    if (data.is_edge() && check_schema(data, edge_fields)) {
       shard.add_edge(source, target, data);
       return 0;
     } else {
@@ -207,6 +679,14 @@ namespace graphlab {
     return success;
   }
 
+  int graph_shard_server::get_vertex_mirrors(graph_vid_t vid, std::vector<graph_shard_id_t>& out) {
+    if (!shard.has_vertex(vid)) {
+      return EINVID;
+    }
+    out = shard.mirrors_by_id(vid);
+    return 0;
+  }
+
   /**
    * Add shard_id to the vertex mirror list. Assuming the vertex to be updated is stored in a local shard.
    */
@@ -223,17 +703,75 @@ namespace graphlab {
   }
 
   // ---------- Helper functions -------------
-  int graph_shard_server::set_data_helper(graph_row* old_data, const graph_row& data) {
-    if (old_data == NULL || old_data->num_fields() != data.num_fields())
+  void graph_shard_server::adj_helper(const graph_leid_span spans[2], bool is_in_edges,
+                                      vertex_adj_descriptor& out) {
+    size_t n = spans[0].size() + spans[1].size();
+    out.neighbor_ids.reserve(out.neighbor_ids.size() + n);
+    out.eids.reserve(out.eids.size() + n);
+    for (size_t k = 0; k < 2; ++k) {
+      const graph_leid_span& internal_ids = spans[k];
+      for (size_t i = 0; i < internal_ids.size(); ++i) {
+        const std::pair<graph_vid_t, graph_vid_t> e = shard.edge(internal_ids[i]);
+        out.neighbor_ids.push_back(is_in_edges ? e.first : e.second);
+        // make the internal id into global eids
+        out.eids.push_back(make_eid(shard.id(), internal_ids[i]));
+      }
+    }
+  }
+
+  int graph_shard_server::set_data_helper(graph_row_ref old_data, const graph_row& data) {
+    if (!old_data.is_valid() || old_data.num_fields() != data.num_fields())
       return EINVID;
     for (size_t i = 0; i < data.num_fields(); ++i) {
-      if (old_data->get_field(i)->type() != data.get_field(i)->type()) {
+      if (old_data.field_type(i) != data.get_field(i)->type()) {
         return EINVTYPE;
       }
     }
     for (size_t i = 0; i < data.num_fields(); i++) {
-      *old_data->get_field(i) = *data.get_field(i);
+      old_data.set_field(i, *data.get_field(i));
     }
+    maybe_compact_payloads();
     return 0;
   }
+
+  graph_column* graph_shard_server::ordered_column_helper(bool is_vertex, size_t fieldpos,
+                                                         int& errorcode) {
+    const std::vector<graph_field>& fields = is_vertex ? vertex_fields : edge_fields;
+    if (fieldpos >= fields.size()) {
+      errorcode = EINVID;
+      return NULL;
+    }
+    if (!fields[fieldpos].is_ordered) {
+      errorcode = ENOINDEX;
+      return NULL;
+    }
+    errorcode = 0;
+    return is_vertex ? &shard.vertex_column(fieldpos) : &shard.edge_column(fieldpos);
+  }
+
+  void graph_shard_server::id_value_helper(bool is_vertex, const graph_column& column,
+                                           const std::vector<size_t>& positions,
+                                           std::vector<id_value_pair>& out) {
+    size_t begin = out.size();
+    out.resize(begin + positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+      id_value_pair& pair = out[begin + i];
+      pair.first = is_vertex ? shard.vertex(positions[i])
+                             : make_eid(shard.id(), positions[i]);
+      column.get(positions[i], pair.second);
+    }
+  }
+
+  bool graph_shard_server::check_schema(const graph_row& row,
+                                        const std::vector<graph_field>& fields) {
+    if (row.num_fields() == 0)
+      return true;
+    if (row.num_fields() != fields.size())
+      return false;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (row.get_field(i)->type() != fields[i].type)
+        return false;
+    }
+    return true;
+  }
 } // end of namespace
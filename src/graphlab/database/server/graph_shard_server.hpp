@@ -1,6 +1,10 @@
 #ifndef GRAPHLAB_DATABASE_GRAPH_SHARD_SERVER_HPP
 #define GRAPHLAB_DATABASE_GRAPH_SHARD_SERVER_HPP
 #include <graphlab/database/graph_database.hpp>
+#include <graphlab/database/graph_traversal.hpp>
+#include <graphlab/database/graph_row_filter.hpp>
+#include <graphlab/database/graph_aggregate.hpp>
+#include <boost/unordered_map.hpp>
 namespace graphlab {
   class graph_shard_server : public graph_database {
    public:
@@ -8,6 +12,8 @@ namespace graphlab {
      typedef graph_database::vertex_insert_descriptor vertex_insert_descriptor;
      typedef graph_database::edge_insert_descriptor edge_insert_descriptor;
      typedef graph_database::mirror_insert_descriptor mirror_insert_descriptor;
+     typedef graph_database::id_value_pair id_value_pair;
+     typedef graph_database::scan_descriptor scan_descriptor;
 
    public:
      /// Creates server with empty fields.
@@ -16,13 +22,54 @@ namespace graphlab {
      /// Creates a server with fields and shard id.
      graph_shard_server(graph_shard_id_t shardid,
                         const std::vector<graph_field>& vertex_fields,
-                        const std::vector<graph_field>& edge_fields) : 
-         shard(shardid), vertex_fields(vertex_fields), edge_fields(edge_fields) { }
+                        const std::vector<graph_field>& edge_fields);
 
 
       ~graph_shard_server() {};
 
       void clear();
+
+      /// Compress the adjacency index after bulk loading. See graph_shard::freeze_index().
+      void freeze_index();
+
+      /// Reclaims the memory of overwritten string/blob values. See graph_shard::compact_payloads().
+      void compact_payloads();
+
+      /**
+       * Writes the schema and the shard into a shard image at path. The
+       * image is written to a temporary file, which replaces path once it
+       * is on disk. Returns 0 on success, or EIO.
+       */
+      int save_image(const std::string& path);
+
+      /**
+       * Replaces the schema and the shard with the shard image at path.
+       * The image is mapped and served in place (see graph_shard_impl::load_image()).
+       * Returns 0 on success, EIO if the file cannot be mapped, EINVHEAD if
+       * it is not a compatible shard image or is truncated, or EINVID if it
+       * belongs to another shard. A truncated or corrupt image leaves the
+       * server unchanged.
+       */
+      int load_image(const std::string& path);
+
+      /// Serializes the schema and the shard.
+      void save(oarchive& oarc) const;
+
+      /// Replaces the schema and the shard with the ones saved by save().
+      void load(iarchive& iarc);
+
+      /**
+       * Durably writes a checkpoint of the server covering the log records
+       * up to lsn (see \ref graph_wal). The file at path is replaced
+       * atomically. Returns 0 on success, or EIO.
+       */
+      int save_checkpoint(const std::string& path, uint64_t lsn);
+
+      /**
+       * Loads the checkpoint at path and sets lsn to the last log record it
+       * covers. Returns 0 on success, ENOENT if there is no checkpoint, or EIO.
+       */
+      int load_checkpoint(const std::string& path, uint64_t& lsn);
   // --------------------- Basic Queries ----------------------------
   uint64_t num_vertices() { return shard.num_vertices(); }
   uint64_t num_edges() { return shard.num_edges(); }
@@ -54,10 +101,137 @@ namespace graphlab {
    int get_edge(graph_eid_t eid, graph_row& out);
    int get_vertex_adj(graph_vid_t vid, bool in_edges, vertex_adj_descriptor& out);
 
+  /**
+   * Fills out with the shards holding edges of the vertex, as recorded by
+   * add_vertex_mirror(). Returns EINVID if the vertex is not stored in
+   * this shard, which must be its master.
+   */
+   int get_vertex_mirrors(graph_vid_t vid, std::vector<graph_shard_id_t>& out);
+
+  /**
+   * Same as get_vertex_adj() for each of vids. The vids are looked up in
+   * ascending order, in one pass over the adjacency index.
+   */
+   bool get_vertices_adj(const std::vector<graph_vid_t>& vids, bool in_edges,
+                         std::vector<vertex_adj_descriptor>& out,
+                         std::vector<int>& errorcodes);
+
+  /**
+   * Same as get_vertices(), but out only gets the vertices accepted by
+   * filter, with the fields it selects, each with its position in vids.
+   * The rows borrow their payloads like get_vertex_ref(). If the filter
+   * does not apply to the vertex fields (see graph_row_filter::check()),
+   * every errorcode is set to its error.
+   */
+   bool filter_vertices(const std::vector<graph_vid_t>& vids, const graph_row_filter& filter,
+                        std::vector<std::pair<size_t, graph_row> >& out,
+                        std::vector<int>& errorcodes);
+
+   /// Same as filter_vertices() for edges.
+   bool filter_edges(const std::vector<graph_eid_t>& eids, const graph_row_filter& filter,
+                     std::vector<std::pair<size_t, graph_row> >& out,
+                     std::vector<int>& errorcodes);
+
+  /**
+   * Reads the vertices (or edges) stored here from position on, in storage
+   * order, into out: those accepted by filter, with the fields it selects,
+   * borrowing their payloads like get_vertex_ref(). Stops once out has
+   * max_rows rows, or about max_bytes of values, or after reading
+   * SCAN_MAX_READ rows, so the shard is only held for a bounded time.
+   * At least one row is read. Sets next to the position to continue from,
+   * which is num_vertices() (num_edges()) once the scan is over.
+   */
+   int scan(bool is_vertex, size_t position, size_t max_rows, size_t max_bytes,
+            const graph_row_filter& filter, std::vector<scan_descriptor>& out,
+            size_t& next);
+
+   static const size_t SCAN_MAX_READ = 1 << 16;
+
+  /**
+   * Appends to out the neighbors of vids across the local edges followed
+   * by spec, once per edge. Returns EINVID if the predicate of spec names
+   * an edge field which does not exist.
+   */
+   int expand_vertices(const std::vector<graph_vid_t>& vids,
+                       const graph_traversal_spec& spec,
+                       std::vector<graph_vid_t>& out);
+
+  /**
+   * Aggregates the field at fieldpos of the vertices (or edges) stored
+   * here into out, counting the distinct values if distinct is true. Like
+   * scan(), at most AGGREGATE_MAX_READ rows are read from position on, and
+   * next is set to the position to continue from, or to position if no
+   * row is left. The rows read are split across up to
+   * thread::cpu_count() threads. Returns EINVID if the field does not exist.
+   */
+   int aggregate_field(bool is_vertex, size_t fieldpos, bool distinct, size_t position,
+                       graph_field_aggregate& out, size_t& next);
+
+  /**
+   * Same as aggregate_field(), but adds the values to the bins of out.
+   * Returns EINVTYPE if the field is not INT or DOUBLE.
+   */
+   int histogram_field(bool is_vertex, size_t fieldpos, size_t position,
+                       graph_field_histogram& out, size_t& next);
+
+   static const size_t AGGREGATE_MAX_READ = 1 << 18;
+
+   /// Minimum number of rows aggregated by each thread of aggregate_field().
+   static const size_t AGGREGATE_MIN_ROWS = 1 << 14;
+
+  /**
+   * Adds to out the number of edges in direction of the endpoints of the
+   * local edges, reading at most AGGREGATE_MAX_READ edges from position
+   * on. Returns the position to continue from, or position if no edge is
+   * left.
+   */
+   size_t count_degrees(graph_traversal_spec::direction_type direction, size_t position,
+                        boost::unordered_map<graph_vid_t, uint64_t>& out);
+
+  /**
+   * Same as get_vertex() and get_edge(), but string and blob values in out
+   * point into the shard storage instead of being copied. out must be
+   * consumed before the next modification of the shard.
+   */
+   int get_vertex_ref(graph_vid_t vid, graph_row& out);
+   int get_edge_ref(graph_eid_t eid, graph_row& out);
+
+  /**
+   * Appends to out the ids of the local vertices whose field at fieldpos
+   * equals key. The field must be indexed.
+   */
+   int find_vertices(size_t fieldpos, const graph_value& key,
+                     std::vector<graph_vid_t>& out);
+
+  /**
+   * Appends to out the ids and values of the k local vertices (or edges)
+   * with the largest (or smallest) values of the field at fieldpos, from
+   * the largest (or smallest) one. The field must be ordered.
+   */
+   int topk(bool is_vertex, size_t fieldpos, size_t k, bool largest,
+            std::vector<id_value_pair>& out);
+
+  /**
+   * Appends to out the ids and values of the local vertices (or edges)
+   * whose field at fieldpos is in [lo, hi], in ascending order of value.
+   * A NULL bound leaves that end open. The field must be ordered.
+   */
+   int range(bool is_vertex, size_t fieldpos,
+             const graph_value& lo, const graph_value& hi,
+             std::vector<id_value_pair>& out);
+
   // Write API
    int set_vertex(graph_vid_t vid, const graph_row& data);
    int set_edge(graph_eid_t eid, const graph_row& data);
 
+  /**
+   * Sets the field at fieldpos of every vertex (edge) to the value parsed
+   * from value_str, a column at a time. Returns EINVID if there is no such
+   * field, or EINVTYPE if value_str is not a value of its type.
+   */
+   int reset_vertex_field(size_t fieldpos, const std::string& value_str);
+   int reset_edge_field(size_t fieldpos, const std::string& value_str);
+
 
   // --------------------- Batch Query API -----------------------------------------
    bool get_vertices (const std::vector<graph_vid_t>& vids,
@@ -81,36 +255,74 @@ namespace graphlab {
  
    private:
      // --------------------- Helper functions -----------------------------------
-     // Batch transform vertices 
-     template<typename TransformFun> 
+     // Batch transform vertices, one row at a time.
+     template<typename TransformFun>
          void transform_vertices(TransformFun fun) {
            for (size_t i =0; i < shard.num_vertices(); ++i) {
-             fun(*(shard.vertex_data(i)));
+             graph_row_ref row = shard.vertex_data(i);
+             fun(row);
            }
          };
 
-     // Batch transform edges 
-     template<typename TransformFun> 
+     // Batch transform edges, one row at a time.
+     template<typename TransformFun>
          void transform_edges(TransformFun fun) {
            for (size_t i = 0; i < shard.num_edges(); ++i) {
-             fun(*(shard.edge_data(i)));
+             graph_row_ref row = shard.edge_data(i);
+             fun(row);
            }
          };
 
-    inline void add_field_helper(graph_row& row, graph_field& field) { 
-      row.add_field(field); 
-    }
+     // Batch transform the vertex field at fieldpos, one column at a time.
+     // fun takes the graph_column& and may work on its scalar_data()
+     // directly; the other fields are not touched. Returns what fun returns.
+     template<typename ColumnFun>
+         bool transform_vertices(size_t fieldpos, ColumnFun fun) {
+           return fun(shard.vertex_column(fieldpos));
+         };
+
+     // Batch transform the edge field at fieldpos, one column at a time.
+     // See transform_vertices(size_t, ColumnFun).
+     template<typename ColumnFun>
+         bool transform_edges(size_t fieldpos, ColumnFun fun) {
+           return fun(shard.edge_column(fieldpos));
+         };
 
-    inline bool reset_field_helper(graph_row& row, size_t fieldpos, std::string& value_str) {
-        graph_value* val = row.get_field(fieldpos);
-        if (val != NULL) {
-          return val->set_val(value_str); 
+    // Sets every value of column to value_str. Returns false if it is not
+    // a value of the type of column.
+    static inline bool reset_field_helper(graph_column& column, const std::string& value_str) {
+        graph_value val(column.type());
+        if (val.set_val(value_str)) {
+          return column.fill(val);
         } else {
           return false;
         }
     }
 
-    int set_data_helper(graph_row* old_data, const graph_row& data);
+    // Returns true if row has no fields, or matches the given schema.
+    bool check_schema(const graph_row& row, const std::vector<graph_field>& fields);
+
+    int set_data_helper(graph_row_ref old_data, const graph_row& data);
+
+    // Returns the ordered column at fieldpos, or NULL with the error code in errorcode.
+    graph_column* ordered_column_helper(bool is_vertex, size_t fieldpos, int& errorcode);
+
+    // Appends the neighbors and eids of the edges in spans to out.
+    void adj_helper(const graph_leid_span spans[2], bool is_in_edges,
+                    vertex_adj_descriptor& out);
+
+    // Appends the ids and values of the rows at positions of column to out.
+    void id_value_helper(bool is_vertex, const graph_column& column,
+                         const std::vector<size_t>& positions,
+                         std::vector<id_value_pair>& out);
+
+    // Compacts the string/blob payloads once overwritten values take more
+    // room than live ones. The cost is amortized over the overwrites.
+    inline void maybe_compact_payloads() {
+      if (shard.needs_compaction()) {
+        compact_payloads();
+      }
+    }
 
    private:
      graph_shard shard;
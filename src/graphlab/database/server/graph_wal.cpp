@@ -0,0 +1,234 @@
+#include <graphlab/database/server/graph_wal.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <boost/crc.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace graphlab {
+  namespace {
+    // uint32 length, uint32 crc, uint64 lsn
+    const size_t HEADER_SIZE = 16;
+
+    uint32_t checksum(const char* data, size_t len) {
+      boost::crc_32_type crc;
+      crc.process_bytes(data, len);
+      return crc.checksum();
+    }
+
+    bool write_all(int fd, const char* data, size_t len) {
+      while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+          if (errno == EINTR) continue;
+          return false;
+        }
+        data += n;
+        len -= n;
+      }
+      return true;
+    }
+
+    bool sync_file(int fd) {
+#ifdef __APPLE__
+      return fsync(fd) == 0;
+#else
+      return fdatasync(fd) == 0;
+#endif
+    }
+  }
+
+  graph_wal::graph_wal() :
+      fd(-1), max_delay_ms(0), appended_lsn(0), durable_lsn(0),
+      flushing(false), failed(false), file_size(0), syncs(0) { }
+
+  graph_wal::~graph_wal() {
+    close();
+  }
+
+  bool graph_wal::open(const std::string& path, lsn_type after,
+                       const replay_fun_type& fun, size_t max_delay_ms) {
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+      logstream(LOG_ERROR) << "Unable to open log " << path << ": "
+                           << strerror(errno) << std::endl;
+      return false;
+    }
+    std::vector<char> content;
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) != 0) {
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        logstream(LOG_ERROR) << "Unable to read log " << path << ": "
+                             << strerror(errno) << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+      }
+      content.insert(content.end(), chunk, chunk + n);
+    }
+
+    // replay the valid prefix of the log
+    size_t off = 0;
+    size_t nreplayed = 0;
+    lsn_type last = after;
+    while (off + HEADER_SIZE <= content.size()) {
+      uint32_t len, crc;
+      uint64_t lsn;
+      memcpy(&len, &content[off], sizeof(len));
+      memcpy(&crc, &content[off + 4], sizeof(crc));
+      memcpy(&lsn, &content[off + 8], sizeof(lsn));
+      const char* data = &content[0] + off + HEADER_SIZE;
+      if (off + HEADER_SIZE + len > content.size() || checksum(data, len) != crc) {
+        break;
+      }
+      if (lsn > after) {
+        fun(data, len);
+        ++nreplayed;
+      }
+      last = std::max(last, lsn);
+      off += HEADER_SIZE + len;
+    }
+    if (off < content.size()) {
+      logstream(LOG_WARNING) << "Dropping " << (content.size() - off)
+                             << " bytes of torn log records from " << path << std::endl;
+      if (ftruncate(fd, off) != 0) {
+        logstream(LOG_ERROR) << "Unable to truncate log " << path << ": "
+                             << strerror(errno) << std::endl;
+      }
+    }
+    logstream(LOG_INFO) << "Replayed " << nreplayed << " log records from "
+                        << path << std::endl;
+
+    this->max_delay_ms = max_delay_ms;
+    buffer.clear();
+    appended_lsn = durable_lsn = last;
+    flushing = failed = false;
+    file_size = off;
+    syncs = 0;
+    return true;
+  }
+
+  void graph_wal::close() {
+    if (fd < 0) {
+      return;
+    }
+    mut.lock();
+    while (flushing) {
+      flushed.wait(mut);
+    }
+    if (!buffer.empty() && !failed) {
+      // do not wait for more records
+      max_delay_ms = 0;
+      flush_locked();
+    }
+    ::close(fd);
+    fd = -1;
+    mut.unlock();
+  }
+
+  graph_wal::lsn_type graph_wal::append(const char* data, size_t len) {
+    ASSERT_LT(len, (size_t)(uint32_t)(-1));
+    uint32_t len32 = len;
+    uint32_t crc = checksum(data, len);
+    mut.lock();
+    uint64_t lsn = ++appended_lsn;
+    size_t off = buffer.size();
+    buffer.resize(off + HEADER_SIZE + len);
+    memcpy(&buffer[off], &len32, sizeof(len32));
+    memcpy(&buffer[off + 4], &crc, sizeof(crc));
+    memcpy(&buffer[off + 8], &lsn, sizeof(lsn));
+    if (len > 0) memcpy(&buffer[off + HEADER_SIZE], data, len);
+    if (buffer.size() >= MAX_BATCH) {
+      batch_full.signal();
+    }
+    mut.unlock();
+    return lsn;
+  }
+
+  bool graph_wal::sync(lsn_type lsn) {
+    mut.lock();
+    while (durable_lsn < lsn && !failed) {
+      if (flushing) {
+        flushed.wait(mut);
+      } else {
+        flush_locked();
+      }
+    }
+    bool ret = (durable_lsn >= lsn);
+    mut.unlock();
+    return ret;
+  }
+
+  void graph_wal::flush_locked() {
+    flushing = true;
+    if (max_delay_ms > 0 && buffer.size() < MAX_BATCH) {
+      batch_full.timedwait_ms(mut, max_delay_ms);
+    }
+    std::vector<char> out;
+    out.swap(buffer);
+    lsn_type upto = appended_lsn;
+
+    // other threads keep appending while the batch is written
+    mut.unlock();
+    bool ok = write_all(fd, out.empty() ? NULL : &out[0], out.size()) && sync_file(fd);
+    mut.lock();
+
+    if (ok) {
+      durable_lsn = upto;
+      file_size += out.size();
+      ++syncs;
+    } else {
+      logstream(LOG_ERROR) << "Unable to write log: " << strerror(errno) << std::endl;
+      failed = true;
+    }
+    flushing = false;
+    flushed.broadcast();
+  }
+
+  bool graph_wal::reset() {
+    mut.lock();
+    while (flushing) {
+      flushed.wait(mut);
+    }
+    buffer.clear();
+    // The records are covered by the checkpoint, so a crash before the
+    // truncation reaches the disk only replays records that are skipped.
+    bool ok = (ftruncate(fd, 0) == 0);
+    if (ok) {
+      file_size = 0;
+      durable_lsn = appended_lsn;
+    } else {
+      logstream(LOG_ERROR) << "Unable to truncate log: " << strerror(errno) << std::endl;
+      failed = true;
+    }
+    flushed.broadcast();
+    mut.unlock();
+    return ok;
+  }
+
+  graph_wal::lsn_type graph_wal::last_lsn() const {
+    mut.lock();
+    lsn_type ret = appended_lsn;
+    mut.unlock();
+    return ret;
+  }
+
+  size_t graph_wal::size() const {
+    mut.lock();
+    size_t ret = file_size + buffer.size();
+    mut.unlock();
+    return ret;
+  }
+
+  size_t graph_wal::num_syncs() const {
+    mut.lock();
+    size_t ret = syncs;
+    mut.unlock();
+    return ret;
+  }
+} // namespace graphlab
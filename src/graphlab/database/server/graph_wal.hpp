@@ -0,0 +1,120 @@
+#ifndef GRAPHLAB_DATABASE_GRAPH_WAL_HPP
+#define GRAPHLAB_DATABASE_GRAPH_WAL_HPP
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <boost/function.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+
+namespace graphlab {
+/**
+ * \ingroup group_graph_database
+ * An append-only write-ahead log of shard mutations with group commit.
+ *
+ * Each record holds the bytes of one mutation and gets a log sequence
+ * number (lsn), increasing by one per record. A record is durable once
+ * sync() returns for its lsn or any later one.
+ *
+ * Appends only buffer records in memory. The first thread to call
+ * sync() becomes the leader: it writes every buffered record and issues
+ * a single fdatasync(), while the threads syncing in the meantime wait
+ * and are served by the same or the next flush. With a positive
+ * <code>max_delay_ms</code> the leader waits up to that long for more
+ * records before flushing, trading commit latency for fewer syncs under
+ * concurrent writers. The wait ends early once <code>MAX_BATCH</code>
+ * bytes are buffered.
+ *
+ * The log is meant to be replayed on top of a checkpoint of the shard
+ * which records the lsn it covers (see
+ * graph_shard_server::save_checkpoint()). Once the checkpoint is durable,
+ * reset() empties the log.
+ *
+ * Record layout: uint32 length, uint32 crc32 of the payload, uint64 lsn,
+ * payload. Replay stops at the first torn or corrupt record, which is
+ * cut from the file.
+ */
+class graph_wal {
+ public:
+  typedef uint64_t lsn_type;
+
+  /// Callback receiving the payload of a replayed record.
+  typedef boost::function<void (const char*, size_t)> replay_fun_type;
+
+  /// Bytes buffered before a waiting leader flushes anyway.
+  static const size_t MAX_BATCH = 1 << 20;
+
+  graph_wal();
+
+  ~graph_wal();
+
+  /**
+   * Opens the log at path, creating it if needed. The payloads of the
+   * records with lsn greater than after are passed to fun in log order.
+   * New records are numbered after the last one in the log, and at
+   * least after <code>after</code>. Returns false if the file cannot be
+   * opened.
+   */
+  bool open(const std::string& path, lsn_type after,
+            const replay_fun_type& fun, size_t max_delay_ms = 0);
+
+  /// Flushes the buffered records and closes the log.
+  void close();
+
+  inline bool is_open() const { return fd >= 0; }
+
+  /**
+   * Buffers a record and returns its lsn. The record is not durable
+   * until sync() returns.
+   */
+  lsn_type append(const char* data, size_t len);
+
+  /**
+   * Blocks until the record lsn and all records before it are durable.
+   * Returns false if writing the log failed. Failures are sticky.
+   */
+  bool sync(lsn_type lsn);
+
+  /**
+   * Drops every record of the log, which must all be covered by a
+   * durable checkpoint. The numbering continues after the last record.
+   * Appends must not run concurrently.
+   */
+  bool reset();
+
+  /// Returns the lsn of the last appended record.
+  lsn_type last_lsn() const;
+
+  /// Returns the size of the log in bytes, including buffered records.
+  size_t size() const;
+
+  /// Returns the number of syncs issued to the file since it was opened.
+  size_t num_syncs() const;
+
+ private:
+  // Writes the buffer to the file as the leader. mut must be held.
+  void flush_locked();
+
+  int fd;
+  size_t max_delay_ms;
+
+  mutex mut;
+  // signaled when a flush completes
+  conditional flushed;
+  // signaled when the buffer exceeds MAX_BATCH
+  conditional batch_full;
+
+  // records appended but not yet handed to the file
+  std::vector<char> buffer;
+  lsn_type appended_lsn;
+  lsn_type durable_lsn;
+  bool flushing;
+  bool failed;
+  size_t file_size;
+  size_t syncs;
+
+  // not copyable
+  graph_wal(const graph_wal&);
+  graph_wal& operator=(const graph_wal&);
+};
+} // namespace graphlab
+#endif
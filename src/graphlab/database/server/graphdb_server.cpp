@@ -1,18 +1,53 @@
 #include <graphlab/database/server/graphdb_server.hpp>
 #include <graphlab/serialization/iarchive.hpp>
 #include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/database/graph_row_view.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
 
 namespace graphlab {
      typedef graph_database::vertex_adj_descriptor vertex_adj_descriptor;
      typedef graph_database::vertex_insert_descriptor vertex_insert_descriptor;
      typedef graph_database::edge_insert_descriptor edge_insert_descriptor;
      typedef graph_database::mirror_insert_descriptor mirror_insert_descriptor;
+     typedef graph_database::id_value_pair id_value_pair;
 
   // ------------------ Server Query and Update interface ----------------------------
   bool graphdb_server::update(char* msg, size_t msglen, char** outreply, size_t *outreplylen) {
     logstream(LOG_EMPH) << "Update Request. "; 
     oarchive oarc;
+    graph_wal::lsn_type lsn = 0;
+    lock.lock();
     bool success = process(msg, msglen, oarc);
+    QueryMessage::header h = QueryMessage(msg, msglen).get_header();
+    // a failed update changed nothing, except for the rows of a batch which
+    // succeeded; replaying a batch fails the other rows the same way
+    bool applied = success || h.cmd == QueryMessage::BADD || h.cmd == QueryMessage::BSET;
+    if (applied && wal.is_open()) {
+      if (h.cmd == QueryMessage::ADMIN) {
+        // the whole shard is replaced
+        if (h.obj == QueryMessage::RESET || h.obj == QueryMessage::LOAD) {
+          success &= checkpoint();
+        }
+      } else if (h.cmd != QueryMessage::GET && h.cmd != QueryMessage::BGET) {
+        lsn = wal.append(msg, msglen);
+        if (wal.size() >= next_checkpoint_bytes && !checkpoint()) {
+          // back off instead of saving the whole shard on every update
+          next_checkpoint_bytes = 2 * wal.size();
+          logstream(LOG_ERROR) << "Checkpoint failed, trying again once the log holds "
+                               << next_checkpoint_bytes << " bytes" << std::endl;
+        }
+      }
+    }
+    if (applied && !transfers.empty()) {
+      record_update(h, msg, msglen);
+    }
+    lock.unlock();
+    // reply once the update is durable
+    if (lsn > 0 && !wal.sync(lsn)) {
+      success = false;
+    }
     if (success) {
       logstream(LOG_EMPH) << "Success." << std::endl;
     } else {
@@ -26,7 +61,18 @@ namespace graphlab {
   void graphdb_server::query(char* msg, size_t msglen, char** outreply, size_t *outreplylen) {
     logstream(LOG_EMPH) << "Query Request. "; 
     oarchive oarc;
-    bool success = process(msg, msglen, oarc);
+    bool success;
+    QueryMessage qm(msg, msglen);
+    if (qm.get_header().obj == QueryMessage::TRAVERSE) {
+      // takes lock by itself
+      success = (process_traverse(qm, oarc) == 0);
+    } else if (qm.get_header().obj == QueryMessage::AGGREGATE) {
+      success = (process_aggregate(qm, oarc) == 0);
+    } else {
+      lock.lock();
+      success = process(msg, msglen, oarc);
+      lock.unlock();
+    }
     if (success) {
       logstream(LOG_EMPH) << "Success." << std::endl;
     } else {
@@ -36,38 +82,801 @@ namespace graphlab {
     *outreplylen = oarc.off;
   }
 
+  bool graphdb_server::open_log(const std::string& dir, size_t max_delay_ms,
+                                size_t checkpoint_bytes) {
+    std::string prefix = dir + "/shard" +
+        boost::lexical_cast<std::string>(server.get_shard().id());
+    checkpoint_path = prefix + ".ckpt";
+    this->checkpoint_bytes = checkpoint_bytes;
+    next_checkpoint_bytes = checkpoint_bytes;
+    uint64_t lsn = 0;
+    int errorcode = server.load_checkpoint(checkpoint_path, lsn);
+    invalidate_codec();
+    if (errorcode != 0 && errorcode != ENOENT) {
+      return false;
+    }
+    return wal.open(prefix + ".log", lsn,
+                    boost::bind(&graphdb_server::replay, this, _1, _2),
+                    max_delay_ms);
+  }
+
+  void graphdb_server::replay(const char* msg, size_t msglen) {
+    oarchive oarc;
+    process(const_cast<char*>(msg), msglen, oarc);
+    free(oarc.buf);
+  }
+
+  bool graphdb_server::checkpoint() {
+    // every appended record is applied, so the checkpoint covers them all
+    if (server.save_checkpoint(checkpoint_path, wal.last_lsn()) != 0 || !wal.reset()) {
+      return false;
+    }
+    next_checkpoint_bytes = checkpoint_bytes;
+    return true;
+  }
+
+  // ------------------ State transfer ----------------------------
+  const size_t graphdb_server::MAX_TRANSFER_ATTEMPTS;
+
+  namespace {
+    enum chunk_type { SCHEMA_CHUNK, VERTEX_CHUNK, EDGE_CHUNK, TAIL_CHUNK };
+  }
+
+  void graphdb_server::serialize(char** outbuf, size_t *outbuflen) {
+    oarchive oarc;
+    bool done = false;
+    for (size_t i = 0; i < MAX_TRANSFER_ATTEMPTS && !done; ++i) {
+      // the transfer may go stale in the meantime, then start over
+      oarc.off = 0;
+      size_t id = begin_transfer();
+      done = append_chunks(id, oarc, false);
+      end_transfer(id);
+    }
+    if (!done) {
+      // the updates keep outgrowing the tail, hold them back this time
+      logstream(LOG_WARNING) << "State transfer went stale " << MAX_TRANSFER_ATTEMPTS
+                             << " times, blocking the updates until it is done" << std::endl;
+      oarc.off = 0;
+      lock.lock();
+      size_t id = new_transfer(DEFAULT_ROWS_PER_CHUNK);
+      done = append_chunks(id, oarc, true);
+      transfers.erase(id);
+      lock.unlock();
+      ASSERT_TRUE(done);
+    }
+    *outbuf = oarc.buf;
+    *outbuflen = oarc.off;
+  }
+
+  bool graphdb_server::append_chunks(size_t id, oarchive& oarc, bool locked) {
+    size_t pos = 0;
+    bool last = false;
+    while (!last) {
+      oarchive chunk;
+      size_t next;
+      int errorcode = locked ? cut_chunk(id, pos, chunk, next, last)
+                             : transfer_chunk(id, pos, chunk, next, last);
+      if (errorcode != 0) {
+        free(chunk.buf);
+        return false;
+      }
+      oarc << chunk.off;
+      oarc.write(chunk.buf, chunk.off);
+      free(chunk.buf);
+      pos = next;
+    }
+    return true;
+  }
+
+  void graphdb_server::deserialize(const char* buf, size_t buflen) {
+    iarchive iarc(buf, buflen);
+    while (iarc.off < iarc.len) {
+      size_t len;
+      iarc >> len;
+      int errorcode = apply_chunk(buf + iarc.off, len);
+      if (errorcode != 0) {
+        logstream(LOG_ERROR) << "Unable to apply the transferred state: "
+                             << glstrerr(errorcode) << std::endl;
+        return;
+      }
+      iarc.off += len;
+    }
+  }
+
+  size_t graphdb_server::begin_transfer(size_t rows_per_chunk) {
+    ASSERT_GT(rows_per_chunk, 0);
+    lock.lock();
+    size_t id = new_transfer(rows_per_chunk);
+    lock.unlock();
+    return id;
+  }
+
+  size_t graphdb_server::new_transfer(size_t rows_per_chunk) {
+    size_t id = next_transfer_id++;
+    transfer_state& t = transfers[id];
+    t.num_vertices = server.num_vertices();
+    t.num_edges = server.num_edges();
+    t.rows_per_chunk = rows_per_chunk;
+    t.tail_bytes = 0;
+    t.stale = false;
+    return id;
+  }
+
+  int graphdb_server::transfer_chunk(size_t id, size_t pos, oarchive& oarc,
+                                     size_t& next, bool& last) {
+    lock.lock();
+    int errorcode = cut_chunk(id, pos, oarc, next, last);
+    lock.unlock();
+    return errorcode;
+  }
+
+  int graphdb_server::cut_chunk(size_t id, size_t pos, oarchive& oarc,
+                                size_t& next, bool& last) {
+    std::map<size_t, transfer_state>::iterator it = transfers.find(id);
+    if (it == transfers.end() || it->second.stale) {
+      return (it == transfers.end()) ? EINVID : ESTALE;
+    }
+    const transfer_state& t = it->second;
+    graph_shard& shard = server.get_shard();
+    size_t vertex_chunks = (t.num_vertices + t.rows_per_chunk - 1) / t.rows_per_chunk;
+    size_t edge_chunks = (t.num_edges + t.rows_per_chunk - 1) / t.rows_per_chunk;
+    size_t tail_pos = 1 + vertex_chunks + edge_chunks;
+
+    oarc << id << pos;
+    next = pos + 1;
+    last = false;
+    // the rows are serialized right away, borrow the payloads
+    graph_row row;
+    if (pos == 0) {
+      oarc << SCHEMA_CHUNK << shard.id()
+           << server.get_vertex_fields() << server.get_edge_fields();
+    } else if (pos < 1 + vertex_chunks) {
+      size_t begin = (pos - 1) * t.rows_per_chunk;
+      size_t end = std::min(begin + t.rows_per_chunk, t.num_vertices);
+      oarc << VERTEX_CHUNK << (end - begin);
+      for (size_t i = begin; i < end; ++i) {
+        shard.vertex_data(i).borrow_to(row);
+        oarc << shard.vertex(i) << row << shard.mirrors(i);
+      }
+    } else if (pos < tail_pos) {
+      size_t begin = (pos - 1 - vertex_chunks) * t.rows_per_chunk;
+      size_t end = std::min(begin + t.rows_per_chunk, t.num_edges);
+      oarc << EDGE_CHUNK << (end - begin);
+      for (size_t i = begin; i < end; ++i) {
+        shard.edge_data(i).borrow_to(row);
+        oarc << shard.edge(i).first << shard.edge(i).second << row;
+      }
+    } else {
+      size_t begin = std::min(pos - tail_pos, t.tail.size());
+      size_t end = std::min(begin + t.rows_per_chunk, t.tail.size());
+      last = (end == t.tail.size());
+      oarc << TAIL_CHUNK << last << (end - begin);
+      for (size_t i = begin; i < end; ++i) {
+        oarc << t.tail[i];
+      }
+      next = tail_pos + end;
+    }
+    return 0;
+  }
+
+  void graphdb_server::end_transfer(size_t id) {
+    lock.lock();
+    transfers.erase(id);
+    lock.unlock();
+  }
+
+  void graphdb_server::record_update(const QueryMessage::header& h,
+                                     const char* msg, size_t msglen) {
+    bool replaced = (h.cmd == QueryMessage::ADMIN &&
+                     (h.obj == QueryMessage::RESET || h.obj == QueryMessage::LOAD));
+    // segments cut from now on would not match the schema sent first
+    bool new_field = (h.cmd == QueryMessage::ADD &&
+                      (h.obj == QueryMessage::VFIELD || h.obj == QueryMessage::EFIELD));
+    bool mutation = (h.cmd != QueryMessage::GET && h.cmd != QueryMessage::BGET &&
+                     h.cmd != QueryMessage::ADMIN);
+    std::map<size_t, transfer_state>::iterator it;
+    for (it = transfers.begin(); it != transfers.end(); ++it) {
+      transfer_state& t = it->second;
+      if (replaced || new_field || (mutation && t.tail_bytes + msglen > max_tail_bytes)) {
+        t.stale = true;
+        std::vector<std::string>().swap(t.tail);
+        t.tail_bytes = 0;
+      } else if (mutation && !t.stale) {
+        t.tail.push_back(std::string(msg, msglen));
+        t.tail_bytes += msglen;
+      }
+    }
+  }
+
+  int graphdb_server::apply_chunk(const char* buf, size_t len) {
+    iarchive iarc(buf, len);
+    size_t id, pos;
+    chunk_type type;
+    iarc >> id >> pos >> type;
+    lock.lock();
+    if (pos != 0 && (id != applied_transfer_id || pos > applied_position)) {
+      lock.unlock();
+      return EINVID;
+    }
+    if ((pos != 0 && pos < applied_position) ||
+        (pos == 0 && id == applied_transfer_id && applied_position > 0)) {
+      // already applied
+      lock.unlock();
+      return 0;
+    }
+    graph_shard& shard = server.get_shard();
+    int errorcode = 0;
+    size_t count = 0;
+    bool last = false;
+    switch (type) {
+     case SCHEMA_CHUNK: {
+       graph_shard_id_t shardid;
+       std::vector<graph_field> vertex_fields, edge_fields;
+       iarc >> shardid >> vertex_fields >> edge_fields;
+       if (shardid != shard.id()) {
+         errorcode = EINVID;
+         break;
+       }
+       server.clear();
+       invalidate_codec();
+       for (size_t i = 0; i < vertex_fields.size(); ++i) {
+         server.add_vertex_field(vertex_fields[i]);
+       }
+       for (size_t i = 0; i < edge_fields.size(); ++i) {
+         server.add_edge_field(edge_fields[i]);
+       }
+       applied_transfer_id = id;
+       break;
+     }
+     case VERTEX_CHUNK: {
+       iarc >> count;
+       graph_vid_t vid;
+       graph_row row;
+       std::vector<graph_shard_id_t> mirrors;
+       for (size_t i = 0; i < count; ++i) {
+         iarc >> vid >> row >> mirrors;
+         shard.add_vertex(vid, row);
+         for (size_t j = 0; j < mirrors.size(); ++j) {
+           shard.add_vertex_mirror(vid, mirrors[j]);
+         }
+       }
+       break;
+     }
+     case EDGE_CHUNK: {
+       iarc >> count;
+       graph_vid_t source, target;
+       graph_row row;
+       for (size_t i = 0; i < count; ++i) {
+         iarc >> source >> target >> row;
+         shard.add_edge(source, target, row);
+       }
+       break;
+     }
+     case TAIL_CHUNK: {
+       iarc >> last >> count;
+       std::string msg;
+       for (size_t i = 0; i < count; ++i) {
+         iarc >> msg;
+         replay(msg.c_str(), msg.length());
+       }
+       break;
+     }
+    }
+    if (errorcode == 0) {
+      applied_position = (type == TAIL_CHUNK) ? pos + count : pos + 1;
+      // the chunks were not logged, the checkpoint makes them durable
+      if (last && wal.is_open() && !checkpoint()) {
+        errorcode = EIO;
+      }
+    }
+    lock.unlock();
+    return errorcode;
+  }
+
+  size_t graphdb_server::transfer_position() {
+    lock.lock();
+    size_t ret = applied_position;
+    lock.unlock();
+    return ret;
+  }
+
   bool graphdb_server::process(char* msg, size_t msglen, oarchive& oarc) {
     QueryMessage qm(msg, msglen);
     QueryMessage::header header = qm.get_header();
     logstream(LOG_EMPH) << header << std::endl;
 
+    // a codec without schema, for the requests without a schema version
+    static const graph_row_codec no_codec;
+    const graph_row_codec* codec = &no_codec;
+    if (header.schema_version != 0) {
+      // rows are compact if the sender knows the current schema
+      bool compact = (current_codec().version() == header.schema_version);
+      oarc << compact;
+      if (compact) {
+        codec = &schema_codec;
+      }
+    }
+    if (header.cmd == QueryMessage::ADMIN) {
+      // the shard reset or loaded, process_add() covers the fields added
+      invalidate_codec();
+    }
+
     switch (header.cmd) {
-     case QueryMessage::GET: return (process_get(qm, oarc) == 0);
+     case QueryMessage::GET: return (process_get(qm, oarc, *codec) == 0);
      case QueryMessage::SET: return (process_set(qm, oarc) == 0);
      case QueryMessage::ADD: return (process_add(qm, oarc) == 0);
      case QueryMessage::BADD: return process_batch_add(qm, oarc);
-     case QueryMessage::BGET: return process_batch_get(qm, oarc);
+     case QueryMessage::BGET: return process_batch_get(qm, oarc, *codec);
      case QueryMessage::BSET: return process_batch_set(qm, oarc);
      case QueryMessage::ADMIN: return (process_admin(qm, oarc) == 0);
      default: return false;
     }
   }
 
+  const graph_row_codec& graphdb_server::current_codec() {
+    if (!schema_codec_valid) {
+      schema_codec = graph_row_codec(server.get_vertex_fields(), server.get_edge_fields());
+      schema_codec_valid = true;
+    }
+    return schema_codec;
+  }
+
+  // ------------------ Traversal ----------------------------
+  void graphdb_server::set_peers(const graph_shard_manager& manager,
+                                 const graph_traversal::scatter_function& scatter) {
+    stop_sender();
+    peer_manager = manager;
+    peer_scatter = scatter;
+    if (peer_scatter) {
+      stopping = false;
+      sender.launch(boost::bind(&graphdb_server::send_loop, this));
+    }
+  }
+
+  graphdb_server::traversal_state* graphdb_server::find_traversal(uint64_t id) {
+    std::map<uint64_t, traversal_state>::iterator it = traversals.find(id);
+    if (it == traversals.end()) {
+      return NULL;
+    }
+    it->second.last_used = time(NULL);
+    return &it->second;
+  }
+
+  void graphdb_server::receive(traversal_state* state, graph_traversal::op_type op,
+                               std::vector<graph_vid_t>& vids) {
+    std::vector<graph_vid_t>& to = (op == graph_traversal::FRONTIER) ?
+        state->frontier : state->candidates;
+    to.insert(to.end(), vids.begin(), vids.end());
+  }
+
+  void graphdb_server::receive(traversal_state* state, graph_traversal::op_type op,
+                               std::vector<std::pair<graph_vid_t, uint64_t> >& degrees) {
+    for (size_t i = 0; i < degrees.size(); ++i) {
+      state->degrees[degrees[i].first] += degrees[i].second;
+    }
+  }
+
+  int graphdb_server::process_traverse(QueryMessage& qm, oarchive& oarc) {
+    graph_traversal::op_type op;
+    uint64_t id;
+    qm >> op >> id;
+    int errorcode = 0;
+    switch (op) {
+     case graph_traversal::START: {
+       graph_traversal_spec spec;
+       qm >> spec;
+       time_t now = time(NULL);
+       traversal_lock.lock();
+       // drop the traversals of the clients which are gone
+       std::map<uint64_t, traversal_state>::iterator it = traversals.begin();
+       while (it != traversals.end()) {
+         if ((size_t)(now - it->second.last_used) > traversal_timeout_secs) {
+           traversals.erase(it++);
+         } else {
+           ++it;
+         }
+       }
+       if (traversals.count(id) != 0) {
+         errorcode = EDUP;
+       } else {
+         traversal_state& state = traversals[id];
+         state.spec = spec;
+         state.last_used = now;
+       }
+       traversal_lock.unlock();
+       oarc << errorcode;
+       break;
+     }
+     case graph_traversal::SEED:
+     case graph_traversal::FRONTIER:
+     case graph_traversal::CANDIDATES: {
+       std::vector<graph_vid_t> vids;
+       qm >> vids;
+       traversal_lock.lock();
+       traversal_state* state = find_traversal(id);
+       if (state == NULL) {
+         errorcode = EINVID;
+       } else {
+         receive(state, op, vids);
+       }
+       traversal_lock.unlock();
+       oarc << errorcode;
+       break;
+     }
+     case graph_traversal::VISIT: {
+       // keep the candidates reached for the first time
+       std::vector<graph_vid_t> visited;
+       bool expand = false;
+       traversal_lock.lock();
+       traversal_state* state = find_traversal(id);
+       if (state == NULL) {
+         errorcode = EINVID;
+       } else {
+         for (size_t i = 0; i < state->candidates.size(); ++i) {
+           if (state->visited.insert(std::make_pair(state->candidates[i], state->hop)).second) {
+             visited.push_back(state->candidates[i]);
+           }
+         }
+         std::vector<graph_vid_t>().swap(state->candidates);
+         expand = (state->hop < state->spec.max_hops);
+       }
+       traversal_lock.unlock();
+
+       if (expand && !visited.empty()) {
+         // their edges are on this shard and on their mirrors
+         std::map<graph_shard_id_t, std::vector<graph_vid_t> > frontier;
+         graph_shard_id_t self = server.get_shard().id();
+         std::vector<graph_shard_id_t> mirrors;
+         lock.lock();
+         for (size_t i = 0; i < visited.size(); ++i) {
+           frontier[self].push_back(visited[i]);
+           mirrors.clear();
+           server.get_vertex_mirrors(visited[i], mirrors);
+           for (size_t j = 0; j < mirrors.size(); ++j) {
+             if (mirrors[j] != self) {
+               frontier[mirrors[j]].push_back(visited[i]);
+             }
+           }
+         }
+         lock.unlock();
+         errorcode = deliver(id, graph_traversal::FRONTIER, frontier);
+       }
+       oarc << errorcode;
+       if (errorcode == 0) oarc << (uint64_t)visited.size();
+       break;
+     }
+     case graph_traversal::EXPAND: {
+       std::vector<graph_vid_t> frontier;
+       graph_traversal_spec spec;
+       traversal_lock.lock();
+       traversal_state* state = find_traversal(id);
+       if (state == NULL) {
+         errorcode = EINVID;
+       } else {
+         frontier.swap(state->frontier);
+         spec = state->spec;
+         ++state->hop;
+       }
+       traversal_lock.unlock();
+
+       std::vector<graph_vid_t> neighbors;
+       if (errorcode == 0 && !frontier.empty()) {
+         lock.lock();
+         errorcode = server.expand_vertices(frontier, spec, neighbors);
+         lock.unlock();
+       }
+       if (errorcode == 0 && !neighbors.empty()) {
+         // send each neighbor once to its master
+         std::sort(neighbors.begin(), neighbors.end());
+         neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+         std::map<graph_shard_id_t, std::vector<graph_vid_t> > candidates;
+         for (size_t i = 0; i < neighbors.size(); ++i) {
+           candidates[peer_master(neighbors[i])].push_back(neighbors[i]);
+         }
+         errorcode = deliver(id, graph_traversal::CANDIDATES, candidates);
+       }
+       oarc << errorcode;
+       break;
+     }
+     case graph_traversal::SYNC: {
+       uint64_t pending = 0;
+       traversal_lock.lock();
+       traversal_state* state = find_traversal(id);
+       if (state == NULL) {
+         errorcode = EINVID;
+       } else {
+         errorcode = state->peer_error;
+         pending = state->pending;
+       }
+       traversal_lock.unlock();
+       oarc << errorcode;
+       if (errorcode == 0) oarc << pending;
+       break;
+     }
+     case graph_traversal::RESULT: {
+       bool count_only;
+       qm >> count_only;
+       std::vector<std::pair<graph_vid_t, size_t> > out;
+       uint64_t count = 0;
+       traversal_lock.lock();
+       traversal_state* state = find_traversal(id);
+       if (state == NULL) {
+         errorcode = EINVID;
+       } else {
+         boost::unordered_map<graph_vid_t, size_t>::const_iterator v;
+         for (v = state->visited.begin(); v != state->visited.end(); ++v) {
+           if (v->second >= state->spec.min_hops) {
+             ++count;
+             if (!count_only) out.push_back(*v);
+           }
+         }
+       }
+       traversal_lock.unlock();
+       oarc << errorcode;
+       if (errorcode == 0) {
+         if (count_only) oarc << count;
+         else oarc << out;
+       }
+       break;
+     }
+     case graph_traversal::DEGREES: {
+       graph_traversal_spec::direction_type direction = graph_traversal_spec::OUT_EDGES;
+       traversal_lock.lock();
+       traversal_state* state = find_traversal(id);
+       if (state == NULL) {
+         errorcode = EINVID;
+       } else {
+         direction = state->spec.direction;
+       }
+       traversal_lock.unlock();
+
+       boost::unordered_map<graph_vid_t, uint64_t> degrees;
+       for (size_t position = 0, next = 0; errorcode == 0; position = next) {
+         lock.lock();
+         next = server.count_degrees(direction, position, degrees);
+         lock.unlock();
+         if (next == position) break;
+       }
+       if (errorcode == 0) {
+         // the master of each vertex adds up its degrees over all shards
+         std::map<graph_shard_id_t, std::vector<std::pair<graph_vid_t, uint64_t> > > partials;
+         boost::unordered_map<graph_vid_t, uint64_t>::const_iterator it;
+         for (it = degrees.begin(); it != degrees.end(); ++it) {
+           partials[peer_master(it->first)].push_back(*it);
+         }
+         errorcode = deliver(id, graph_traversal::PARTIAL_DEGREES, partials);
+       }
+       oarc << errorcode;
+       break;
+     }
+     case graph_traversal::PARTIAL_DEGREES: {
+       std::vector<std::pair<graph_vid_t, uint64_t> > degrees;
+       qm >> degrees;
+       traversal_lock.lock();
+       traversal_state* state = find_traversal(id);
+       if (state == NULL) {
+         errorcode = EINVID;
+       } else {
+         receive(state, op, degrees);
+       }
+       traversal_lock.unlock();
+       oarc << errorcode;
+       break;
+     }
+     case graph_traversal::DEGREE_RESULT: {
+       // the vertices mastered here, a slice at a time, have degree 0
+       // unless some were counted
+       graph_degree_distribution out;
+       std::vector<graph_vid_t> vids;
+       for (size_t position = 0; errorcode == 0; position += vids.size()) {
+         vids.clear();
+         lock.lock();
+         graph_shard& shard = server.get_shard();
+         size_t end = std::min(shard.num_vertices(),
+                               position + graph_shard_server::AGGREGATE_MAX_READ);
+         for (size_t i = position; i < end; ++i) {
+           vids.push_back(shard.vertex(i));
+         }
+         lock.unlock();
+         traversal_lock.lock();
+         traversal_state* state = find_traversal(id);
+         if (state == NULL) {
+           errorcode = EINVID;
+         } else {
+           for (size_t i = 0; i < vids.size(); ++i) {
+             boost::unordered_map<graph_vid_t, uint64_t>::const_iterator it =
+                 state->degrees.find(vids[i]);
+             ++out.counts[it == state->degrees.end() ? 0 : it->second];
+           }
+         }
+         traversal_lock.unlock();
+         if (vids.empty()) break;
+       }
+       oarc << errorcode;
+       if (errorcode == 0) oarc << out;
+       break;
+     }
+     case graph_traversal::END: {
+       traversal_lock.lock();
+       traversals.erase(id);
+       traversal_lock.unlock();
+       oarc << errorcode;
+       break;
+     }
+     default: errorcode = EINVHEAD;
+              oarc << errorcode;
+    }
+    return errorcode;
+  }
+
+  template<typename T>
+  int graphdb_server::deliver(uint64_t id, graph_traversal::op_type op,
+                              std::map<graph_shard_id_t, std::vector<T> >& items) {
+    graph_shard_id_t self = server.get_shard().id();
+    std::vector<peer_request> requests;
+    typename std::map<graph_shard_id_t, std::vector<T> >::iterator it;
+    for (it = items.begin(); it != items.end(); ++it) {
+      if (it->first != self) {
+        requests.push_back(peer_request());
+        requests.back().id = id;
+        requests.back().shard = it->first;
+        requests.back().msg = graph_traversal::request(op, id, it->second);
+      }
+    }
+    if (!requests.empty() && !peer_scatter) {
+      return ESRVUNREACH;
+    }
+    int errorcode = 0;
+    traversal_lock.lock();
+    traversal_state* state = find_traversal(id);
+    if (state == NULL) {
+      errorcode = EINVID;
+    } else {
+      state->pending += requests.size();
+      it = items.find(self);
+      if (it != items.end()) {
+        receive(state, op, it->second);
+      }
+    }
+    traversal_lock.unlock();
+    if (errorcode == 0 && !requests.empty()) {
+      outbox_lock.lock();
+      outbox.insert(outbox.end(), requests.begin(), requests.end());
+      outbox_cond.signal();
+      outbox_lock.unlock();
+    }
+    return errorcode;
+  }
+
+  void graphdb_server::send_loop() {
+    std::vector<peer_request> requests;
+    outbox_lock.lock();
+    while (true) {
+      while (outbox.empty() && !stopping) {
+        outbox_cond.wait(outbox_lock);
+      }
+      if (outbox.empty()) {
+        break;
+      }
+      requests.swap(outbox);
+      outbox_lock.unlock();
+
+      // one round to every peer with requests, whatever their traversal
+      graph_traversal::request_list messages(requests.size());
+      for (size_t i = 0; i < requests.size(); ++i) {
+        messages[i].first = requests[i].shard;
+        messages[i].second.swap(requests[i].msg);
+      }
+      std::vector<std::string> replies;
+      peer_scatter(messages, replies);
+
+      traversal_lock.lock();
+      for (size_t i = 0; i < requests.size(); ++i) {
+        // the traversal may have ended or expired meanwhile
+        std::map<uint64_t, traversal_state>::iterator it = traversals.find(requests[i].id);
+        if (it == traversals.end()) {
+          continue;
+        }
+        int err = (i < replies.size()) ?
+            graph_traversal::parse_reply<int>(replies[i], NULL) : ESRVUNREACH;
+        --it->second.pending;
+        if (err != 0 && it->second.peer_error == 0) {
+          it->second.peer_error = err;
+        }
+      }
+      traversal_lock.unlock();
+      requests.clear();
+      outbox_lock.lock();
+    }
+    outbox_lock.unlock();
+  }
+
+  void graphdb_server::stop_sender() {
+    outbox_lock.lock();
+    stopping = true;
+    outbox_cond.signal();
+    outbox_lock.unlock();
+    sender.join();
+  }
+
+  // ------------------ Aggregation ----------------------------
+  int graphdb_server::process_aggregate(QueryMessage& qm, oarchive& oarc) {
+    graph_aggregate_type op;
+    qm >> op;
+    int errorcode = 0;
+    switch (op) {
+     case FIELD_AGGREGATE: {
+       bool is_vertex, distinct;
+       size_t fieldpos;
+       qm >> is_vertex >> fieldpos >> distinct;
+       graph_field_aggregate out;
+       for (size_t position = 0, next = 0; errorcode == 0; position = next) {
+         lock.lock();
+         errorcode = server.aggregate_field(is_vertex, fieldpos, distinct, position, out, next);
+         lock.unlock();
+         if (next == position) break;
+       }
+       oarc << errorcode;
+       if (errorcode == 0) oarc << out;
+       break;
+     }
+     case FIELD_HISTOGRAM: {
+       bool is_vertex;
+       size_t fieldpos, nbins;
+       double lo, hi;
+       qm >> is_vertex >> fieldpos >> lo >> hi >> nbins;
+       graph_field_histogram out(lo, hi, std::min(nbins, graph_field_histogram::MAX_BINS + 1));
+       if (!out.valid()) {
+         errorcode = EINVHEAD;
+       }
+       for (size_t position = 0, next = 0; errorcode == 0; position = next) {
+         lock.lock();
+         errorcode = server.histogram_field(is_vertex, fieldpos, position, out, next);
+         lock.unlock();
+         if (next == position) break;
+       }
+       oarc << errorcode;
+       if (errorcode == 0) oarc << out;
+       break;
+     }
+     default: errorcode = EINVHEAD;
+              oarc << errorcode;
+    }
+    return errorcode;
+  }
+
   // ------------------ Handler for add/get/set request ----------------------------
+  static void save_row(oarchive& oarc, const graph_row& row, const graph_row_codec& codec) {
+    if (codec.version() != 0) {
+      codec.save(oarc, row);
+    } else {
+      oarc << row;
+    }
+  }
+
+  static void save_rows(oarchive& oarc, const std::vector<graph_row>& rows,
+                        const graph_row_codec& codec) {
+    if (codec.version() != 0) {
+      codec.save_rows(oarc, rows);
+    } else {
+      oarc << rows;
+    }
+  }
+
   int graphdb_server::process_add(QueryMessage& qm, oarchive& oarc) {
     int errorcode = 0;
     QueryMessage::header h = qm.get_header(); 
     switch (h.obj) {
      case QueryMessage::VERTEX: {
-       graph_vid_t vid; graph_row data;
+       graph_vid_t vid; graph_row_view data;
        qm >> vid >> data;
-       errorcode = server.add_vertex(vid, data);
+       errorcode = server.add_vertex(vid, data.row());
        break;
      }
      case QueryMessage::EDGE: {
-       graph_vid_t source, dest; graph_row data;
+       graph_vid_t source, dest; graph_row_view data;
        qm >> source >> dest >> data;
-       errorcode = server.add_edge(source, dest, data);
+       errorcode = server.add_edge(source, dest, data.row());
        break;
      }
      case QueryMessage::VMIRROR: {
@@ -80,12 +889,18 @@ namespace graphlab {
        graph_field field;
        qm >> field;
        errorcode = server.add_vertex_field(field);
+       if (errorcode == 0) {
+         invalidate_codec();
+       }
        break;
      }
      case QueryMessage::EFIELD: {
        graph_field field;
        qm >> field;
        errorcode = server.add_edge_field(field);
+       if (errorcode == 0) {
+         invalidate_codec();
+       }
        break;
      }
      default: errorcode = EINVHEAD;
@@ -94,26 +909,28 @@ namespace graphlab {
     return errorcode;
   }
 
-  int graphdb_server::process_get(QueryMessage& qm, oarchive& oarc) {
+  int graphdb_server::process_get(QueryMessage& qm, oarchive& oarc,
+                                  const graph_row_codec& codec) {
     int errorcode = 0;
     QueryMessage::header h = qm.get_header(); 
     switch (h.obj) {
      case QueryMessage::VERTEX: {
        graph_vid_t vid; 
        qm >> vid; 
+       // the row is serialized right away, borrow the payloads
        graph_row data;
-       errorcode = server.get_vertex(vid, data);
+       errorcode = server.get_vertex_ref(vid, data);
        oarc << errorcode;
-       if (errorcode == 0) oarc << data;
+       if (errorcode == 0) save_row(oarc, data, codec);
        break;
      }
      case QueryMessage::EDGE: {
        graph_eid_t eid;
        qm >> eid; 
        graph_row data;
-       errorcode = server.get_edge(eid, data);
+       errorcode = server.get_edge_ref(eid, data);
        oarc << errorcode;
-       if (errorcode == 0) oarc << data;
+       if (errorcode == 0) save_row(oarc, data, codec);
        break;
      }
      case QueryMessage::VERTEXADJ: {
@@ -125,6 +942,62 @@ namespace graphlab {
        if (errorcode == 0) oarc << data;
        break;
      }
+     case QueryMessage::VMIRROR: {
+       // the mirrors of a vertex and its adjacency on its master, so
+       // that clients only query the other shards holding its edges
+       graph_vid_t vid; bool in_edges;
+       qm >> vid >> in_edges;
+       std::vector<graph_shard_id_t> mirrors;
+       vertex_adj_descriptor data;
+       errorcode = server.get_vertex_mirrors(vid, mirrors);
+       if (errorcode == 0) errorcode = server.get_vertex_adj(vid, in_edges, data);
+       oarc << errorcode;
+       if (errorcode == 0) oarc << mirrors << data;
+       break;
+     }
+     case QueryMessage::SCAN: {
+       // the scan is resumed from the position in the reply, so the
+       // server keeps no state between chunks
+       bool is_vertex; size_t position, max_rows, max_bytes; graph_row_filter filter;
+       qm >> is_vertex >> position >> max_rows >> max_bytes >> filter;
+       std::vector<graph_database::scan_descriptor> rows;
+       size_t next;
+       errorcode = server.scan(is_vertex, position, max_rows, max_bytes, filter, rows, next);
+       oarc << errorcode;
+       if (errorcode == 0) {
+         bool end = next >= (is_vertex ? server.get_shard().num_vertices()
+                                       : server.get_shard().num_edges());
+         oarc << next << end << rows;
+       }
+       break;
+     }
+     case QueryMessage::VINDEX: {
+       size_t fieldpos; graph_value key;
+       qm >> fieldpos >> key;
+       std::vector<graph_vid_t> vids;
+       errorcode = server.find_vertices(fieldpos, key, vids);
+       oarc << errorcode;
+       if (errorcode == 0) oarc << vids;
+       break;
+     }
+     case QueryMessage::TOPK: {
+       bool is_vertex, largest; size_t fieldpos, k;
+       qm >> is_vertex >> fieldpos >> k >> largest;
+       std::vector<id_value_pair> out;
+       errorcode = server.topk(is_vertex, fieldpos, k, largest, out);
+       oarc << errorcode;
+       if (errorcode == 0) oarc << out;
+       break;
+     }
+     case QueryMessage::RANGE: {
+       bool is_vertex; size_t fieldpos; graph_value lo, hi;
+       qm >> is_vertex >> fieldpos >> lo >> hi;
+       std::vector<id_value_pair> out;
+       errorcode = server.range(is_vertex, fieldpos, lo, hi, out);
+       oarc << errorcode;
+       if (errorcode == 0) oarc << out;
+       break;
+     }
      case QueryMessage::VFIELD: {
        errorcode = 0;
        oarc << 0 << (server.get_vertex_fields());
@@ -156,15 +1029,15 @@ namespace graphlab {
     QueryMessage::header h = qm.get_header();
     switch (h.obj) {
      case QueryMessage::VERTEX: {
-       graph_vid_t vid; graph_row data;
+       graph_vid_t vid; graph_row_view data;
        qm >> vid >> data;
-       errorcode = server.set_vertex(vid, data);
+       errorcode = server.set_vertex(vid, data.row());
        break;
      }
      case QueryMessage::EDGE: {
-       graph_eid_t eid; graph_row data;
+       graph_eid_t eid; graph_row_view data;
        qm >> eid >> data;
-       errorcode = server.set_edge(eid, data);
+       errorcode = server.set_edge(eid, data.row());
        break;
      }
      default: errorcode = EINVHEAD;
@@ -179,16 +1052,29 @@ namespace graphlab {
     std::vector<int> errorcodes;
     QueryMessage::header h = qm.get_header();
     switch (h.obj) {
+     // rows are applied as they are decoded, borrowing from the request
      case QueryMessage::VERTEX:  {
-       std::vector<vertex_insert_descriptor> in;
-       qm >> in;
-       success = server.add_vertices(in, errorcodes);
+       graph_vid_t vid; graph_row_view data;
+       size_t n = qm.read_vector_length();
+       success = true;
+       for (size_t i = 0; i < n; ++i) {
+         qm >> vid >> data;
+         int err = server.add_vertex(vid, data.row());
+         errorcodes.push_back(err);
+         success &= (err == 0);
+       }
        break;
      }
      case QueryMessage::EDGE: {
-       std::vector<edge_insert_descriptor> in;
-       qm >> in;
-       success = server.add_edges(in, errorcodes);
+       graph_vid_t source, dest; graph_row_view data;
+       size_t n = qm.read_vector_length();
+       success = true;
+       for (size_t i = 0; i < n; ++i) {
+         qm >> source >> dest >> data;
+         int err = server.add_edge(source, dest, data.row());
+         errorcodes.push_back(err);
+         success &= (err == 0);
+       }
        break;
      }
      case QueryMessage::VMIRROR: {
@@ -207,7 +1093,8 @@ namespace graphlab {
     return success;
   }
 
-  bool graphdb_server::process_batch_get(QueryMessage& qm, oarchive& oarc) {
+  bool graphdb_server::process_batch_get(QueryMessage& qm, oarchive& oarc,
+                                         const graph_row_codec& codec) {
     bool success = false;
     std::vector<int> errorcodes;
     QueryMessage::header h = qm.get_header();
@@ -217,7 +1104,8 @@ namespace graphlab {
        std::vector<graph_row> out;
        qm >> in;
        success = server.get_vertices(in, out, errorcodes);
-       oarc << success << out;
+       oarc << success;
+       save_rows(oarc, out, codec);
        break;
      }
      case QueryMessage::EDGE: {
@@ -225,6 +1113,42 @@ namespace graphlab {
        std::vector<graph_row> out;
        qm >> in;
        success = server.get_edges(in, out, errorcodes);
+       oarc << success;
+       save_rows(oarc, out, codec);
+       break;
+     }
+     case QueryMessage::VERTEXADJ: {
+       bool in_edges; std::vector<graph_vid_t> in;
+       std::vector<vertex_adj_descriptor> out;
+       qm >> in_edges >> in;
+       success = server.get_vertices_adj(in, in_edges, out, errorcodes);
+       oarc << success << out;
+       break;
+     }
+     case QueryMessage::VMIRROR: {
+       // same as GET VMIRROR for each vid
+       bool in_edges; std::vector<graph_vid_t> in;
+       std::vector<vertex_adj_descriptor> adj;
+       qm >> in_edges >> in;
+       server.get_vertices_adj(in, in_edges, adj, errorcodes);
+       std::vector<std::pair<std::vector<graph_shard_id_t>, vertex_adj_descriptor> > out(in.size());
+       success = true;
+       for (size_t i = 0; i < in.size(); ++i) {
+         errorcodes[i] = server.get_vertex_mirrors(in[i], out[i].first);
+         out[i].second.neighbor_ids.swap(adj[i].neighbor_ids);
+         out[i].second.eids.swap(adj[i].eids);
+         success &= (errorcodes[i] == 0);
+       }
+       oarc << success << out;
+       break;
+     }
+     case QueryMessage::FILTER: {
+       // the positions of the matching rows, with the selected fields only
+       bool is_vertex; graph_row_filter filter; std::vector<uint64_t> in;
+       std::vector<std::pair<size_t, graph_row> > out;
+       qm >> is_vertex >> filter >> in;
+       success = is_vertex ? server.filter_vertices(in, filter, out, errorcodes)
+                           : server.filter_edges(in, filter, out, errorcodes);
        oarc << success << out;
        break;
      }
@@ -241,16 +1165,29 @@ namespace graphlab {
     std::vector<int> errorcodes;
     QueryMessage::header h = qm.get_header();
     switch (h.obj) {
+     // rows are applied as they are decoded, borrowing from the request
      case QueryMessage::VERTEX:  {
-       std::vector< std::pair<graph_vid_t, graph_row> > in;
-       qm >> in;
-       success = server.set_vertices(in, errorcodes);
+       graph_vid_t vid; graph_row_view data;
+       size_t n = qm.read_vector_length();
+       success = true;
+       for (size_t i = 0; i < n; ++i) {
+         qm >> vid >> data;
+         int err = server.set_vertex(vid, data.row());
+         errorcodes.push_back(err);
+         success &= (err == 0);
+       }
        break;
      }
      case QueryMessage::EDGE: {
-       std::vector< std::pair<graph_eid_t, graph_row> > in;
-       qm >> in;
-       success = server.set_edges(in, errorcodes);
+       graph_eid_t eid; graph_row_view data;
+       size_t n = qm.read_vector_length();
+       success = true;
+       for (size_t i = 0; i < n; ++i) {
+         qm >> eid >> data;
+         int err = server.set_edge(eid, data.row());
+         errorcodes.push_back(err);
+         success &= (err == 0);
+       }
        break;
      }
      default: oarc << false << EINVHEAD; 
@@ -265,9 +1202,27 @@ namespace graphlab {
 
   int graphdb_server::process_admin(QueryMessage& qm, oarchive& oarc) {
     switch (qm.get_header().obj) {
+      // both reply the errorcode alone, as SAVE and LOAD
       case QueryMessage::RESET:
         server.clear();
+        oarc << 0;
+        return 0;
+      case QueryMessage::FREEZE:
+        server.freeze_index();
+        oarc << 0;
         return 0;
+      case QueryMessage::SAVE:
+      case QueryMessage::LOAD: {
+        // each shard has its own image file in the given directory
+        std::string dir;
+        qm >> dir;
+        std::string path = dir + "/shard" +
+            boost::lexical_cast<std::string>(server.get_shard().id()) + ".img";
+        int errorcode = (qm.get_header().obj == QueryMessage::SAVE) ?
+            server.save_image(path) : server.load_image(path);
+        oarc << errorcode;
+        return errorcode;
+      }
       default:
         oarc << false << EINVHEAD; 
         return EINVHEAD;
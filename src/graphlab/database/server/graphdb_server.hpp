@@ -1,10 +1,18 @@
 #ifndef GRAPHLAB_DATABASE_GRAPHDB_SERVER_HPP
 #define GRAPHLAB_DATABASE_GRAPHDB_SERVER_HPP
 #include <graphlab/database/server/graph_shard_server.hpp>
+#include <graphlab/database/server/graph_wal.hpp>
 #include <graphlab/database/query_message.hpp>
+#include <graphlab/database/graph_row_codec.hpp>
+#include <graphlab/database/graph_shard_manager.hpp>
+#include <graphlab/database/graph_traversal.hpp>
 #include <graphlab/database/errno.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
 
 #include <fault/query_object.hpp>
+#include <boost/unordered_map.hpp>
+#include <ctime>
+#include <map>
 
 namespace graphlab {
 
@@ -12,9 +20,23 @@ class graphdb_server : public libfault::query_object {
 
 public:
   graphdb_server(size_t shardid, bool is_master = true) 
-      : server(shardid), is_master(is_master) {}
+      : server(shardid), is_master(is_master), checkpoint_bytes(0), next_checkpoint_bytes(0),
+        schema_codec_valid(false), next_transfer_id(1),
+        max_tail_bytes(DEFAULT_MAX_TAIL_BYTES), applied_transfer_id(0), applied_position(0),
+        traversal_timeout_secs(DEFAULT_TRAVERSAL_TIMEOUT_SECS), stopping(false) {}
 
-  virtual ~graphdb_server() { }
+  virtual ~graphdb_server() { stop_sender(); }
+
+  /**
+   * Makes the updates durable. Loads the checkpoint of the shard in dir,
+   * replays the write-ahead log on top of it, and logs every following
+   * update before replying (see \ref graph_wal). Concurrent updates share
+   * their log syncs, waiting up to max_delay_ms for each other. A new
+   * checkpoint replaces the log once it grows beyond checkpoint_bytes.
+   * After a checkpoint fails, the next is tried once the log doubles.
+   * Returns false if the checkpoint or the log cannot be read.
+   */
+  bool open_log(const std::string& dir, size_t max_delay_ms, size_t checkpoint_bytes);
 
   void query(char* msg, size_t msglen, char** outreply, size_t *outreplylen);
 
@@ -25,24 +47,180 @@ public:
     is_master = true;
   }
 
-  void serialize(char** outbuf, size_t *outbuflen) { }
+  /**
+   * Concatenates the chunks of a new state transfer into outbuf. libfault
+   * asks for the whole state at once, but the chunks are still cut one at
+   * a time, so the updates are only held back for one chunk at a time.
+   * After MAX_TRANSFER_ATTEMPTS transfers went stale, the chunks of the
+   * last one are all cut under lock, which holds back the updates until
+   * it is done but keeps a steady load of updates from starving it.
+   */
+  void serialize(char** outbuf, size_t *outbuflen);
+
+  static const size_t MAX_TRANSFER_ATTEMPTS = 3;
+
+  /// Applies the chunks written by serialize().
+  void deserialize(const char* buf, size_t buflen);
+
+  // --------------------- State Transfer ----------------------------
+  /**
+   * Starts a state transfer to a standby and returns its id.
+   *
+   * The transfer is a stream of chunks addressed by position. Position 0
+   * holds the schema. The next positions hold the vertices, then the
+   * edges, which the shard had when the transfer started, rows_per_chunk
+   * rows per chunk. Each of these chunks reads the rows when it is cut,
+   * so the updates keep being served between chunks. The updates applied
+   * since the start of the transfer are recorded, and the positions
+   * after the segments return them from the given record on, so the
+   * standby replays them in order on top of the segments. Replaying an
+   * update whose effect a segment already holds leaves the same state,
+   * because segments stop at the rows present at the start.
+   *
+   * Chunks can be asked again from any position, which lets a standby
+   * resume after losing a chunk.
+   *
+   * The recorded updates are held until the transfer ends. A transfer
+   * whose updates outgrow the limit of set_max_tail_bytes() goes stale.
+   */
+  size_t begin_transfer(size_t rows_per_chunk = DEFAULT_ROWS_PER_CHUNK);
+
+  /**
+   * Writes the chunk at pos of the transfer id into oarc. Sets next to
+   * the position of the following chunk, and last to true if the chunk
+   * holds the last recorded update. Returns 0 on success, EINVID if
+   * there is no such transfer, or ESTALE if the schema changed, the
+   * shard was replaced, or the recorded updates outgrew their limit since
+   * the transfer started. A stale transfer must be started again.
+   */
+  int transfer_chunk(size_t id, size_t pos, oarchive& oarc, size_t& next, bool& last);
+
+  /// Stops recording the updates for the transfer id.
+  void end_transfer(size_t id);
+
+  /// Limits the bytes of updates recorded for each transfer.
+  void set_max_tail_bytes(size_t bytes) {
+    lock.lock();
+    max_tail_bytes = bytes;
+    lock.unlock();
+  }
+
+  static const size_t DEFAULT_MAX_TAIL_BYTES = 256 << 20;
+  static const size_t DEFAULT_ROWS_PER_CHUNK = 4096;
+
+  /**
+   * Applies a chunk on a standby. A chunk at position 0 of a new transfer
+   * replaces the shard. Chunks already applied are skipped. A standby with
+   * a log (see open_log()) writes a checkpoint once it applied the last
+   * chunk, as the chunks are not logged. Returns 0 on success, EINVID if
+   * the chunk does not follow the last one applied or belongs to another
+   * shard, or EIO if the checkpoint cannot be written.
+   */
+  int apply_chunk(const char* buf, size_t len);
 
-  void deserialize(const char* buf, size_t buflen) { }
+  /// Returns the position of the next chunk to apply on a standby.
+  size_t transfer_position();
+
+  // --------------------- Traversal ----------------------------
+  /**
+   * Lets the shard send the frontier of traversals (see \ref
+   * graph_traversal) to the other shards of manager with scatter. Without
+   * peers, the shard assumes it is the only one. The frontier is sent in
+   * the background by a thread of the shard, so that no request waits for
+   * another shard.
+   */
+  void set_peers(const graph_shard_manager& manager,
+                 const graph_traversal::scatter_function& scatter);
+
+  /**
+   * Drops the traversals without any request for secs seconds, left
+   * behind by clients which stopped before their END. They are dropped
+   * when another traversal starts.
+   */
+  void set_traversal_timeout(size_t secs) {
+    traversal_lock.lock();
+    traversal_timeout_secs = secs;
+    traversal_lock.unlock();
+  }
+
+  static const size_t DEFAULT_TRAVERSAL_TIMEOUT_SECS = 600;
 
  private:
 
   bool process(char* msg, size_t msglen, oarchive& oarc);
 
-  int process_get(QueryMessage& qm, oarchive& oarc);
+  // Applies a mutation replayed from the log.
+  void replay(const char* msg, size_t msglen);
+
+  // Writes a checkpoint and empties the log. lock must be held.
+  bool checkpoint();
+
+  // Starts a state transfer, see begin_transfer(). lock must be held.
+  size_t new_transfer(size_t rows_per_chunk);
+
+  // Writes a chunk of a transfer, see transfer_chunk(). lock must be held.
+  int cut_chunk(size_t id, size_t pos, oarchive& oarc, size_t& next, bool& last);
+
+  // Appends the length and bytes of each chunk of the transfer id to oarc,
+  // taking lock for each chunk unless locked. Returns false if the
+  // transfer went stale.
+  bool append_chunks(size_t id, oarchive& oarc, bool locked);
+
+  // Records an update into the active transfers. lock must be held.
+  void record_update(const QueryMessage::header& h, const char* msg, size_t msglen);
+
+  // Returns the codec of the current schema, built again only after
+  // invalidate_codec(). lock must be held.
+  const graph_row_codec& current_codec();
+
+  // Called when the schema may have changed. lock must be held.
+  inline void invalidate_codec() { schema_codec_valid = false; }
+
+  // Rows in the reply use codec, or graph_row::save() if it has no schema.
+  int process_get(QueryMessage& qm, oarchive& oarc, const graph_row_codec& codec);
   int process_set(QueryMessage& qm, oarchive& oarc);
   int process_add(QueryMessage& qm, oarchive& oarc);
 
   int process_admin(QueryMessage& qm, oarchive& oarc);
 
-  bool process_batch_get(QueryMessage& qm, oarchive& oarc);
+  bool process_batch_get(QueryMessage& qm, oarchive& oarc, const graph_row_codec& codec);
   bool process_batch_set(QueryMessage& qm, oarchive& oarc);
   bool process_batch_add(QueryMessage& qm, oarchive& oarc);
 
+  /**
+   * Handles a GET TRAVERSE query. It only holds lock while reading the
+   * shard, and never waits for the other shards: the vertices sent to them
+   * are queued to send_loop(), and SYNC tells when they arrived.
+   */
+  int process_traverse(QueryMessage& qm, oarchive& oarc);
+
+  /**
+   * Handles a GET AGGREGATE query. The rows are read a slice at a time,
+   * taking lock for each slice only, as SCAN does.
+   */
+  int process_aggregate(QueryMessage& qm, oarchive& oarc);
+
+  /**
+   * Adds the items of each shard to its FRONTIER, CANDIDATES or
+   * PARTIAL_DEGREES (op) of the traversal id. The ones of this shard are
+   * added directly, the others are queued to send_loop(). Returns
+   * ESRVUNREACH if there are other shards but no peers.
+   */
+  template<typename T>
+  int deliver(uint64_t id, graph_traversal::op_type op,
+              std::map<graph_shard_id_t, std::vector<T> >& items);
+
+  // Sends the requests of the outbox to the peers until stop_sender().
+  void send_loop();
+
+  // Sends what is left in the outbox and stops send_loop().
+  void stop_sender();
+
+  // Returns the master of vid, which is this shard if it has no peers.
+  inline graph_shard_id_t peer_master(graph_vid_t vid) {
+    return peer_scatter ? peer_manager.get_master(vid) : server.get_shard().id();
+  }
+
 
   void terminate() { exit(0); }
 
@@ -50,6 +228,88 @@ public:
   graphlab::graph_shard_server server;
   bool is_master;
   size_t counter;
+
+  // serializes the requests, and the appends to the log in the same order
+  mutex lock;
+  graph_wal wal;
+  std::string checkpoint_path;
+  size_t checkpoint_bytes;
+  // the log size which triggers the next checkpoint
+  size_t next_checkpoint_bytes;
+
+  // the codec of the schema of server, see current_codec()
+  graph_row_codec schema_codec;
+  bool schema_codec_valid;
+
+  struct transfer_state {
+    // rows in the shard at the start of the transfer
+    size_t num_vertices;
+    size_t num_edges;
+    size_t rows_per_chunk;
+    // updates applied since the start, and their bytes
+    std::vector<std::string> tail;
+    size_t tail_bytes;
+    bool stale;
+  };
+  std::map<size_t, transfer_state> transfers;
+  size_t next_transfer_id;
+  size_t max_tail_bytes;
+
+  // on a standby, the transfer being applied and its next position
+  size_t applied_transfer_id;
+  size_t applied_position;
+
+  struct traversal_state {
+    graph_traversal_spec spec;
+    // number of hops expanded so far
+    size_t hop;
+    // the vertices mastered here which were reached, and their hop
+    boost::unordered_map<graph_vid_t, size_t> visited;
+    // vertices reached in the last hop, to visit
+    std::vector<graph_vid_t> candidates;
+    // vertices whose local edges are followed in the next hop
+    std::vector<graph_vid_t> frontier;
+    // the degrees of the vertices mastered here, over the edges counted so far
+    boost::unordered_map<graph_vid_t, uint64_t> degrees;
+    // requests to the peers not answered yet, and the first error replied
+    size_t pending;
+    int peer_error;
+    // when the last request on the traversal arrived
+    time_t last_used;
+    traversal_state() : hop(0), pending(0), peer_error(0), last_used(0) { }
+  };
+
+  // Returns the traversal id, and marks it used, or NULL if there is none.
+  // traversal_lock must be held.
+  traversal_state* find_traversal(uint64_t id);
+
+  // Adds vids to the FRONTIER or CANDIDATES (op) of state.
+  static void receive(traversal_state* state, graph_traversal::op_type op,
+                      std::vector<graph_vid_t>& vids);
+
+  // Adds the PARTIAL_DEGREES of the vertices mastered here to state.
+  static void receive(traversal_state* state, graph_traversal::op_type op,
+                      std::vector<std::pair<graph_vid_t, uint64_t> >& degrees);
+
+  // guards traversals, never held together with lock
+  mutex traversal_lock;
+  std::map<uint64_t, traversal_state> traversals;
+  size_t traversal_timeout_secs;
+  graph_shard_manager peer_manager;
+  graph_traversal::scatter_function peer_scatter;
+
+  // a request of the traversal id to a peer
+  struct peer_request {
+    uint64_t id;
+    graph_shard_id_t shard;
+    std::string msg;
+  };
+  // the requests queued by deliver(), guarded by outbox_lock
+  std::vector<peer_request> outbox;
+  bool stopping;
+  mutex outbox_lock;
+  conditional outbox_cond;
+  thread_group sender;
 };
 } // end of namespace
 #endif
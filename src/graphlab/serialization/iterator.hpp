@@ -25,6 +25,7 @@
 #define GRAPHLAB_SERIALIZE_ITERATOR_HPP
 
 #include <iterator>
+#include <utility>
 #include <graphlab/serialization/oarchive.hpp>
 #include <graphlab/serialization/iarchive.hpp>
 
@@ -130,7 +131,11 @@ namespace graphlab {
        */
       T v;
       iarc >> v;
+#if defined(__cplusplus) && __cplusplus >= 201103L
+      (*result) = std::move(v);
+#else
       (*result) = v;
+#endif
       result++;
     }
   }
@@ -76,14 +76,30 @@ namespace graphlab {
       }
     };
 
+    /**
+     * Reads the length of a vector of non-POD elements. It is written
+     * twice, by vector_serialize_impl and again by serialize_iterator,
+     * and both must agree. The archive is left at the first element.
+     */
+    template <typename InArcType>
+    size_t deserialize_vector_length(InArcType& iarc) {
+      size_t len = 0, length = 0;
+      iarc >> len >> length;
+      ASSERT_EQ(len, length);
+      return length;
+    }
+
     /// If contained type is not a POD use the standard deserializer
     template <typename InArcType, typename ValueType>
     struct vector_deserialize_impl<InArcType, ValueType, false > {
       static void exec(InArcType& iarc, std::vector<ValueType>& vec){
-        size_t len;
-        iarc >> len;
-        vec.clear(); vec.reserve(len);
-        deserialize_iterator<InArcType, ValueType>(iarc, std::inserter(vec, vec.end()));
+        // Elements are loaded in place instead of through a temporary,
+        // which would copy every element (and its heap data) once more.
+        size_t length = deserialize_vector_length(iarc);
+        vec.clear(); vec.resize(length);
+        for (size_t i = 0; i < length; ++i) {
+          iarc >> vec[i];
+        }
       }
     };
 
@@ -36,6 +36,7 @@ namespace graphlab {
       */
      static bool compare_graph_field(const graph_field& lhs, const graph_field& rhs) {
        if ((lhs.name == rhs.name) && (lhs.is_indexed == rhs.is_indexed) 
+           && (lhs.is_ordered == rhs.is_ordered)
            && (lhs.type == rhs.type) && (lhs.max_data_length == rhs.max_data_length)) {
          return true;
        } else {
@@ -91,12 +92,18 @@ namespace graphlab {
                    && (lhs.num_edges() == rhs.num_edges())));
        for (size_t i = 0; i < lhs.num_vertices(); i++) {
          eq &= (lhs.vertex(i) == rhs.vertex(i));
-         eq &= (compare_row(*lhs.vertex_data(i), *rhs.vertex_data(i)));
+         graph_row lrow, rrow;
+         lhs.vertex_data(i).copy_to(lrow);
+         rhs.vertex_data(i).copy_to(rrow);
+         eq &= (compare_row(lrow, rrow));
        }
        for (size_t i = 0; i < lhs.num_edges(); i++) {
 
          eq &= ((lhs.edge(i).first == rhs.edge(i).first) && (lhs.edge(i).second == rhs.edge(i).second));
-         eq &= (compare_row(*lhs.edge_data(i), *rhs.edge_data(i)));
+         graph_row lrow, rrow;
+         lhs.edge_data(i).copy_to(lrow);
+         rhs.edge_data(i).copy_to(rrow);
+         eq &= (compare_row(lrow, rrow));
        }
        return eq;
      }
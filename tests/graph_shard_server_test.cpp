@@ -1,6 +1,18 @@
 #include <graphlab/database/server/graph_shard_server.hpp>
+#include <graphlab/database/server/graph_wal.hpp>
+#include <graphlab/database/graph_row_codec.hpp>
+#include <graphlab/database/graph_row_view.hpp>
+#include <graphlab/database/query_message.hpp>
 #include <graphlab/database/errno.hpp>
 #include "graph_database_test_util.hpp"
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <limits>
 using namespace std;
 typedef graphlab::graph_database_test_util testutil;
 /**
@@ -49,22 +61,22 @@ void testFieldAPI() {
 
   graphlab::graph_shard& shard = server.get_shard();
     for (size_t j = 0; j < shard.num_vertices(); j++) {
-      graphlab::graph_row& row = *shard.vertex_data(j);
+      graphlab::graph_row_ref row = shard.vertex_data(j);
       ASSERT_TRUE(row.is_null());
       ASSERT_TRUE(row.is_vertex());
       ASSERT_EQ(row.num_fields(), vertexfields.size());
       for (size_t k = 0; k < row.num_fields(); k++) {
-        ASSERT_EQ(row.get_field(k)->type(), vertexfields[k].type);
+        ASSERT_EQ(row.field_type(k), vertexfields[k].type);
       }
     }
 
     for (size_t j = 0; j < shard.num_edges(); j++) {
-      graphlab::graph_row& row = *shard.edge_data(j);
+      graphlab::graph_row_ref row = shard.edge_data(j);
       ASSERT_TRUE(row.is_null());
       ASSERT_TRUE(!row.is_vertex());
       ASSERT_EQ(row.num_fields(), edgefields.size());
       for (size_t k = 0; k < row.num_fields(); k++) {
-        ASSERT_EQ(row.get_field(k)->type(), edgefields[k].type);
+        ASSERT_EQ(row.field_type(k), edgefields[k].type);
       }
     }
   delete &server;
@@ -191,10 +203,1624 @@ void testEdgeAPI() {
   // }
 }
 
+/**
+ * Test the dense and the hashed modes of the vertex index, and
+ * serializing both.
+ */
+void testVertexIndex() {
+  cout << "Test vertex index." << endl;
+  size_t nverts = 100000;
+  // Contiguous vids inserted in descending order stay dense.
+  graphlab::graph_vertex_index dense_index;
+  for (size_t i = 0; i < nverts; ++i) {
+    ASSERT_TRUE(dense_index.add_vertex(1000 + nverts - i, i));
+  }
+  ASSERT_TRUE(dense_index.is_dense());
+  ASSERT_FALSE(dense_index.add_vertex(1000 + nverts, 0));
+  // Sparse vids switch to the hash table.
+  graphlab::graph_vertex_index sparse_index;
+  for (size_t i = 0; i < nverts; ++i) {
+    ASSERT_TRUE(sparse_index.add_vertex(i * 16 + 3, i));
+  }
+  ASSERT_FALSE(sparse_index.is_dense());
+  ASSERT_FALSE(sparse_index.add_vertex(3, 0));
+
+  for (size_t i = 0; i < nverts; ++i) {
+    ASSERT_EQ(dense_index.find(1000 + nverts - i), i);
+    ASSERT_EQ(sparse_index.find(i * 16 + 3), i);
+    ASSERT_EQ(sparse_index.find(i * 16 + 4), size_t(graphlab::graph_vertex_index::npos));
+  }
+  ASSERT_EQ(dense_index.find(1000), size_t(graphlab::graph_vertex_index::npos));
+  ASSERT_EQ(dense_index.find(0), size_t(graphlab::graph_vertex_index::npos));
+  ASSERT_EQ(dense_index.size(), nverts);
+  ASSERT_EQ(sparse_index.size(), nverts);
+
+  // Serialize and reload both modes.
+  graphlab::oarchive oarc;
+  oarc << dense_index << sparse_index;
+  graphlab::graph_vertex_index dense_copy, sparse_copy;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  iarc >> dense_copy >> sparse_copy;
+  ASSERT_TRUE(dense_copy.is_dense());
+  ASSERT_FALSE(sparse_copy.is_dense());
+  for (size_t i = 0; i < nverts; ++i) {
+    ASSERT_EQ(dense_copy.find(1000 + nverts - i), i);
+    ASSERT_EQ(sparse_copy.find(i * 16 + 3), i);
+  }
+  free(oarc.buf);
+}
+
+/**
+ * Test reading and writing values through the columnar shard storage,
+ * and serializing the shard.
+ */
+void testColumnStorage() {
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("pagerank", graphlab::DOUBLE_TYPE));
+  vertexfields.push_back(graphlab::graph_field("url", graphlab::STRING_TYPE));
+  edgefields.push_back(graphlab::graph_field("weight", graphlab::INT_TYPE));
+
+  size_t nverts = 1000;
+  size_t nedges = 5000;
+  cout << "Test column storage. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server = 
+      *(testutil::createShardServer(nverts, nedges, 0, vertexfields, edgefields));
+
+  // Set pagerank field to 1/vid and url field to "http://$vid" on even vertices.
+  for (size_t i = 0; i < nverts; i += 2) {
+    graphlab::graph_row data(vertexfields, true);
+    data.get_field(0)->set_double(1.0 / (i+1));
+    data.get_field(1)->set_string("http://" + boost::lexical_cast<string>(i));
+    ASSERT_EQ(server.set_vertex(i, data), 0);
+  }
+  for (size_t i = 0; i < nedges; ++i) {
+    graphlab::graph_row data(edgefields, false);
+    data.get_field(0)->set_integer(i);
+    ASSERT_EQ(server.set_edge(graphlab::make_eid(0, i), data), 0);
+  }
+  // Type mismatches are rejected.
+  graphlab::graph_row baddata(edgefields, true);
+  ASSERT_EQ(server.set_vertex(0, baddata), EINVID);
+  ASSERT_EQ(server.add_vertex(nverts, baddata), EINVTYPE);
+
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_row out;
+    ASSERT_EQ(server.get_vertex(i, out), 0);
+    ASSERT_EQ(out.num_fields(), vertexfields.size());
+    if (i % 2 == 0) {
+      double pr; string url;
+      ASSERT_TRUE(out.get_field(0)->get_double(&pr));
+      ASSERT_TRUE(out.get_field(1)->get_string(&url));
+      ASSERT_EQ(pr, 1.0 / (i+1));
+      ASSERT_EQ(url, "http://" + boost::lexical_cast<string>(i));
+    } else {
+      ASSERT_TRUE(out.is_null());
+    }
+  }
+  for (size_t i = 0; i < nedges; ++i) {
+    graphlab::graph_row out;
+    graphlab::graph_int_t weight;
+    ASSERT_EQ(server.get_edge(graphlab::make_eid(0, i), out), 0);
+    ASSERT_TRUE(out.get_field(0)->get_integer(&weight));
+    ASSERT_EQ(weight, (graphlab::graph_int_t)i);
+  }
+
+  // Column scan over the pagerank field.
+  graphlab::graph_shard& shard = server.get_shard();
+  const graphlab::graph_column& prcol = shard.vertex_column(0);
+  double total = 0;
+  for (size_t i = 0; i < prcol.size(); ++i) {
+    if (!prcol.is_null(i)) total += prcol.scalar_data()[i].double_value;
+  }
+  ASSERT_GT(total, 0);
+
+  // Serialize and reload the shard.
+  graphlab::oarchive oarc;
+  oarc << shard;
+  graphlab::graph_shard copy;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  iarc >> copy;
+  ASSERT_TRUE(testutil::compare_shard(shard, copy));
+  free(oarc.buf);
+  delete &server;
+}
+
+/**
+ * Test resetting a field of every vertex and edge, a column at a time.
+ */
+void testResetField() {
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("pagerank", graphlab::DOUBLE_TYPE));
+  vertexfields.push_back(graphlab::graph_field("url", graphlab::STRING_TYPE));
+  vertexfields[1].is_indexed = true;
+  edgefields.push_back(graphlab::graph_field("weight", graphlab::INT_TYPE));
+
+  size_t nverts = 100;
+  size_t nedges = 500;
+  cout << "Test reset field. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server = 
+      *(testutil::createShardServer(nverts, nedges, 0, vertexfields, edgefields));
+  for (size_t i = 0; i < nverts; i += 2) {
+    graphlab::graph_row data(vertexfields, true);
+    data.get_field(0)->set_double(i);
+    data.get_field(1)->set_string("http://" + boost::lexical_cast<string>(i));
+    ASSERT_EQ(server.set_vertex(i, data), 0);
+  }
+
+  ASSERT_EQ(server.reset_vertex_field(1, "home"), 0);
+  ASSERT_EQ(server.reset_edge_field(0, "7"), 0);
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_row out;
+    ASSERT_EQ(server.get_vertex(i, out), 0);
+    string url;
+    ASSERT_TRUE(out.get_field(1)->get_string(&url));
+    ASSERT_EQ(url, "home");
+    // the other fields are untouched
+    ASSERT_EQ(out.get_field(0)->is_null(), i % 2 == 1);
+  }
+  for (size_t i = 0; i < nedges; ++i) {
+    graphlab::graph_row out;
+    graphlab::graph_int_t weight;
+    ASSERT_EQ(server.get_edge(graphlab::make_eid(0, i), out), 0);
+    ASSERT_TRUE(out.get_field(0)->get_integer(&weight));
+    ASSERT_EQ(weight, (graphlab::graph_int_t)7);
+  }
+  // the index of the field follows the new values
+  graphlab::graph_value home(graphlab::STRING_TYPE);
+  home.set_string("home");
+  vector<graphlab::graph_vid_t> vids;
+  ASSERT_EQ(server.find_vertices(1, home, vids), 0);
+  ASSERT_EQ(vids.size(), nverts);
+
+  ASSERT_EQ(server.reset_vertex_field(2, "1"), EINVID);
+  ASSERT_EQ(server.reset_edge_field(0, "seven"), EINVTYPE);
+  delete &server;
+}
+
+/**
+ * Test the adjacency lookup before and after freezing the edge index.
+ */
+void testPayloadArena() {
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("text", graphlab::STRING_TYPE));
+
+  size_t nverts = 200;
+  cout << "Test payload arena. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server = 
+      *(testutil::createShardServer(nverts, 0, 0, vertexfields, edgefields));
+  graphlab::graph_shard& shard = server.get_shard();
+
+  // Odd vertices get short (inline) strings, even vertices long ones.
+  // Overwrite the long strings enough times to trigger a compaction.
+  for (size_t round = 0; round < 10; ++round) {
+    for (size_t i = 0; i < nverts; ++i) {
+      graphlab::graph_row data(vertexfields, true);
+      string val = boost::lexical_cast<string>(i) + "/" + boost::lexical_cast<string>(round);
+      if (i % 2 == 0) val += string(4096, 'x');
+      data.get_field(0)->set_string(val);
+      ASSERT_EQ(server.set_vertex(i, data), 0);
+    }
+  }
+  ASSERT_FALSE(shard.needs_compaction());
+
+  for (size_t i = 0; i < nverts; ++i) {
+    string expected = boost::lexical_cast<string>(i) + "/9";
+    if (i % 2 == 0) expected += string(4096, 'x');
+    graphlab::graph_row out, ref;
+    string val;
+    ASSERT_EQ(server.get_vertex(i, out), 0);
+    ASSERT_TRUE(out.get_field(0)->get_string(&val));
+    ASSERT_EQ(val, expected);
+    ASSERT_TRUE(out.get_field(0)->owns_data());
+    // borrowed values point into the shard
+    ASSERT_EQ(server.get_vertex_ref(i, ref), 0);
+    ASSERT_FALSE(ref.get_field(0)->owns_data());
+    ASSERT_TRUE(ref.get_field(0)->get_string(&val));
+    ASSERT_EQ(val, expected);
+    // modifying a borrowed value copies it first
+    ref.get_field(0)->set_string("changed");
+    ASSERT_TRUE(ref.get_field(0)->owns_data());
+    ASSERT_EQ(server.get_vertex(i, out), 0);
+    ASSERT_TRUE(out.get_field(0)->get_string(&val));
+    ASSERT_EQ(val, expected);
+  }
+
+  // NULL values release their payloads.
+  graphlab::graph_row nulldata(vertexfields, true);
+  ASSERT_EQ(server.set_vertex(0, nulldata), 0);
+  graphlab::graph_row out;
+  ASSERT_EQ(server.get_vertex(0, out), 0);
+  ASSERT_TRUE(out.is_null());
+
+  // Serialize and reload the shard. The payloads are reloaded into a
+  // single region.
+  graphlab::oarchive oarc;
+  oarc << shard;
+  graphlab::graph_shard copy;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  iarc >> copy;
+  ASSERT_TRUE(testutil::compare_shard(shard, copy));
+  free(oarc.buf);
+  delete &server;
+}
+
+void testBatchInsert() {
+  typedef graphlab::graph_database::edge_insert_descriptor edge_insert_descriptor;
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  edgefields.push_back(graphlab::graph_field("label", graphlab::STRING_TYPE));
+  edgefields.push_back(graphlab::graph_field("weight", graphlab::DOUBLE_TYPE));
+
+  size_t nedges = 10000;
+  cout << "Test batch insert. Num edges = " << nedges << endl;
+  graphlab::graph_shard_server server(0, vertexfields, edgefields);
+
+  // Build the batch the way a BADD EDGE request carries it.
+  graphlab::oarchive oarc;
+  {
+    vector<edge_insert_descriptor> edges(nedges);
+    for (size_t i = 0; i < nedges; ++i) {
+      edges[i].src = i;
+      edges[i].dest = (i + 1) % nedges;
+      graphlab::graph_row row(edgefields, false);
+      row.get_field(0)->set_string("edge label " + boost::lexical_cast<string>(i));
+      row.get_field(1)->set_double(i * 0.5);
+      edges[i].data.swap(row);
+      ASSERT_EQ(row.num_fields(), 0);
+    }
+    oarc << edges;
+  }
+
+  vector<edge_insert_descriptor> in;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  iarc >> in;
+  ASSERT_EQ(in.size(), nedges);
+  vector<int> errorcodes;
+  ASSERT_TRUE(server.add_edges(in, errorcodes));
+  free(oarc.buf);
+
+  for (size_t i = 0; i < nedges; ++i) {
+    graphlab::graph_row out;
+    string label;
+    double weight;
+    ASSERT_EQ(server.get_edge(graphlab::make_eid(0, i), out), 0);
+    ASSERT_TRUE(out.get_field(0)->get_string(&label));
+    ASSERT_TRUE(out.get_field(1)->get_double(&weight));
+    ASSERT_EQ(label, "edge label " + boost::lexical_cast<string>(i));
+    ASSERT_EQ(weight, i * 0.5);
+  }
+
+  // Swapping values exchanges the payloads without copying them.
+  graphlab::graph_value a(graphlab::STRING_TYPE), b(graphlab::INT_TYPE);
+  a.set_string("a long string which is not inlined");
+  b.set_integer(3);
+  const void* payload = a.get_raw_pointer();
+  a.swap(b);
+  ASSERT_EQ(b.get_raw_pointer(), payload);
+  ASSERT_EQ(a.type(), graphlab::INT_TYPE);
+}
+
+void testFrozenIndex() {
+  typedef graphlab::graph_shard_server::vertex_adj_descriptor vertex_adj_descriptor;
+  size_t nverts = 1000;
+  size_t nedges = 20000;
+  cout << "Test frozen edge index. Num edges = " << nedges << endl;
+  vector<graphlab::graph_field> fields;
+  graphlab::graph_shard_server& server = 
+      *(testutil::createShardServer(nverts, nedges, 0, fields, fields));
+
+  // Expected adjacency computed from the edge list.
+  vector<vector<graphlab::graph_eid_t> > expected_in(nverts), expected_out(nverts);
+  graphlab::graph_shard& shard = server.get_shard();
+  for (size_t i = 0; i < shard.num_edges(); ++i) {
+    expected_out[shard.edge(i).first].push_back(graphlab::make_eid(0, i));
+    expected_in[shard.edge(i).second].push_back(graphlab::make_eid(0, i));
+  }
+
+  for (size_t round = 0; round < 3; ++round) {
+    if (round == 1) {
+      server.freeze_index();
+    } else if (round == 2) {
+      // edges added after the freeze go to the delta.
+      graphlab::graph_row empty_edata(fields, false);
+      for (size_t i = 0; i < nverts; ++i) {
+        size_t pos = shard.num_edges();
+        server.add_edge(i, (i + 1) % nverts, empty_edata);
+        expected_out[i].push_back(graphlab::make_eid(0, pos));
+        expected_in[(i + 1) % nverts].push_back(graphlab::make_eid(0, pos));
+      }
+    }
+    for (size_t i = 0; i < nverts; ++i) {
+      vertex_adj_descriptor in, out;
+      ASSERT_EQ(server.get_vertex_adj(i, true, in), 0);
+      ASSERT_EQ(server.get_vertex_adj(i, false, out), 0);
+      ASSERT_TRUE(in.eids == expected_in[i]);
+      ASSERT_TRUE(out.eids == expected_out[i]);
+    }
+  }
+
+  // Re-freeze merges the delta, and the index survives serialization.
+  server.freeze_index();
+  graphlab::oarchive oarc;
+  oarc << shard;
+  graphlab::graph_shard copy;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  iarc >> copy;
+  for (size_t i = 0; i < nverts; ++i) {
+    vector<graphlab::graph_leid_t> in;
+    copy.vertex_adj_ids(in, i, true);
+    ASSERT_EQ(in.size(), expected_in[i].size());
+    for (size_t j = 0; j < in.size(); ++j) {
+      ASSERT_EQ(graphlab::make_eid(0, in[j]), expected_in[i][j]);
+    }
+  }
+  free(oarc.buf);
+  delete &server;
+}
+
+
+void testFieldIndex() {
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("name", graphlab::STRING_TYPE));
+  vertexfields.push_back(graphlab::graph_field("age", graphlab::INT_TYPE));
+  vertexfields.push_back(graphlab::graph_field("score", graphlab::DOUBLE_TYPE));
+  vertexfields[0].is_indexed = true;
+  vertexfields[1].is_indexed = true;
+
+  size_t nverts = 100;
+  cout << "Test field index. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server = 
+      *(testutil::createShardServer(nverts, 0, 0, vertexfields, edgefields));
+  graphlab::graph_shard& shard = server.get_shard();
+
+  // vertex i has name "user<i>" (long for even i) and age i % 10
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_row data(vertexfields, true);
+    string name = "user" + boost::lexical_cast<string>(i);
+    if (i % 2 == 0) name += string(32, 'x');
+    data.get_field(0)->set_string(name);
+    data.get_field(1)->set_integer(i % 10);
+    data.get_field(2)->set_double(i);
+    ASSERT_EQ(server.set_vertex(i, data), 0);
+  }
+
+  graphlab::graph_value age(graphlab::INT_TYPE);
+  graphlab::graph_value name(graphlab::STRING_TYPE);
+  vector<graphlab::graph_vid_t> vids;
+  age.set_integer(3);
+  ASSERT_EQ(server.find_vertices(1, age, vids), 0);
+  ASSERT_EQ(vids.size(), nverts / 10);
+  for (size_t i = 0; i < vids.size(); ++i) {
+    ASSERT_EQ(vids[i] % 10, 3);
+  }
+  vids.clear();
+  name.set_string("user42" + string(32, 'x'));
+  ASSERT_EQ(server.find_vertices(0, name, vids), 0);
+  ASSERT_EQ(vids.size(), 1);
+  ASSERT_EQ(vids[0], (graphlab::graph_vid_t)42);
+
+  // the index follows updates and NULLs
+  graphlab::graph_row data(vertexfields, true);
+  data.get_field(0)->set_string("renamed");
+  data.get_field(1)->set_integer(3);
+  ASSERT_EQ(server.set_vertex(42, data), 0);
+  vids.clear();
+  ASSERT_EQ(server.find_vertices(0, name, vids), 0);
+  ASSERT_TRUE(vids.empty());
+  name.set_string("renamed");
+  ASSERT_EQ(server.find_vertices(0, name, vids), 0);
+  ASSERT_EQ(vids.size(), 1);
+  vids.clear();
+  ASSERT_EQ(server.find_vertices(1, age, vids), 0);
+  ASSERT_EQ(vids.size(), nverts / 10 + 1);
+  graphlab::graph_row nulldata(vertexfields, true);
+  ASSERT_EQ(server.set_vertex(43, nulldata), 0);
+  vids.clear();
+  ASSERT_EQ(server.find_vertices(1, age, vids), 0);
+  ASSERT_EQ(vids.size(), nverts / 10);
+
+  // new vertices are indexed when inserted
+  graphlab::graph_row newdata(vertexfields, true);
+  newdata.get_field(0)->set_string("newcomer");
+  ASSERT_EQ(server.add_vertex(nverts, newdata), 0);
+  vids.clear();
+  name.set_string("newcomer");
+  ASSERT_EQ(server.find_vertices(0, name, vids), 0);
+  ASSERT_EQ(vids.size(), 1);
+  ASSERT_EQ(vids[0], nverts);
+
+  // errors: unindexed field, type mismatch, invalid field
+  vids.clear();
+  graphlab::graph_value score(graphlab::DOUBLE_TYPE);
+  score.set_double(1);
+  ASSERT_EQ(server.find_vertices(2, score, vids), ENOINDEX);
+  ASSERT_EQ(server.find_vertices(1, name, vids), EINVTYPE);
+  ASSERT_EQ(server.find_vertices(3, age, vids), EINVID);
+  graphlab::graph_field badfield("weight", graphlab::DOUBLE_TYPE);
+  badfield.is_indexed = true;
+  ASSERT_EQ(server.add_vertex_field(badfield), EINVTYPE);
+
+  // a field added later is indexed over the existing vertices
+  graphlab::graph_field idfield("alias", graphlab::VID_TYPE);
+  idfield.is_indexed = true;
+  ASSERT_EQ(server.add_vertex_field(idfield), 0);
+  graphlab::graph_value alias(graphlab::VID_TYPE);
+  ASSERT_EQ(server.find_vertices(3, alias, vids), 0);
+  ASSERT_TRUE(vids.empty());
+
+  // the indexes are rebuilt when the shard is loaded
+  graphlab::oarchive oarc;
+  oarc << shard;
+  graphlab::graph_shard copy;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  iarc >> copy;
+  ASSERT_TRUE(testutil::compare_shard(shard, copy));
+  vids.clear();
+  ASSERT_TRUE(copy.find_vertices(1, age, vids));
+  ASSERT_EQ(vids.size(), nverts / 10);
+  vids.clear();
+  ASSERT_TRUE(copy.find_vertices(0, name, vids));
+  ASSERT_EQ(vids.size(), 1);
+  ASSERT_FALSE(copy.find_vertices(2, score, vids));
+  free(oarc.buf);
+  delete &server;
+}
+
+// Returns the ids of the rows with the k largest values in brute force.
+vector<size_t> brute_topk(const vector<double>& values, size_t k) {
+  vector<pair<double, size_t> > sorted;
+  for (size_t i = 0; i < values.size(); ++i) {
+    sorted.push_back(make_pair(-values[i], i));
+  }
+  std::sort(sorted.begin(), sorted.end());
+  vector<size_t> ret;
+  for (size_t i = 0; i < k && i < sorted.size(); ++i) {
+    ret.push_back(sorted[i].second);
+  }
+  return ret;
+}
+
+void testOrderedIndex() {
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("pagerank", graphlab::DOUBLE_TYPE));
+  vertexfields[0].is_ordered = true;
+  edgefields.push_back(graphlab::graph_field("weight", graphlab::INT_TYPE));
+  edgefields[0].is_ordered = true;
+
+  size_t nverts = 5000;
+  size_t nedges = 5000;
+  cout << "Test ordered index. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server = 
+      *(testutil::createShardServer(nverts, nedges, 0, vertexfields, edgefields));
+  graphlab::graph_shard& shard = server.get_shard();
+
+  // Several rounds of updates go through the delta and the merges of
+  // the sorted run. Negative values check the order of the encoding.
+  vector<double> ranks(nverts);
+  for (size_t round = 0; round < 3; ++round) {
+    for (size_t i = 0; i < nverts; ++i) {
+      ranks[i] = (double)((i * 7919 + round * 104729) % 10007) - 5000.5;
+      graphlab::graph_row data(vertexfields, true);
+      data.get_field(0)->set_double(ranks[i]);
+      ASSERT_EQ(server.set_vertex(i, data), 0);
+    }
+  }
+  for (size_t i = 0; i < nedges; ++i) {
+    graphlab::graph_row data(edgefields, false);
+    data.get_field(0)->set_integer((graphlab::graph_int_t)(i % 100) - 50);
+    ASSERT_EQ(server.set_edge(graphlab::make_eid(0, i), data), 0);
+  }
+
+  vector<graphlab::graph_database::id_value_pair> out;
+  size_t k = 100;
+  ASSERT_EQ(server.topk(true, 0, k, true, out), 0);
+  vector<size_t> expected = brute_topk(ranks, k);
+  ASSERT_EQ(out.size(), k);
+  for (size_t i = 0; i < k; ++i) {
+    graphlab::graph_double_t val;
+    ASSERT_EQ(out[i].first, expected[i]);
+    ASSERT_TRUE(out[i].second.get_double(&val));
+    ASSERT_EQ(val, ranks[expected[i]]);
+  }
+
+  // NULL values are not ranked
+  graphlab::graph_row nulldata(vertexfields, true);
+  ASSERT_EQ(server.set_vertex(expected[0], nulldata), 0);
+  out.clear();
+  ASSERT_EQ(server.topk(true, 0, 1, true, out), 0);
+  ASSERT_EQ(out[0].first, expected[1]);
+  out.clear();
+  ASSERT_EQ(server.topk(true, 0, 1, false, out), 0);
+  graphlab::graph_double_t smallest;
+  ASSERT_TRUE(out[0].second.get_double(&smallest));
+  ASSERT_EQ(smallest, -5000.5);
+
+  // edges with weight in [-2, 2], and with weight at least 45
+  graphlab::graph_value lo(graphlab::INT_TYPE), hi(graphlab::INT_TYPE);
+  lo.set_integer(-2);
+  hi.set_integer(2);
+  out.clear();
+  ASSERT_EQ(server.range(false, 0, lo, hi, out), 0);
+  ASSERT_EQ(out.size(), nedges / 100 * 5);
+  graphlab::graph_int_t prev = -2;
+  for (size_t i = 0; i < out.size(); ++i) {
+    graphlab::graph_int_t w;
+    ASSERT_TRUE(out[i].second.get_integer(&w));
+    ASSERT_LE(prev, w);
+    ASSERT_LE(w, 2);
+    ASSERT_EQ(graphlab::split_eid(out[i].first).second % 100, (size_t)(w + 50));
+    prev = w;
+  }
+  lo.set_integer(45);
+  out.clear();
+  ASSERT_EQ(server.range(false, 0, lo, graphlab::graph_value(graphlab::INT_TYPE), out), 0);
+  ASSERT_EQ(out.size(), nedges / 100 * 5);
+
+  // errors: wrong bound type, unordered field, invalid field
+  graphlab::graph_value dbl(graphlab::DOUBLE_TYPE);
+  ASSERT_EQ(server.range(false, 0, dbl, hi, out), EINVTYPE);
+  ASSERT_EQ(server.topk(false, 1, 1, true, out), EINVID);
+  graphlab::graph_field strfield("name", graphlab::STRING_TYPE);
+  strfield.is_ordered = true;
+  ASSERT_EQ(server.add_vertex_field(strfield), EINVTYPE);
+  graphlab::graph_field plain("age", graphlab::INT_TYPE);
+  ASSERT_EQ(server.add_vertex_field(plain), 0);
+  ASSERT_EQ(server.topk(true, 1, 1, true, out), ENOINDEX);
+
+  // the ordered indexes are rebuilt when the shard is loaded
+  graphlab::oarchive oarc;
+  oarc << shard;
+  graphlab::graph_shard copy;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  iarc >> copy;
+  ASSERT_TRUE(testutil::compare_shard(shard, copy));
+  vector<size_t> positions;
+  ASSERT_TRUE(copy.vertex_column(0).topk(2, true, positions));
+  ASSERT_EQ(positions.size(), 2);
+  ASSERT_EQ(copy.vertex(positions[0]), expected[1]);
+  ASSERT_EQ(copy.vertex(positions[1]), expected[2]);
+  free(oarc.buf);
+  delete &server;
+}
+
+// The sections of a shard image with one STRING vertex field and one INT
+// edge field, which may disagree with each other.
+struct image_parts {
+  vector<graphlab::graph_vid_t> vids;
+  // the vertex columns save their long payloads from region_base on
+  vector<graphlab::graph_column> vertex_columns;
+  size_t region_base;
+  vector<pair<graphlab::graph_vid_t, graphlab::graph_vid_t> > edges;
+  // the edge column, written by hand to control its null flags
+  vector<graphlab::graph_int_t> weights;
+  graphlab::dense_bitset weight_nulls;
+  graphlab::graph_vertex_index vertex_index;
+  graphlab::graph_edge_index edge_index;
+  // if not empty, the arrays of both halves of the edge index instead
+  vector<graphlab::graph_vid_t> index_vids;
+  vector<graphlab::graph_leid_t> index_offsets, index_leids;
+};
+
+// Writes parts as graph_shard_server::save_image() lays out a shard image.
+void write_image(const string& path, const image_parts& parts) {
+  vector<graphlab::graph_field> vertexfields(1, graphlab::graph_field("name", graphlab::STRING_TYPE));
+  vector<graphlab::graph_field> edgefields(1, graphlab::graph_field("weight", graphlab::INT_TYPE));
+  graphlab::graph_image_writer writer;
+  ASSERT_TRUE(writer.open(path));
+  writer.write((graphlab::graph_shard_id_t)0);
+  writer.write_archived(vertexfields);
+  writer.write_archived(edgefields);
+  writer.write((graphlab::graph_shard_id_t)0);
+  writer.write_vector(parts.vids);
+  size_t region_offset = parts.region_base;
+  writer.write<uint64_t>(parts.vertex_columns.size());
+  for (size_t i = 0; i < parts.vertex_columns.size(); ++i) {
+    parts.vertex_columns[i].save_image(writer, region_offset);
+  }
+  writer.write_vector(vector<graphlab::graph_eid_t>());
+  writer.write_vector(parts.edges);
+  writer.write<uint64_t>(1);
+  writer.write<int32_t>(graphlab::INT_TYPE);
+  writer.write<uint8_t>(0);
+  writer.write<uint8_t>(0);
+  writer.write<uint64_t>(parts.weights.size());
+  writer.write_archived(parts.weight_nulls);
+  writer.write_vector(parts.weights);
+  writer.write<uint64_t>(region_offset - parts.region_base);
+  for (size_t i = 0; i < parts.vertex_columns.size(); ++i) {
+    parts.vertex_columns[i].save_payloads(writer);
+  }
+  writer.align();
+  parts.vertex_index.save_image(writer);
+  if (parts.index_vids.empty()) {
+    parts.edge_index.save_image(writer);
+  } else {
+    for (size_t i = 0; i < 2; ++i) {
+      writer.write_vector(parts.index_vids);
+      writer.write_vector(parts.index_offsets);
+      writer.write_vector(parts.index_leids);
+    }
+  }
+  writer.write_vector(vector<uint64_t>(parts.vids.size() + 1, 0));
+  writer.write_vector(vector<graphlab::graph_shard_id_t>());
+  ASSERT_TRUE(writer.close());
+}
+
+// Returns the error of loading parts, checking that a failed load leaves
+// the server empty.
+int load_parts(const string& path, const image_parts& parts) {
+  write_image(path, parts);
+  graphlab::graph_shard_server server(0);
+  int errorcode = server.load_image(path);
+  if (errorcode != 0) {
+    ASSERT_EQ(server.num_vertices(), (uint64_t)0);
+    ASSERT_EQ(server.num_edges(), (uint64_t)0);
+  }
+  return errorcode;
+}
+
+/**
+ * Test the shard image: a restarted server maps the image and serves
+ * the same content as the serialized shard.
+ */
+void testShardImage() {
+  typedef graphlab::graph_shard_server::vertex_adj_descriptor vertex_adj_descriptor;
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("name", graphlab::STRING_TYPE));
+  vertexfields.push_back(graphlab::graph_field("age", graphlab::INT_TYPE));
+  vertexfields.push_back(graphlab::graph_field("pagerank", graphlab::DOUBLE_TYPE));
+  vertexfields[0].is_indexed = true;
+  vertexfields[1].is_indexed = true;
+  vertexfields[2].is_ordered = true;
+  edgefields.push_back(graphlab::graph_field("weight", graphlab::INT_TYPE));
+
+  size_t nverts = 1000;
+  size_t nedges = 5000;
+  cout << "Test shard image. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server = 
+      *(testutil::createShardServer(nverts, nedges, 0, vertexfields, edgefields));
+  graphlab::graph_shard& shard = server.get_shard();
+
+  // long names on even vertices, NULL rows on every 7th vertex
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_row data(vertexfields, true);
+    if (i % 7 != 0) {
+      string name = "user" + boost::lexical_cast<string>(i);
+      if (i % 2 == 0) name += string(32, 'x');
+      data.get_field(0)->set_string(name);
+      data.get_field(1)->set_integer(i % 10);
+      data.get_field(2)->set_double(1.0 / (i + 1));
+    }
+    ASSERT_EQ(server.set_vertex(i, data), 0);
+  }
+  for (size_t i = 0; i < nedges; ++i) {
+    graphlab::graph_row data(edgefields, false);
+    data.get_field(0)->set_integer(i);
+    ASSERT_EQ(server.set_edge(graphlab::make_eid(0, i), data), 0);
+  }
+  for (size_t i = 0; i < nverts; i += 3) {
+    vector<graphlab::graph_shard_id_t> mirrors;
+    mirrors.push_back(1 + i % 4);
+    mirrors.push_back(5);
+    ASSERT_EQ(server.add_vertex_mirror(i, mirrors), 0);
+  }
+  // part of the edges are frozen, the others in the delta
+  server.freeze_index();
+  graphlab::graph_row empty_edata(edgefields, false);
+  for (size_t i = 0; i < nverts; i += 5) {
+    server.add_edge(i, (i + 1) % nverts, empty_edata);
+  }
+
+  const string path = "/tmp/graph_shard_server_test.img";
+  ASSERT_EQ(server.save_image(path), 0);
+  graphlab::graph_shard_server loaded(0);
+  ASSERT_EQ(loaded.load_image(path), 0);
+  graphlab::graph_shard& image = loaded.get_shard();
+  // saving again replaces the file, and leaves the mapped one intact
+  ASSERT_EQ(server.save_image(path), 0);
+  ASSERT_FALSE(ifstream((path + ".tmp").c_str()).good());
+
+  // same content as the serialized shard
+  graphlab::oarchive oarc;
+  oarc << shard;
+  graphlab::graph_shard copy;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  iarc >> copy;
+  ASSERT_TRUE(testutil::compare_shard(copy, image));
+  ASSERT_EQ(loaded.get_vertex_fields().size(), vertexfields.size());
+  for (size_t i = 0; i < vertexfields.size(); ++i) {
+    ASSERT_TRUE(testutil::compare_graph_field(loaded.get_vertex_fields()[i], vertexfields[i]));
+  }
+  for (size_t i = 0; i < nverts; ++i) {
+    vertex_adj_descriptor in, out, imagein, imageout;
+    ASSERT_EQ(server.get_vertex_adj(i, true, in), 0);
+    ASSERT_EQ(server.get_vertex_adj(i, false, out), 0);
+    ASSERT_EQ(loaded.get_vertex_adj(i, true, imagein), 0);
+    ASSERT_EQ(loaded.get_vertex_adj(i, false, imageout), 0);
+    ASSERT_TRUE(in.eids == imagein.eids);
+    ASSERT_TRUE(out.eids == imageout.eids);
+    vector<graphlab::graph_shard_id_t> mirrors = shard.mirrors(i);
+    vector<graphlab::graph_shard_id_t> imagemirrors = image.mirrors(i);
+    sort(mirrors.begin(), mirrors.end());
+    sort(imagemirrors.begin(), imagemirrors.end());
+    ASSERT_TRUE(mirrors == imagemirrors);
+  }
+
+  // the field indexes are rebuilt
+  graphlab::graph_value name(graphlab::STRING_TYPE);
+  name.set_string("user44" + string(32, 'x'));
+  vector<graphlab::graph_vid_t> vids;
+  ASSERT_EQ(loaded.find_vertices(0, name, vids), 0);
+  ASSERT_EQ(vids.size(), 1);
+  ASSERT_EQ(vids[0], (graphlab::graph_vid_t)44);
+  vector<graphlab::graph_database::id_value_pair> top;
+  ASSERT_EQ(loaded.topk(true, 2, 1, true, top), 0);
+  ASSERT_EQ(top[0].first, (uint64_t)1);
+
+  // modifications of the mapped shard go to owned memory
+  graphlab::graph_row data(vertexfields, true);
+  data.get_field(0)->set_string("renamed" + string(32, 'y'));
+  ASSERT_EQ(loaded.set_vertex(44, data), 0);
+  ASSERT_EQ(server.set_vertex(44, data), 0);
+  for (size_t i = 0; i < nverts; i += 5) {
+    loaded.add_edge(i, (i + 2) % nverts, empty_edata);
+    server.add_edge(i, (i + 2) % nverts, empty_edata);
+  }
+  loaded.freeze_index();
+  loaded.compact_payloads();
+  ASSERT_TRUE(testutil::compare_shard(shard, image));
+  for (size_t i = 0; i < nverts; ++i) {
+    vertex_adj_descriptor in, imagein;
+    ASSERT_EQ(server.get_vertex_adj(i, true, in), 0);
+    ASSERT_EQ(loaded.get_vertex_adj(i, true, imagein), 0);
+    ASSERT_TRUE(in.eids == imagein.eids);
+  }
+
+  // images of another shard or with a bad header are rejected
+  graphlab::graph_shard_server other(1);
+  ASSERT_EQ(other.load_image(path), EINVID);
+
+  // truncated images fail to load and leave the server empty, at any length
+  // short of the padding of the last section
+  string bytes;
+  {
+    ifstream in(path.c_str(), ios::binary);
+    bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  }
+  ASSERT_GT(bytes.size(), (size_t)8);
+  const string partpath = path + ".part";
+  vector<size_t> lengths;
+  for (size_t len = 0; len + 8 < bytes.size(); len += bytes.size() / 64 + 1) {
+    lengths.push_back(len);
+  }
+  lengths.push_back(bytes.size() - 8);
+  for (size_t i = 0; i < lengths.size(); ++i) {
+    {
+      ofstream out(partpath.c_str(), ios::binary | ios::trunc);
+      out.write(bytes.data(), lengths[i]);
+    }
+    graphlab::graph_shard_server truncated(0);
+    int expected = (lengths[i] == 0) ? EIO : EINVHEAD;
+    ASSERT_EQ(truncated.load_image(partpath), expected);
+    ASSERT_EQ(truncated.num_vertices(), (uint64_t)0);
+    ASSERT_EQ(truncated.num_edges(), (uint64_t)0);
+  }
+
+  // so do images whose sections disagree, before anything reads through
+  // them: two vertices, the second with a long name, and one edge
+  graphlab::graph_payload_arena arena;
+  image_parts parts;
+  parts.vids.push_back(1);
+  parts.vids.push_back(2);
+  parts.vertex_columns.push_back(graphlab::graph_column(graphlab::STRING_TYPE, 2, &arena));
+  graphlab::graph_value vname(graphlab::STRING_TYPE);
+  vname.set_string(string(32, 'n'));
+  parts.vertex_columns[0].set(1, vname);
+  parts.region_base = 0;
+  parts.edges.push_back(make_pair(1, 2));
+  parts.weights.push_back(7);
+  parts.weight_nulls.resize(1);
+  parts.weight_nulls.clear();
+  parts.vertex_index.add_vertex(1, 0);
+  parts.vertex_index.add_vertex(2, 1);
+  parts.edge_index.add_edge(1, 2, 0);
+  ASSERT_EQ(load_parts(partpath, parts), 0);
+  // a column with more values than vertices
+  image_parts bad = parts;
+  bad.vertex_columns[0].push_back_null();
+  ASSERT_EQ(load_parts(partpath, bad), EINVHEAD);
+  // an edge column with fewer null flags than values
+  bad = parts;
+  bad.weight_nulls = graphlab::dense_bitset();
+  ASSERT_EQ(load_parts(partpath, bad), EINVHEAD);
+  // a long payload past the end of the region
+  bad = parts;
+  bad.region_base = 8;
+  ASSERT_EQ(load_parts(partpath, bad), EINVHEAD);
+  // a vertex index pointing past the vertices, or to the wrong vertex
+  bad = parts;
+  bad.vertex_index.clear();
+  bad.vertex_index.add_vertex(1, 0);
+  bad.vertex_index.add_vertex(2, 2);
+  ASSERT_EQ(load_parts(partpath, bad), EINVHEAD);
+  bad.vertex_index.clear();
+  bad.vertex_index.add_vertex(1, 1);
+  bad.vertex_index.add_vertex(2, 0);
+  ASSERT_EQ(load_parts(partpath, bad), EINVHEAD);
+  // an edge index with an edge past the edges
+  bad = parts;
+  bad.edge_index.add_edge(2, 1, 1);
+  ASSERT_EQ(load_parts(partpath, bad), EINVHEAD);
+  // an edge index whose vids are not ascending
+  bad = parts;
+  bad.edges.push_back(make_pair(2, 1));
+  bad.weights.push_back(8);
+  bad.index_vids.push_back(1);
+  bad.index_vids.push_back(2);
+  bad.index_offsets.push_back(0);
+  bad.index_offsets.push_back(1);
+  bad.index_offsets.push_back(2);
+  bad.index_leids.push_back(0);
+  bad.index_leids.push_back(1);
+  ASSERT_EQ(load_parts(partpath, bad), 0);
+  swap(bad.index_vids[0], bad.index_vids[1]);
+  ASSERT_EQ(load_parts(partpath, bad), EINVHEAD);
+  bad.index_vids[0] = 1;
+  ASSERT_EQ(load_parts(partpath, bad), EINVHEAD);
+  remove(partpath.c_str());
+  FILE* fp = fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(fp != NULL);
+  fputc(0, fp);
+  fclose(fp);
+  // a server failing to load an image keeps serving what it had
+  ASSERT_EQ(loaded.load_image(path), EINVHEAD);
+  ASSERT_EQ(loaded.load_image(path + ".missing"), EIO);
+  ASSERT_EQ(loaded.num_vertices(), (uint64_t)nverts);
+  ASSERT_EQ(loaded.get_vertex_fields().size(), vertexfields.size());
+  ASSERT_TRUE(testutil::compare_shard(shard, image));
+  remove(path.c_str());
+  free(oarc.buf);
+  delete &server;
+}
+
+static void append_records(graphlab::graph_wal* wal, size_t writer, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    string record = boost::lexical_cast<string>(writer) + ":" +
+        boost::lexical_cast<string>(i);
+    ASSERT_TRUE(wal->sync(wal->append(record.c_str(), record.length())));
+  }
+}
+
+static void collect_record(vector<string>* records, const char* data, size_t len) {
+  records->push_back(string(data, len));
+}
+
+/**
+ * Test the write-ahead log and the checkpoints.
+ */
+void testWriteAheadLog() {
+  size_t nwriters = 8;
+  size_t nrecords = 200;
+  cout << "Test write-ahead log. Num records = " << nwriters * nrecords << endl;
+  const string path = "/tmp/graph_shard_server_test.log";
+  remove(path.c_str());
+  vector<string> records;
+  graphlab::graph_wal::replay_fun_type collect =
+      boost::bind(collect_record, &records, _1, _2);
+
+  // concurrent writers share their syncs
+  graphlab::graph_wal wal;
+  ASSERT_TRUE(wal.open(path, 0, collect, 2));
+  ASSERT_TRUE(records.empty());
+  graphlab::thread_group writers;
+  for (size_t i = 0; i < nwriters; ++i) {
+    writers.launch(boost::bind(append_records, &wal, i, nrecords));
+  }
+  writers.join();
+  ASSERT_EQ(wal.last_lsn(), nwriters * nrecords);
+  ASSERT_LT(wal.num_syncs(), nwriters * nrecords);
+  wal.close();
+
+  // every record is replayed, in the order of each writer
+  ASSERT_TRUE(wal.open(path, 0, collect));
+  ASSERT_EQ(records.size(), nwriters * nrecords);
+  vector<size_t> next(nwriters, 0);
+  for (size_t i = 0; i < records.size(); ++i) {
+    size_t sep = records[i].find(':');
+    size_t writer = boost::lexical_cast<size_t>(records[i].substr(0, sep));
+    ASSERT_EQ(boost::lexical_cast<size_t>(records[i].substr(sep + 1)), next[writer]);
+    ++next[writer];
+  }
+  wal.close();
+
+  // records covered by a checkpoint are skipped, a torn tail is dropped
+  FILE* fp = fopen(path.c_str(), "ab");
+  ASSERT_TRUE(fp != NULL);
+  fputs("torn", fp);
+  fclose(fp);
+  records.clear();
+  ASSERT_TRUE(wal.open(path, 100, collect));
+  ASSERT_EQ(records.size(), nwriters * nrecords - 100);
+  ASSERT_TRUE(wal.sync(wal.append("x", 1)));
+  ASSERT_EQ(wal.last_lsn(), nwriters * nrecords + 1);
+  ASSERT_TRUE(wal.reset());
+  ASSERT_EQ(wal.size(), (size_t)0);
+  wal.close();
+  records.clear();
+  ASSERT_TRUE(wal.open(path, 0, collect));
+  ASSERT_TRUE(records.empty());
+  wal.close();
+  remove(path.c_str());
+
+  // checkpoints restore the schema and the shard
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("name", graphlab::STRING_TYPE));
+  vertexfields[0].is_indexed = true;
+  edgefields.push_back(graphlab::graph_field("weight", graphlab::INT_TYPE));
+  graphlab::graph_shard_server& server =
+      *(testutil::createShardServer(100, 500, 0, vertexfields, edgefields));
+  graphlab::graph_row data(vertexfields, true);
+  data.get_field(0)->set_string("checkpointed");
+  ASSERT_EQ(server.set_vertex(7, data), 0);
+  const string ckpt = "/tmp/graph_shard_server_test.ckpt";
+  ASSERT_EQ(server.save_checkpoint(ckpt, 42), 0);
+  graphlab::graph_shard_server loaded(0);
+  uint64_t lsn = 0;
+  ASSERT_EQ(loaded.load_checkpoint(ckpt, lsn), 0);
+  ASSERT_EQ(lsn, (uint64_t)42);
+  ASSERT_TRUE(testutil::compare_shard(server.get_shard(), loaded.get_shard()));
+  ASSERT_EQ(loaded.get_vertex_fields().size(), vertexfields.size());
+  graphlab::graph_value name(graphlab::STRING_TYPE);
+  name.set_string("checkpointed");
+  vector<graphlab::graph_vid_t> vids;
+  ASSERT_EQ(loaded.find_vertices(0, name, vids), 0);
+  ASSERT_EQ(vids.size(), 1);
+  ASSERT_EQ(vids[0], (graphlab::graph_vid_t)7);
+  ASSERT_EQ(loaded.load_checkpoint(ckpt + ".missing", lsn), ENOENT);
+  remove(ckpt.c_str());
+  delete &server;
+}
+
+/**
+ * Test the compact row encoding and the schema version of query headers.
+ */
+void testRowCodec() {
+  size_t nrows = 1000;
+  cout << "Test row codec. Num rows = " << nrows << endl;
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("a", graphlab::DOUBLE_TYPE));
+  vertexfields.push_back(graphlab::graph_field("b", graphlab::DOUBLE_TYPE));
+  vertexfields.push_back(graphlab::graph_field("c", graphlab::DOUBLE_TYPE));
+  vertexfields.push_back(graphlab::graph_field("d", graphlab::DOUBLE_TYPE));
+  vertexfields.push_back(graphlab::graph_field("name", graphlab::STRING_TYPE));
+  vertexfields.push_back(graphlab::graph_field("id", graphlab::VID_TYPE));
+  edgefields.push_back(graphlab::graph_field("weight", graphlab::INT_TYPE));
+  edgefields.push_back(graphlab::graph_field("payload", graphlab::BLOB_TYPE));
+  graphlab::graph_row_codec codec(vertexfields, edgefields);
+  ASSERT_NE(codec.version(), (uint64_t)0);
+
+  // NULLs, empty and long strings, and rows without fields
+  vector<graphlab::graph_row> rows;
+  for (size_t i = 0; i < nrows; ++i) {
+    graphlab::graph_row row(vertexfields, true);
+    for (size_t j = 0; j < 4; ++j) {
+      if ((i + j) % 5 != 0) row.get_field(j)->set_double(i * 0.5 + j);
+    }
+    if (i % 3 != 0) row.get_field(4)->set_string(string(i % 300, 'a' + i % 26));
+    row.get_field(5)->set_vid(i << 20);
+    rows.push_back(row);
+  }
+  rows.push_back(graphlab::graph_row());
+  graphlab::oarchive compact, plain;
+  codec.save_rows(compact, rows);
+  plain << rows;
+  ASSERT_LT(compact.off, plain.off);
+  vector<graphlab::graph_row> loaded;
+  graphlab::iarchive iarc(compact.buf, compact.off);
+  codec.load_rows(iarc, loaded, true);
+  ASSERT_EQ(iarc.off, compact.off);
+  ASSERT_EQ(loaded.size(), rows.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    ASSERT_TRUE(testutil::compare_row(rows[i], loaded[i]));
+  }
+
+  // edge rows with blobs
+  graphlab::graph_row edge(edgefields, false);
+  edge.get_field(0)->set_integer(-7);
+  edge.get_field(1)->set_blob(string("\0\1\2", 3));
+  graphlab::oarchive edgearc;
+  codec.save(edgearc, edge);
+  graphlab::graph_row edgecopy;
+  graphlab::iarchive edgeiarc(edgearc.buf, edgearc.off);
+  codec.load(edgeiarc, edgecopy, false);
+  ASSERT_TRUE(edgecopy.is_edge());
+  ASSERT_TRUE(testutil::compare_row(edge, edgecopy));
+
+  // varints
+  graphlab::oarchive varints;
+  uint64_t values[] = {0, 1, 127, 128, 300, 1ULL << 35, (uint64_t)-1};
+  for (size_t i = 0; i < 7; ++i) {
+    graphlab::graph_row_codec::write_varint(varints, values[i]);
+  }
+  graphlab::iarchive variarc(varints.buf, varints.off);
+  for (size_t i = 0; i < 7; ++i) {
+    ASSERT_EQ(graphlab::graph_row_codec::read_varint(variarc), values[i]);
+  }
+
+  // another schema has another version
+  vertexfields[0].type = graphlab::INT_TYPE;
+  ASSERT_NE(graphlab::graph_row_codec(vertexfields, edgefields).version(), codec.version());
+
+  // headers with and without a schema version
+  graphlab::QueryMessage versioned(graphlab::QueryMessage::header(
+      graphlab::QueryMessage::BGET, graphlab::QueryMessage::VERTEX, codec.version()));
+  versioned << (size_t)42;
+  graphlab::QueryMessage parsed(versioned.message(), versioned.length());
+  ASSERT_EQ(parsed.get_header().cmd, graphlab::QueryMessage::BGET);
+  ASSERT_EQ(parsed.get_header().obj, graphlab::QueryMessage::VERTEX);
+  ASSERT_EQ(parsed.get_header().schema_version, codec.version());
+  size_t arg;
+  parsed >> arg;
+  ASSERT_EQ(arg, (size_t)42);
+  graphlab::QueryMessage old(graphlab::QueryMessage::GET, graphlab::QueryMessage::EDGE);
+  graphlab::QueryMessage oldparsed(old.message(), old.length());
+  ASSERT_EQ(oldparsed.get_header().cmd, graphlab::QueryMessage::GET);
+  ASSERT_EQ(oldparsed.get_header().schema_version, (uint64_t)0);
+
+  free(compact.buf);
+  free(plain.buf);
+  free(edgearc.buf);
+  free(varints.buf);
+}
+
+void testRowView() {
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  vertexfields.push_back(graphlab::graph_field("text", graphlab::STRING_TYPE));
+  vertexfields.push_back(graphlab::graph_field("rank", graphlab::DOUBLE_TYPE));
+
+  size_t nverts = 100;
+  cout << "Test row view. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server =
+      *(testutil::createShardServer(nverts, 0, 0, vertexfields, edgefields));
+
+  // a batch set request, decoded one row at a time into the same view
+  graphlab::QueryMessage request(graphlab::QueryMessage::BSET, graphlab::QueryMessage::VERTEX);
+  vector<graphlab::graph_row> rows;
+  request << nverts;
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_row data(vertexfields, true);
+    if (i % 7 != 0) data.get_field(0)->set_string(string(i * 10, 'a' + i % 26));
+    data.get_field(1)->set_double(i * 0.25);
+    request << (graphlab::graph_vid_t)i << data;
+    rows.push_back(data);
+  }
+  graphlab::QueryMessage parsed(request.message(), request.length());
+  const char* begin = request.message();
+  const char* end = begin + request.length();
+  size_t n;
+  parsed >> n;
+  ASSERT_EQ(n, nverts);
+  graphlab::graph_row_view view;
+  for (size_t i = 0; i < n; ++i) {
+    graphlab::graph_vid_t vid;
+    parsed >> vid >> view;
+    ASSERT_EQ(vid, (graphlab::graph_vid_t)i);
+    ASSERT_TRUE(view.is_vertex());
+    ASSERT_TRUE(testutil::compare_row(rows[i], view.row()));
+    const graphlab::graph_value* text = view.get_field(0);
+    if (!text->is_null()) {
+      // the payload points into the request
+      ASSERT_FALSE(text->owns_data());
+      const char* ptr = (const char*)text->get_raw_pointer();
+      ASSERT_TRUE(ptr >= begin && ptr + text->data_length() <= end);
+    }
+    ASSERT_EQ(server.set_vertex(vid, view.row()), 0);
+  }
+
+  // the shard keeps its own copy
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_row out;
+    ASSERT_EQ(server.get_vertex(i, out), 0);
+    ASSERT_TRUE(testutil::compare_row(rows[i], out));
+  }
+  delete &server;
+}
+
+void testVertexMirrors() {
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  size_t nverts = 10;
+  cout << "Test vertex mirrors. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server =
+      *(testutil::createShardServer(nverts, 0, 0, vertexfields, edgefields));
+  vector<graphlab::graph_shard_id_t> mirrors;
+  ASSERT_EQ(server.get_vertex_mirrors(3, mirrors), 0);
+  ASSERT_TRUE(mirrors.empty());
+  ASSERT_EQ(server.get_vertex_mirrors(nverts, mirrors), EINVID);
+
+  vector<graphlab::graph_shard_id_t> added;
+  added.push_back(2);
+  added.push_back(5);
+  added.push_back(2);
+  ASSERT_EQ(server.add_vertex_mirror(3, added), 0);
+  ASSERT_EQ(server.get_vertex_mirrors(3, mirrors), 0);
+  std::sort(mirrors.begin(), mirrors.end());
+  ASSERT_EQ(mirrors.size(), (size_t)2);
+  ASSERT_EQ(mirrors[0], (graphlab::graph_shard_id_t)2);
+  ASSERT_EQ(mirrors[1], (graphlab::graph_shard_id_t)5);
+  // a mirror added for an unknown vertex makes this shard its master
+  ASSERT_EQ(server.add_vertex_mirror(nverts, added), 0);
+  ASSERT_EQ(server.get_vertex_mirrors(nverts, mirrors), 0);
+  ASSERT_EQ(mirrors.size(), (size_t)2);
+  delete &server;
+}
+
+void testBatchAdjacency() {
+  typedef graphlab::graph_shard_server::vertex_adj_descriptor vertex_adj_descriptor;
+  vector<graphlab::graph_field> vertexfields;
+  vector<graphlab::graph_field> edgefields;
+  size_t nverts = 1000;
+  size_t nedges = 10000;
+  cout << "Test batch adjacency. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server =
+      *(testutil::createShardServer(nverts, nedges, 0, vertexfields, edgefields));
+
+  // unsorted, repeated and unknown vids
+  vector<graphlab::graph_vid_t> vids;
+  for (size_t i = 0; i < nverts; i += 3) {
+    vids.push_back((i * 7919) % nverts);
+  }
+  vids.push_back(vids[0]);
+  vids.push_back(nverts + 1);
+  for (size_t round = 0; round < 2; ++round) {
+    // the second round reads a frozen index with a delta
+    if (round == 1) {
+      server.freeze_index();
+      graphlab::graph_row empty_edata(edgefields, false);
+      for (size_t i = 0; i < 100; ++i) {
+        server.add_edge(i, (i * 31) % nverts, empty_edata);
+      }
+    }
+    for (size_t in_edges = 0; in_edges < 2; ++in_edges) {
+      vector<vertex_adj_descriptor> out;
+      vector<int> errorcodes;
+      ASSERT_TRUE(server.get_vertices_adj(vids, in_edges, out, errorcodes));
+      ASSERT_EQ(out.size(), vids.size());
+      for (size_t i = 0; i < vids.size(); ++i) {
+        vertex_adj_descriptor expected;
+        ASSERT_EQ(server.get_vertex_adj(vids[i], in_edges, expected), 0);
+        ASSERT_TRUE(out[i].neighbor_ids == expected.neighbor_ids);
+        ASSERT_TRUE(out[i].eids == expected.eids);
+      }
+    }
+  }
+  delete &server;
+}
+
+void testRowFilter() {
+  using graphlab::graph_condition;
+  vector<graphlab::graph_field> vertexfields;
+  vertexfields.push_back(graphlab::graph_field("age", graphlab::INT_TYPE));
+  vertexfields.push_back(graphlab::graph_field("score", graphlab::DOUBLE_TYPE));
+  vertexfields.push_back(graphlab::graph_field("name", graphlab::STRING_TYPE));
+  vector<graphlab::graph_field> edgefields;
+  size_t nverts = 100;
+  size_t nedges = 100;
+  cout << "Test row filter. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server =
+      *(testutil::createShardServer(nverts, nedges, 0, vertexfields, edgefields));
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_row data(vertexfields, true);
+    data.get_field(0)->set_integer(i);
+    data.get_field(1)->set_double(i * 0.5);
+    data.get_field(2)->set_string("v" + boost::lexical_cast<string>(i));
+    ASSERT_EQ(server.set_vertex(i, data), 0);
+  }
+
+  // (age >= 10 AND score < 20) OR name == "v3", keeping the name only
+  graphlab::graph_value ten(graphlab::INT_TYPE), twenty(graphlab::DOUBLE_TYPE);
+  graphlab::graph_value v3(graphlab::STRING_TYPE);
+  ten.set_integer(10);
+  twenty.set_double(20);
+  v3.set_string("v3");
+  graphlab::graph_row_filter filter;
+  filter.select(2);
+  filter.where(0, graph_condition::GE, ten);
+  filter.where(1, graph_condition::LT, twenty);
+  filter.or_where(2, graph_condition::EQ, v3);
+
+  vector<graphlab::graph_vid_t> vids;
+  for (size_t i = 0; i < nverts; ++i) {
+    vids.push_back(nverts - 1 - i);
+  }
+  vids.push_back(nverts + 1);
+  vector<pair<size_t, graphlab::graph_row> > out;
+  vector<int> errorcodes;
+  ASSERT_FALSE(server.filter_vertices(vids, filter, out, errorcodes));
+  ASSERT_EQ(errorcodes.back(), EINVID);
+  size_t expected = 0;
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_vid_t vid = vids[i];
+    ASSERT_EQ(errorcodes[i], 0);
+    if ((vid >= 10 && vid < 40) || vid == 3) {
+      ASSERT_LT(expected, out.size());
+      ASSERT_EQ(out[expected].first, i);
+      ASSERT_EQ(out[expected].second.num_fields(), (size_t)1);
+      graphlab::graph_string_t name;
+      ASSERT_TRUE(out[expected].second.get_field(0)->get_string(&name));
+      ASSERT_EQ(name, "v" + boost::lexical_cast<string>(vid));
+      ++expected;
+    }
+  }
+  ASSERT_EQ(out.size(), expected);
+
+  // no condition and no selected field: every row, whole
+  out.clear();
+  graphlab::graph_row_filter all;
+  ASSERT_TRUE(server.filter_edges(vector<graphlab::graph_eid_t>(1, graphlab::make_eid(0, 5)),
+                                  all, out, errorcodes));
+  ASSERT_EQ(out.size(), (size_t)1);
+
+  // fields which do not exist, and values of another type
+  graphlab::graph_row_filter missing;
+  missing.select(3);
+  ASSERT_FALSE(server.filter_vertices(vids, missing, out, errorcodes));
+  ASSERT_EQ(errorcodes[0], EINVID);
+  graphlab::graph_row_filter mistyped;
+  mistyped.where(0, graph_condition::EQ, twenty);
+  ASSERT_FALSE(server.filter_vertices(vids, mistyped, out, errorcodes));
+  ASSERT_EQ(errorcodes[0], EINVTYPE);
+  delete &server;
+}
+
+void testScan() {
+  typedef graphlab::graph_shard_server::scan_descriptor scan_descriptor;
+  vector<graphlab::graph_field> vertexfields;
+  vertexfields.push_back(graphlab::graph_field("age", graphlab::INT_TYPE));
+  vertexfields.push_back(graphlab::graph_field("name", graphlab::STRING_TYPE));
+  vector<graphlab::graph_field> edgefields;
+  size_t nverts = 1000;
+  size_t nedges = 3000;
+  cout << "Test scan. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server =
+      *(testutil::createShardServer(nverts, nedges, 0, vertexfields, edgefields));
+  for (size_t i = 0; i < nverts; ++i) {
+    graphlab::graph_row data(vertexfields, true);
+    data.get_field(0)->set_integer(i);
+    data.get_field(1)->set_string(string(100, 'a'));
+    ASSERT_EQ(server.set_vertex(i, data), 0);
+  }
+
+  // every vertex once, in chunks of at most 64 rows
+  graphlab::graph_row_filter all;
+  vector<bool> seen(nverts, false);
+  size_t position = 0;
+  while (position < server.get_shard().num_vertices()) {
+    vector<scan_descriptor> out;
+    size_t next;
+    ASSERT_EQ(server.scan(true, position, 64, 1 << 20, all, out, next), 0);
+    ASSERT_LE(out.size(), (size_t)64);
+    ASSERT_GT(next, position);
+    for (size_t i = 0; i < out.size(); ++i) {
+      ASSERT_LT(out[i].id, nverts);
+      ASSERT_FALSE(seen[out[i].id]);
+      seen[out[i].id] = true;
+      ASSERT_EQ(out[i].data.num_fields(), (size_t)2);
+    }
+    position = next;
+  }
+  ASSERT_EQ((size_t)count(seen.begin(), seen.end(), true), nverts);
+
+  // the byte budget ends the chunk, but at least one row is returned
+  vector<scan_descriptor> out;
+  size_t next;
+  ASSERT_EQ(server.scan(true, 0, 64, 350, all, out, next), 0);
+  ASSERT_EQ(out.size(), (size_t)4);
+  out.clear();
+  ASSERT_EQ(server.scan(true, 0, 64, 0, all, out, next), 0);
+  ASSERT_EQ(out.size(), (size_t)1);
+
+  // a single scan reads at most SCAN_MAX_READ rows, whatever max_rows is
+  size_t nbig = graphlab::graph_shard_server::SCAN_MAX_READ + 100;
+  graphlab::graph_shard_server& big =
+      *(testutil::createShardServer(10, nbig, 0, vertexfields, edgefields));
+  size_t nscans = 0;
+  position = 0;
+  while (position < nbig) {
+    out.clear();
+    ASSERT_EQ(big.scan(false, position, (size_t)-1, (size_t)-1, all, out, next), 0);
+    ASSERT_EQ(out.size(), next - position);
+    ASSERT_LE(out.size(), (size_t)graphlab::graph_shard_server::SCAN_MAX_READ);
+    position = next;
+    ++nscans;
+  }
+  ASSERT_EQ(position, nbig);
+  ASSERT_EQ(nscans, (size_t)2);
+  delete &big;
+
+  // projected and filtered rows
+  graphlab::graph_value threshold(graphlab::INT_TYPE);
+  threshold.set_integer(10);
+  graphlab::graph_row_filter small;
+  small.select(0);
+  small.where(0, graphlab::graph_condition::LT, threshold);
+  out.clear();
+  ASSERT_EQ(server.scan(true, 0, nverts, 1 << 20, small, out, next), 0);
+  ASSERT_EQ(out.size(), (size_t)10);
+  ASSERT_EQ(next, server.get_shard().num_vertices());
+  for (size_t i = 0; i < out.size(); ++i) {
+    ASSERT_EQ(out[i].data.num_fields(), (size_t)1);
+  }
+
+  // edges carry their ends, and serialize them
+  out.clear();
+  ASSERT_EQ(server.scan(false, 0, nedges, 1 << 20, all, out, next), 0);
+  ASSERT_EQ(out.size(), nedges);
+  ASSERT_EQ(next, nedges);
+  for (size_t i = 0; i < out.size(); ++i) {
+    graphlab::graph_row data;
+    ASSERT_EQ(server.get_edge(out[i].id, data), 0);
+  }
+  graphlab::oarchive oarc;
+  oarc << out;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  vector<scan_descriptor> copy;
+  iarc >> copy;
+  ASSERT_EQ(copy.size(), out.size());
+  for (size_t i = 0; i < copy.size(); ++i) {
+    pair<graphlab::graph_vid_t, graphlab::graph_vid_t> e =
+        server.get_shard().edge(graphlab::split_eid(copy[i].id).second);
+    ASSERT_EQ(copy[i].source, e.first);
+    ASSERT_EQ(copy[i].target, e.second);
+  }
+  free(oarc.buf);
+
+  graphlab::graph_row_filter missing;
+  missing.select(2);
+  ASSERT_EQ(server.scan(true, 0, 10, 1 << 20, missing, out, next), EINVID);
+  delete &server;
+}
+
+// Aggregates the field at fieldpos of all the vertices of server, a slice at a time.
+int aggregate_vertices(graphlab::graph_shard_server& server, size_t fieldpos, bool distinct,
+                       graphlab::graph_field_aggregate& out) {
+  size_t position = 0, next = 0;
+  do {
+    position = next;
+    int errorcode = server.aggregate_field(true, fieldpos, distinct, position, out, next);
+    if (errorcode != 0) {
+      return errorcode;
+    }
+  } while (next != position);
+  return 0;
+}
+
+void testAggregate() {
+  vector<graphlab::graph_field> vertexfields;
+  vertexfields.push_back(graphlab::graph_field("age", graphlab::INT_TYPE));
+  vertexfields.push_back(graphlab::graph_field("score", graphlab::DOUBLE_TYPE));
+  vertexfields.push_back(graphlab::graph_field("name", graphlab::STRING_TYPE));
+  vector<graphlab::graph_field> edgefields;
+  size_t nverts = 1000;
+  size_t nedges = 3000;
+  cout << "Test aggregate. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server =
+      *(testutil::createShardServer(nverts, nedges, 0, vertexfields, edgefields));
+  // the last 10 vertices keep NULL values
+  size_t nset = nverts - 10;
+  graphlab::graph_int_t agesum = 0;
+  for (size_t i = 0; i < nset; ++i) {
+    graphlab::graph_row data(vertexfields, true);
+    data.get_field(0)->set_integer(i % 100);
+    data.get_field(1)->set_double(i * 0.5);
+    data.get_field(2)->set_string("name" + boost::lexical_cast<string>(i % 37));
+    ASSERT_EQ(server.set_vertex(i, data), 0);
+    agesum += i % 100;
+  }
+
+  graphlab::graph_field_aggregate age;
+  ASSERT_EQ(aggregate_vertices(server, 0, true, age), 0);
+  ASSERT_EQ(age.count, (uint64_t)nset);
+  ASSERT_EQ(age.int_sum, agesum);
+  ASSERT_EQ(age.sum, 0.0);
+  graphlab::graph_int_t x;
+  age.min.get_integer(&x);
+  ASSERT_EQ(x, 0);
+  age.max.get_integer(&x);
+  ASSERT_EQ(x, 99);
+  ASSERT_LT(fabs(age.distinct_count() - 100), 5.0);
+
+  graphlab::graph_field_aggregate score;
+  ASSERT_EQ(aggregate_vertices(server, 1, false, score), 0);
+  ASSERT_EQ(score.mean(), (nset - 1) * 0.25);
+  ASSERT_TRUE(score.distinct.empty());
+  graphlab::graph_double_t d;
+  score.max.get_double(&d);
+  ASSERT_EQ(d, (nset - 1) * 0.5);
+
+  // strings only get a count and distinct values
+  graphlab::graph_field_aggregate name;
+  ASSERT_EQ(aggregate_vertices(server, 2, true, name), 0);
+  ASSERT_EQ(name.count, (uint64_t)nset);
+  ASSERT_TRUE(name.min.is_null());
+  ASSERT_LT(fabs(name.distinct_count() - 37), 2.0);
+
+  graphlab::graph_field_aggregate missing;
+  ASSERT_EQ(aggregate_vertices(server, 3, false, missing), EINVID);
+  size_t next;
+  ASSERT_EQ(server.aggregate_field(false, 0, false, 0, missing, next), EINVID);
+
+  // only INT and DOUBLE fields have a histogram
+  graphlab::graph_field_histogram histogram(10, 60, 5);
+  ASSERT_EQ(server.histogram_field(true, 0, 0, histogram, next), 0);
+  ASSERT_EQ(next, nverts);
+  ASSERT_EQ(server.histogram_field(true, 0, next, histogram, next), 0);
+  ASSERT_EQ(next, nverts);
+  // each of the 100 ages is held by 10 vertices, but 90 to 99 by 9
+  ASSERT_EQ(histogram.below, (uint64_t)100);
+  ASSERT_EQ(histogram.above, (uint64_t)(40 * 10 - 10));
+  for (size_t i = 0; i < histogram.bins.size(); ++i) {
+    ASSERT_EQ(histogram.bins[i], (uint64_t)100);
+  }
+  graphlab::graph_field_histogram names(0, 1, 4);
+  ASSERT_EQ(server.histogram_field(true, 2, 0, names, next), EINVTYPE);
+  ASSERT_EQ(server.histogram_field(true, 3, 0, names, next), EINVID);
+  // partials with other bins are flagged, not added
+  graphlab::graph_field_histogram merged = histogram;
+  merged += graphlab::graph_field_histogram(10, 60, 4);
+  ASSERT_TRUE(merged.mismatched);
+  merged.mismatched = false;
+  merged += graphlab::graph_field_histogram(0, 60, 5);
+  ASSERT_TRUE(merged.mismatched);
+  ASSERT_TRUE(merged.bins == histogram.bins);
+  ASSERT_EQ(merged.below, histogram.below);
+
+  // partials of disjoint rows add up to the aggregate of all of them
+  graphlab::graph_field_aggregate all, lo, hi;
+  for (size_t i = 0; i < 100000; ++i) {
+    graphlab::graph_value v(graphlab::INT_TYPE);
+    v.set_integer(i * 7919);
+    all.add(v, true);
+    (i < 30000 ? lo : hi).add(v, true);
+  }
+  lo += hi;
+  ASSERT_EQ(lo.count, all.count);
+  ASSERT_EQ(lo.int_sum, all.int_sum);
+  lo.min.get_integer(&x);
+  ASSERT_EQ(x, 0);
+  lo.max.get_integer(&x);
+  ASSERT_EQ(x, 99999 * 7919);
+  ASSERT_EQ(lo.distinct_count(), all.distinct_count());
+  ASSERT_LT(fabs(all.distinct_count() - 100000), 5000.0);
+  graphlab::oarchive oarc;
+  oarc << lo;
+  graphlab::iarchive iarc(oarc.buf, oarc.off);
+  graphlab::graph_field_aggregate loaded;
+  iarc >> loaded;
+  ASSERT_EQ(loaded.count, lo.count);
+  ASSERT_EQ(loaded.distinct_count(), lo.distinct_count());
+  ASSERT_EQ(loaded.int_sum, lo.int_sum);
+  free(oarc.buf);
+
+  // INT sums stay exact past 2^53, and an overflow is flagged
+  graphlab::graph_field_aggregate big, wrap;
+  graphlab::graph_value v(graphlab::INT_TYPE);
+  v.set_integer((1LL << 53) + 1);
+  big.add(v, false);
+  v.set_integer(2);
+  big.add(v, false);
+  ASSERT_EQ(big.int_sum, (1LL << 53) + 3);
+  ASSERT_FALSE(big.int_overflow);
+  v.set_integer(std::numeric_limits<graphlab::graph_int_t>::max());
+  wrap.add(v, false);
+  ASSERT_FALSE(wrap.int_overflow);
+  wrap += big;
+  ASSERT_TRUE(wrap.int_overflow);
+  ASSERT_EQ(wrap.int_sum, 0);
+  // past an overflow, the INT values are summed in the double sum
+  graphlab::graph_field_aggregate near_max;
+  const graphlab::graph_int_t max_int = std::numeric_limits<graphlab::graph_int_t>::max();
+  for (size_t i = 0; i < 4; ++i) {
+    v.set_integer(max_int - i);
+    near_max.add(v, false);
+  }
+  ASSERT_TRUE(near_max.int_overflow);
+  ASSERT_LT(fabs(near_max.mean() / ((double)max_int - 1.5) - 1), 1e-12);
+  near_max += wrap;
+  ASSERT_EQ(near_max.count, (uint64_t)7);
+  double total = 5 * (double)max_int + (double)(1LL << 53);
+  ASSERT_LT(fabs(near_max.mean() / (total / 7) - 1), 1e-12);
+
+  // degrees over the edges of the shard
+  vector<uint64_t> outdeg(nverts, 0), indeg(nverts, 0);
+  for (size_t i = 0; i < nedges; ++i) {
+    ++outdeg[server.get_shard().edge(i).first];
+    ++indeg[server.get_shard().edge(i).second];
+  }
+  boost::unordered_map<graphlab::graph_vid_t, uint64_t> degrees;
+  ASSERT_EQ(server.count_degrees(graphlab::graph_traversal_spec::OUT_EDGES, 0, degrees), nedges);
+  ASSERT_EQ(server.count_degrees(graphlab::graph_traversal_spec::OUT_EDGES, nedges, degrees),
+            nedges);
+  for (size_t i = 0; i < nverts; ++i) {
+    ASSERT_EQ(degrees[i], outdeg[i]);
+  }
+  degrees.clear();
+  server.count_degrees(graphlab::graph_traversal_spec::ALL_EDGES, 0, degrees);
+  for (size_t i = 0; i < nverts; ++i) {
+    ASSERT_EQ(degrees[i], outdeg[i] + indeg[i]);
+  }
+  delete &server;
+}
+
+/**
+ * Test that an aggregate reads at most AGGREGATE_MAX_READ rows per call,
+ * and that the slices add up to all the rows.
+ */
+void testAggregateSlices() {
+  vector<graphlab::graph_field> vertexfields;
+  vertexfields.push_back(graphlab::graph_field("age", graphlab::INT_TYPE));
+  vector<graphlab::graph_field> edgefields;
+  size_t nverts = graphlab::graph_shard_server::AGGREGATE_MAX_READ + 100;
+  cout << "Test aggregate slices. Num vertices = " << nverts << endl;
+  graphlab::graph_shard_server& server =
+      *(testutil::createShardServer(nverts, 0, 0, vertexfields, edgefields));
+  // one vertex in 1000 has an age, and the last one
+  vector<graphlab::graph_vid_t> vids;
+  for (size_t i = 0; i < nverts; i += 1000) {
+    vids.push_back(i);
+  }
+  vids.push_back(nverts - 1);
+  size_t nset = vids.size();
+  for (size_t i = 0; i < nset; ++i) {
+    graphlab::graph_row data(vertexfields, true);
+    data.get_field(0)->set_integer(1);
+    ASSERT_EQ(server.set_vertex(vids[i], data), 0);
+  }
+  graphlab::graph_field_aggregate age;
+  size_t next;
+  ASSERT_EQ(server.aggregate_field(true, 0, false, 0, age, next), 0);
+  ASSERT_EQ(next, graphlab::graph_shard_server::AGGREGATE_MAX_READ);
+  ASSERT_LT(age.count, (uint64_t)nset);
+  ASSERT_EQ(server.aggregate_field(true, 0, false, next, age, next), 0);
+  ASSERT_EQ(next, nverts);
+  ASSERT_EQ(age.count, (uint64_t)nset);
+  ASSERT_EQ(age.int_sum, (graphlab::graph_int_t)nset);
+  ASSERT_EQ(server.aggregate_field(true, 0, false, next, age, next), 0);
+  ASSERT_EQ(next, nverts);
+  ASSERT_EQ(age.count, (uint64_t)nset);
+  delete &server;
+}
 
 int main(int argc, char** argv) {
   testFieldAPI();
   testVertexAPI();
   testEdgeAPI();
+  testVertexIndex();
+  testColumnStorage();
+  testResetField();
+  testPayloadArena();
+  testBatchInsert();
+  testFrozenIndex();
+  testFieldIndex();
+  testOrderedIndex();
+  testShardImage();
+  testWriteAheadLog();
+  testRowCodec();
+  testRowView();
+  testVertexMirrors();
+  testBatchAdjacency();
+  testRowFilter();
+  testScan();
+  testAggregate();
+  testAggregateSlices();
   return 0;
 }
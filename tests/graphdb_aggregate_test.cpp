@@ -0,0 +1,211 @@
+#include <graphlab/database/graph_aggregate.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include "graphdb_test_shards.hpp"
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+using namespace std;
+using namespace graphlab;
+
+// Sends the GET AGGREGATE query qm to every shard with send and adds up their replies into out.
+template<typename T>
+int aggregate(size_t nshards, const graph_traversal::scatter_function& send,
+              QueryMessage& qm, T& out) {
+  string msg(qm.message(), qm.length());
+  free(qm.message());
+  graph_traversal::request_list requests;
+  for (size_t i = 0; i < nshards; ++i) {
+    requests.push_back(make_pair(i, msg));
+  }
+  vector<string> replies;
+  send(requests, replies);
+  for (size_t i = 0; i < replies.size(); ++i) {
+    T partial;
+    int errorcode = graph_traversal::parse_reply(replies[i], &partial);
+    if (errorcode != 0) {
+      return errorcode;
+    }
+    out += partial;
+  }
+  return 0;
+}
+
+// Returns the histogram of the weights of the edges, counted locally.
+graph_field_histogram local_histogram(const vector<test_edge>& edges,
+                                      double lo, double hi, size_t nbins) {
+  graph_field_histogram out(lo, hi, nbins);
+  for (size_t i = 0; i < edges.size(); ++i) {
+    graph_value weight;
+    weight.set_integer(edges[i].weight);
+    out.add(weight);
+  }
+  return out;
+}
+
+void testFieldAggregate() {
+  size_t nshards = 4;
+  size_t nverts = 300;
+  size_t nedges = 2000;
+  cout << "Test field aggregate. Num shards = " << nshards
+       << " Num vertices = " << nverts << " Num edges = " << nedges << endl;
+  graph_shard_manager manager(nshards);
+  vector<graphdb_server*> servers;
+  for (size_t i = 0; i < nshards; ++i) {
+    servers.push_back(new graphdb_server(i));
+  }
+  graph_traversal::scatter_function send = boost::bind(scatter, &servers, _1, _2);
+
+  srand(1);
+  vector<test_edge> edges(nedges);
+  graph_int_t sum = 0, max = 0;
+  for (size_t i = 0; i < nedges; ++i) {
+    edges[i].source = rand() % nverts;
+    edges[i].target = rand() % nverts;
+    edges[i].weight = rand() % 1000;
+    sum += edges[i].weight;
+    max = std::max(max, edges[i].weight);
+  }
+  load_graph(manager, servers, nverts, edges);
+
+  QueryMessage field(QueryMessage::GET, QueryMessage::AGGREGATE);
+  field << FIELD_AGGREGATE << false << (size_t)0 << true;
+  graph_field_aggregate weight;
+  ASSERT_EQ(aggregate(nshards, send, field, weight), 0);
+  ASSERT_EQ(weight.count, (uint64_t)nedges);
+  ASSERT_EQ(weight.int_sum, sum);
+  ASSERT_FALSE(weight.int_overflow);
+  graph_int_t x;
+  weight.max.get_integer(&x);
+  ASSERT_EQ(x, max);
+  ASSERT_GT(weight.distinct_count(), 800.0);
+  ASSERT_LT(weight.distinct_count(), 1000.0);
+
+  // the values below lo and from hi on are counted apart
+  QueryMessage histogram(QueryMessage::GET, QueryMessage::AGGREGATE);
+  histogram << FIELD_HISTOGRAM << false << (size_t)0 << 100.0 << 900.0 << (size_t)16;
+  graph_field_histogram out;
+  ASSERT_EQ(aggregate(nshards, send, histogram, out), 0);
+  graph_field_histogram expected = local_histogram(edges, 100, 900, 16);
+  ASSERT_TRUE(out.bins == expected.bins);
+  ASSERT_EQ(out.below, expected.below);
+  ASSERT_EQ(out.above, expected.above);
+  ASSERT_EQ(out.bin_lo(1), 150.0);
+  uint64_t total = out.below + out.above;
+  for (size_t i = 0; i < out.bins.size(); ++i) {
+    total += out.bins[i];
+  }
+  ASSERT_EQ(total, (uint64_t)nedges);
+
+  // bins which are not valid, and fields which do not exist or are not numbers
+  double bounds[3][2] = {{1, 1}, {2, 1}, {0, numeric_limits<double>::infinity()}};
+  for (size_t i = 0; i < 3; ++i) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::AGGREGATE);
+    qm << FIELD_HISTOGRAM << false << (size_t)0 << bounds[i][0] << bounds[i][1] << (size_t)4;
+    ASSERT_EQ(aggregate(nshards, send, qm, out), EINVHEAD);
+  }
+  size_t nbins[2] = {0, graph_field_histogram::MAX_BINS + 1};
+  for (size_t i = 0; i < 2; ++i) {
+    QueryMessage qm(QueryMessage::GET, QueryMessage::AGGREGATE);
+    qm << FIELD_HISTOGRAM << false << (size_t)0 << 0.0 << 1.0 << nbins[i];
+    ASSERT_EQ(aggregate(nshards, send, qm, out), EINVHEAD);
+  }
+  QueryMessage missing(QueryMessage::GET, QueryMessage::AGGREGATE);
+  missing << FIELD_HISTOGRAM << false << (size_t)1 << 0.0 << 1.0 << (size_t)4;
+  ASSERT_EQ(aggregate(nshards, send, missing, out), EINVID);
+  QueryMessage string_field(QueryMessage::ADD, QueryMessage::VFIELD);
+  string_field << graph_field("name", STRING_TYPE);
+  update(*servers[0], string_field);
+  QueryMessage names(QueryMessage::GET, QueryMessage::AGGREGATE);
+  names << FIELD_HISTOGRAM << true << (size_t)0 << 0.0 << 1.0 << (size_t)4;
+  ASSERT_EQ(aggregate(1, send, names, out), EINVTYPE);
+
+  for (size_t i = 0; i < nshards; ++i) {
+    delete servers[i];
+  }
+}
+
+// Checks the degree distributions of edges over nverts vertices computed with traversal.
+void check_degrees(graph_traversal* traversal, uint64_t id, size_t nverts,
+                   const vector<test_edge>* edges) {
+  graph_traversal_spec::direction_type directions[3] =
+      {graph_traversal_spec::OUT_EDGES, graph_traversal_spec::IN_EDGES,
+       graph_traversal_spec::ALL_EDGES};
+  for (size_t k = 0; k < 3; ++k) {
+    vector<uint64_t> degrees(nverts, 0);
+    for (size_t i = 0; i < edges->size(); ++i) {
+      if (directions[k] != graph_traversal_spec::IN_EDGES) {
+        ++degrees[(*edges)[i].source];
+      }
+      if (directions[k] != graph_traversal_spec::OUT_EDGES) {
+        ++degrees[(*edges)[i].target];
+      }
+    }
+    graph_degree_distribution expected;
+    for (size_t i = 0; i < nverts; ++i) {
+      ++expected.counts[degrees[i]];
+    }
+    graph_degree_distribution out;
+    ASSERT_EQ(traversal->degree_distribution(id + k, directions[k], out), 0);
+    ASSERT_TRUE(out.counts == expected.counts);
+  }
+}
+
+/**
+ * Test the degree distribution on shards serving one request at a time,
+ * asked by several drivers at once. Each vertex is counted once, by its
+ * master, with its edges on all the shards.
+ */
+void testDegreeDistribution() {
+  size_t nshards = 4;
+  size_t nverts = 300;
+  size_t nedges = 2000;
+  cout << "Test degree distribution. Num shards = " << nshards
+       << " Num vertices = " << nverts << " Num edges = " << nedges << endl;
+  graph_shard_manager manager(nshards);
+  vector<graphdb_server*> servers;
+  for (size_t i = 0; i < nshards; ++i) {
+    servers.push_back(new graphdb_server(i));
+  }
+  srand(3);
+  vector<test_edge> edges(nedges);
+  for (size_t i = 0; i < nedges; ++i) {
+    edges[i].source = rand() % nverts;
+    edges[i].target = rand() % nverts;
+    edges[i].weight = 0;
+  }
+  load_graph(manager, servers, nverts, edges);
+
+  shard_workers* workers = new shard_workers(&servers);
+  graph_traversal::scatter_function send =
+      boost::bind(&shard_workers::scatter, workers, _1, _2);
+  for (size_t i = 0; i < nshards; ++i) {
+    servers[i]->set_peers(manager, send);
+  }
+  graph_traversal traversal(manager, send);
+  thread_group drivers;
+  for (size_t i = 0; i < 4; ++i) {
+    drivers.launch(boost::bind(check_degrees, &traversal, 100 * (i + 1), nverts, &edges));
+  }
+  drivers.join();
+
+  // the state is dropped once done
+  string result = graph_traversal::request(graph_traversal::DEGREE_RESULT, 100);
+  vector<string> replies;
+  send(graph_traversal::request_list(1, make_pair(0, result)), replies);
+  ASSERT_EQ(graph_traversal::parse_reply<graph_degree_distribution>(replies[0], NULL), EINVID);
+
+  // the threads of the servers stop before the workers they send to
+  for (size_t i = 0; i < nshards; ++i) {
+    delete servers[i];
+  }
+  delete workers;
+}
+
+int main(int argc, char** argv) {
+  global_logger().set_log_level(LOG_ERROR);
+  testFieldAggregate();
+  testDegreeDistribution();
+  return 0;
+}
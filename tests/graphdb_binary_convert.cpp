@@ -0,0 +1,121 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/lexical_cast.hpp>
+#include <graphlab/database/client/ingress/binary_edge_format.hpp>
+#include <graphlab/database/client/ingress/builtin_parsers.hpp>
+#include <graphlab/database/graph_shard_manager.hpp>
+using namespace std;
+using namespace graphlab;
+
+/**
+ * Converts an edge list in a text format (snap, tsv or adj, optionally
+ * gzipped) to the binary edge format loaded as "bin". With num_shards,
+ * the edges are partitioned as the loader would over num_shards shards,
+ * into output.0 ... output.<num_shards - 1>, each tagged with its shard.
+ *
+ * Usage: graphdb_binary_convert [input] [format] [output] [num_shards] [vid_bytes]
+ */
+
+// Receives the edges from the text parsers.
+struct edge_writer {
+  graph_shard_manager* manager;
+  vector<binary_edge_writer>* files;
+  size_t max_vid;
+  bool success;
+  void add_edge(graph_vid_t source, graph_vid_t target) {
+    if (source > max_vid || target > max_vid) {
+      success = false;
+      return;
+    }
+    size_t i = (manager == NULL) ? 0 : manager->get_master(source, target);
+    success &= (*files)[i].add_edge(source, target);
+  }
+};
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    cout << "Usage: graphdb_binary_convert [input] [format] [output] [num_shards] [vid_bytes]\n";
+    return 0;
+  }
+  string input = argv[1];
+  string format = argv[2];
+  string output = argv[3];
+  size_t num_shards = argc > 4 ? boost::lexical_cast<size_t>(argv[4]) : 0;
+  size_t vid_bytes = argc > 5 ? boost::lexical_cast<size_t>(argv[5]) : 8;
+
+  bool (*parser)(edge_writer&, const char*, const char*);
+  if (format == "snap") {
+    parser = builtin_parsers::snap_range_parser<edge_writer>;
+  } else if (format == "tsv") {
+    parser = builtin_parsers::tsv_range_parser<edge_writer>;
+  } else if (format == "adj") {
+    parser = builtin_parsers::adj_range_parser<edge_writer>;
+  } else {
+    cerr << "Unrecognized format " << format << endl;
+    return 1;
+  }
+
+  binary_edge_header header;
+  if (vid_bytes == 4) {
+    header.flags |= binary_edge_header::VID32;
+  }
+  graph_shard_manager manager(num_shards > 0 ? num_shards : 1);
+  vector<binary_edge_writer> files(num_shards > 0 ? num_shards : 1);
+  for (size_t i = 0; i < files.size(); ++i) {
+    string filename = output;
+    if (num_shards > 0) {
+      header.num_shards = num_shards;
+      header.shard = i;
+      filename += "." + boost::lexical_cast<string>(i);
+    }
+    if (!files[i].open(filename, header)) {
+      cerr << "Cannot create " << filename << endl;
+      return 1;
+    }
+  }
+
+  ifstream in_file(input.c_str(), ios_base::in | ios_base::binary);
+  if (!in_file.good()) {
+    cerr << "Cannot open " << input << endl;
+    return 1;
+  }
+  boost::iostreams::filtering_stream<boost::iostreams::input> fin;
+  if (boost::ends_with(input, ".gz")) {
+    fin.push(boost::iostreams::gzip_decompressor());
+  }
+  fin.push(in_file);
+
+  edge_writer writer;
+  writer.manager = (num_shards > 0) ? &manager : NULL;
+  writer.files = &files;
+  writer.max_vid = (vid_bytes == 4) ? 0xffffffffUL : (size_t)-1;
+  writer.success = true;
+  string line;
+  size_t nlines = 0;
+  while (getline(fin, line)) {
+    ++nlines;
+    if (!line.empty() && line[line.size() - 1] == '\r') {
+      line.resize(line.size() - 1);
+    }
+    if (!line.empty() && !parser(writer, line.data(), line.data() + line.size())) {
+      cerr << "Error parsing line " << nlines << ": " << line << endl;
+    }
+    if (!writer.success) {
+      cerr << "Cannot write the edges of line " << nlines << endl;
+      return 1;
+    }
+  }
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!files[i].close()) {
+      cerr << "Cannot write " << output << endl;
+      return 1;
+    }
+  }
+  cout << "Converted " << nlines << " lines of " << input << endl;
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <graphlab/database/client/graphdb_client.hpp>
+#include <graphlab/database/admin/graphdb_admin.hpp>
+#include <graphlab/database/graphdb_config.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <boost/bind.hpp>
+using namespace std;
+using namespace graphlab;
+
+/**
+ * Measures the throughput of single vertex reads and writes through
+ * graphdb_client::async_batch as the number of requests in flight grows.
+ * Depth 1 is the synchronous API. Then measures the throughput of
+ * concurrent get_vertex() calls coalesced by graphdb_client::set_coalescing,
+ * to the vertices of one shard and to those of all the shards.
+ *
+ * Usage: graphdb_client_bench config [num_vertices] [num_ops]
+ *
+ * The servers of config must be running. Their database is reset.
+ */
+
+void bench(graphdb_client& client, const vector<graph_field>& fields,
+           size_t nverts, size_t nops, size_t depth) {
+  vector<graph_row> rows(depth);
+  vector<int> errorcodes(depth);
+  graph_row data(fields, true);
+  timer ti;
+
+  ti.start();
+  {
+    graphdb_client::async_batch batch(client, depth);
+    for (size_t i = 0; i < nops; ++i) {
+      data.get_field(0)->set_integer(i);
+      batch.set_vertex(i % nverts, data, &errorcodes[i % depth]);
+    }
+    ASSERT_EQ(batch.wait(), (size_t)0);
+  }
+  double set_time = ti.current_time();
+
+  ti.start();
+  {
+    // a slot is reused once the request which used it has completed
+    graphdb_client::async_batch batch(client, depth);
+    for (size_t i = 0; i < nops; ++i) {
+      batch.get_vertex(i % nverts, &rows[i % depth], &errorcodes[i % depth]);
+    }
+    ASSERT_EQ(batch.wait(), (size_t)0);
+  }
+  double get_time = ti.current_time();
+
+  cout << setw(10) << depth
+       << setw(16) << (size_t)(nops / set_time)
+       << setw(16) << (size_t)(nops / get_time) << endl;
+}
+
+// Gets the vertices of vids one call at a time, nops times in total.
+void coalesced_gets(graphdb_client* client, const vector<graph_vid_t>* vids,
+                    size_t first, size_t nops) {
+  graph_row row;
+  for (size_t i = 0; i < nops; ++i) {
+    ASSERT_EQ(client->get_vertex((*vids)[(first + i) % vids->size()], row), 0);
+  }
+}
+
+double coalesced_ops(graphdb_client& client, const vector<graph_vid_t>& vids,
+                     size_t nops, size_t nthreads) {
+  timer ti;
+  ti.start();
+  thread_group threads;
+  for (size_t i = 0; i < nthreads; ++i) {
+    threads.launch(boost::bind(coalesced_gets, &client, &vids,
+                               i * vids.size() / nthreads, nops / nthreads));
+  }
+  threads.join();
+  return (nops / nthreads) * nthreads / ti.current_time();
+}
+
+// The batches of each shard are sent one at a time, so the calls spread
+// over all the shards should go about num_shards() times faster.
+void bench_coalescing(graphdb_client& client, size_t nverts, size_t nops) {
+  const graph_shard_manager& manager = client.get_shard_manager();
+  vector<graph_vid_t> one_shard, all_shards;
+  for (graph_vid_t vid = 0; vid < nverts; ++vid) {
+    if (manager.get_master(vid) == manager.get_master(0)) {
+      one_shard.push_back(vid);
+    }
+    all_shards.push_back(vid);
+  }
+
+  cout << "coalesced gets, " << manager.num_shards() << " shards" << endl;
+  cout << setw(10) << "threads" << setw(16) << "1 shard ops/s"
+       << setw(16) << "all ops/s" << endl;
+  client.set_coalescing(64, 0);
+  for (size_t nthreads = 4; nthreads <= 64; nthreads *= 4) {
+    cout << setw(10) << nthreads
+         << setw(16) << (size_t)coalesced_ops(client, one_shard, nops, nthreads)
+         << setw(16) << (size_t)coalesced_ops(client, all_shards, nops, nthreads)
+         << endl;
+  }
+  client.set_coalescing(0, 0);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    cout << "Usage: graphdb_client_bench config [num_vertices] [num_ops]\n";
+    return 0;
+  }
+  graphdb_config config(argv[1]);
+  size_t nverts = argc > 2 ? boost::lexical_cast<size_t>(argv[2]) : 10000;
+  size_t nops = argc > 3 ? boost::lexical_cast<size_t>(argv[3]) : 100000;
+
+  graphdb_client client(config);
+  graphdb_admin admin(config);
+  admin.process(graphdb_admin::RESET, 0, NULL);
+
+  vector<graph_field> fields(1, graph_field("value", INT_TYPE));
+  ASSERT_EQ(client.add_vertex_field(fields[0]), 0);
+  {
+    graphdb_client::async_batch batch(client);
+    graph_row data(fields, true);
+    for (size_t i = 0; i < nverts; ++i) {
+      batch.add_vertex(i, data);
+    }
+    ASSERT_EQ(batch.wait(), (size_t)0);
+  }
+
+  cout << nverts << " vertices, " << nops << " operations" << endl;
+  cout << setw(10) << "in flight" << setw(16) << "set ops/s"
+       << setw(16) << "get ops/s" << endl;
+  for (size_t depth = 1; depth <= 4096; depth *= 4) {
+    bench(client, fields, nverts, nops, depth);
+  }
+  bench_coalescing(client, nverts, nops);
+  return 0;
+}
@@ -0,0 +1,467 @@
+#include <graphlab/database/client/ingress/ingress_pipeline.hpp>
+#include <graphlab/database/client/ingress/binary_edge_format.hpp>
+#include <graphlab/database/errno.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+using namespace std;
+using namespace graphlab;
+
+typedef ingress_pipeline::edge_insert_descriptor edge_insert_descriptor;
+typedef pair<graph_vid_t, graph_vid_t> edge_key;
+
+// Returns the 8 bytes of the value of each field of row.
+string row_bytes(const graph_row& row) {
+  string out;
+  for (size_t i = 0; i < row.num_fields(); ++i) {
+    char bytes[8] = {0};
+    memcpy(bytes, row.get_field(i)->get_raw_pointer(), sizeof(bytes));
+    out.append(bytes, sizeof(bytes));
+  }
+  return out;
+}
+
+// Stands for graphdb_client::add_edges_to_shard(), and counts each edge it is sent.
+struct edge_sink {
+  graph_shard_manager manager;
+  graphlab::mutex lock;
+  map<edge_key, size_t> edges;
+  // row_bytes() of the data of each edge
+  map<edge_key, string> values;
+  size_t batches;
+  // edges sent to another shard than their master
+  size_t misplaced;
+  // how long each batch takes to send
+  size_t delay_us;
+  // fails the first edge of every batch
+  bool fail;
+
+  edge_sink(size_t nshards) : manager(nshards), batches(0), misplaced(0),
+                              delay_us(0), fail(false) { }
+
+  bool send(graph_shard_id_t shard, const vector<edge_insert_descriptor>& batch,
+            vector<int>& errorcodes) {
+    if (delay_us > 0) {
+      usleep(delay_us);
+    }
+    lock.lock();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      edge_key key(batch[i].src, batch[i].dest);
+      ++edges[key];
+      values[key] = row_bytes(batch[i].data);
+      misplaced += (manager.get_master(batch[i].src, batch[i].dest) != shard);
+    }
+    ++batches;
+    lock.unlock();
+    if (fail) {
+      errorcodes.assign(batch.size(), 0);
+      errorcodes[0] = EINVID;
+    }
+    return true;
+  }
+
+  ingress_pipeline::send_function function() {
+    return boost::bind(&edge_sink::send, this, _1, _2, _3);
+  }
+};
+
+graph_vid_t target_of(size_t i) {
+  return 4000000000ULL + i * 37;
+}
+
+// Writes nedges edges in the snap format, after a comment line, and returns the file size.
+size_t write_edges(const string& path, size_t nedges) {
+  FILE* fp = fopen(path.c_str(), "w");
+  ASSERT_TRUE(fp != NULL);
+  fprintf(fp, "# FromNodeId\tToNodeId\n");
+  for (size_t i = 0; i < nedges; ++i) {
+    fprintf(fp, "%lu\t%llu\n", (unsigned long)i, (unsigned long long)target_of(i));
+  }
+  size_t bytes = ftell(fp);
+  fclose(fp);
+  return bytes;
+}
+
+// Checks that sink got each of the nedges edges of write_edges() once, at its master.
+void check_edges(const edge_sink& sink, size_t nedges) {
+  ASSERT_EQ(sink.edges.size(), nedges);
+  ASSERT_EQ(sink.misplaced, (size_t)0);
+  for (size_t i = 0; i < nedges; ++i) {
+    map<edge_key, size_t>::const_iterator it =
+        sink.edges.find(make_pair((graph_vid_t)i, target_of(i)));
+    ASSERT_TRUE(it != sink.edges.end());
+    ASSERT_EQ(it->second, (size_t)1);
+  }
+}
+
+// Checks the stats of a load of nedges edges from a file of bytes.
+void check_stats(const ingress_stats& stats, const edge_sink& sink,
+                 size_t nedges, size_t bytes) {
+  ASSERT_EQ(stats.read.amount, bytes);
+  ASSERT_EQ(stats.parse.amount, bytes);
+  ASSERT_EQ(stats.send.amount, nedges);
+  ASSERT_EQ(stats.vertices_sent, (size_t)0);
+  ASSERT_EQ(stats.batches_sent, sink.batches);
+  ASSERT_EQ(stats.send_errors, (size_t)0);
+  ASSERT_GT(stats.read.busy_secs, 0.0);
+  ASSERT_GT(stats.total_secs, 0.0);
+}
+
+/**
+ * Test that every edge of a mapped file, and of a stream, is sent once
+ * to its master, across chunks much smaller than the file.
+ */
+void testInputs() {
+  size_t nedges = 5000;
+  size_t nshards = 4;
+  cout << "Test inputs. Num edges = " << nedges << endl;
+  string path = "/tmp/graphdb_ingress_pipeline_test.snap";
+  size_t bytes = write_edges(path, nedges);
+  ingress_options options;
+  options.parse_threads = 3;
+  options.send_threads = 2;
+  options.chunk_bytes = 256;
+  options.max_read_bytes = 4096;
+  options.batch_edges = 64;
+  options.max_queued_edges = 1000;
+
+  {
+    edge_sink sink(nshards);
+    ingress_pipeline pipeline(sink.manager, sink.function(), "snap", options);
+    ASSERT_TRUE(pipeline.read_mapped(path));
+    const ingress_stats& stats = pipeline.finish();
+    check_edges(sink, nedges);
+    check_stats(stats, sink, nedges, bytes);
+  }
+
+  // chunks shorter than a line are carried over to the next read
+  size_t chunk_bytes[2] = {256, 8};
+  for (size_t i = 0; i < 2; ++i) {
+    options.chunk_bytes = chunk_bytes[i];
+    edge_sink sink(nshards);
+    ingress_pipeline pipeline(sink.manager, sink.function(), "snap", options);
+    ifstream in(path.c_str(), ios_base::in | ios_base::binary);
+    pipeline.read_stream(path, in);
+    const ingress_stats& stats = pipeline.finish();
+    check_edges(sink, nedges);
+    check_stats(stats, sink, nedges, bytes);
+  }
+
+  edge_sink sink(nshards);
+  ingress_pipeline pipeline(sink.manager, sink.function(), "snap", options);
+  ASSERT_FALSE(pipeline.read_mapped(path + ".missing"));
+  ASSERT_EQ(pipeline.finish().batches_sent, (size_t)0);
+  remove(path.c_str());
+}
+
+/**
+ * Test that parsers wait for a slow sender once max_queued_edges edges
+ * are queued, and that a batch larger than the queue still goes through.
+ */
+void testBackpressure() {
+  size_t nedges = 2000;
+  cout << "Test backpressure. Num edges = " << nedges << endl;
+  string path = "/tmp/graphdb_ingress_pipeline_test.snap";
+  size_t bytes = write_edges(path, nedges);
+  ingress_options options;
+  options.parse_threads = 2;
+  options.send_threads = 1;
+  options.chunk_bytes = 1024;
+  options.batch_edges = 8;
+  options.max_queued_edges = 1;
+  edge_sink sink(2);
+  sink.delay_us = 200;
+  ingress_pipeline pipeline(sink.manager, sink.function(), "snap", options);
+  ASSERT_TRUE(pipeline.read_mapped(path));
+  const ingress_stats& stats = pipeline.finish();
+  check_edges(sink, nedges);
+  check_stats(stats, sink, nedges, bytes);
+  ASSERT_GT(stats.parse.blocked_secs, 0.0);
+  ASSERT_GT(stats.send.busy_secs, 0.0);
+  remove(path.c_str());
+}
+
+/**
+ * Test that finish() only stops the pipeline once, and that the errors
+ * replied for the edges are counted.
+ */
+void testFinish() {
+  size_t nedges = 500;
+  cout << "Test finish. Num edges = " << nedges << endl;
+  string path = "/tmp/graphdb_ingress_pipeline_test.snap";
+  write_edges(path, nedges);
+  ingress_options options;
+  options.batch_edges = 100;
+  edge_sink sink(3);
+  sink.fail = true;
+  {
+    ingress_pipeline pipeline(sink.manager, sink.function(), "snap", options);
+    ASSERT_TRUE(pipeline.read_mapped(path));
+    const ingress_stats& stats = pipeline.finish();
+    ASSERT_EQ(stats.send_errors, sink.batches);
+    double total_secs = stats.total_secs;
+    usleep(10000);
+    const ingress_stats& again = pipeline.finish();
+    ASSERT_TRUE(&again == &stats);
+    ASSERT_EQ(again.total_secs, total_secs);
+    ASSERT_EQ(again.send.amount, nedges);
+    // and the destructor does not finish again
+  }
+  check_edges(sink, nedges);
+
+  // nothing read
+  edge_sink empty(3);
+  ingress_pipeline pipeline(empty.manager, empty.function(), "snap", options);
+  const ingress_stats& stats = pipeline.finish();
+  ASSERT_EQ(stats.read.amount, (size_t)0);
+  ASSERT_EQ(stats.batches_sent, (size_t)0);
+  ASSERT_EQ(empty.batches, (size_t)0);
+  remove(path.c_str());
+}
+
+// Returns the row of the columns of edge i, for write_binary_edges().
+graph_row binary_row(const vector<graph_datatypes_enum>& columns, size_t i) {
+  graph_row row;
+  row._is_vertex = false;
+  for (size_t j = 0; j < columns.size(); ++j) {
+    graph_field field("", columns[j]);
+    row.add_field(field);
+    graph_value* value = row.get_field(j);
+    if (columns[j] == INT_TYPE) {
+      value->set_integer(-3 * (graph_int_t)i);
+    } else if (columns[j] == DOUBLE_TYPE) {
+      value->set_double(i * 0.5);
+    } else {
+      value->set_vid(i + 7);
+    }
+  }
+  return row;
+}
+
+// Returns the source of edge i of write_binary_edges(), out of 4 bytes unless vid32.
+graph_vid_t binary_source(size_t i, bool vid32) {
+  return vid32 ? i : i + (1ULL << 40);
+}
+
+/**
+ * Writes nedges edges in the binary format, from binary_source(i) to
+ * target_of(i) with the values of binary_row(), into one file tagged
+ * with the master of its edges for each shard of manager if tagged, or
+ * into the first file otherwise. Returns the size of each file.
+ */
+vector<size_t> write_binary_edges(const vector<string>& paths, size_t nedges,
+                                  const binary_edge_header& header, bool tagged,
+                                  const graph_shard_manager& manager) {
+  vector<binary_edge_writer*> writers(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    binary_edge_header file_header = header;
+    file_header.num_shards = manager.num_shards();
+    file_header.shard = tagged ? i : binary_edge_header::UNTAGGED;
+    writers[i] = new binary_edge_writer();
+    ASSERT_TRUE(writers[i]->open(paths[i], file_header));
+  }
+  bool vid32 = (header.vid_bytes() == 4);
+  for (size_t i = 0; i < nedges; ++i) {
+    graph_vid_t source = binary_source(i, vid32);
+    size_t file = tagged ? manager.get_master(source, target_of(i)) : 0;
+    graph_row row = binary_row(header.columns, i);
+    ASSERT_TRUE(writers[file]->add_edge(source, target_of(i), &row));
+  }
+  vector<size_t> bytes(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    ASSERT_TRUE(writers[i]->close());
+    delete writers[i];
+    ifstream in(paths[i].c_str(), ios_base::in | ios_base::binary);
+    in.seekg(0, ios_base::end);
+    bytes[i] = in.tellg();
+  }
+  return bytes;
+}
+
+// Checks that sink got each edge of write_binary_edges() once, at its master, with its values.
+void check_binary_edges(const edge_sink& sink, size_t nedges,
+                        const binary_edge_header& header) {
+  ASSERT_EQ(sink.edges.size(), nedges);
+  ASSERT_EQ(sink.misplaced, (size_t)0);
+  bool vid32 = (header.vid_bytes() == 4);
+  for (size_t i = 0; i < nedges; ++i) {
+    edge_key key(binary_source(i, vid32), target_of(i));
+    map<edge_key, size_t>::const_iterator it = sink.edges.find(key);
+    ASSERT_TRUE(it != sink.edges.end());
+    ASSERT_EQ(it->second, (size_t)1);
+    ASSERT_TRUE(sink.values.find(key)->second == row_bytes(binary_row(header.columns, i)));
+  }
+}
+
+// Loads paths in format "bin" with options, mapped or as streams, into sink, and returns the stats.
+ingress_stats load_binary(edge_sink& sink, const vector<string>& paths,
+                          const ingress_options& options, bool mapped,
+                          const vector<graph_datatypes_enum>& edge_columns) {
+  ingress_pipeline pipeline(sink.manager, sink.function(), "bin", options);
+  pipeline.set_edge_columns(edge_columns);
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (mapped) {
+      ASSERT_TRUE(pipeline.read_mapped(paths[i]));
+    } else {
+      ifstream in(paths[i].c_str(), ios_base::in | ios_base::binary);
+      pipeline.read_stream(paths[i], in);
+    }
+  }
+  return pipeline.finish();
+}
+
+/**
+ * Test that edges written with binary_edge_writer load with their values,
+ * with vids of 4 and 8 bytes, with and without columns, and from files
+ * tagged with their shard or not.
+ */
+void testBinaryEdges() {
+  size_t nedges = 3000;
+  size_t nshards = 4;
+  cout << "Test binary edges. Num edges = " << nedges << endl;
+  graph_shard_manager manager(nshards);
+  vector<string> paths;
+  for (size_t i = 0; i < nshards; ++i) {
+    paths.push_back("/tmp/graphdb_ingress_pipeline_test." + boost::lexical_cast<string>(i) + ".bin");
+  }
+  ingress_options options;
+  options.parse_threads = 3;
+  options.chunk_bytes = 1000;
+  options.batch_edges = 64;
+  vector<graph_datatypes_enum> columns;
+  columns.push_back(INT_TYPE);
+  columns.push_back(DOUBLE_TYPE);
+  columns.push_back(VID_TYPE);
+
+  for (size_t k = 0; k < 8; ++k) {
+    binary_edge_header header;
+    header.flags = (k & 1) ? binary_edge_header::VID32 : 0;
+    if (k & 2) {
+      header.columns = columns;
+    }
+    bool tagged = (k & 4);
+    vector<string> files(paths.begin(), paths.begin() + (tagged ? nshards : 1));
+    vector<size_t> bytes = write_binary_edges(files, nedges, header, tagged, manager);
+    for (size_t mapped = 0; mapped < 2; ++mapped) {
+      edge_sink sink(nshards);
+      ingress_stats stats = load_binary(sink, files, options, mapped, columns);
+      check_binary_edges(sink, nedges, header);
+      size_t total = 0;
+      for (size_t i = 0; i < files.size(); ++i) {
+        total += bytes[i] - header.header_bytes();
+      }
+      ASSERT_EQ(stats.parse.amount, total);
+      ASSERT_EQ(stats.send.amount, nedges);
+    }
+  }
+
+  // columns which are not the edge fields
+  binary_edge_header header;
+  header.columns.push_back(DOUBLE_TYPE);
+  write_binary_edges(vector<string>(1, paths[0]), nedges, header, false, manager);
+  edge_sink sink(nshards);
+  ASSERT_EQ(load_binary(sink, vector<string>(1, paths[0]), options, true, columns).send.amount,
+            (size_t)0);
+  for (size_t i = 0; i < nshards; ++i) {
+    remove(paths[i].c_str());
+  }
+}
+
+/**
+ * Test that files with a truncated header are skipped, that the partial
+ * last record of a file is dropped, and that the edges of a file tagged
+ * with the wrong shard are still sent to their masters.
+ */
+void testBinaryErrors() {
+  size_t nedges = 1000;
+  size_t nshards = 3;
+  cout << "Test binary errors. Num edges = " << nedges << endl;
+  graph_shard_manager manager(nshards);
+  string path = "/tmp/graphdb_ingress_pipeline_test.bin";
+  vector<string> paths(1, path);
+  ingress_options options;
+  options.chunk_bytes = 512;
+  options.batch_edges = 32;
+  binary_edge_header header;
+  header.columns.push_back(INT_TYPE);
+  header.columns.push_back(VID_TYPE);
+  size_t bytes = write_binary_edges(paths, nedges, header, false, manager)[0];
+  string contents(bytes, '\0');
+  {
+    ifstream in(path.c_str(), ios_base::in | ios_base::binary);
+    in.read(&contents[0], bytes);
+  }
+
+  // cut in the fixed part, and in the column types
+  size_t cuts[4] = {1, 8, 35, header.header_bytes() - 1};
+  for (size_t i = 0; i < 4; ++i) {
+    ofstream(path.c_str(), ios_base::out | ios_base::binary).write(contents.data(), cuts[i]);
+    binary_edge_header truncated;
+    ASSERT_EQ(truncated.read(contents.data(), contents.data() + cuts[i]), (size_t)0);
+    for (size_t mapped = 0; mapped < 2; ++mapped) {
+      edge_sink sink(nshards);
+      load_binary(sink, paths, options, mapped, header.columns);
+      ASSERT_EQ(sink.edges.size(), (size_t)0);
+    }
+  }
+
+  // a partial last record
+  contents.append(header.record_bytes() - 1, '\1');
+  ofstream(path.c_str(), ios_base::out | ios_base::binary).write(contents.data(), contents.size());
+  for (size_t mapped = 0; mapped < 2; ++mapped) {
+    edge_sink sink(nshards);
+    load_binary(sink, paths, options, mapped, header.columns);
+    check_binary_edges(sink, nedges, header);
+  }
+
+  // all the edges tagged with shard 0, though most belong elsewhere, in
+  // one batch so that the sample of the tag check covers all of them
+  options.chunk_bytes = contents.size();
+  options.batch_edges = nedges;
+  header.num_shards = nshards;
+  header.shard = 0;
+  binary_edge_writer writer;
+  ASSERT_TRUE(writer.open(path, header));
+  for (size_t i = 0; i < nedges; ++i) {
+    graph_row row = binary_row(header.columns, i);
+    ASSERT_TRUE(writer.add_edge(binary_source(i, false), target_of(i), &row));
+  }
+  ASSERT_TRUE(writer.close());
+  for (size_t mapped = 0; mapped < 2; ++mapped) {
+    edge_sink sink(nshards);
+    load_binary(sink, paths, options, mapped, header.columns);
+    check_binary_edges(sink, nedges, header);
+  }
+
+  // vids which do not fit in 4 bytes are not cut
+  binary_edge_header vid32;
+  vid32.flags = binary_edge_header::VID32;
+  ASSERT_TRUE(writer.open(path, vid32));
+  ASSERT_TRUE(writer.add_edge(0xffffffffULL, 1));
+  ASSERT_FALSE(writer.add_edge(1ULL << 32, 1));
+  ASSERT_FALSE(writer.add_edge(1, 1ULL << 32));
+  ASSERT_TRUE(writer.close());
+  edge_sink sink(nshards);
+  load_binary(sink, paths, options, true, vid32.columns);
+  ASSERT_EQ(sink.edges.size(), (size_t)1);
+  ASSERT_EQ(sink.edges.count(edge_key(0xffffffffULL, 1)), (size_t)1);
+  remove(path.c_str());
+}
+
+int main(int argc, char** argv) {
+  global_logger().set_log_level(LOG_ERROR);
+  testInputs();
+  testBackpressure();
+  testFinish();
+  testBinaryEdges();
+  testBinaryErrors();
+  return 0;
+}
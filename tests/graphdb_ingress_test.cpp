@@ -6,8 +6,10 @@
 using namespace std;
 
 int main(int argc, char** argv) {
-  if (argc != 4) {
-    cout << "Usate: graphdb_ingress_test [config] [graph] [format]\n";
+  if (argc != 4 && argc != 5) {
+    cout << "Usate: graphdb_ingress_test [config] [graph] [format] [columns]\n"
+         << "  format \"vertex\" or \"edge\" loads tab separated lines with\n"
+         << "  data; columns names them, e.g. id,name,,age\n";
     return 0;
   }
 
@@ -21,6 +23,25 @@ int main(int argc, char** argv) {
 
   graphlab::timer ti;
   ti.start();
-  loader.load_from_posixfs(graphfile, format);
+  if (format == "vertex" || format == "edge") {
+    bool is_vertex = (format == "vertex");
+    graphlab::delimited_format delimited(is_vertex, is_vertex ? config.get_vertex_fields()
+                                                              : config.get_edge_fields());
+    vector<string> columns;
+    string names = argc > 4 ? argv[4] : "";
+    size_t begin = 0;
+    while (true) {
+      size_t stop = names.find(',', begin);
+      columns.push_back(names.substr(begin, stop - begin));
+      if (stop == string::npos) break;
+      begin = stop + 1;
+    }
+    if (!delimited.set_columns(columns)) {
+      return 1;
+    }
+    loader.load_delimited(graphfile, delimited);
+  } else {
+    loader.load_from_posixfs(graphfile, format);
+  }
   cout << "Ingress completed in " << ti.current_time() << " secs" << endl;
 }
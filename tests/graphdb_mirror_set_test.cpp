@@ -0,0 +1,111 @@
+#include <graphlab/database/client/graphdb_mirror_set.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <iostream>
+using namespace std;
+using namespace graphlab;
+
+/**
+ * Test that the set holds exactly the pairs inserted, while it has room.
+ */
+void testMembership() {
+  cout << "Test membership...." << endl;
+  graphdb_mirror_set set(1 << 20);
+  ASSERT_EQ(set.bytes(), (size_t)(1 << 20));
+  for (graph_vid_t vid = 0; vid < 1000; ++vid) {
+    ASSERT_TRUE(set.insert(vid, vid % 7));
+  }
+  for (graph_vid_t vid = 0; vid < 1000; ++vid) {
+    ASSERT_TRUE(set.contains(vid, vid % 7));
+    // the same vertex on another shard, and the same shard for another vertex
+    ASSERT_FALSE(set.contains(vid, vid % 7 + 1));
+    ASSERT_FALSE(set.contains(vid + 1000, vid % 7));
+    ASSERT_FALSE(set.insert(vid, vid % 7));
+  }
+  // shard 0 and vid 0 are not taken for empty entries
+  ASSERT_TRUE(set.contains(0, 0));
+
+  set.clear();
+  ASSERT_EQ(set.bytes(), (size_t)(1 << 20));
+  for (graph_vid_t vid = 0; vid < 1000; ++vid) {
+    ASSERT_FALSE(set.contains(vid, vid % 7));
+  }
+  cout << "done" << endl;
+}
+
+/**
+ * Test that a pair inserted into a full block evicts exactly one other.
+ */
+void testEviction() {
+  cout << "Test eviction...." << endl;
+  // a single block of 4 entries
+  graphdb_mirror_set set(64);
+  ASSERT_EQ(set.bytes(), (size_t)64);
+  for (graph_vid_t vid = 0; vid < 5; ++vid) {
+    ASSERT_TRUE(set.insert(vid, 3));
+  }
+  size_t found = 0;
+  for (graph_vid_t vid = 0; vid < 5; ++vid) {
+    found += set.contains(vid, 3);
+  }
+  ASSERT_EQ(found, (size_t)4);
+  // the last pair is always kept
+  ASSERT_TRUE(set.contains(4, 3));
+  cout << "done" << endl;
+}
+
+/**
+ * Test that erase() forgets only the given pair.
+ */
+void testErase() {
+  cout << "Test erase...." << endl;
+  graphdb_mirror_set set(4096);
+  ASSERT_TRUE(set.insert(42, 1));
+  ASSERT_TRUE(set.insert(42, 2));
+  ASSERT_TRUE(set.insert(43, 1));
+  set.erase(42, 1);
+  ASSERT_FALSE(set.contains(42, 1));
+  ASSERT_TRUE(set.contains(42, 2));
+  ASSERT_TRUE(set.contains(43, 1));
+  // erasing a missing pair does nothing
+  set.erase(44, 1);
+  ASSERT_TRUE(set.contains(43, 1));
+  ASSERT_TRUE(set.insert(42, 1));
+  cout << "done" << endl;
+}
+
+/**
+ * Test that an empty set remembers nothing, so that every pair is sent.
+ */
+void testEmptySet() {
+  cout << "Test size 0...." << endl;
+  graphdb_mirror_set set;
+  ASSERT_EQ(set.bytes(), (size_t)0);
+  ASSERT_TRUE(set.insert(1, 1));
+  ASSERT_TRUE(set.insert(1, 1));
+  ASSERT_FALSE(set.contains(1, 1));
+  set.erase(1, 1);
+  set.clear();
+
+  // smaller than a block
+  set.resize(63);
+  ASSERT_EQ(set.bytes(), (size_t)0);
+  ASSERT_TRUE(set.insert(1, 1));
+  ASSERT_FALSE(set.contains(1, 1));
+
+  // and back to nothing, freeing the memory
+  set.resize(1 << 16);
+  ASSERT_TRUE(set.insert(1, 1));
+  ASSERT_TRUE(set.contains(1, 1));
+  set.resize(0);
+  ASSERT_EQ(set.bytes(), (size_t)0);
+  ASSERT_FALSE(set.contains(1, 1));
+  cout << "done" << endl;
+}
+
+int main(int argc, char** argv) {
+  testMembership();
+  testEviction();
+  testErase();
+  testEmptySet();
+  return 0;
+}
@@ -0,0 +1,330 @@
+#include <graphlab/database/client/ingress/builtin_parsers.hpp>
+#include <graphlab/database/client/ingress/delimited_format.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace graphlab;
+
+// Records the edges given by the parsers.
+struct edge_list {
+  vector<pair<graph_vid_t, graph_vid_t> > edges;
+  void add_edge(graph_vid_t source, graph_vid_t target) {
+    edges.push_back(make_pair(source, target));
+  }
+};
+
+// Records the vertices and edges given by delimited_format.
+struct row_list {
+  vector<graph_vid_t> ids;
+  vector<graph_row> rows;
+  void add_vertex(graph_vid_t vid, graph_row& row) {
+    ids.push_back(vid);
+    rows.push_back(row);
+  }
+  void add_edge(graph_vid_t source, graph_vid_t target, graph_row& row) {
+    ids.push_back(source);
+    ids.push_back(target);
+    rows.push_back(row);
+  }
+};
+
+// Parses str with parser into graph.
+template <typename Parser>
+bool parse(Parser parser, edge_list& graph, const string& str) {
+  return parser(graph, str.data(), str.data() + str.size());
+}
+
+// Returns the value of str parsed by parse_uint, checking that it ends at
+// the first character that is not a digit, or -1 if it is not parsed.
+uint64_t parse_uint(const string& str) {
+  uint64_t value = 0;
+  const char* p = builtin_parsers::parse_uint(str.data(), str.data() + str.size(), value);
+  if (p == NULL) return (uint64_t)-1;
+  ASSERT_TRUE(p == str.data() + str.size() || (unsigned char)(*p - '0') > 9);
+  return value;
+}
+
+/**
+ * Test parse_uint on the lengths around the runs of eight digits
+ * converted at once, and on the integers that do not fit in 64 bits.
+ */
+void testParseUint() {
+  cout << "Test parse_uint...." << endl;
+  const char* lengths[] = {"1", "1234567", "12345678", "123456789",
+                           "1234567890123456", "12345678901234567890"};
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+    string digits(lengths[i]);
+    uint64_t expected = strtoull(digits.c_str(), NULL, 10);
+    ASSERT_EQ(parse_uint(digits), expected);
+    // followed by a separator, and by a letter inside a word of 8 bytes
+    ASSERT_EQ(parse_uint(digits + " 7"), expected);
+    ASSERT_EQ(parse_uint(digits + "x1234567"), expected);
+  }
+  ASSERT_EQ(parse_uint("18446744073709551615"), (uint64_t)18446744073709551615ULL);
+  ASSERT_EQ(parse_uint("00000000000000000042"), (uint64_t)42);
+  // 20 digits above 2^64 - 1, and 21 digits
+  ASSERT_EQ(parse_uint("18446744073709551616"), (uint64_t)-1);
+  ASSERT_EQ(parse_uint("99999999999999999999"), (uint64_t)-1);
+  ASSERT_EQ(parse_uint("123456789012345678901"), (uint64_t)-1);
+  ASSERT_EQ(parse_uint("000000000000000000001"), (uint64_t)-1);
+  ASSERT_EQ(parse_uint("99999999999999999999999 1"), (uint64_t)-1);
+
+  // leading blanks and commas are skipped, nothing else is
+  ASSERT_EQ(parse_uint(" \t,42"), (uint64_t)42);
+  ASSERT_EQ(parse_uint(", ,7"), (uint64_t)7);
+  ASSERT_EQ(parse_uint(""), (uint64_t)-1);
+  ASSERT_EQ(parse_uint("  "), (uint64_t)-1);
+  ASSERT_EQ(parse_uint("-1"), (uint64_t)-1);
+  ASSERT_EQ(parse_uint("x1"), (uint64_t)-1);
+  cout << "done" << endl;
+}
+
+/**
+ * Test the snap and tsv parsers on valid and invalid lines.
+ */
+void testEdgeLines() {
+  cout << "Test snap and tsv lines...." << endl;
+  edge_list graph;
+  ASSERT_TRUE(parse(builtin_parsers::snap_range_parser<edge_list>, graph, "1 2"));
+  ASSERT_TRUE(parse(builtin_parsers::snap_range_parser<edge_list>, graph, "\t3\t4"));
+  ASSERT_TRUE(parse(builtin_parsers::snap_range_parser<edge_list>, graph, "5 6\r"));
+  ASSERT_TRUE(parse(builtin_parsers::snap_range_parser<edge_list>, graph,
+                    "12345678901 123456789012345678"));
+  ASSERT_TRUE(parse(builtin_parsers::snap_range_parser<edge_list>, graph, "# 7 8"));
+  ASSERT_TRUE(parse(builtin_parsers::snap_range_parser<edge_list>, graph, ""));
+  // self edges are dropped
+  ASSERT_TRUE(parse(builtin_parsers::snap_range_parser<edge_list>, graph, "9 9"));
+  ASSERT_EQ(graph.edges.size(), (size_t)4);
+  ASSERT_TRUE(graph.edges[1] == make_pair((graph_vid_t)3, (graph_vid_t)4));
+  ASSERT_TRUE(graph.edges[2] == make_pair((graph_vid_t)5, (graph_vid_t)6));
+  ASSERT_TRUE(graph.edges[3] == make_pair((graph_vid_t)12345678901ULL,
+                                          (graph_vid_t)123456789012345678ULL));
+
+  graph.edges.clear();
+  ASSERT_FALSE(parse(builtin_parsers::snap_range_parser<edge_list>, graph, "1"));
+  ASSERT_FALSE(parse(builtin_parsers::snap_range_parser<edge_list>, graph, "a b"));
+  ASSERT_FALSE(parse(builtin_parsers::snap_range_parser<edge_list>, graph,
+                     "1 99999999999999999999999"));
+  ASSERT_FALSE(parse(builtin_parsers::tsv_range_parser<edge_list>, graph,
+                     "99999999999999999999999\t1"));
+  ASSERT_FALSE(parse(builtin_parsers::tsv_range_parser<edge_list>, graph, "# 1 2"));
+  ASSERT_TRUE(parse(builtin_parsers::tsv_range_parser<edge_list>, graph, "1\t2"));
+  ASSERT_EQ(graph.edges.size(), (size_t)1);
+  cout << "done" << endl;
+}
+
+/**
+ * Test that the adj parser adds the listed targets, and fails the lines
+ * whose count disagrees with them.
+ */
+void testAdjLines() {
+  cout << "Test adj lines...." << endl;
+  edge_list graph;
+  ASSERT_TRUE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "1 3 2 3 4"));
+  ASSERT_TRUE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "5,2,6,7"));
+  ASSERT_TRUE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "8 1 9\r"));
+  // no targets, a source alone, and a self edge
+  ASSERT_TRUE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "10 0"));
+  ASSERT_TRUE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "11 "));
+  ASSERT_TRUE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "12 1 12"));
+  ASSERT_EQ(graph.edges.size(), (size_t)6);
+  ASSERT_TRUE(graph.edges[3] == make_pair((graph_vid_t)5, (graph_vid_t)6));
+  ASSERT_TRUE(graph.edges[5] == make_pair((graph_vid_t)8, (graph_vid_t)9));
+
+  ASSERT_FALSE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "1 2 2 3 4"));
+  ASSERT_FALSE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "1 4 2 3 4"));
+  ASSERT_FALSE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "1 1"));
+  ASSERT_FALSE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "x 1 2"));
+  // a target or a count that is not a vid
+  ASSERT_FALSE(parse(builtin_parsers::adj_range_parser<edge_list>, graph,
+                     "1 2 3 99999999999999999999999"));
+  ASSERT_FALSE(parse(builtin_parsers::adj_range_parser<edge_list>, graph,
+                     "1 99999999999999999999999 2"));
+  ASSERT_FALSE(parse(builtin_parsers::adj_range_parser<edge_list>, graph, "1 1 2 x"));
+  cout << "done" << endl;
+}
+
+/**
+ * Test that split_lines() cuts after line terminators, "\r\n" included.
+ */
+void testSplitLines() {
+  cout << "Test split_lines...." << endl;
+  string text = "1 2\r\n3 4\r\n\r\n5 6";
+  vector<pair<const char*, const char*> > ranges;
+  builtin_parsers::split_lines(text.data(), text.data() + text.size(), 1, ranges);
+  ASSERT_EQ(ranges.size(), (size_t)4);
+  ASSERT_EQ(string(ranges[0].first, ranges[0].second), "1 2\r\n");
+  ASSERT_EQ(string(ranges[2].first, ranges[2].second), "\r\n");
+  ASSERT_EQ(string(ranges[3].first, ranges[3].second), "5 6");
+
+  // the whole text in one range
+  ranges.clear();
+  builtin_parsers::split_lines(text.data(), text.data() + text.size(), 1 << 20, ranges);
+  ASSERT_EQ(ranges.size(), (size_t)1);
+  ASSERT_TRUE(ranges[0].second == text.data() + text.size());
+
+  // each line without its terminator parses to its edge, as in ingress_worker
+  edge_list graph;
+  ranges.clear();
+  builtin_parsers::split_lines(text.data(), text.data() + text.size(), 1, ranges);
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    const char* eol = ranges[i].second;
+    if (eol != ranges[i].first && eol[-1] == '\n') --eol;
+    if (eol != ranges[i].first && eol[-1] == '\r') --eol;
+    ASSERT_TRUE(builtin_parsers::snap_range_parser(graph, ranges[i].first, eol));
+  }
+  ASSERT_EQ(graph.edges.size(), (size_t)3);
+  cout << "done" << endl;
+}
+
+// Returns the value of the INT field of str parsed as its only column, or
+// -1 if the line fails.
+graph_int_t parse_int(const delimited_format& format, const string& str) {
+  row_list graph;
+  if (!format.parse(graph, str.data(), str.data() + str.size())) return -1;
+  graph_int_t value;
+  ASSERT_TRUE(graph.rows.back().get_field(0)->get_integer(&value));
+  return value;
+}
+
+/**
+ * Test that delimited_format parses the values of each type into their
+ * fields, and fails the lines with invalid values or ids.
+ */
+void testDelimitedVertices() {
+  cout << "Test delimited vertices...." << endl;
+  vector<graph_field> fields;
+  fields.push_back(graph_field("name", STRING_TYPE));
+  fields.push_back(graph_field("age", INT_TYPE));
+  fields.push_back(graph_field("score", DOUBLE_TYPE));
+  fields.push_back(graph_field("parent", VID_TYPE));
+  delimited_format format(true, fields, '\t');
+  ASSERT_FALSE(format.set_columns("id\tname\tunknown"));
+  ASSERT_FALSE(format.set_columns("name\tage"));
+  ASSERT_TRUE(format.set_columns("id\tname\tage\t\tscore\tparent"));
+
+  row_list graph;
+  string lines[] = {"1\talice\t30\tskipped\t0.5\t7",
+                    // NULL values, empty or missing
+                    "2\t\t\t\t",
+                    "3",
+                    // CRLF, and values past the last column
+                    " 4 \tbob\t-12\t\t1e3\t8\r",
+                    "5\tcarol\t+7\t\t\t\textra\tcolumns",
+                    "# 6\tcomment",
+                    ""};
+  for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+    ASSERT_TRUE(format.parse(graph, lines[i].data(), lines[i].data() + lines[i].size()));
+  }
+  ASSERT_EQ(graph.rows.size(), (size_t)5);
+  ASSERT_EQ(graph.ids[3], (graph_vid_t)4);
+  string name;
+  graph_int_t age;
+  graph_double_t score;
+  graph_vid_t parent;
+  ASSERT_TRUE(graph.rows[0].get_field(0)->get_string(&name));
+  ASSERT_EQ(name, "alice");
+  ASSERT_TRUE(graph.rows[0].get_field(1)->get_integer(&age));
+  ASSERT_EQ(age, (graph_int_t)30);
+  ASSERT_TRUE(graph.rows[0].get_field(2)->get_double(&score));
+  ASSERT_EQ(score, 0.5);
+  ASSERT_TRUE(graph.rows[0].get_field(3)->get_vid(&parent));
+  ASSERT_EQ(parent, (graph_vid_t)7);
+  for (size_t i = 1; i <= 2; ++i) {
+    ASSERT_TRUE(graph.rows[i].is_vertex());
+    ASSERT_TRUE(graph.rows[i].is_null());
+  }
+  ASSERT_TRUE(graph.rows[3].get_field(0)->get_string(&name));
+  ASSERT_EQ(name, "bob");
+  ASSERT_TRUE(graph.rows[3].get_field(1)->get_integer(&age));
+  ASSERT_EQ(age, (graph_int_t)-12);
+  ASSERT_TRUE(graph.rows[3].get_field(3)->get_vid(&parent));
+  ASSERT_EQ(parent, (graph_vid_t)8);
+  ASSERT_TRUE(graph.rows[4].get_field(1)->get_integer(&age));
+  ASSERT_EQ(age, (graph_int_t)7);
+  ASSERT_TRUE(graph.rows[4].get_field(2)->is_null());
+
+  // missing or invalid ids, and invalid values
+  string invalid[] = {"\talice", "x\talice", "-1\talice",
+                      "99999999999999999999999\talice",
+                      "1\talice\tthirty", "1\talice\t3 0",
+                      "1\talice\t30\t\tnan?", "1\talice\t30\t\t0.5\t-7"};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+    ASSERT_FALSE(format.parse(graph, invalid[i].data(), invalid[i].data() + invalid[i].size()));
+  }
+  ASSERT_EQ(graph.rows.size(), (size_t)5);
+  cout << "done" << endl;
+}
+
+/**
+ * Test the range of the INT fields parsed by delimited_format.
+ */
+void testDelimitedIntegers() {
+  cout << "Test delimited integers...." << endl;
+  vector<graph_field> fields(1, graph_field("value", INT_TYPE));
+  delimited_format format(true, fields, ',');
+  ASSERT_TRUE(format.set_columns("value,id"));
+  ASSERT_EQ(parse_int(format, "0,1"), (graph_int_t)0);
+  ASSERT_EQ(parse_int(format, "-0,1"), (graph_int_t)0);
+  ASSERT_EQ(parse_int(format, "9223372036854775807,1"),
+            std::numeric_limits<graph_int_t>::max());
+  ASSERT_EQ(parse_int(format, "-9223372036854775808,1"),
+            std::numeric_limits<graph_int_t>::min());
+  ASSERT_EQ(parse_int(format, "-9223372036854775807,1"),
+            -std::numeric_limits<graph_int_t>::max());
+  // out of range, with and without overflowing 64 bits
+  ASSERT_EQ(parse_int(format, "9223372036854775808,1"), (graph_int_t)-1);
+  ASSERT_EQ(parse_int(format, "-9223372036854775809,1"), (graph_int_t)-1);
+  ASSERT_EQ(parse_int(format, "18446744073709551615,1"), (graph_int_t)-1);
+  ASSERT_EQ(parse_int(format, "99999999999999999999999,1"), (graph_int_t)-1);
+  ASSERT_EQ(parse_int(format, "-99999999999999999999999,1"), (graph_int_t)-1);
+  ASSERT_EQ(parse_int(format, "--1,1"), (graph_int_t)-1);
+  ASSERT_EQ(parse_int(format, "-,1"), (graph_int_t)-1);
+  cout << "done" << endl;
+}
+
+/**
+ * Test that delimited_format adds edges between their ids, without self
+ * edges.
+ */
+void testDelimitedEdges() {
+  cout << "Test delimited edges...." << endl;
+  vector<graph_field> fields(1, graph_field("weight", DOUBLE_TYPE));
+  delimited_format format(false, fields, ',');
+  ASSERT_FALSE(format.set_columns("source,weight"));
+  ASSERT_FALSE(format.set_columns("source,source,target"));
+  ASSERT_TRUE(format.set_columns("weight,target,source"));
+  row_list graph;
+  string lines[] = {"0.25,2,1", ",3,1\r", "1.0,4,4"};
+  for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+    ASSERT_TRUE(format.parse(graph, lines[i].data(), lines[i].data() + lines[i].size()));
+  }
+  ASSERT_EQ(graph.rows.size(), (size_t)2);
+  ASSERT_EQ(graph.ids[0], (graph_vid_t)1);
+  ASSERT_EQ(graph.ids[1], (graph_vid_t)2);
+  ASSERT_TRUE(graph.rows[0].is_edge());
+  graph_double_t weight;
+  ASSERT_TRUE(graph.rows[0].get_field(0)->get_double(&weight));
+  ASSERT_EQ(weight, 0.25);
+  ASSERT_TRUE(graph.rows[1].get_field(0)->is_null());
+  // a missing target
+  string missing = "0.5,,1";
+  ASSERT_FALSE(format.parse(graph, missing.data(), missing.data() + missing.size()));
+  missing = "0.5";
+  ASSERT_FALSE(format.parse(graph, missing.data(), missing.data() + missing.size()));
+  cout << "done" << endl;
+}
+
+int main(int argc, char** argv) {
+  testParseUint();
+  testEdgeLines();
+  testAdjLines();
+  testSplitLines();
+  testDelimitedVertices();
+  testDelimitedIntegers();
+  testDelimitedEdges();
+  return 0;
+}
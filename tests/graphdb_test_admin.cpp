@@ -4,7 +4,7 @@ using namespace std;
 int main(int argc, const char *argv[])
 {
   if (argc < 3) {
-    cout << "Usage graphdb_admin config [START | RESET] [args...]" << endl;
+    cout << "Usage graphdb_admin config [START | RESET | FREEZE | SAVE dir | LOAD dir] [args...]" << endl;
     return 0;
   }
   graphlab::graphdb_config config(argv[1]);
@@ -4,7 +4,10 @@
 #include <graphlab/database/graphdb_config.hpp>
 #include <graphlab/database/util/graphdb_util.hpp>
 #include <graphlab/logger/logger.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <boost/bind.hpp>
 #include <algorithm>
+#include <set>
 
 using namespace std;
 
@@ -126,6 +129,273 @@ void test_ring_graph(graphlab::graphdb_client& client) {
 }
 
 
+// Gets, or sets if value is not empty, the title of each vertex of vids
+// one call at a time, checking the titles got against "vertex<vid>".
+void coalesced_calls(graphlab::graphdb_client* client,
+                     vector<graphlab::graph_vid_t> vids,
+                     string value) {
+  for (size_t i = 0; i < vids.size(); ++i) {
+    graphlab::graph_row row;
+    if (value.empty()) {
+      ASSERT_EQ(client->get_vertex(vids[i], row), 0);
+      string actual;
+      ASSERT_TRUE(row.get_field(0)->get_string(&actual));
+      ASSERT_EQ(actual, "vertex" + boost::lexical_cast<string>(vids[i]));
+    } else {
+      ASSERT_EQ(client->get_vertex(vids[i], row), 0);
+      ASSERT_TRUE(row.get_field(0)->set_string(value));
+      ASSERT_EQ(client->set_vertex(vids[i], row), 0);
+    }
+  }
+}
+
+// Concurrent get_vertex() and set_vertex() calls are batched per shard and
+// each gets its own result. Runs on the titles set by test_ring_graph().
+void test_coalescing(graphlab::graphdb_client& client, size_t nverts) {
+  cout << "Coalesce concurrent calls..." << endl;
+  // vertices of the master shard of vertex 0
+  const graphlab::graph_shard_manager& manager = client.get_shard_manager();
+  vector<graphlab::graph_vid_t> same_shard;
+  for (graphlab::graph_vid_t vid = 0; vid < nverts; ++vid) {
+    if (manager.get_master(vid) == manager.get_master(0)) {
+      same_shard.push_back(vid);
+    }
+  }
+  size_t nthreads = 8;
+  ASSERT_TRUE(same_shard.size() >= nthreads);
+
+  // a full batch is sent at once, long before the delay
+  client.set_coalescing(nthreads, 60 * 1000000);
+  size_t batches = client.num_coalesced_batches();
+  graphlab::timer ti;
+  ti.start();
+  graphlab::thread_group threads;
+  for (size_t i = 0; i < nthreads; ++i) {
+    threads.launch(boost::bind(coalesced_calls, &client,
+                               vector<graphlab::graph_vid_t>(1, same_shard[i]), string()));
+  }
+  threads.join();
+  ASSERT_EQ(client.num_coalesced_batches(), batches + 1);
+  ASSERT_LT(ti.current_time(), 30);
+
+  // a batch that does not fill up is sent after the delay
+  client.set_coalescing(nthreads, 20000);
+  batches = client.num_coalesced_batches();
+  ti.start();
+  for (size_t i = 0; i < nthreads / 2; ++i) {
+    threads.launch(boost::bind(coalesced_calls, &client,
+                               vector<graphlab::graph_vid_t>(1, same_shard[i]), string()));
+  }
+  threads.join();
+  ASSERT_GE(client.num_coalesced_batches(), batches + 1);
+  ASSERT_LE(client.num_coalesced_batches(), batches + nthreads / 2);
+  ASSERT_LT(ti.current_time(), 30);
+
+  // without delay, calls share a batch only while another one is in
+  // flight, which depends on the latency of the servers; all are answered
+  // and the sets are applied
+  client.set_coalescing(nthreads, 0);
+  batches = client.num_coalesced_batches();
+  size_t ncalls = 0;
+  for (size_t i = 0; i < nthreads; ++i) {
+    vector<graphlab::graph_vid_t> vids;
+    for (graphlab::graph_vid_t vid = i; vid < nverts; vid += nthreads) {
+      vids.push_back(vid);
+    }
+    ncalls += vids.size();
+    threads.launch(boost::bind(coalesced_calls, &client, vids, string()));
+  }
+  threads.join();
+  ASSERT_LE(client.num_coalesced_batches(), batches + ncalls);
+  for (size_t i = 0; i < nthreads; ++i) {
+    vector<graphlab::graph_vid_t> vids;
+    for (graphlab::graph_vid_t vid = i; vid < nverts; vid += nthreads) {
+      vids.push_back(vid);
+    }
+    threads.launch(boost::bind(coalesced_calls, &client, vids, string("coalesced")));
+  }
+  threads.join();
+  client.set_coalescing(0, 0);
+  for (graphlab::graph_vid_t vid = 0; vid < nverts; ++vid) {
+    graphlab::graph_row row;
+    ASSERT_EQ(client.get_vertex(vid, row), 0);
+    string actual;
+    ASSERT_TRUE(row.get_field(0)->get_string(&actual));
+    ASSERT_EQ(actual, "coalesced");
+  }
+  cout << "done" << endl;
+}
+
+
+// A scanner pages every shard to completion, returning each vertex and
+// each edge once, and continues from its token in another scanner. Runs
+// on the ring graph of test_ring_graph().
+void test_scan(graphlab::graphdb_client& client, size_t nverts) {
+  typedef graphlab::graph_database::scan_descriptor scan_descriptor;
+  cout << "Scan the shards..." << endl;
+  graphlab::graph_row_filter titles;
+  titles.select(0);
+  vector<size_t> seen(nverts, 0);
+  size_t nrows = 0;
+  {
+    // chunks much smaller than the shards
+    graphlab::graphdb_client::scanner scanner(client, true, titles, 7);
+    scan_descriptor desc;
+    graphlab::graphdb_client::scanner::resume_token token;
+    while (nrows < nverts / 3 && scanner.next(desc)) {
+      ASSERT_LT(desc.id, nverts);
+      ASSERT_EQ(desc.data.num_fields(), (size_t)1);
+      ++seen[desc.id];
+      ++nrows;
+    }
+    token = scanner.token();
+
+    graphlab::graphdb_client::scanner rest(client, true, titles, 7);
+    rest.resume(token);
+    while (rest.next(desc)) {
+      ASSERT_LT(desc.id, nverts);
+      ++seen[desc.id];
+      ++nrows;
+    }
+    ASSERT_EQ(rest.error(), 0);
+  }
+  ASSERT_EQ(nrows, nverts);
+  for (size_t i = 0; i < nverts; ++i) {
+    ASSERT_EQ(seen[i], (size_t)1);
+  }
+
+  // the edges, in chunks bounded by bytes
+  graphlab::graphdb_client::scanner edges(client, false, graphlab::graph_row_filter(), 4096, 1);
+  scan_descriptor desc;
+  set<graphlab::graph_eid_t> eids;
+  while (edges.next(desc)) {
+    ASSERT_TRUE(eids.insert(desc.id).second);
+    ASSERT_TRUE(desc.target == (desc.source + 1) % nverts ||
+                desc.source == (desc.target + 1) % nverts);
+  }
+  ASSERT_EQ(edges.error(), 0);
+  ASSERT_EQ(eids.size(), 2 * nverts);
+  cout << "done" << endl;
+}
+
+
+// Edges added by another client are seen by get_vertex_adj() of a client
+// which already looked the vertex up.
+void test_two_clients(graphlab::graphdb_config& config) {
+  typedef graphlab::graph_database::vertex_adj_descriptor vertex_adj_descriptor;
+  graphlab::graphdb_client reader(config);
+  graphlab::graphdb_client writer(config);
+  graphlab::graph_row empty_edata;
+  empty_edata._is_vertex = false;
+
+  cout << "Get adjacency across clients..." << endl;
+  // a star around vertex 0, whose edges spread over the shards
+  size_t nverts = 100;
+  for (size_t i = 1; i < nverts; ++i) {
+    ASSERT_EQ(writer.add_edge(0, i, empty_edata), 0);
+    vertex_adj_descriptor out_edges;
+    ASSERT_EQ(reader.get_vertex_adj(0, false, out_edges), 0);
+    ASSERT_EQ(out_edges.size(), i);
+
+    vector<graphlab::graph_vid_t> vids(1, 0);
+    vector<vertex_adj_descriptor> out;
+    vector<int> errorcodes;
+    ASSERT_TRUE(reader.get_vertices_adj(vids, false, out, errorcodes));
+    ASSERT_EQ(out[0].size(), i);
+  }
+
+  // the cache sees the edges of other clients once cleared
+  reader.set_mirror_cache_size(1000);
+  vertex_adj_descriptor cached;
+  ASSERT_EQ(reader.get_vertex_adj(0, false, cached), 0);
+  ASSERT_EQ(writer.add_edge(0, nverts, empty_edata), 0);
+  reader.clear_mirror_cache();
+  vertex_adj_descriptor out_edges;
+  ASSERT_EQ(reader.get_vertex_adj(0, false, out_edges), 0);
+  ASSERT_EQ(out_edges.size(), nverts);
+  cout << "done" << endl;
+}
+
+
+// A vertex read again after a field is added has the new field, whether the
+// client read it before the add or not.
+void test_add_field(graphlab::graphdb_config& config) {
+  graphlab::graphdb_client client(config);
+  graphlab::graphdb_client other(config);
+  cout << "Get vertices across a new field..." << endl;
+  graphlab::graph_field name("name", graphlab::STRING_TYPE);
+  ASSERT_EQ(client.add_vertex_field(name), 0);
+  vector<graphlab::graph_field> fields = client.get_vertex_fields();
+  graphlab::graph_row data(fields, true);
+  data.get_field(0)->set_string("seven");
+  ASSERT_EQ(client.add_vertex(7, data), 0);
+
+  graphlab::graph_row out;
+  ASSERT_EQ(client.get_vertex(7, out), 0);
+  ASSERT_EQ(other.get_vertex(7, out), 0);
+  ASSERT_EQ(out.num_fields(), 1);
+  graphlab::graph_field age("age", graphlab::INT_TYPE);
+  ASSERT_EQ(client.add_vertex_field(age), 0);
+  for (size_t i = 0; i < 2; ++i) {
+    graphlab::graph_row row;
+    ASSERT_EQ(client.get_vertex(7, row), 0);
+    ASSERT_EQ(row.num_fields(), 2);
+    ASSERT_TRUE(row.get_field(1)->is_null());
+    graphlab::graph_row other_row;
+    ASSERT_EQ(other.get_vertex(7, other_row), 0);
+    ASSERT_EQ(other_row.num_fields(), 2);
+  }
+  cout << "done" << endl;
+}
+
+
+// The mirrors remembered by add_edges() are registered again after the
+// shards are reset, once forgotten.
+void test_known_mirrors(graphlab::graphdb_client& client, graphlab::graphdb_admin& admin) {
+  typedef graphlab::graph_database::edge_insert_descriptor edge_insert_descriptor;
+  typedef graphlab::graph_database::vertex_insert_descriptor vertex_insert_descriptor;
+  typedef graphlab::graph_database::vertex_adj_descriptor vertex_adj_descriptor;
+  cout << "Add edges with known mirrors..." << endl;
+  client.set_known_mirrors_bytes(1 << 20);
+  vector<edge_insert_descriptor> edges;
+  graphlab::graph_row empty_edata;
+  empty_edata._is_vertex = false;
+  size_t nverts = 100;
+  for (size_t i = 1; i < nverts; ++i) {
+    edge_insert_descriptor e;
+    e.data = empty_edata;
+    e.src = 0;
+    e.dest = i;
+    edges.push_back(e);
+  }
+  // the vertices are known to their masters, which are then asked only
+  // for the mirrors they know
+  vector<vertex_insert_descriptor> vertices(nverts);
+  for (size_t i = 0; i < nverts; ++i) {
+    vertices[i].vid = i;
+  }
+  vector<int> errorcodes;
+  for (size_t round = 0; round < 2; ++round) {
+    admin.process(graphlab::graphdb_admin::RESET, 0, NULL);
+    client.clear_known_mirrors();
+    ASSERT_TRUE(client.add_vertices(vertices, errorcodes));
+    ASSERT_TRUE(client.add_edges(edges, errorcodes));
+    // the second batch sends no mirrors
+    ASSERT_TRUE(client.add_edges(edges, errorcodes));
+    vertex_adj_descriptor out_edges;
+    ASSERT_EQ(client.get_vertex_adj(0, false, out_edges), 0);
+    ASSERT_EQ(out_edges.size(), 2 * (nverts - 1));
+    for (size_t i = 1; i < nverts; ++i) {
+      vertex_adj_descriptor in_edges;
+      ASSERT_EQ(client.get_vertex_adj(i, true, in_edges), 0);
+      ASSERT_EQ(in_edges.size(), 2);
+    }
+  }
+  client.set_known_mirrors_bytes(0);
+  cout << "done" << endl;
+}
+
+
 void test_random_graph(graphlab::graphdb_client& client,
                        size_t expected_nverts = 100000,
                        size_t expected_nedges = 5000000) {
@@ -218,6 +488,22 @@ int main(int argc, char** argv) {
 
   test_ring_graph(client);
 
+  test_coalescing(client, 1000);
+
+  test_scan(client, 1000);
+
+  // reset db 
+  admin.process(graphlab::graphdb_admin::RESET, 0, NULL);
+
+  test_two_clients(config);
+
+  // reset db 
+  admin.process(graphlab::graphdb_admin::RESET, 0, NULL);
+
+  test_add_field(config);
+
+  test_known_mirrors(client, admin);
+
   // reset db 
   admin.process(graphlab::graphdb_admin::RESET, 0, NULL);
 
@@ -1,13 +1,35 @@
 #include <graphlab/database/server/graphdb_server.hpp>
+#include <graphlab/database/graphdb_query_object.hpp>
+#include <graphlab/database/graphdb_config.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
 #include <graphlab/logger/logger.hpp>
 
 #include <fault/query_object.hpp>
 #include <fault/query_object_server_process.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
 
 #include <vector>
+#include <cstdlib>
 
 using namespace graphlab;
+
+// The connection of a shard to the other shards. Traversals only send
+// from the thread of the shard, aggregations from the request being served.
+struct peer_connection {
+  graphdb_query_object queryobj;
+  mutex lock;
+  peer_connection(graphdb_config& config) : queryobj(config) { }
+};
+
+static void query_peers(peer_connection* peers,
+                        const graph_traversal::request_list& requests,
+                        std::vector<std::string>& replies) {
+  peers->lock.lock();
+  peers->queryobj.query_each(requests, replies);
+  peers->lock.unlock();
+}
+
 static libfault::query_object* factory(std::string objectkey, 
                                        std::vector<std::string> zkhosts,
                                        std::string prefix,
@@ -16,6 +38,33 @@ static libfault::query_object* factory(std::string objectkey,
   graph_shard_id_t shardid = boost::lexical_cast<graph_shard_id_t>(objectkey);
   bool is_master = (create_flags & QUERY_OBJECT_CREATE_MASTER);
   graphdb_server* server = new graphdb_server(shardid, is_master);
+
+  // Masters log their updates if GRAPHDB_LOG_DIR is set. The group commit
+  // delay (GRAPHDB_SYNC_DELAY_MS, default 0) and the log size triggering a
+  // checkpoint (GRAPHDB_CHECKPOINT_MB, default 64) are optional.
+  const char* logdir = getenv("GRAPHDB_LOG_DIR");
+  if (is_master && logdir != NULL) {
+    const char* delay = getenv("GRAPHDB_SYNC_DELAY_MS");
+    const char* checkpoint_mb = getenv("GRAPHDB_CHECKPOINT_MB");
+    size_t max_delay_ms = delay ? boost::lexical_cast<size_t>(delay) : 0;
+    size_t checkpoint_bytes =
+        (checkpoint_mb ? boost::lexical_cast<size_t>(checkpoint_mb) : 64) << 20;
+    if (!server->open_log(logdir, max_delay_ms, checkpoint_bytes)) {
+      logstream(LOG_FATAL) << "Unable to recover shard " << shardid
+                           << " from " << logdir << std::endl;
+    }
+  }
+
+  // Traversals exchange their frontier with the other shards of the
+  // database configured in GRAPHDB_CONFIG.
+  const char* config_path = getenv("GRAPHDB_CONFIG");
+  if (config_path != NULL) {
+    graphdb_config config(config_path);
+    // lives as long as the process, like the server
+    peer_connection* peers = new peer_connection(config);
+    server->set_peers(graph_shard_manager(config.get_nshards()),
+                      boost::bind(query_peers, peers, _1, _2));
+  }
   return server;
 }
 
@@ -0,0 +1,160 @@
+#ifndef GRAPHLAB_TESTS_GRAPHDB_TEST_SHARDS_HPP
+#define GRAPHLAB_TESTS_GRAPHDB_TEST_SHARDS_HPP
+#include <graphlab/database/server/graphdb_server.hpp>
+#include <graphlab/database/graph_traversal.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <boost/bind.hpp>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Helpers running graphdb_server shards in one process, which send to
+// each other like the shards of a deployment.
+namespace graphlab {
+struct test_edge {
+  graph_vid_t source, target;
+  graph_int_t weight;
+};
+
+// Sends an update to server and checks the reply.
+inline void update(graphdb_server& server, QueryMessage& qm) {
+  char* reply;
+  size_t replylen;
+  ASSERT_TRUE(server.update(qm.message(), qm.length(), &reply, &replylen));
+  free(reply);
+  free(qm.message());
+}
+
+// Queries the shard of each request, as the shards of one process.
+inline void scatter(std::vector<graphdb_server*>* servers,
+                    const graph_traversal::request_list& requests,
+                    std::vector<std::string>& replies) {
+  replies.resize(requests.size());
+  for (size_t i = 0; i < requests.size(); ++i) {
+    std::string msg = requests[i].second;
+    char* reply;
+    size_t replylen;
+    (*servers)[requests[i].first]->query(&msg[0], msg.length(), &reply, &replylen);
+    replies[i].assign(reply, replylen);
+    free(reply);
+  }
+}
+
+/**
+ * Serves the requests of each shard with a single thread, as a query
+ * object does, and sends the requests of a scatter at the same time. A
+ * shard waiting for another one while serving a request would deadlock.
+ */
+struct shard_workers {
+  struct job {
+    graph_shard_id_t shard;
+    std::string msg;
+    std::string reply;
+    bool done;
+  };
+
+  std::vector<graphdb_server*>* servers;
+  std::vector<std::deque<job*> > queues;
+  bool stopping;
+  mutex lock;
+  conditional cond;
+  thread_group threads;
+
+  shard_workers(std::vector<graphdb_server*>* servers)
+      : servers(servers), queues(servers->size()), stopping(false) {
+    for (size_t i = 0; i < servers->size(); ++i) {
+      threads.launch(boost::bind(&shard_workers::serve, this, i));
+    }
+  }
+
+  ~shard_workers() {
+    lock.lock();
+    stopping = true;
+    cond.broadcast();
+    lock.unlock();
+    threads.join();
+  }
+
+  void serve(size_t shard) {
+    lock.lock();
+    while (true) {
+      while (queues[shard].empty() && !stopping) {
+        cond.wait(lock);
+      }
+      if (queues[shard].empty()) {
+        break;
+      }
+      job* j = queues[shard].front();
+      queues[shard].pop_front();
+      lock.unlock();
+      char* reply;
+      size_t replylen;
+      (*servers)[shard]->query(&j->msg[0], j->msg.length(), &reply, &replylen);
+      lock.lock();
+      j->reply.assign(reply, replylen);
+      free(reply);
+      j->done = true;
+      cond.broadcast();
+    }
+    lock.unlock();
+  }
+
+  void scatter(const graph_traversal::request_list& requests, std::vector<std::string>& replies) {
+    std::vector<job> jobs(requests.size());
+    lock.lock();
+    for (size_t i = 0; i < requests.size(); ++i) {
+      jobs[i].shard = requests[i].first;
+      jobs[i].msg = requests[i].second;
+      jobs[i].done = false;
+      queues[jobs[i].shard].push_back(&jobs[i]);
+    }
+    cond.broadcast();
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      while (!jobs[i].done) {
+        cond.wait(lock);
+      }
+    }
+    lock.unlock();
+    replies.resize(requests.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      replies[i].swap(jobs[i].reply);
+    }
+  }
+};
+
+// Stores the edges on nshards in-process servers, placed like graphdb_client does.
+inline void load_graph(const graph_shard_manager& manager,
+                       std::vector<graphdb_server*>& servers,
+                       size_t nverts, const std::vector<test_edge>& edges) {
+  graph_field weight("weight", INT_TYPE);
+  for (size_t i = 0; i < servers.size(); ++i) {
+    QueryMessage field(QueryMessage::ADD, QueryMessage::EFIELD);
+    field << weight;
+    update(*servers[i], field);
+  }
+  for (graph_vid_t vid = 0; vid < nverts; ++vid) {
+    QueryMessage qm(QueryMessage::ADD, QueryMessage::VERTEX);
+    qm << vid << graph_row();
+    update(*servers[manager.get_master(vid)], qm);
+  }
+  std::vector<graph_field> fields(1, weight);
+  for (size_t i = 0; i < edges.size(); ++i) {
+    graph_row data(fields, false);
+    data.get_field(0)->set_integer(edges[i].weight);
+    graph_shard_id_t shard = manager.get_master(edges[i].source, edges[i].target);
+    QueryMessage qm(QueryMessage::ADD, QueryMessage::EDGE);
+    qm << edges[i].source << edges[i].target << data;
+    update(*servers[shard], qm);
+
+    std::vector<graph_shard_id_t> mirrors(1, shard);
+    QueryMessage source(QueryMessage::ADD, QueryMessage::VMIRROR);
+    source << edges[i].source << mirrors;
+    update(*servers[manager.get_master(edges[i].source)], source);
+    QueryMessage target(QueryMessage::ADD, QueryMessage::VMIRROR);
+    target << edges[i].target << mirrors;
+    update(*servers[manager.get_master(edges[i].target)], target);
+  }
+}
+} // namespace graphlab
+#endif
@@ -0,0 +1,402 @@
+#include <graphlab/database/server/graphdb_server.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/logger/assertions.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+using namespace graphlab;
+
+// Sends an update to server and checks the reply.
+void update(graphdb_server& server, QueryMessage& qm) {
+  char* reply;
+  size_t replylen;
+  ASSERT_TRUE(server.update(qm.message(), qm.length(), &reply, &replylen));
+  free(reply);
+}
+
+// Returns the reply of server to the query qm.
+string query(graphdb_server& server, QueryMessage& qm) {
+  char* reply;
+  size_t replylen;
+  server.query(qm.message(), qm.length(), &reply, &replylen);
+  string ret(reply, replylen);
+  free(reply);
+  return ret;
+}
+
+void add_vertex(graphdb_server& server, graph_vid_t vid, const graph_row& data) {
+  QueryMessage qm(QueryMessage::ADD, QueryMessage::VERTEX);
+  qm << vid << data;
+  update(server, qm);
+}
+
+void set_vertex(graphdb_server& server, graph_vid_t vid, const graph_row& data) {
+  QueryMessage qm(QueryMessage::SET, QueryMessage::VERTEX);
+  qm << vid << data;
+  update(server, qm);
+}
+
+void add_edge(graphdb_server& server, graph_vid_t source, graph_vid_t target,
+              const graph_row& data) {
+  QueryMessage qm(QueryMessage::ADD, QueryMessage::EDGE);
+  qm << source << target << data;
+  update(server, qm);
+}
+
+graph_row make_vertex(const vector<graph_field>& fields, size_t i, size_t version) {
+  graph_row data(fields, true);
+  data.get_field(0)->set_string("v" + boost::lexical_cast<string>(i) + "." +
+                                boost::lexical_cast<string>(version));
+  data.get_field(1)->set_integer(version);
+  return data;
+}
+
+// Compares the vertices, edges and adjacency served by lhs and rhs.
+void compare_servers(graphdb_server& lhs, graphdb_server& rhs, size_t max_vid) {
+  QueryMessage nverts(QueryMessage::GET, QueryMessage::NVERTS);
+  QueryMessage nedges(QueryMessage::GET, QueryMessage::NEDGES);
+  ASSERT_TRUE(query(lhs, nverts) == query(rhs, nverts));
+  ASSERT_TRUE(query(lhs, nedges) == query(rhs, nedges));
+  for (graph_vid_t vid = 0; vid < max_vid; ++vid) {
+    QueryMessage vertex(QueryMessage::GET, QueryMessage::VERTEX);
+    vertex << vid;
+    ASSERT_TRUE(query(lhs, vertex) == query(rhs, vertex));
+    QueryMessage adj(QueryMessage::GET, QueryMessage::VERTEXADJ);
+    adj << vid << false;
+    ASSERT_TRUE(query(lhs, adj) == query(rhs, adj));
+  }
+  string reply = query(lhs, nedges);
+  iarchive iarc(reply.c_str(), reply.length());
+  int errorcode;
+  uint64_t num_edges;
+  iarc >> errorcode >> num_edges;
+  for (size_t i = 0; i < num_edges; ++i) {
+    QueryMessage edge(QueryMessage::GET, QueryMessage::EDGE);
+    edge << make_eid(0, i);
+    ASSERT_TRUE(query(lhs, edge) == query(rhs, edge));
+  }
+}
+
+// Keeps updating the master while the state is transferred.
+void write_updates(graphdb_server* master, const vector<graph_field>* vertexfields,
+                   const vector<graph_field>* edgefields, size_t nverts, size_t nupdates) {
+  graph_row edata(*edgefields, false);
+  for (size_t i = 0; i < nupdates; ++i) {
+    set_vertex(*master, (i * 7) % nverts, make_vertex(*vertexfields, (i * 7) % nverts, i + 1));
+    add_edge(*master, i % nverts, (i * 3) % nverts, edata);
+    if (i % 10 == 0) {
+      add_vertex(*master, nverts + i, make_vertex(*vertexfields, nverts + i, 0));
+    }
+  }
+}
+
+// Pulls the transfer id from master into standby, dropping every
+// drop_every'th chunk. Returns false if the transfer went stale.
+bool pull(graphdb_server& master, graphdb_server& standby, size_t id, size_t drop_every) {
+  size_t pos = 0;
+  size_t nchunks = 0;
+  bool last = false;
+  while (!last) {
+    oarchive oarc;
+    size_t next;
+    int errorcode = master.transfer_chunk(id, pos, oarc, next, last);
+    if (errorcode == ESTALE) {
+      free(oarc.buf);
+      return false;
+    }
+    ASSERT_EQ(errorcode, 0);
+    if (drop_every > 0 && ++nchunks % drop_every == 0) {
+      // lost on the way, resume from the last applied chunk
+      last = false;
+    } else {
+      ASSERT_EQ(standby.apply_chunk(oarc.buf, oarc.off), 0);
+      // applying the same chunk again is harmless
+      ASSERT_EQ(standby.apply_chunk(oarc.buf, oarc.off), 0);
+    }
+    free(oarc.buf);
+    pos = standby.transfer_position();
+  }
+  return true;
+}
+
+/**
+ * Test streaming the state of a master to a standby while it serves updates.
+ */
+void testStreamingTransfer() {
+  size_t nverts = 2000;
+  size_t nupdates = 3000;
+  cout << "Test streaming transfer. Num vertices = " << nverts << endl;
+  vector<graph_field> vertexfields;
+  vector<graph_field> edgefields;
+  vertexfields.push_back(graph_field("name", STRING_TYPE));
+  vertexfields.push_back(graph_field("version", INT_TYPE));
+  vertexfields[0].is_indexed = true;
+  edgefields.push_back(graph_field("weight", DOUBLE_TYPE));
+
+  graphdb_server master(0);
+  for (size_t i = 0; i < vertexfields.size(); ++i) {
+    QueryMessage qm(QueryMessage::ADD, QueryMessage::VFIELD);
+    qm << vertexfields[i];
+    update(master, qm);
+  }
+  QueryMessage efield(QueryMessage::ADD, QueryMessage::EFIELD);
+  efield << edgefields[0];
+  update(master, efield);
+  graph_row edata(edgefields, false);
+  for (size_t i = 0; i < nverts; ++i) {
+    add_vertex(master, i, make_vertex(vertexfields, i, 0));
+    add_edge(master, i, (i + 1) % nverts, edata);
+  }
+  QueryMessage mirror(QueryMessage::ADD, QueryMessage::VMIRROR);
+  mirror << (graph_vid_t)5 << vector<graph_shard_id_t>(1, 3);
+  update(master, mirror);
+
+  // segments and tail are pulled while another thread updates the master
+  graphdb_server standby(0, false);
+  size_t id = master.begin_transfer(64);
+  thread writer;
+  writer.launch(boost::bind(write_updates, &master, &vertexfields, &edgefields,
+                            nverts, nupdates));
+  ASSERT_TRUE(pull(master, standby, id, 5));
+  writer.join();
+  // catch up with the updates made after the last chunk
+  size_t pos = standby.transfer_position();
+  bool last = false;
+  while (!last) {
+    oarchive oarc;
+    size_t next;
+    ASSERT_EQ(master.transfer_chunk(id, pos, oarc, next, last), 0);
+    ASSERT_EQ(standby.apply_chunk(oarc.buf, oarc.off), 0);
+    free(oarc.buf);
+    pos = next;
+  }
+  // the schema chunk again does not clear the shard
+  oarchive schema;
+  size_t next;
+  ASSERT_EQ(master.transfer_chunk(id, 0, schema, next, last), 0);
+  ASSERT_EQ(standby.apply_chunk(schema.buf, schema.off), 0);
+  ASSERT_EQ(standby.transfer_position(), pos);
+  free(schema.buf);
+  master.end_transfer(id);
+  compare_servers(master, standby, nverts + nupdates);
+
+  // chunks of an ended transfer or out of order are rejected
+  oarchive oarc;
+  ASSERT_EQ(master.transfer_chunk(id, 0, oarc, next, last), EINVID);
+  id = master.begin_transfer(64);
+  ASSERT_EQ(master.transfer_chunk(id, 2, oarc, next, last), 0);
+  ASSERT_EQ(standby.apply_chunk(oarc.buf, oarc.off), EINVID);
+
+  // a new field makes the transfer stale
+  graph_field extra("extra", INT_TYPE);
+  QueryMessage vfield(QueryMessage::ADD, QueryMessage::VFIELD);
+  vfield << extra;
+  update(master, vfield);
+  vertexfields.push_back(extra);
+  ASSERT_EQ(master.transfer_chunk(id, 1, oarc, next, last), ESTALE);
+  master.end_transfer(id);
+
+  // so do more updates than the tail holds
+  master.set_max_tail_bytes(4096);
+  id = master.begin_transfer(64);
+  for (size_t i = 0; i < 100; ++i) {
+    if (i == 10) {
+      ASSERT_EQ(master.transfer_chunk(id, 0, oarc, next, last), 0);
+    }
+    set_vertex(master, i, make_vertex(vertexfields, i, nupdates + i));
+  }
+  ASSERT_EQ(master.transfer_chunk(id, 0, oarc, next, last), ESTALE);
+  master.end_transfer(id);
+  master.set_max_tail_bytes(graphdb_server::DEFAULT_MAX_TAIL_BYTES);
+  free(oarc.buf);
+
+  // libfault state transfer
+  char* buf;
+  size_t buflen;
+  master.serialize(&buf, &buflen);
+  graphdb_server replica(0, false);
+  replica.deserialize(buf, buflen);
+  free(buf);
+  compare_servers(master, replica, nverts + nupdates);
+}
+
+// Keeps setting vertex 0 of the master until stop is set.
+void write_until_stopped(graphdb_server* master, const vector<graph_field>* vertexfields,
+                         const graphlab::atomic<size_t>* stop, graphlab::atomic<size_t>* nupdates) {
+  while (*stop == 0) {
+    size_t version = ++*nupdates;
+    set_vertex(*master, 0, make_vertex(*vertexfields, 0, version));
+  }
+}
+
+/**
+ * Test that serialize() completes while the updates keep every transfer
+ * stale.
+ */
+void testStaleTransfer() {
+  size_t nverts = 20000;
+  cout << "Test stale transfer. Num vertices = " << nverts << endl;
+  vector<graph_field> vertexfields;
+  vertexfields.push_back(graph_field("name", STRING_TYPE));
+  vertexfields.push_back(graph_field("version", INT_TYPE));
+  graphdb_server master(0);
+  for (size_t i = 0; i < vertexfields.size(); ++i) {
+    QueryMessage qm(QueryMessage::ADD, QueryMessage::VFIELD);
+    qm << vertexfields[i];
+    update(master, qm);
+  }
+  graph_row edata;
+  edata._is_vertex = false;
+  for (size_t i = 0; i < nverts; ++i) {
+    add_vertex(master, i, make_vertex(vertexfields, i, 0));
+    add_edge(master, i, (i + 1) % nverts, edata);
+  }
+
+  // any update makes the transfer stale
+  master.set_max_tail_bytes(1);
+  graphlab::atomic<size_t> stop(0), nupdates(0);
+  thread writer;
+  writer.launch(boost::bind(write_until_stopped, &master, &vertexfields, &stop, &nupdates));
+  while (nupdates == 0) {
+    usleep(1000);
+  }
+  char* buf;
+  size_t buflen;
+  master.serialize(&buf, &buflen);
+  stop.inc();
+  writer.join();
+  master.set_max_tail_bytes(graphdb_server::DEFAULT_MAX_TAIL_BYTES);
+
+  graphdb_server replica(0, false);
+  replica.deserialize(buf, buflen);
+  free(buf);
+  // the replica holds the state at some point of the updates
+  set_vertex(master, 0, make_vertex(vertexfields, 0, nupdates.value + 1));
+  set_vertex(replica, 0, make_vertex(vertexfields, 0, nupdates.value + 1));
+  compare_servers(master, replica, nverts);
+}
+
+/**
+ * Test that a standby with a log keeps the transferred state, tail
+ * included, when it restarts from its checkpoint and log.
+ */
+void testDurableStandby() {
+  size_t nverts = 500;
+  cout << "Test durable standby. Num vertices = " << nverts << endl;
+  vector<graph_field> vertexfields;
+  vertexfields.push_back(graph_field("name", STRING_TYPE));
+  vertexfields.push_back(graph_field("version", INT_TYPE));
+  graphdb_server master(0);
+  for (size_t i = 0; i < vertexfields.size(); ++i) {
+    QueryMessage qm(QueryMessage::ADD, QueryMessage::VFIELD);
+    qm << vertexfields[i];
+    update(master, qm);
+  }
+  graph_row edata;
+  edata._is_vertex = false;
+  for (size_t i = 0; i < nverts; ++i) {
+    add_vertex(master, i, make_vertex(vertexfields, i, 0));
+    add_edge(master, i, (i + 1) % nverts, edata);
+  }
+
+  char dir[] = "/tmp/graphdb_transfer_test.XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  graphdb_server* standby = new graphdb_server(0, false);
+  ASSERT_TRUE(standby->open_log(dir, 0, 1 << 20));
+  size_t id = master.begin_transfer(64);
+  ASSERT_TRUE(pull(master, *standby, id, 0));
+  // the tail of a transfer started again
+  set_vertex(master, 1, make_vertex(vertexfields, 1, 1));
+  add_vertex(master, nverts, make_vertex(vertexfields, nverts, 0));
+  size_t pos = standby->transfer_position();
+  bool last = false;
+  while (!last) {
+    oarchive oarc;
+    size_t next;
+    ASSERT_EQ(master.transfer_chunk(id, pos, oarc, next, last), 0);
+    ASSERT_EQ(standby->apply_chunk(oarc.buf, oarc.off), 0);
+    free(oarc.buf);
+    pos = next;
+  }
+  master.end_transfer(id);
+  delete standby;
+
+  graphdb_server restarted(0, false);
+  ASSERT_TRUE(restarted.open_log(dir, 0, 1 << 20));
+  compare_servers(master, restarted, nverts + 1);
+  string prefix = string(dir) + "/shard0";
+  remove((prefix + ".ckpt").c_str());
+  remove((prefix + ".log").c_str());
+  rmdir(dir);
+}
+
+// Returns the size of the file at path.
+size_t file_size(const string& path) {
+  struct stat st;
+  ASSERT_EQ(stat(path.c_str(), &st), 0);
+  return st.st_size;
+}
+
+/**
+ * Test that failed updates are neither logged nor recorded for transfers.
+ */
+void testFailedUpdates() {
+  cout << "Test failed updates" << endl;
+  vector<graph_field> vertexfields;
+  vertexfields.push_back(graph_field("name", STRING_TYPE));
+  vertexfields.push_back(graph_field("version", INT_TYPE));
+  char dir[] = "/tmp/graphdb_transfer_test.XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  string prefix = string(dir) + "/shard0";
+  {
+    graphdb_server master(0);
+    ASSERT_TRUE(master.open_log(dir, 0, 1 << 20));
+    for (size_t i = 0; i < vertexfields.size(); ++i) {
+      QueryMessage qm(QueryMessage::ADD, QueryMessage::VFIELD);
+      qm << vertexfields[i];
+      update(master, qm);
+    }
+    add_vertex(master, 1, make_vertex(vertexfields, 1, 0));
+    size_t logged = file_size(prefix + ".log");
+    size_t id = master.begin_transfer(64);
+
+    // a vertex which exists, a field which exists, a vertex which does not
+    QueryMessage dup(QueryMessage::ADD, QueryMessage::VERTEX);
+    dup << (graph_vid_t)1 << make_vertex(vertexfields, 1, 1);
+    QueryMessage dupfield(QueryMessage::ADD, QueryMessage::VFIELD);
+    dupfield << vertexfields[0];
+    QueryMessage missing(QueryMessage::SET, QueryMessage::VERTEX);
+    missing << (graph_vid_t)2 << make_vertex(vertexfields, 2, 1);
+    QueryMessage* failed[] = {&dup, &dupfield, &missing};
+    for (size_t i = 0; i < 3; ++i) {
+      char* reply;
+      size_t replylen;
+      ASSERT_FALSE(master.update(failed[i]->message(), failed[i]->length(), &reply, &replylen));
+      free(reply);
+    }
+    ASSERT_EQ(file_size(prefix + ".log"), logged);
+    // the transfer is not stale, and its tail is empty
+    graphdb_server standby(0, false);
+    ASSERT_TRUE(pull(master, standby, id, 0));
+    master.end_transfer(id);
+    compare_servers(master, standby, 3);
+  }
+  remove((prefix + ".ckpt").c_str());
+  remove((prefix + ".log").c_str());
+  rmdir(dir);
+}
+
+int main(int argc, char** argv) {
+  global_logger().set_log_level(LOG_ERROR);
+  testStreamingTransfer();
+  testStaleTransfer();
+  testDurableStandby();
+  testFailedUpdates();
+  return 0;
+}
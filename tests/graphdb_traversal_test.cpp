@@ -0,0 +1,230 @@
+#include <graphlab/logger/assertions.hpp>
+#include "graphdb_test_shards.hpp"
+#include <boost/bind.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <unistd.h>
+using namespace std;
+using namespace graphlab;
+
+typedef vector<pair<graph_vid_t, size_t> > hop_list;
+
+// The traversal of spec from sources over edges, done locally.
+hop_list local_traversal(size_t nverts, const vector<test_edge>& edges,
+                         const vector<graph_vid_t>& sources,
+                         const graph_traversal_spec& spec) {
+  vector<vector<graph_vid_t> > adj(nverts);
+  for (size_t i = 0; i < edges.size(); ++i) {
+    graph_value weight;
+    weight.set_integer(edges[i].weight);
+    if (!spec.predicate.accepts(weight)) {
+      continue;
+    }
+    if (spec.direction != graph_traversal_spec::IN_EDGES) {
+      adj[edges[i].source].push_back(edges[i].target);
+    }
+    if (spec.direction != graph_traversal_spec::OUT_EDGES) {
+      adj[edges[i].target].push_back(edges[i].source);
+    }
+  }
+  boost::unordered_map<graph_vid_t, size_t> visited;
+  vector<graph_vid_t> frontier;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (visited.insert(make_pair(sources[i], 0)).second) {
+      frontier.push_back(sources[i]);
+    }
+  }
+  for (size_t hop = 1; hop <= spec.max_hops && !frontier.empty(); ++hop) {
+    vector<graph_vid_t> next;
+    for (size_t i = 0; i < frontier.size(); ++i) {
+      for (size_t j = 0; j < adj[frontier[i]].size(); ++j) {
+        if (visited.insert(make_pair(adj[frontier[i]][j], hop)).second) {
+          next.push_back(adj[frontier[i]][j]);
+        }
+      }
+    }
+    frontier.swap(next);
+  }
+  hop_list out;
+  for (boost::unordered_map<graph_vid_t, size_t>::iterator it = visited.begin();
+       it != visited.end(); ++it) {
+    if (it->second >= spec.min_hops) {
+      out.push_back(*it);
+    }
+  }
+  sort(out.begin(), out.end());
+  return out;
+}
+
+void check_traversal(graph_traversal& traversal, uint64_t id, size_t nverts,
+                     const vector<test_edge>& edges, const vector<graph_vid_t>& sources,
+                     const graph_traversal_spec& spec) {
+  hop_list expected = local_traversal(nverts, edges, sources, spec);
+  hop_list out;
+  ASSERT_EQ(traversal.traverse(id, sources, spec, out), 0);
+  sort(out.begin(), out.end());
+  ASSERT_TRUE(out == expected);
+  uint64_t count;
+  ASSERT_EQ(traversal.count(id + 1, sources, spec, count), 0);
+  ASSERT_EQ(count, (uint64_t)expected.size());
+}
+
+void testTraversal() {
+  size_t nshards = 4;
+  size_t nverts = 500;
+  size_t nedges = 1500;
+  cout << "Test traversal. Num shards = " << nshards
+       << " Num vertices = " << nverts << " Num edges = " << nedges << endl;
+  graph_shard_manager manager(nshards);
+  vector<graphdb_server*> servers;
+  for (size_t i = 0; i < nshards; ++i) {
+    servers.push_back(new graphdb_server(i));
+  }
+  graph_traversal::scatter_function send = boost::bind(scatter, &servers, _1, _2);
+  for (size_t i = 0; i < nshards; ++i) {
+    servers[i]->set_peers(manager, send);
+  }
+
+  srand(0);
+  vector<test_edge> edges(nedges);
+  for (size_t i = 0; i < nedges; ++i) {
+    edges[i].source = rand() % nverts;
+    edges[i].target = rand() % nverts;
+    edges[i].weight = rand() % 100;
+  }
+  load_graph(manager, servers, nverts, edges);
+
+  graph_traversal traversal(manager, send);
+  vector<graph_vid_t> sources;
+  sources.push_back(0);
+  sources.push_back(7);
+  sources.push_back(7);
+
+  graph_traversal_spec spec(3);
+  check_traversal(traversal, 10, nverts, edges, sources, spec);
+
+  // the sources only
+  spec.max_hops = 0;
+  check_traversal(traversal, 20, nverts, edges, sources, spec);
+
+  spec = graph_traversal_spec(2, graph_traversal_spec::IN_EDGES);
+  spec.min_hops = 1;
+  check_traversal(traversal, 30, nverts, edges, sources, spec);
+
+  // until every reachable vertex is found
+  spec = graph_traversal_spec(nverts, graph_traversal_spec::ALL_EDGES);
+  check_traversal(traversal, 40, nverts, edges, sources, spec);
+
+  graph_value threshold;
+  threshold.set_integer(50);
+  spec.set_predicate(0, graph_condition::LT, threshold);
+  check_traversal(traversal, 50, nverts, edges, sources, spec);
+  spec.set_predicate(0, graph_condition::GE, threshold);
+  check_traversal(traversal, 60, nverts, edges, sources, spec);
+
+  // the predicate names a field which does not exist
+  spec.set_predicate(1, graph_condition::EQ, threshold);
+  hop_list out;
+  ASSERT_EQ(traversal.traverse(70, sources, spec, out), EINVID);
+
+  // the traversals are dropped once done
+  string visit = graph_traversal::request(graph_traversal::VISIT, 10);
+  vector<string> replies;
+  send(graph_traversal::request_list(1, make_pair(0, visit)), replies);
+  ASSERT_EQ(graph_traversal::parse_reply<uint64_t>(replies[0], NULL), EINVID);
+
+  for (size_t i = 0; i < nshards; ++i) {
+    delete servers[i];
+  }
+}
+
+// Runs the traversals of ids [first, first + n) with traversal.
+void traverse_many(graph_traversal* traversal, uint64_t first, size_t n, size_t nverts,
+                   const vector<test_edge>* edges) {
+  for (size_t i = 0; i < n; ++i) {
+    vector<graph_vid_t> sources(1, (first + i) % nverts);
+    graph_traversal_spec spec(2 + i % 3, (graph_traversal_spec::direction_type)(i % 3));
+    check_traversal(*traversal, first + 2 * i, nverts, *edges, sources, spec);
+  }
+}
+
+/**
+ * Test traversals running at the same time on shards serving one request
+ * at a time, which send to each other in the middle of every round.
+ */
+void testConcurrentTraversal() {
+  size_t nshards = 4;
+  size_t nverts = 500;
+  size_t nedges = 2000;
+  cout << "Test concurrent traversal. Num shards = " << nshards
+       << " Num vertices = " << nverts << " Num edges = " << nedges << endl;
+  graph_shard_manager manager(nshards);
+  vector<graphdb_server*> servers;
+  for (size_t i = 0; i < nshards; ++i) {
+    servers.push_back(new graphdb_server(i));
+  }
+  srand(2);
+  vector<test_edge> edges(nedges);
+  for (size_t i = 0; i < nedges; ++i) {
+    edges[i].source = rand() % nverts;
+    edges[i].target = rand() % nverts;
+    edges[i].weight = rand() % 100;
+  }
+  load_graph(manager, servers, nverts, edges);
+
+  shard_workers* workers = new shard_workers(&servers);
+  graph_traversal::scatter_function send =
+      boost::bind(&shard_workers::scatter, workers, _1, _2);
+  for (size_t i = 0; i < nshards; ++i) {
+    servers[i]->set_peers(manager, send);
+  }
+  graph_traversal traversal(manager, send);
+  thread_group drivers;
+  for (size_t i = 0; i < 4; ++i) {
+    drivers.launch(boost::bind(traverse_many, &traversal, 1000 * (i + 1), 10,
+                               nverts, &edges));
+  }
+  drivers.join();
+
+  // an id can only be taken once, and a failed start leaves the other
+  // traversal in place
+  string start = graph_traversal::request(graph_traversal::START, 1,
+                                          graph_traversal_spec());
+  vector<string> replies;
+  send(graph_traversal::request_list(1, make_pair(0, start)), replies);
+  ASSERT_EQ(graph_traversal::parse_reply<int>(replies[0], NULL), 0);
+  hop_list out;
+  vector<graph_vid_t> sources(1, 0);
+  ASSERT_EQ(traversal.traverse(1, sources, graph_traversal_spec(), out), EDUP);
+  string sync = graph_traversal::request(graph_traversal::SYNC, 1);
+  send(graph_traversal::request_list(1, make_pair(0, sync)), replies);
+  ASSERT_EQ(graph_traversal::parse_reply<uint64_t>(replies[0], NULL), 0);
+
+  // the traversals of a client which stopped before END expire
+  servers[0]->set_traversal_timeout(0);
+  time_t used = time(NULL);
+  while (time(NULL) <= used + 1) {
+    usleep(100000);
+  }
+  start = graph_traversal::request(graph_traversal::START, 2, graph_traversal_spec());
+  send(graph_traversal::request_list(1, make_pair(0, start)), replies);
+  ASSERT_EQ(graph_traversal::parse_reply<int>(replies[0], NULL), 0);
+  send(graph_traversal::request_list(1, make_pair(0, sync)), replies);
+  ASSERT_EQ(graph_traversal::parse_reply<uint64_t>(replies[0], NULL), EINVID);
+
+  // the threads of the servers stop before the workers they send to
+  for (size_t i = 0; i < nshards; ++i) {
+    delete servers[i];
+  }
+  delete workers;
+}
+
+int main(int argc, char** argv) {
+  global_logger().set_log_level(LOG_ERROR);
+  testTraversal();
+  testConcurrentTraversal();
+  return 0;
+}
@@ -0,0 +1,376 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <graphlab/database/client/ingress/binary_edge_format.hpp>
+#include <graphlab/database/client/ingress/builtin_parsers.hpp>
+#include <graphlab/database/client/ingress/delimited_format.hpp>
+#include <graphlab/database/client/ingress/ingress_pipeline.hpp>
+#include <graphlab/database/graph_shard_image.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/logger/assertions.hpp>
+using namespace std;
+using namespace graphlab;
+
+/**
+ * Compares the parsing throughput of ingress paths on a synthetic SNAP
+ * file: the former stream path of graph_loader (std::getline into buffers
+ * of lines, copied to the worker, parsed with strtoul), the mapped path
+ * (newline aligned chunks of the mapped file, parsed in place) on one
+ * thread and on all cores, and the whole ingress_pipeline, on the text
+ * file and on the same edges in the binary edge format, untagged and
+ * tagged with a shard. Then compares loading vertices with a name, an
+ * INT and a DOUBLE field, from the former stream of lines parsed with
+ * graph_value::set_val() to the pipeline with a delimited_format. The
+ * edges and vertices go to a counter instead of a client.
+ *
+ * Usage: ingress_bench [num_edges] [path] [num_shards]
+ */
+
+typedef vector<pair<const char*, const char*> > chunk_list;
+
+// Stands for ingress_worker, checks all paths see the same edges.
+struct edge_counter {
+  size_t nedges;
+  uint64_t checksum;
+  edge_counter() : nedges(0), checksum(0) { }
+  void add_edge(graph_vid_t source, graph_vid_t target) {
+    ++nedges;
+    checksum += source * 31 + target;
+  }
+};
+
+void write_snap_file(const string& path, size_t nedges) {
+  FILE* fp = fopen(path.c_str(), "w");
+  ASSERT_TRUE(fp != NULL);
+  fprintf(fp, "# Synthetic graph\n# FromNodeId\tToNodeId\n");
+  srand(0);
+  for (size_t i = 0; i < nedges; ++i) {
+    // 32 bit vids, of up to 10 digits
+    unsigned long source = ((unsigned long)rand() << 16 ^ rand()) & 0xffffffffUL;
+    unsigned long target = ((unsigned long)rand() << 16 ^ rand()) & 0xffffffffUL;
+    // self edges are dropped by the parsers
+    if (source == target) ++target;
+    fprintf(fp, "%lu\t%lu\n", source, target);
+  }
+  fclose(fp);
+}
+
+// getline into buffers of lines, each copied to ingress_worker::process_lines().
+void process_lines(vector<string> lines, edge_counter* counter) {
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (lines[i][0] != '#') {
+      builtin_parsers::snap_parser(*counter, lines[i]);
+    }
+  }
+}
+
+edge_counter stream_path(const string& path) {
+  edge_counter counter;
+  std::ifstream in_file(path.c_str(), std::ios_base::in | std::ios_base::binary);
+  boost::iostreams::filtering_stream<boost::iostreams::input> fin;
+  fin.push(in_file);
+  vector<string> buffer;
+  size_t max_buffer = 500000;
+  buffer.reserve(max_buffer);
+  while (fin.good() && !fin.eof()) {
+    string line;
+    std::getline(fin, line);
+    if (line.empty()) continue;
+    if (fin.fail()) break;
+    buffer.push_back(line);
+    if (buffer.size() == max_buffer) {
+      process_lines(buffer, &counter);
+      buffer.clear();
+    }
+  }
+  process_lines(buffer, &counter);
+  return counter;
+}
+
+// ingress_worker::process_range() without the comment lines.
+void process_range(const char* begin, const char* end, edge_counter* counter) {
+  while (begin != end) {
+    const char* nl = (const char*)memchr(begin, '\n', end - begin);
+    const char* eol = (nl == NULL) ? end : nl;
+    if (eol != begin && *begin != '#') {
+      builtin_parsers::snap_range_parser(*counter, begin, eol);
+    }
+    begin = (nl == NULL) ? end : nl + 1;
+  }
+}
+
+edge_counter mapped_path(const string& path, size_t nthreads) {
+  graph_image_mapping mapping;
+  ASSERT_TRUE(mapping.open(path));
+  chunk_list chunks;
+  builtin_parsers::split_lines(mapping.data(), mapping.data() + mapping.size(),
+                               8 << 20, chunks);
+  vector<edge_counter> counters(chunks.size());
+  thread_group threads;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (threads.running_threads() == nthreads) {
+      threads.join();
+    }
+    threads.launch(boost::bind(process_range, chunks[i].first, chunks[i].second,
+                               &counters[i]));
+  }
+  threads.join();
+  edge_counter counter;
+  for (size_t i = 0; i < counters.size(); ++i) {
+    counter.nedges += counters[i].nedges;
+    counter.checksum += counters[i].checksum;
+  }
+  return counter;
+}
+
+// Stands for graphdb_client::add_edges_to_shard() behind an ingress_pipeline.
+bool count_batch(mutex* lock, edge_counter* counter, graph_shard_id_t shard,
+                 const vector<ingress_pipeline::edge_insert_descriptor>& edges,
+                 vector<int>& errorcodes) {
+  edge_counter batch;
+  for (size_t i = 0; i < edges.size(); ++i) {
+    batch.add_edge(edges[i].src, edges[i].dest);
+  }
+  lock->lock();
+  counter->nedges += batch.nedges;
+  counter->checksum += batch.checksum;
+  lock->unlock();
+  return true;
+}
+
+edge_counter pipeline_path(const string& path, const string& format, size_t nshards,
+                           const ingress_options& options, timer* ti, ingress_stats* stats) {
+  mutex lock;
+  edge_counter sent;
+  ti->start();
+  ingress_pipeline pipeline(graph_shard_manager(nshards),
+                            boost::bind(count_batch, &lock, &sent, _1, _2, _3),
+                            format, options);
+  ASSERT_TRUE(pipeline.read_mapped(path));
+  const ingress_stats& result = pipeline.finish();
+  if (stats != NULL) {
+    *stats = result;
+  }
+  return sent;
+}
+
+// Adds the edges of the snap file to a binary file, whatever their shard.
+struct binary_file_writer {
+  binary_edge_writer* writer;
+  void add_edge(graph_vid_t source, graph_vid_t target) {
+    ASSERT_TRUE(writer->add_edge(source, target));
+  }
+};
+
+void write_binary_file(const string& path, const string& bin_path,
+                       const binary_edge_header& header) {
+  binary_edge_writer writer;
+  ASSERT_TRUE(writer.open(bin_path, header));
+  binary_file_writer file = {&writer};
+  graph_image_mapping mapping;
+  ASSERT_TRUE(mapping.open(path));
+  const char* p = mapping.data();
+  const char* end = p + mapping.size();
+  while (p != end) {
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    const char* eol = (nl == NULL) ? end : nl;
+    if (eol != p && *p != '#') {
+      builtin_parsers::snap_range_parser(file, p, eol);
+    }
+    p = (nl == NULL) ? end : nl + 1;
+  }
+  ASSERT_TRUE(writer.close());
+}
+
+const char* NAMES[] = {"alice", "bob", "carol", "dave"};
+
+void write_vertex_file(const string& path, size_t nvertices) {
+  FILE* fp = fopen(path.c_str(), "w");
+  ASSERT_TRUE(fp != NULL);
+  fprintf(fp, "# id\tname\tcount\tscore\n");
+  for (size_t i = 0; i < nvertices; ++i) {
+    fprintf(fp, "%lu\t%s\t%ld\t%.3f\n", (unsigned long)i, NAMES[i % 4],
+            -(long)(i * 7), i * 0.25);
+  }
+  fclose(fp);
+}
+
+vector<graph_field> vertex_fields() {
+  vector<graph_field> fields;
+  fields.push_back(graph_field("name", STRING_TYPE));
+  fields.push_back(graph_field("count", INT_TYPE));
+  fields.push_back(graph_field("score", DOUBLE_TYPE));
+  return fields;
+}
+
+// Sums the vids and the INT field of the vertices.
+struct vertex_counter {
+  size_t nvertices;
+  int64_t checksum;
+  vertex_counter() : nvertices(0), checksum(0) { }
+  void add_vertex(graph_vid_t vid, const graph_row& row) {
+    graph_int_t count = 0;
+    row.get_field(1)->get_integer(&count);
+    ++nvertices;
+    checksum += vid * 31 + count;
+  }
+};
+
+// getline, split at tabs, then graph_value::set_val(string), which uses lexical_cast.
+vertex_counter vertex_stream_path(const string& path) {
+  vertex_counter counter;
+  vector<graph_field> fields = vertex_fields();
+  std::ifstream fin(path.c_str());
+  string line;
+  while (getline(fin, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    graph_row row(fields, true);
+    vector<string> values;
+    size_t begin = 0;
+    while (true) {
+      size_t stop = line.find('\t', begin);
+      values.push_back(line.substr(begin, stop - begin));
+      if (stop == string::npos) break;
+      begin = stop + 1;
+    }
+    ASSERT_EQ(values.size(), 4);
+    for (size_t i = 0; i < fields.size(); ++i) {
+      ASSERT_TRUE(row.get_field(i)->set_val(values[i + 1]));
+    }
+    counter.add_vertex(boost::lexical_cast<graph_vid_t>(values[0]), row);
+  }
+  return counter;
+}
+
+bool count_vertices(mutex* lock, vertex_counter* counter, graph_shard_id_t shard,
+                    const vector<ingress_pipeline::vertex_insert_descriptor>& vertices,
+                    vector<int>& errorcodes) {
+  vertex_counter batch;
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    batch.add_vertex(vertices[i].vid, vertices[i].data);
+  }
+  lock->lock();
+  counter->nvertices += batch.nvertices;
+  counter->checksum += batch.checksum;
+  lock->unlock();
+  return true;
+}
+
+void report(const string& name, double secs, size_t bytes, double baseline) {
+  double mbps = bytes / (1024.0 * 1024) / secs;
+  cout << setw(20) << name << setw(12) << setprecision(4) << secs
+       << setw(12) << mbps << setw(10) << (baseline > 0 ? baseline / secs : 1.0) << endl;
+}
+
+int main(int argc, char** argv) {
+  size_t nedges = argc > 1 ? boost::lexical_cast<size_t>(argv[1]) : 20000000;
+  string path = argc > 2 ? argv[2] : "/tmp/ingress_bench.snap";
+  size_t nshards = argc > 3 ? boost::lexical_cast<size_t>(argv[3]) : 16;
+  write_snap_file(path, nedges);
+  graph_image_mapping mapping;
+  ASSERT_TRUE(mapping.open(path));
+  size_t bytes = mapping.size();
+  mapping.close();
+  size_t ncpus = thread::cpu_count();
+
+  cout << nedges << " edges, " << bytes / (1024 * 1024) << " MB, "
+       << ncpus << " cores" << endl;
+  cout << setw(20) << "path" << setw(12) << "secs"
+       << setw(12) << "MB/s" << setw(10) << "speedup" << endl;
+  timer ti;
+  ti.start();
+  edge_counter expected = stream_path(path);
+  double baseline = ti.current_time();
+  ASSERT_EQ(expected.nedges, nedges);
+  report("getline + strtoul", baseline, bytes, 0);
+
+  ti.start();
+  edge_counter mapped = mapped_path(path, 1);
+  report("mmap, 1 thread", ti.current_time(), bytes, baseline);
+  ASSERT_EQ(mapped.nedges, expected.nedges);
+  ASSERT_EQ(mapped.checksum, expected.checksum);
+
+  ti.start();
+  mapped = mapped_path(path, ncpus);
+  report("mmap, all cores", ti.current_time(), bytes, baseline);
+  ASSERT_EQ(mapped.checksum, expected.checksum);
+
+  ingress_options options;
+  options.parse_threads = ncpus;
+  options.send_threads = ncpus;
+  ingress_stats stats;
+  edge_counter sent = pipeline_path(path, "snap", nshards, options, &ti, &stats);
+  report("pipeline", ti.current_time(), bytes, baseline);
+  ASSERT_EQ(sent.nedges, expected.nedges);
+  ASSERT_EQ(sent.checksum, expected.checksum);
+
+  // the same edges with 4 byte vids, untagged then tagged with shard 0
+  string bin_path = path + ".bin";
+  binary_edge_header header;
+  header.flags = binary_edge_header::VID32;
+  write_binary_file(path, bin_path, header);
+  sent = pipeline_path(bin_path, "bin", nshards, options, &ti, NULL);
+  report("pipeline, bin", ti.current_time(), bytes, baseline);
+  ASSERT_EQ(sent.checksum, expected.checksum);
+
+  header.num_shards = nshards;
+  header.shard = 0;
+  write_binary_file(path, bin_path, header);
+  ingress_stats tagged_stats;
+  sent = pipeline_path(bin_path, "bin", nshards, options, &ti, &tagged_stats);
+  report("pipeline, bin tagged", ti.current_time(), bytes, baseline);
+  ASSERT_EQ(sent.checksum, expected.checksum);
+  remove(bin_path.c_str());
+
+  // vertices with data
+  string vertex_path = path + ".vertices";
+  write_vertex_file(vertex_path, nedges / 2);
+  ASSERT_TRUE(mapping.open(vertex_path));
+  size_t vertex_bytes = mapping.size();
+  mapping.close();
+  ti.start();
+  vertex_counter expected_vertices = vertex_stream_path(vertex_path);
+  double vertex_baseline = ti.current_time();
+  ASSERT_EQ(expected_vertices.nvertices, nedges / 2);
+  report("vertices, set_val", vertex_baseline, vertex_bytes, 0);
+
+  delimited_format format(true, vertex_fields());
+  ASSERT_TRUE(format.set_columns("id\tname\tcount\tscore"));
+  mutex lock;
+  edge_counter no_edges;
+  vertex_counter vertices;
+  ti.start();
+  ingress_stats vertex_stats;
+  {
+    ingress_pipeline pipeline(graph_shard_manager(nshards),
+                              boost::bind(count_batch, &lock, &no_edges, _1, _2, _3),
+                              boost::bind(count_vertices, &lock, &vertices, _1, _2, _3),
+                              format, options);
+    ASSERT_TRUE(pipeline.read_mapped(vertex_path));
+    vertex_stats = pipeline.finish();
+  }
+  report("vertices, pipeline", ti.current_time(), vertex_bytes, vertex_baseline);
+  ASSERT_EQ(vertices.nvertices, expected_vertices.nvertices);
+  ASSERT_EQ(vertices.checksum, expected_vertices.checksum);
+  ASSERT_EQ(no_edges.nedges, 0);
+  remove(vertex_path.c_str());
+
+  cout << endl << "snap:" << endl;
+  stats.print(cout);
+  cout << endl << "bin tagged:" << endl;
+  tagged_stats.print(cout);
+  cout << endl << "vertices:" << endl;
+  vertex_stats.print(cout);
+
+  remove(path.c_str());
+  return 0;
+}
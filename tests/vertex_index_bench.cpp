@@ -0,0 +1,119 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <boost/unordered_map.hpp>
+#include <boost/lexical_cast.hpp>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/util/cuckoo_map_pow2.hpp>
+#include <graphlab/util/hopscotch_map.hpp>
+#include <graphlab/database/graph_vertex_index.hpp>
+#include <graphlab/logger/assertions.hpp>
+using namespace std;
+using namespace graphlab;
+
+/**
+ * Compares the vid -> position lookup structures a shard could use.
+ *
+ * Usage: vertex_index_bench [num_vertices] [num_lookups]
+ *
+ * Two vid distributions are measured: a contiguous range (one shard
+ * holding a range partition) and vids spread with a stride of 16 (one
+ * of 16 hash partitioned shards). Lookups are half hits, half misses.
+ */
+
+typedef boost::unordered_map<graph_vid_t, size_t> boost_map_type;
+typedef cuckoo_map_pow2<graph_vid_t, size_t> cuckoo_map_type;
+typedef hopscotch_map<graph_vid_t, size_t, false> hopscotch_map_type;
+
+// Adapters exposing the same find(vid) -> position or npos interface.
+template<typename MapType>
+struct map_adapter {
+  MapType map;
+  map_adapter() { }
+  template<typename Arg>
+  explicit map_adapter(const Arg& arg) : map(arg) { }
+  void add(graph_vid_t vid, size_t pos) { map.insert(std::make_pair(vid, pos)); }
+  size_t find(graph_vid_t vid) {
+    typename MapType::iterator it = map.find(vid);
+    return it == map.end() ? graph_vertex_index::npos : (*it).second;
+  }
+};
+
+struct index_adapter {
+  graph_vertex_index index;
+  void add(graph_vid_t vid, size_t pos) { index.add_vertex(vid, pos); }
+  size_t find(graph_vid_t vid) { return index.find(vid); }
+};
+
+template<typename Adapter>
+void run(const string& name, Adapter& adapter,
+         const vector<graph_vid_t>& vids,
+         const vector<graph_vid_t>& queries) {
+  timer ti;
+  ti.start();
+  for (size_t i = 0; i < vids.size(); ++i) {
+    adapter.add(vids[i], i);
+  }
+  double insert_time = ti.current_time();
+
+  ti.start();
+  size_t hits = 0;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    hits += (adapter.find(queries[i]) != graph_vertex_index::npos);
+  }
+  double find_time = ti.current_time();
+  ASSERT_EQ(hits, queries.size() / 2);
+
+  cout << setw(16) << name
+       << setw(14) << insert_time * 1e9 / vids.size()
+       << setw(14) << find_time * 1e9 / queries.size() << endl;
+}
+
+void bench(const string& title, size_t nverts, size_t nlookups, graph_vid_t stride) {
+  vector<graph_vid_t> vids(nverts);
+  for (size_t i = 0; i < nverts; ++i) {
+    vids[i] = i * stride;
+  }
+  // insert in random order, as ingress does
+  for (size_t i = nverts - 1; i > 0; --i) {
+    std::swap(vids[i], vids[rand() % (i + 1)]);
+  }
+  // even queries hit, odd queries miss
+  vector<graph_vid_t> queries(nlookups);
+  for (size_t i = 0; i < nlookups; ++i) {
+    graph_vid_t v = vids[rand() % nverts];
+    queries[i] = (i % 2 == 0) ? v : v + nverts * stride;
+  }
+
+  cout << title << ": " << nverts << " vertices, " << nlookups << " lookups" << endl;
+  cout << setw(16) << "structure" << setw(14) << "insert ns/op"
+       << setw(14) << "find ns/op" << endl;
+  {
+    map_adapter<boost_map_type> a;
+    run("unordered_map", a, vids, queries);
+  }
+  {
+    map_adapter<cuckoo_map_type> a((graph_vid_t(-1)));
+    run("cuckoo_pow2", a, vids, queries);
+  }
+  {
+    map_adapter<hopscotch_map_type> a;
+    run("hopscotch", a, vids, queries);
+  }
+  {
+    index_adapter a;
+    run(stride == 1 ? "index (dense)" : "index (hash)", a, vids, queries);
+    ASSERT_EQ(a.index.is_dense(), (stride == 1));
+  }
+  cout << endl;
+}
+
+int main(int argc, char** argv) {
+  size_t nverts = argc > 1 ? boost::lexical_cast<size_t>(argv[1]) : 1000000;
+  size_t nlookups = argc > 2 ? boost::lexical_cast<size_t>(argv[2]) : 10000000;
+  bench("contiguous vids", nverts, nlookups, 1);
+  bench("strided vids", nverts, nlookups, 16);
+  return 0;
+}